@@ -7,6 +7,7 @@
 //
 
 #import "AppDelegate.h"
+#import "CryptoManager.h"
 
 @implementation AppDelegate
 
@@ -23,6 +24,10 @@ static NSString* DB_NAME = @"Limelight_iOS.sqlite";
 #endif
 
 - (BOOL)application:(UIApplication *)application didFinishLaunchingWithOptions:(NSDictionary *)launchOptions {
+    // Generating the client identity is slow on first launch, so get it started
+    // before anything needs it.
+    [CryptoManager prewarmKeyPair];
+    
 #if !TARGET_OS_TV
     UIApplicationShortcutItem* shortcut = [launchOptions valueForKey:UIApplicationLaunchOptionsShortcutItemKey];
     if (shortcut != nil) {
@@ -8,6 +8,10 @@
 
 @interface CryptoManager : NSObject
 
+// Starts generating the client identity in the background if it doesn't exist yet
++ (void) prewarmKeyPair;
++ (BOOL) isKeyPairReady;
+// Blocks until the client identity is available
 + (void) generateKeyPairUsingSSL;
 + (NSData*) readCertFromFile;
 + (NSData*) readKeyFromFile;
@@ -14,6 +14,97 @@
 #include <openssl/pem.h>
 #include <openssl/evp.h>
 
+// Hosts running GFE only accept RSA client certificates, so the much faster
+// ECDSA identities are opt-in for builds that only pair with hosts that do.
+// This only applies when a new identity is generated.
+#ifdef USE_ECDSA_CLIENT_IDENTITY
+#define CLIENT_KEY_TYPE CertKeyTypeEcdsaP256
+#else
+#define CLIENT_KEY_TYPE CertKeyTypeRsa2048
+#endif
+
+// The client's key and certificate, parsed once. It's immutable after
+// creation, so it can be shared across threads without locking.
+@interface ClientIdentity : NSObject {
+@public
+    EVP_PKEY* pkey;
+    X509* x509;
+}
+
+@property (nonatomic, readonly) NSData* keyPem;
+@property (nonatomic, readonly) NSData* certPem;
+@property (nonatomic, readonly) NSData* certDer;
+@property (nonatomic, readonly) NSData* certSignature;
+
+- (id) initWithKey:(NSData*)keyPem cert:(NSData*)certPem;
+
+@end
+
+static NSData* getSignatureFromX509(X509* x509) {
+#if (OPENSSL_VERSION_NUMBER < 0x10002000L)
+    ASN1_BIT_STRING *asnSignature = x509->signature;
+#elif (OPENSSL_VERSION_NUMBER < 0x10100000L)
+    ASN1_BIT_STRING *asnSignature;
+    X509_get0_signature(&asnSignature, NULL, x509);
+#else
+    const ASN1_BIT_STRING *asnSignature;
+    X509_get0_signature(&asnSignature, NULL, x509);
+#endif
+    
+    return [NSData dataWithBytes:asnSignature->data length:asnSignature->length];
+}
+
+static NSData* getDerFromX509(X509* x509) {
+    BIO* bio = BIO_new(BIO_s_mem());
+    i2d_X509_bio(bio, x509);
+
+    BUF_MEM* mem;
+    BIO_get_mem_ptr(bio, &mem);
+    
+    NSData* ret = [[NSData alloc] initWithBytes:mem->data length:mem->length];
+    BIO_free(bio);
+    
+    return ret;
+}
+
+static X509* parseX509(NSData* pem) {
+    BIO* bio = BIO_new_mem_buf([pem bytes], (int)[pem length]);
+    X509* x509 = PEM_read_bio_X509(bio, NULL, NULL, NULL);
+    BIO_free(bio);
+    return x509;
+}
+
+@implementation ClientIdentity
+
+- (id) initWithKey:(NSData*)keyPem cert:(NSData*)certPem {
+    self = [super init];
+    
+    BIO* bio = BIO_new_mem_buf([keyPem bytes], (int)[keyPem length]);
+    pkey = PEM_read_bio_PrivateKey(bio, NULL, NULL, NULL);
+    BIO_free(bio);
+    
+    x509 = parseX509(certPem);
+    
+    if (pkey == NULL || x509 == NULL) {
+        Log(LOG_E, @"Unable to parse client identity!");
+        return nil;
+    }
+    
+    _keyPem = keyPem;
+    _certPem = certPem;
+    _certDer = getDerFromX509(x509);
+    _certSignature = getSignatureFromX509(x509);
+    
+    return self;
+}
+
+- (void) dealloc {
+    EVP_PKEY_free(pkey);
+    X509_free(x509);
+}
+
+@end
+
 @implementation CryptoManager
 static const int SHA1_HASH_LENGTH = 20;
 static const int SHA256_HASH_LENGTH = 32;
@@ -21,6 +112,67 @@ static NSData* key = nil;
 static NSData* cert = nil;
 static NSData* p12 = nil;
 
+// Guarded by identityLock
+static ClientIdentity* clientIdentity;
+static NSData* lastPeerCertPem;
+static X509* lastPeerX509;
+static NSLock* identityLock;
+
+// keyPairGroup is left once the client identity is on disk (or generation failed)
+static dispatch_group_t keyPairGroup;
+static volatile BOOL keyPairReady;
+
++ (void) initialize {
+    if (self == [CryptoManager class]) {
+        identityLock = [[NSLock alloc] init];
+        keyPairGroup = dispatch_group_create();
+    }
+}
+
++ (ClientIdentity*) getClientIdentity {
+    [identityLock lock];
+    if (clientIdentity == nil) {
+        NSData* keyPem = [CryptoManager readKeyFromFile];
+        NSData* certPem = [CryptoManager readCertFromFile];
+        if (keyPem != nil && certPem != nil) {
+            clientIdentity = [[ClientIdentity alloc] initWithKey:keyPem cert:certPem];
+        }
+    }
+    ClientIdentity* identity = clientIdentity;
+    [identityLock unlock];
+    
+    return identity;
+}
+
+// Returns a new reference to the parsed certificate that the caller must free.
+// Our own certificate comes from the client identity, and the most recent peer
+// certificate is kept since pairing uses the server's certificate repeatedly.
++ (X509*) copyX509FromPem:(NSData*)pem {
+    ClientIdentity* identity = [CryptoManager getClientIdentity];
+    if ([identity.certPem isEqualToData:pem]) {
+        X509_up_ref(identity->x509);
+        return identity->x509;
+    }
+    
+    [identityLock lock];
+    if (lastPeerX509 == NULL || ![lastPeerCertPem isEqualToData:pem]) {
+        X509* x509 = parseX509(pem);
+        if (x509 == NULL) {
+            [identityLock unlock];
+            return NULL;
+        }
+        
+        X509_free(lastPeerX509);
+        lastPeerX509 = x509;
+        lastPeerCertPem = [pem copy];
+    }
+    X509_up_ref(lastPeerX509);
+    X509* x509 = lastPeerX509;
+    [identityLock unlock];
+    
+    return x509;
+}
+
 - (NSData*) createAESKeyFromSaltSHA1:(NSData*)saltedPIN {
     return [[self SHA1HashData:saltedPIN] subdataWithRange:NSMakeRange(0, 16)];
 }
@@ -88,32 +240,25 @@ static NSData* p12 = nil;
 }
 
 + (NSData*) pemToDer:(NSData*)pemCertBytes {
-    X509* x509;
+    ClientIdentity* identity = [CryptoManager getClientIdentity];
+    if ([identity.certPem isEqualToData:pemCertBytes]) {
+        return identity.certDer;
+    }
     
-    BIO* bio = BIO_new_mem_buf([pemCertBytes bytes], (int)[pemCertBytes length]);
-    x509 = PEM_read_bio_X509(bio, NULL, NULL, NULL);
-    BIO_free(bio);
+    X509* x509 = [CryptoManager copyX509FromPem:pemCertBytes];
+    if (!x509) {
+        Log(LOG_E, @"Unable to parse certificate in memory");
+        return nil;
+    }
     
-    bio = BIO_new(BIO_s_mem());
-    i2d_X509_bio(bio, x509);
+    NSData* ret = getDerFromX509(x509);
     X509_free(x509);
-
-    BUF_MEM* mem;
-    BIO_get_mem_ptr(bio, &mem);
-    
-    NSData* ret = [[NSData alloc] initWithBytes:mem->data length:mem->length];
-    BIO_free(bio);
     
     return ret;
 }
 
 - (bool) verifySignature:(NSData *)data withSignature:(NSData*)signature andCert:(NSData*)cert {
-    X509* x509;
-    BIO* bio = BIO_new_mem_buf([cert bytes], (int)[cert length]);
-    x509 = PEM_read_bio_X509(bio, NULL, NULL, NULL);
-    
-    BIO_free(bio);
-    
+    X509* x509 = [CryptoManager copyX509FromPem:cert];
     if (!x509) {
         Log(LOG_E, @"Unable to parse certificate in memory");
         return NULL;
@@ -134,12 +279,19 @@ static NSData* p12 = nil;
 }
 
 - (NSData *)signData:(NSData *)data withKey:(NSData *)key {
-    BIO* bio = BIO_new_mem_buf([key bytes], (int)[key length]);
-    
     EVP_PKEY* pkey;
-    pkey = PEM_read_bio_PrivateKey(bio, NULL, NULL, NULL);
     
-    BIO_free(bio);
+    ClientIdentity* identity = [CryptoManager getClientIdentity];
+    if ([identity.keyPem isEqualToData:key]) {
+        // Signing only reads the key, so the shared one is safe to use
+        pkey = identity->pkey;
+        EVP_PKEY_up_ref(pkey);
+    }
+    else {
+        BIO* bio = BIO_new_mem_buf([key bytes], (int)[key length]);
+        pkey = PEM_read_bio_PrivateKey(bio, NULL, NULL, NULL);
+        BIO_free(bio);
+    }
     
     if (!pkey) {
         Log(LOG_E, @"Unable to parse private key in memory!");
@@ -192,6 +344,7 @@ static NSData* p12 = nil;
 }
 
 + (NSData*) readCertFromFile {
+    [CryptoManager generateKeyPairUsingSSL];
     if (cert == nil) {
         cert = [CryptoManager readCryptoObject:@"client.crt"];
     }
@@ -199,6 +352,7 @@ static NSData* p12 = nil;
 }
 
 + (NSData*) readP12FromFile {
+    [CryptoManager generateKeyPairUsingSSL];
     if (p12 == nil) {
         p12 = [CryptoManager readCryptoObject:@"client.p12"];
     }
@@ -206,6 +360,7 @@ static NSData* p12 = nil;
 }
 
 + (NSData*) readKeyFromFile {
+    [CryptoManager generateKeyPairUsingSSL];
     if (key == nil) {
         key = [CryptoManager readCryptoObject:@"client.key"];
     }
@@ -221,26 +376,18 @@ static NSData* p12 = nil;
 }
 
 + (NSData *)getSignatureFromCert:(NSData *)cert {
-    BIO* bio = BIO_new_mem_buf([cert bytes], (int)[cert length]);
-    X509* x509 = PEM_read_bio_X509(bio, NULL, NULL, NULL);
-    BIO_free(bio);
+    ClientIdentity* identity = [CryptoManager getClientIdentity];
+    if ([identity.certPem isEqualToData:cert]) {
+        return identity.certSignature;
+    }
     
+    X509* x509 = [CryptoManager copyX509FromPem:cert];
     if (!x509) {
         Log(LOG_E, @"Unable to parse certificate in memory!");
         return NULL;
     }
     
-#if (OPENSSL_VERSION_NUMBER < 0x10002000L)
-    ASN1_BIT_STRING *asnSignature = x509->signature;
-#elif (OPENSSL_VERSION_NUMBER < 0x10100000L)
-    ASN1_BIT_STRING *asnSignature;
-    X509_get0_signature(&asnSignature, NULL, x509);
-#else
-    const ASN1_BIT_STRING *asnSignature;
-    X509_get0_signature(&asnSignature, NULL, x509);
-#endif
-    
-    NSData* sig = [NSData dataWithBytes:asnSignature->data length:asnSignature->length];
+    NSData* sig = getSignatureFromX509(x509);
     
     X509_free(x509);
     
@@ -283,26 +430,49 @@ static NSData* p12 = nil;
     return data;
 }
 
-+ (void) generateKeyPairUsingSSL {
++ (void) prewarmKeyPair {
     static dispatch_once_t pred;
     dispatch_once(&pred, ^{
-        if (![CryptoManager keyPairExists]) {
-            Log(LOG_I, @"Generating Certificate... ");
-            CertKeyPair certKeyPair = generateCertKeyPair();
+        dispatch_group_async(keyPairGroup, dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0), ^{
+            if (![CryptoManager keyPairExists]) {
+                Log(LOG_I, @"Generating Certificate... ");
+                NSDate* startTime = [NSDate date];
+                CertKeyPair certKeyPair = generateCertKeyPairWithType(CLIENT_KEY_TYPE);
+                
+                if (certKeyPair.p12 != NULL) {
+                    NSData* certData = [CryptoManager getCertFromCertKeyPair:&certKeyPair];
+                    NSData* p12Data = [CryptoManager getP12FromCertKeyPair:&certKeyPair];
+                    NSData* keyData = [CryptoManager getKeyFromCertKeyPair:&certKeyPair];
+                    
+                    [CryptoManager writeCryptoObject:@"client.crt" data:certData];
+                    [CryptoManager writeCryptoObject:@"client.p12" data:p12Data];
+                    [CryptoManager writeCryptoObject:@"client.key" data:keyData];
+                    
+                    Log(LOG_I, @"Certificate created in %.0f ms", -[startTime timeIntervalSinceNow] * 1000);
+                }
+                else {
+                    Log(LOG_E, @"Failed to generate certificate");
+                }
+                
+                freeCertKeyPair(certKeyPair);
+            }
             
-            NSData* certData = [CryptoManager getCertFromCertKeyPair:&certKeyPair];
-            NSData* p12Data = [CryptoManager getP12FromCertKeyPair:&certKeyPair];
-            NSData* keyData = [CryptoManager getKeyFromCertKeyPair:&certKeyPair];
-            
-            freeCertKeyPair(certKeyPair);
-            
-            [CryptoManager writeCryptoObject:@"client.crt" data:certData];
-            [CryptoManager writeCryptoObject:@"client.p12" data:p12Data];
-            [CryptoManager writeCryptoObject:@"client.key" data:keyData];
-            
-            Log(LOG_I, @"Certificate created");
-        }
+            keyPairReady = YES;
+        });
     });
 }
 
++ (BOOL) isKeyPairReady {
+    return keyPairReady;
+}
+
++ (void) generateKeyPairUsingSSL {
+    if (keyPairReady) {
+        return;
+    }
+    
+    [CryptoManager prewarmKeyPair];
+    dispatch_group_wait(keyPairGroup, DISPATCH_TIME_FOREVER);
+}
+
 @end
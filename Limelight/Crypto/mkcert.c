@@ -6,28 +6,56 @@
 
 #include <openssl/evp.h>
 #include <openssl/pem.h>
-#include <OpenSSL/provider.h>
-#include <OpenSSL/rsa.h>
+#include <openssl/rsa.h>
+#include <openssl/ec.h>
 #include <openssl/x509.h>
-#include <OpenSSL/rand.h>
 
 static const int NUM_BITS = 2048;
 static const int SERIAL = 0;
 static const int NUM_YEARS = 20;
 
-void mkcert(X509 **x509p, EVP_PKEY **pkeyp, int bits, int serial, int years) {
-    X509* cert = X509_new();
+static EVP_PKEY* mkkey(CertKeyType keyType, int bits) {
+    EVP_PKEY_CTX* ctx;
     
-    EVP_PKEY_CTX* ctx = EVP_PKEY_CTX_new_id(EVP_PKEY_RSA, NULL);
-
-    EVP_PKEY_keygen_init(ctx);
-    EVP_PKEY_CTX_set_rsa_keygen_bits(ctx, bits);
+    switch (keyType) {
+        case CertKeyTypeEcdsaP256:
+            ctx = EVP_PKEY_CTX_new_id(EVP_PKEY_EC, NULL);
+            if (ctx == NULL || EVP_PKEY_keygen_init(ctx) <= 0 ||
+                EVP_PKEY_CTX_set_ec_paramgen_curve_nid(ctx, NID_X9_62_prime256v1) <= 0 ||
+                EVP_PKEY_CTX_set_ec_param_enc(ctx, OPENSSL_EC_NAMED_CURVE) <= 0) {
+                EVP_PKEY_CTX_free(ctx);
+                return NULL;
+            }
+            break;
+            
+        case CertKeyTypeRsa2048:
+        default:
+            ctx = EVP_PKEY_CTX_new_id(EVP_PKEY_RSA, NULL);
+            if (ctx == NULL || EVP_PKEY_keygen_init(ctx) <= 0 ||
+                EVP_PKEY_CTX_set_rsa_keygen_bits(ctx, bits) <= 0) {
+                EVP_PKEY_CTX_free(ctx);
+                return NULL;
+            }
+            break;
+    }
 
     // pk must be initialized on input
     EVP_PKEY* pk = NULL;
-    EVP_PKEY_keygen(ctx, &pk);
+    if (EVP_PKEY_keygen(ctx, &pk) <= 0) {
+        pk = NULL;
+    }
 
     EVP_PKEY_CTX_free(ctx);
+    return pk;
+}
+
+static int mkcert(X509 **x509p, EVP_PKEY **pkeyp, CertKeyType keyType, int bits, int serial, int years) {
+    EVP_PKEY* pk = mkkey(keyType, bits);
+    if (pk == NULL) {
+        return 0;
+    }
+    
+    X509* cert = X509_new();
     
     X509_set_version(cert, 2);
     ASN1_INTEGER_set(X509_get_serialNumber(cert), serial);
@@ -56,18 +84,30 @@ void mkcert(X509 **x509p, EVP_PKEY **pkeyp, int bits, int serial, int years) {
                                -1, -1, 0);
     X509_set_issuer_name(cert, name);
 
-    X509_sign(cert, pk, EVP_sha256());
+    if (X509_sign(cert, pk, EVP_sha256()) == 0) {
+        X509_free(cert);
+        EVP_PKEY_free(pk);
+        return 0;
+    }
     
     *x509p = cert;
     *pkeyp = pk;
+    return 1;
 }
 
 struct CertKeyPair generateCertKeyPair(void) {
+    return generateCertKeyPairWithType(CertKeyTypeRsa2048);
+}
+
+struct CertKeyPair generateCertKeyPairWithType(CertKeyType keyType) {
     X509 *x509 = NULL;
     EVP_PKEY *pkey = NULL;
     PKCS12 *p12 = NULL;
     
-    mkcert(&x509, &pkey, NUM_BITS, SERIAL, NUM_YEARS);
+    if (!mkcert(&x509, &pkey, keyType, NUM_BITS, SERIAL, NUM_YEARS)) {
+        printf("Error generating a certificate key pair.\n");
+        return (CertKeyPair){NULL, NULL, NULL};
+    }
     
     char* pass = "limelight";
     p12 = PKCS12_create(pass,
@@ -80,12 +120,14 @@ struct CertKeyPair generateCertKeyPair(void) {
                         2048,
                         -1, // disable the automatic MAC
                         0);
-    // MAC it ourselves with SHA1 since iOS refuses to load anything else.
-    PKCS12_set_mac(p12, pass, -1, NULL, 0, 1, EVP_sha1());
     
     if (p12 == NULL) {
         printf("Error generating a valid PKCS12 certificate.\n");
     }
+    else {
+        // MAC it ourselves with SHA1 since iOS refuses to load anything else.
+        PKCS12_set_mac(p12, pass, -1, NULL, 0, 1, EVP_sha1());
+    }
     
     return (CertKeyPair){x509, pkey, p12};
 }
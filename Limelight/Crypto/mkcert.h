@@ -18,7 +18,15 @@ typedef struct CertKeyPair {
     PKCS12 *p12;
 } CertKeyPair;
 
+typedef enum {
+    CertKeyTypeRsa2048,
+    // Much faster to generate than RSA, but only usable with hosts
+    // that accept ECDSA client certificates
+    CertKeyTypeEcdsaP256,
+} CertKeyType;
+
 struct CertKeyPair generateCertKeyPair(void);
+struct CertKeyPair generateCertKeyPairWithType(CertKeyType keyType);
 void freeCertKeyPair(CertKeyPair);
 #endif
 
@@ -0,0 +1,32 @@
+//
+//  AppListDiff.h
+//  Moonlight
+//
+//  Copyright © 2026 Moonlight Game Streaming Project. All rights reserved.
+//
+
+#import "TemporaryHost.h"
+#import "TemporaryApp.h"
+
+// The changes between a host's known apps and a freshly fetched app list.
+// Apps are matched by (host UUID, app ID), so each list is walked once.
+@interface AppListDiff : NSObject
+
+@property (nonatomic, readonly) NSArray<TemporaryApp*>* insertedApps;
+@property (nonatomic, readonly) NSArray<TemporaryApp*>* deletedApps;
+@property (nonatomic, readonly) NSArray<TemporaryApp*>* updatedApps;
+
+- (id) initWithInsertedApps:(NSArray<TemporaryApp*>*)insertedApps
+                deletedApps:(NSArray<TemporaryApp*>*)deletedApps
+                updatedApps:(NSArray<TemporaryApp*>*)updatedApps;
+
+// Merges the new list into host.appList and returns what changed. Existing
+// TemporaryApp objects are kept (and updated in place) so the UI can track them,
+// and local-only state like hidden is preserved.
++ (AppListDiff*) mergeAppList:(NSSet<TemporaryApp*>*)newList intoHost:(TemporaryHost*)host;
+
++ (NSString*) keyForApp:(TemporaryApp*)app;
+
+- (BOOL) isEmpty;
+
+@end
@@ -0,0 +1,69 @@
+//
+//  AppListDiff.m
+//  Moonlight
+//
+//  Copyright © 2026 Moonlight Game Streaming Project. All rights reserved.
+//
+
+#import "AppListDiff.h"
+
+@implementation AppListDiff
+
+- (id) initWithInsertedApps:(NSArray<TemporaryApp*>*)insertedApps
+                deletedApps:(NSArray<TemporaryApp*>*)deletedApps
+                updatedApps:(NSArray<TemporaryApp*>*)updatedApps {
+    self = [super init];
+    _insertedApps = insertedApps;
+    _deletedApps = deletedApps;
+    _updatedApps = updatedApps;
+    return self;
+}
+
++ (NSString*) keyForApp:(TemporaryApp*)app {
+    return [NSString stringWithFormat:@"%@/%@", app.host.uuid, app.id];
+}
+
++ (AppListDiff*) mergeAppList:(NSSet<TemporaryApp*>*)newList intoHost:(TemporaryHost*)host {
+    NSMutableDictionary<NSString*, TemporaryApp*>* existingApps = [[NSMutableDictionary alloc] init];
+    for (TemporaryApp* app in host.appList) {
+        existingApps[app.id] = app;
+    }
+    
+    NSMutableArray<TemporaryApp*>* insertedApps = [[NSMutableArray alloc] init];
+    NSMutableArray<TemporaryApp*>* updatedApps = [[NSMutableArray alloc] init];
+    NSMutableSet<TemporaryApp*>* mergedAppList = [[NSMutableSet alloc] init];
+    
+    for (TemporaryApp* app in newList) {
+        TemporaryApp* savedApp = existingApps[app.id];
+        if (savedApp != nil) {
+            [existingApps removeObjectForKey:app.id];
+            
+            if (![savedApp.name isEqualToString:app.name] || savedApp.hdrSupported != app.hdrSupported) {
+                savedApp.name = app.name;
+                savedApp.hdrSupported = app.hdrSupported;
+                // Don't propagate hidden, because we want the local data to prevail
+                [updatedApps addObject:savedApp];
+            }
+            
+            [mergedAppList addObject:savedApp];
+        }
+        else {
+            app.host = host;
+            [insertedApps addObject:app];
+            [mergedAppList addObject:app];
+        }
+    }
+    
+    // Anything we didn't see in the new list is gone from the host
+    host.appList = mergedAppList;
+    
+    return [[AppListDiff alloc] initWithInsertedApps:insertedApps
+                                         deletedApps:[existingApps allValues]
+                                         updatedApps:updatedApps];
+}
+
+- (BOOL) isEmpty {
+    return _insertedApps.count == 0 && _deletedApps.count == 0 && _updatedApps.count == 0;
+}
+
+@end
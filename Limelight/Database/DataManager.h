@@ -10,6 +10,7 @@
 #import "TemporaryHost.h"
 #import "TemporaryApp.h"
 #import "TemporarySettings.h"
+#import "AppListDiff.h"
 
 @interface DataManager : NSObject
 
@@ -31,8 +32,10 @@
                     statsOverlay:(BOOL)statsOverlay;
 
 - (NSArray*) getHosts;
+// Host updates are coalesced and written asynchronously in batches
 - (void) updateHost:(TemporaryHost*)host;
-- (void) updateAppsForExistingHost:(TemporaryHost *)host;
+// Persists only the apps that the diff touches
+- (void) updateAppsForExistingHost:(TemporaryHost *)host withDiff:(AppListDiff*)diff;
 - (void) removeHost:(TemporaryHost*)host;
 - (void) removeApp:(TemporaryApp*)app;
 
@@ -10,26 +10,58 @@
 #import "TemporaryApp.h"
 #import "TemporarySettings.h"
 
+// Host updates from discovery are coalesced for this long before being
+// written to the database in a single batch
+#define HOST_UPDATE_BATCH_INTERVAL 1.0
+
 @implementation DataManager {
     NSManagedObjectContext *_managedObjectContext;
     AppDelegate *_appDelegate;
 }
 
+// Deferred host updates and the last state we wrote, both keyed by host UUID.
+// Guarded by @synchronized (pendingHostUpdates).
+static NSMutableDictionary<NSString*, NSDictionary*>* pendingHostUpdates;
+static NSMutableDictionary<NSString*, NSDictionary*>* persistedHostState;
+static BOOL hostUpdateFlushScheduled;
+
+// Held from taking pending updates until they're saved, so an older batch
+// can never be saved on top of a newer one
+static NSLock* hostUpdateWriteLock;
+
+static dispatch_queue_t hostUpdateQueue;
+
++ (void) initialize {
+    if (self == [DataManager class]) {
+        pendingHostUpdates = [[NSMutableDictionary alloc] init];
+        persistedHostState = [[NSMutableDictionary alloc] init];
+        hostUpdateWriteLock = [[NSLock alloc] init];
+        hostUpdateQueue = dispatch_queue_create("Host database updates", DISPATCH_QUEUE_SERIAL);
+    }
+}
+
 - (id) init {
-    self = [super init];
+    __block AppDelegate* appDelegate;
     
     // HACK: Avoid calling [UIApplication delegate] off the UI thread to keep
     // Main Thread Checker happy.
     if ([NSThread isMainThread]) {
-        _appDelegate = (AppDelegate *)[[UIApplication sharedApplication] delegate];
+        appDelegate = (AppDelegate *)[[UIApplication sharedApplication] delegate];
     }
     else {
         dispatch_sync(dispatch_get_main_queue(), ^{
-            self->_appDelegate = (AppDelegate *)[[UIApplication sharedApplication] delegate];
+            appDelegate = (AppDelegate *)[[UIApplication sharedApplication] delegate];
         });
     }
     
-    _managedObjectContext = [[NSManagedObjectContext alloc] initWithConcurrencyType:NSMainQueueConcurrencyType];
+    return [self initWithConcurrencyType:NSMainQueueConcurrencyType appDelegate:appDelegate];
+}
+
+- (id) initWithConcurrencyType:(NSManagedObjectContextConcurrencyType)concurrencyType appDelegate:(AppDelegate*)appDelegate {
+    self = [super init];
+    
+    _appDelegate = appDelegate;
+    _managedObjectContext = [[NSManagedObjectContext alloc] initWithConcurrencyType:concurrencyType];
     [_managedObjectContext setParentContext:[_appDelegate managedObjectContext]];
     
     return self;
@@ -93,47 +125,81 @@
 }
 
 - (void) updateHost:(TemporaryHost *)host {
-    [_managedObjectContext performBlockAndWait:^{
-        // Add a new persistent managed object if one doesn't exist
-        Host* parent = [self getHostForTemporaryHost:host withHostRecords:[self fetchRecords:@"Host"]];
-        if (parent == nil) {
-            NSEntityDescription* entity = [NSEntityDescription entityForName:@"Host" inManagedObjectContext:self->_managedObjectContext];
-            parent = [[Host alloc] initWithEntity:entity insertIntoManagedObjectContext:self->_managedObjectContext];
+    NSDictionary* state = [host persistentState];
+    NSString* uuid = host.uuid;
+    if (uuid == nil) {
+        return;
+    }
+    
+    @synchronized (pendingHostUpdates) {
+        // Skip the write entirely if nothing changed since the last one
+        NSMutableDictionary* pendingState = [NSMutableDictionary dictionaryWithDictionary:pendingHostUpdates[uuid]];
+        NSMutableDictionary* currentState = [NSMutableDictionary dictionaryWithDictionary:persistedHostState[uuid]];
+        [currentState addEntriesFromDictionary:pendingState];
+        NSMutableDictionary* newState = [NSMutableDictionary dictionaryWithDictionary:currentState];
+        [newState addEntriesFromDictionary:state];
+        if (persistedHostState[uuid] != nil && [newState isEqualToDictionary:currentState]) {
+            return;
         }
         
-        // Push changes from the temp host to the persistent one
-        [host propagateChangesToParent:parent];
+        [pendingState addEntriesFromDictionary:state];
+        pendingHostUpdates[uuid] = pendingState;
         
-        [self saveData];
-    }];
+        if (!hostUpdateFlushScheduled) {
+            hostUpdateFlushScheduled = YES;
+            dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(HOST_UPDATE_BATCH_INTERVAL * NSEC_PER_SEC)), hostUpdateQueue, ^{
+                @synchronized (pendingHostUpdates) {
+                    hostUpdateFlushScheduled = NO;
+                }
+                
+                // Write the batch on a private queue context so we never wait on the main thread
+                DataManager* dataMan = [[DataManager alloc] initWithConcurrencyType:NSPrivateQueueConcurrencyType appDelegate:self->_appDelegate];
+                [dataMan performBlockAndWaitWithPendingUpdates:^{}];
+            });
+        }
+    }
 }
 
-- (void) updateAppsForExistingHost:(TemporaryHost *)host {
-    [_managedObjectContext performBlockAndWait:^{
-        Host* parent = [self getHostForTemporaryHost:host withHostRecords:[self fetchRecords:@"Host"]];
+- (void) updateAppsForExistingHost:(TemporaryHost *)host withDiff:(AppListDiff*)diff {
+    [self performBlockAndWaitWithPendingUpdates:^{
+        Host* parent = [self getHostForTemporaryHost:host];
         if (parent == nil) {
             // The host must exist to be updated
             return;
         }
         
-        NSMutableSet *applist = [[NSMutableSet alloc] init];
-        NSArray *appRecords = [self fetchRecords:@"App"];
-        for (TemporaryApp* app in host.appList) {
-            // Add a new persistent managed object if one doesn't exist
-            App* parentApp = [self getAppForTemporaryApp:app withAppRecords:appRecords];
-            if (parentApp == nil) {
-                NSEntityDescription* entity = [NSEntityDescription entityForName:@"App" inManagedObjectContext:self->_managedObjectContext];
-                parentApp = [[App alloc] initWithEntity:entity insertIntoManagedObjectContext:self->_managedObjectContext];
+        NSMutableArray<NSString*>* appIds = [[NSMutableArray alloc] init];
+        for (NSArray<TemporaryApp*>* apps in @[diff.insertedApps, diff.deletedApps, diff.updatedApps]) {
+            for (TemporaryApp* app in apps) {
+                [appIds addObject:app.id];
             }
-            
-            [app propagateChangesToParent:parentApp withHost:parent];
-            
-            [applist addObject:parentApp];
         }
         
-        parent.appList = applist;
+        NSMutableDictionary<NSString*, App*>* appRecords = [[NSMutableDictionary alloc] init];
+        for (App* app in [self fetchRecords:@"App" withPredicate:[NSPredicate predicateWithFormat:@"host.uuid == %@ AND id IN %@", host.uuid, appIds]]) {
+            appRecords[app.id] = app;
+        }
         
-        [self saveData];
+        for (TemporaryApp* app in diff.deletedApps) {
+            App* managedApp = appRecords[app.id];
+            if (managedApp != nil) {
+                [self->_managedObjectContext deleteObject:managedApp];
+            }
+        }
+        
+        for (NSArray<TemporaryApp*>* apps in @[diff.insertedApps, diff.updatedApps]) {
+            for (TemporaryApp* app in apps) {
+                // Add a new persistent managed object if one doesn't exist
+                App* parentApp = appRecords[app.id];
+                if (parentApp == nil) {
+                    NSEntityDescription* entity = [NSEntityDescription entityForName:@"App" inManagedObjectContext:self->_managedObjectContext];
+                    parentApp = [[App alloc] initWithEntity:entity insertIntoManagedObjectContext:self->_managedObjectContext];
+                }
+                
+                // This also adds the app to the host's appList
+                [app propagateChangesToParent:parentApp withHost:parent];
+            }
+        }
     }];
 }
 
@@ -162,25 +228,76 @@
 }
 
 - (void) removeApp:(TemporaryApp*)app {
-    [_managedObjectContext performBlockAndWait:^{
-        App* managedApp = [self getAppForTemporaryApp:app withAppRecords:[self fetchRecords:@"App"]];
+    [self performBlockAndWaitWithPendingUpdates:^{
+        App* managedApp = [self getAppForTemporaryApp:app];
         if (managedApp != nil) {
             [self->_managedObjectContext deleteObject:managedApp];
-            [self saveData];
         }
     }];
 }
 
 - (void) removeHost:(TemporaryHost*)host {
-    [_managedObjectContext performBlockAndWait:^{
-        Host* managedHost = [self getHostForTemporaryHost:host withHostRecords:[self fetchRecords:@"Host"]];
+    [self performBlockAndWaitWithPendingUpdates:^{
+        Host* managedHost = [self getHostForTemporaryHost:host];
         if (managedHost != nil) {
             [self->_managedObjectContext deleteObject:managedHost];
-            [self saveData];
+        }
+        
+        @synchronized (pendingHostUpdates) {
+            [persistedHostState removeObjectForKey:host.uuid];
         }
     }];
 }
 
+// Runs the block on our context after applying any deferred host updates, then saves.
+// This lets the block see those updates and keeps them from landing on top of its changes.
+- (void) performBlockAndWaitWithPendingUpdates:(void (^)(void))block {
+    [_managedObjectContext performBlockAndWait:^{
+        [hostUpdateWriteLock lock];
+        [self applyPendingHostUpdates];
+        block();
+        [self saveData];
+        [hostUpdateWriteLock unlock];
+    }];
+}
+
+// Only call from within performBlockAndWaitWithPendingUpdates!!!
+- (void) applyPendingHostUpdates {
+    NSDictionary<NSString*, NSDictionary*>* updates;
+    @synchronized (pendingHostUpdates) {
+        if (pendingHostUpdates.count == 0) {
+            return;
+        }
+        
+        updates = [pendingHostUpdates copy];
+        [pendingHostUpdates removeAllObjects];
+        
+        for (NSString* uuid in updates) {
+            NSMutableDictionary* state = [NSMutableDictionary dictionaryWithDictionary:persistedHostState[uuid]];
+            [state addEntriesFromDictionary:updates[uuid]];
+            persistedHostState[uuid] = state;
+        }
+    }
+    
+    NSMutableDictionary<NSString*, Host*>* hostRecords = [[NSMutableDictionary alloc] init];
+    for (Host* host in [self fetchRecords:@"Host" withPredicate:[NSPredicate predicateWithFormat:@"uuid IN %@", [updates allKeys]]]) {
+        hostRecords[host.uuid] = host;
+    }
+    
+    for (NSString* uuid in updates) {
+        // Add a new persistent managed object if one doesn't exist
+        Host* parent = hostRecords[uuid];
+        if (parent == nil) {
+            NSEntityDescription* entity = [NSEntityDescription entityForName:@"Host" inManagedObjectContext:_managedObjectContext];
+            parent = [[Host alloc] initWithEntity:entity insertIntoManagedObjectContext:_managedObjectContext];
+        }
+        
+        [parent setValuesForKeysWithDictionary:updates[uuid]];
+    }
+    
+    Log(LOG_D, @"Wrote %lu batched host updates", (unsigned long)updates.count);
+}
+
 - (void) saveData {
     NSError* error;
     if ([_managedObjectContext hasChanges] && ![_managedObjectContext save:&error]) {
@@ -193,11 +310,30 @@
 - (NSArray*) getHosts {
     __block NSMutableArray *tempHosts = [[NSMutableArray alloc] init];
     
-    [_managedObjectContext performBlockAndWait:^{
+    [self performBlockAndWaitWithPendingUpdates:^{
         NSArray *hosts = [self fetchRecords:@"Host"];
         
         for (Host* host in hosts) {
-            [tempHosts addObject:[[TemporaryHost alloc] initFromHost:host]];
+            TemporaryHost* tempHost = [[TemporaryHost alloc] initFromHost:host];
+            [tempHosts addObject:tempHost];
+            
+            // Seed the last written state from the record itself (not the temporary host, which
+            // may have fixed up some fields) so unchanged hosts aren't rewritten on their first poll
+            if (host.uuid != nil) {
+                NSMutableDictionary* state = [[NSMutableDictionary alloc] init];
+                for (NSString* key in [tempHost persistentState]) {
+                    id value = [host valueForKey:key];
+                    if (value != nil) {
+                        state[key] = value;
+                    }
+                }
+                
+                @synchronized (pendingHostUpdates) {
+                    if (persistedHostState[host.uuid] == nil) {
+                        persistedHostState[host.uuid] = state;
+                    }
+                }
+            }
         }
     }];
     
@@ -205,34 +341,26 @@
 }
 
 // Only call from within performBlockAndWait!!!
-- (Host*) getHostForTemporaryHost:(TemporaryHost*)tempHost withHostRecords:(NSArray*)hosts {
-    for (Host* host in hosts) {
-        if ([tempHost.uuid isEqualToString:host.uuid]) {
-            return host;
-        }
-    }
-    
-    return nil;
+- (Host*) getHostForTemporaryHost:(TemporaryHost*)tempHost {
+    return [[self fetchRecords:@"Host" withPredicate:[NSPredicate predicateWithFormat:@"uuid == %@", tempHost.uuid]] firstObject];
 }
 
 // Only call from within performBlockAndWait!!!
-- (App*) getAppForTemporaryApp:(TemporaryApp*)tempApp withAppRecords:(NSArray*)apps {
-    for (App* app in apps) {
-        if ([app.id isEqualToString:tempApp.id] &&
-            [app.host.uuid isEqualToString:tempApp.host.uuid]) {
-            return app;
-        }
-    }
-    
-    return nil;
+- (App*) getAppForTemporaryApp:(TemporaryApp*)tempApp {
+    return [[self fetchRecords:@"App" withPredicate:[NSPredicate predicateWithFormat:@"id == %@ AND host.uuid == %@", tempApp.id, tempApp.host.uuid]] firstObject];
 }
 
 - (NSArray*) fetchRecords:(NSString*)entityName {
+    return [self fetchRecords:entityName withPredicate:nil];
+}
+
+- (NSArray*) fetchRecords:(NSString*)entityName withPredicate:(NSPredicate*)predicate {
     NSArray* fetchedRecords;
     
     NSFetchRequest* fetchRequest = [[NSFetchRequest alloc] init];
     NSEntityDescription* entity = [NSEntityDescription entityForName:entityName inManagedObjectContext:_managedObjectContext];
     [fetchRequest setEntity:entity];
+    [fetchRequest setPredicate:predicate];
     
     NSError* error;
     fetchedRecords = [_managedObjectContext executeFetchRequest:fetchRequest error:&error];
@@ -242,4 +370,3 @@
 }
 
 @end
-
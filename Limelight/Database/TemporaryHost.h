@@ -38,6 +38,10 @@ NS_ASSUME_NONNULL_BEGIN
 
 - (void) propagateChangesToParent:(Host*)host;
 
+// Persisted fields keyed by Host attribute name. Fields that aren't populated
+// are omitted so they don't overwrite existing data with nil.
+- (NSDictionary<NSString*, id>*) persistentState;
+
 NS_ASSUME_NONNULL_END
 
 @end
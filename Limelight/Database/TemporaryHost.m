@@ -55,31 +55,39 @@
 }
 
 - (void) propagateChangesToParent:(Host*)parentHost {
+    [parentHost setValuesForKeysWithDictionary:[self persistentState]];
+}
+
+- (NSDictionary<NSString*, id>*) persistentState {
+    NSMutableDictionary<NSString*, id>* state = [[NSMutableDictionary alloc] init];
+    
     // Avoid overwriting existing data with nil if
     // we don't have everything populated in the temporary
     // host.
     if (self.address != nil) {
-        parentHost.address = self.address;
+        state[@"address"] = self.address;
     }
     if (self.externalAddress != nil) {
-        parentHost.externalAddress = self.externalAddress;
+        state[@"externalAddress"] = self.externalAddress;
     }
     if (self.localAddress != nil) {
-        parentHost.localAddress = self.localAddress;
+        state[@"localAddress"] = self.localAddress;
     }
     if (self.ipv6Address != nil) {
-        parentHost.ipv6Address = self.ipv6Address;
+        state[@"ipv6Address"] = self.ipv6Address;
     }
     if (self.mac != nil) {
-        parentHost.mac = self.mac;
+        state[@"mac"] = self.mac;
     }
     if (self.serverCert != nil) {
-        parentHost.serverCert = self.serverCert;
+        state[@"serverCert"] = self.serverCert;
     }
-    parentHost.name = self.name;
-    parentHost.uuid = self.uuid;
-    parentHost.serverCodecModeSupport = self.serverCodecModeSupport;
-    parentHost.pairState = [NSNumber numberWithInt:self.pairState];
+    state[@"name"] = self.name;
+    state[@"uuid"] = self.uuid;
+    state[@"serverCodecModeSupport"] = [NSNumber numberWithInt:self.serverCodecModeSupport];
+    state[@"pairState"] = [NSNumber numberWithInt:self.pairState];
+    
+    return state;
 }
 
 - (NSComparisonResult)compareName:(TemporaryHost *)other {
@@ -7,6 +7,7 @@
 //
 
 #import "HapticContext.h"
+#include "ControllerState.h"
 
 @import GameController;
 @import CoreHaptics;
@@ -18,17 +19,24 @@ typedef struct {
     float lastY;
 } controller_touch_context_t;
 
+// The last controller state sent to the host
+typedef struct {
+    uint16_t activeGamepadMask;
+    uint32_t buttonFlags;
+    uint8_t leftTrigger;
+    uint8_t rightTrigger;
+    int16_t leftStickX;
+    int16_t leftStickY;
+    int16_t rightStickX;
+    int16_t rightStickY;
+} controller_sent_state_t;
+
 @property (nullable, nonatomic, retain) GCController* gamepad;
 @property (nonatomic)                   int playerIndex;
-@property (nonatomic)                   int lastButtonFlags;
-@property (nonatomic)                   int emulatingButtonFlags;
 @property (nonatomic)                   int supportedEmulationFlags;
-@property (nonatomic)                   unsigned char lastLeftTrigger;
-@property (nonatomic)                   unsigned char lastRightTrigger;
-@property (nonatomic)                   short lastLeftStickX;
-@property (nonatomic)                   short lastLeftStickY;
-@property (nonatomic)                   short lastRightStickX;
-@property (nonatomic)                   short lastRightStickY;
+
+// Button, trigger, and stick state. Safe to update from any thread.
+@property (nonatomic, readonly)         PCONTROLLER_STATE _Nonnull state;
 
 @property (nonatomic)                   controller_touch_context_t primaryTouch;
 @property (nonatomic)                   controller_touch_context_t secondaryTouch;
@@ -38,15 +46,17 @@ typedef struct {
 @property (nonatomic)                   HapticContext* _Nullable leftTriggerMotor;
 @property (nonatomic)                   HapticContext* _Nullable rightTriggerMotor;
 
-@property (nonatomic)                   NSTimer* _Nullable accelTimer;
-@property (nonatomic)                   GCAcceleration lastAccelSample;
-@property (nonatomic)                   NSTimer* _Nullable gyroTimer;
-@property (nonatomic)                   GCRotationRate lastGyroSample;
+@property (nonatomic)                   uint16_t accelReportRateHz;
+@property (nonatomic)                   uint16_t gyroReportRateHz;
 
 @property (nonatomic)                   NSTimer* _Nullable batteryTimer;
 @property (nonatomic)                   GCDeviceBatteryState lastBatteryState;
 @property (nonatomic)                   float lastBatteryLevel;
 
+@property (nonatomic)                   controller_sent_state_t lastSentState;
+@property (nonatomic)                   CFTimeInterval lastSentTime;
+@property (nonatomic)                   BOOL sendPending;
+
 @property (nonatomic)                   BOOL reportedArrival;
 @property (nonatomic)                   Controller* _Nullable mergedWithController;
 
@@ -8,6 +8,22 @@
 
 #include "Controller.h"
 
-@implementation Controller
+@implementation Controller {
+    CONTROLLER_STATE _state;
+}
+
+- (id)init
+{
+    self = [super init];
+    if (self) {
+        CsInit(&_state);
+    }
+    return self;
+}
+
+- (PCONTROLLER_STATE)state
+{
+    return &_state;
+}
 
 @end
@@ -0,0 +1,197 @@
+//
+//  ControllerState.c
+//  Moonlight
+//
+//  Copyright © 2026 Moonlight Game Streaming Project. All rights reserved.
+//
+
+#include "ControllerState.h"
+
+#include "Limelight.h"
+
+#include <stdlib.h>
+
+#define PACK_BUTTONS(flags, emulating) ((uint64_t)(flags) | ((uint64_t)(emulating) << 32))
+#define PACK_STICK(x, y) ((uint32_t)(uint16_t)(x) | ((uint32_t)(uint16_t)(y) << 16))
+
+#define MAX_MAGNITUDE(x, y) (abs(x) > abs(y) ? (x) : (y))
+
+static void handleSpecialCombosReleased(uint32_t* flags, uint32_t* emulating, uint32_t releasedButtons, int supportedEmulationFlags)
+{
+    if ((*emulating & EMULATING_SELECT) && (releasedButtons & (LB_FLAG | PLAY_FLAG))) {
+        *flags &= ~BACK_FLAG;
+        *emulating &= ~EMULATING_SELECT;
+    }
+    
+    if (*emulating & EMULATING_SPECIAL) {
+        // If Select is emulated, we use RB+Start to emulate special, otherwise we use Start+Select
+        if (supportedEmulationFlags & EMULATING_SELECT) {
+            if (releasedButtons & (RB_FLAG | PLAY_FLAG)) {
+                *flags &= ~SPECIAL_FLAG;
+                *emulating &= ~EMULATING_SPECIAL;
+            }
+        }
+        else {
+            if (releasedButtons & (BACK_FLAG | PLAY_FLAG)) {
+                *flags &= ~SPECIAL_FLAG;
+                *emulating &= ~EMULATING_SPECIAL;
+            }
+        }
+    }
+}
+
+static void handleSpecialCombosPressed(uint32_t* flags, uint32_t* emulating, uint32_t pressedButtons, int supportedEmulationFlags)
+{
+    // Special button combos for select and special
+    if (*flags & PLAY_FLAG) {
+        // If LB and start are down, trigger select
+        if (*flags & LB_FLAG) {
+            if (supportedEmulationFlags & EMULATING_SELECT) {
+                *flags |= BACK_FLAG;
+                *flags &= ~(pressedButtons & (PLAY_FLAG | LB_FLAG));
+                *emulating |= EMULATING_SELECT;
+            }
+        }
+        else if (supportedEmulationFlags & EMULATING_SPECIAL) {
+            // If Select is emulated too, use RB+Start to emulate special
+            if (supportedEmulationFlags & EMULATING_SELECT) {
+                if (*flags & RB_FLAG) {
+                    *flags |= SPECIAL_FLAG;
+                    *flags &= ~(pressedButtons & (PLAY_FLAG | RB_FLAG));
+                    *emulating |= EMULATING_SPECIAL;
+                }
+            }
+            else {
+                // If Select is physical, use Start+Select to emulate special
+                if (*flags & BACK_FLAG) {
+                    *flags |= SPECIAL_FLAG;
+                    *flags &= ~(pressedButtons & (PLAY_FLAG | BACK_FLAG));
+                    *emulating |= EMULATING_SPECIAL;
+                }
+            }
+        }
+    }
+}
+
+void CsInit(PCONTROLLER_STATE state)
+{
+    atomic_init(&state->buttons, 0);
+    atomic_init(&state->triggers, 0);
+    atomic_init(&state->leftStick, 0);
+    atomic_init(&state->rightStick, 0);
+}
+
+void CsSetLeftStick(PCONTROLLER_STATE state, int16_t x, int16_t y)
+{
+    atomic_store_explicit(&state->leftStick, PACK_STICK(x, y), memory_order_relaxed);
+}
+
+void CsSetRightStick(PCONTROLLER_STATE state, int16_t x, int16_t y)
+{
+    atomic_store_explicit(&state->rightStick, PACK_STICK(x, y), memory_order_relaxed);
+}
+
+void CsSetLeftTrigger(PCONTROLLER_STATE state, uint8_t left)
+{
+    uint32_t triggers = atomic_load_explicit(&state->triggers, memory_order_relaxed);
+    while (!atomic_compare_exchange_weak_explicit(&state->triggers, &triggers, (triggers & 0xFF00) | left,
+                                                  memory_order_relaxed, memory_order_relaxed));
+}
+
+void CsSetRightTrigger(PCONTROLLER_STATE state, uint8_t right)
+{
+    uint32_t triggers = atomic_load_explicit(&state->triggers, memory_order_relaxed);
+    while (!atomic_compare_exchange_weak_explicit(&state->triggers, &triggers, (triggers & 0x00FF) | ((uint32_t)right << 8),
+                                                  memory_order_relaxed, memory_order_relaxed));
+}
+
+void CsSetTriggers(PCONTROLLER_STATE state, uint8_t left, uint8_t right)
+{
+    atomic_store_explicit(&state->triggers, left | ((uint32_t)right << 8), memory_order_relaxed);
+}
+
+void CsPressButtons(PCONTROLLER_STATE state, uint32_t flags, int supportedEmulationFlags)
+{
+    uint64_t oldButtons = atomic_load_explicit(&state->buttons, memory_order_relaxed);
+    uint64_t newButtons;
+    do {
+        uint32_t buttonFlags = (uint32_t)oldButtons | flags;
+        uint32_t emulating = (uint32_t)(oldButtons >> 32);
+        
+        handleSpecialCombosPressed(&buttonFlags, &emulating, flags, supportedEmulationFlags);
+        newButtons = PACK_BUTTONS(buttonFlags, emulating);
+    } while (!atomic_compare_exchange_weak_explicit(&state->buttons, &oldButtons, newButtons,
+                                                    memory_order_relaxed, memory_order_relaxed));
+}
+
+void CsReleaseButtons(PCONTROLLER_STATE state, uint32_t flags, int supportedEmulationFlags)
+{
+    uint64_t oldButtons = atomic_load_explicit(&state->buttons, memory_order_relaxed);
+    uint64_t newButtons;
+    do {
+        uint32_t buttonFlags = (uint32_t)oldButtons & ~flags;
+        uint32_t emulating = (uint32_t)(oldButtons >> 32);
+        
+        handleSpecialCombosReleased(&buttonFlags, &emulating, flags, supportedEmulationFlags);
+        newButtons = PACK_BUTTONS(buttonFlags, emulating);
+    } while (!atomic_compare_exchange_weak_explicit(&state->buttons, &oldButtons, newButtons,
+                                                    memory_order_relaxed, memory_order_relaxed));
+}
+
+void CsReplaceButtons(PCONTROLLER_STATE state, uint32_t flags, int supportedEmulationFlags)
+{
+    uint64_t oldButtons = atomic_load_explicit(&state->buttons, memory_order_relaxed);
+    uint64_t newButtons;
+    do {
+        uint32_t releasedButtons = ((uint32_t)oldButtons ^ flags) & ~flags;
+        uint32_t pressedButtons = ((uint32_t)oldButtons ^ flags) & flags;
+        uint32_t buttonFlags = flags;
+        uint32_t emulating = (uint32_t)(oldButtons >> 32);
+        
+        // This must be called before handleSpecialCombosPressed
+        // because we clear the original button flags there
+        handleSpecialCombosReleased(&buttonFlags, &emulating, releasedButtons, supportedEmulationFlags);
+        handleSpecialCombosPressed(&buttonFlags, &emulating, pressedButtons, supportedEmulationFlags);
+        newButtons = PACK_BUTTONS(buttonFlags, emulating);
+    } while (!atomic_compare_exchange_weak_explicit(&state->buttons, &oldButtons, newButtons,
+                                                    memory_order_relaxed, memory_order_relaxed));
+}
+
+bool CsTakeButtonCombo(PCONTROLLER_STATE state, uint32_t combo)
+{
+    uint64_t oldButtons = atomic_load_explicit(&state->buttons, memory_order_relaxed);
+    do {
+        if ((uint32_t)oldButtons != combo) {
+            return false;
+        }
+    } while (!atomic_compare_exchange_weak_explicit(&state->buttons, &oldButtons, oldButtons & ~(uint64_t)UINT32_MAX,
+                                                    memory_order_relaxed, memory_order_relaxed));
+    
+    return true;
+}
+
+void CsGetSnapshot(PCONTROLLER_STATE state, PCONTROLLER_SNAPSHOT snapshot)
+{
+    uint32_t triggers = atomic_load_explicit(&state->triggers, memory_order_relaxed);
+    uint32_t leftStick = atomic_load_explicit(&state->leftStick, memory_order_relaxed);
+    uint32_t rightStick = atomic_load_explicit(&state->rightStick, memory_order_relaxed);
+    
+    snapshot->buttonFlags = (uint32_t)atomic_load_explicit(&state->buttons, memory_order_relaxed);
+    snapshot->leftTrigger = (uint8_t)triggers;
+    snapshot->rightTrigger = (uint8_t)(triggers >> 8);
+    snapshot->leftStickX = (int16_t)(uint16_t)leftStick;
+    snapshot->leftStickY = (int16_t)(uint16_t)(leftStick >> 16);
+    snapshot->rightStickX = (int16_t)(uint16_t)rightStick;
+    snapshot->rightStickY = (int16_t)(uint16_t)(rightStick >> 16);
+}
+
+void CsMergeSnapshot(PCONTROLLER_SNAPSHOT snapshot, const CONTROLLER_SNAPSHOT* other)
+{
+    snapshot->buttonFlags |= other->buttonFlags;
+    snapshot->leftTrigger = snapshot->leftTrigger > other->leftTrigger ? snapshot->leftTrigger : other->leftTrigger;
+    snapshot->rightTrigger = snapshot->rightTrigger > other->rightTrigger ? snapshot->rightTrigger : other->rightTrigger;
+    snapshot->leftStickX = MAX_MAGNITUDE(snapshot->leftStickX, other->leftStickX);
+    snapshot->leftStickY = MAX_MAGNITUDE(snapshot->leftStickY, other->leftStickY);
+    snapshot->rightStickX = MAX_MAGNITUDE(snapshot->rightStickX, other->rightStickX);
+    snapshot->rightStickY = MAX_MAGNITUDE(snapshot->rightStickY, other->rightStickY);
+}
@@ -0,0 +1,69 @@
+//
+//  ControllerState.h
+//  Moonlight
+//
+//  Copyright © 2026 Moonlight Game Streaming Project. All rights reserved.
+//
+
+#pragma once
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+// Combo emulation state kept alongside the button flags
+#define EMULATING_SELECT     0x1
+#define EMULATING_SPECIAL    0x2
+
+// Input state for one gamepad. Each part is a single atomic word, so input
+// callbacks on any thread can update it without locking. Button flags and the
+// combo emulation flags share a word so a press or release and the combo
+// handling it triggers are applied together, and concurrent presses of
+// different buttons can't overwrite each other.
+typedef struct _CONTROLLER_STATE {
+    // Button flags in the low 32 bits, EMULATING_* flags in the high 32 bits
+    _Atomic(uint64_t) buttons;
+    
+    // Left trigger in the low byte, right trigger in the next
+    _Atomic(uint32_t) triggers;
+    
+    // X in the low 16 bits, Y in the high 16 bits
+    _Atomic(uint32_t) leftStick;
+    _Atomic(uint32_t) rightStick;
+} CONTROLLER_STATE, *PCONTROLLER_STATE;
+
+// A plain copy of the state for merging and sending
+typedef struct _CONTROLLER_SNAPSHOT {
+    uint32_t buttonFlags;
+    uint8_t leftTrigger;
+    uint8_t rightTrigger;
+    int16_t leftStickX;
+    int16_t leftStickY;
+    int16_t rightStickX;
+    int16_t rightStickY;
+} CONTROLLER_SNAPSHOT, *PCONTROLLER_SNAPSHOT;
+
+void CsInit(PCONTROLLER_STATE state);
+
+void CsSetLeftStick(PCONTROLLER_STATE state, int16_t x, int16_t y);
+void CsSetRightStick(PCONTROLLER_STATE state, int16_t x, int16_t y);
+void CsSetLeftTrigger(PCONTROLLER_STATE state, uint8_t left);
+void CsSetRightTrigger(PCONTROLLER_STATE state, uint8_t right);
+void CsSetTriggers(PCONTROLLER_STATE state, uint8_t left, uint8_t right);
+
+// These apply the Start+LB (Select) and Start+RB or Start+Select (Special) combos
+// allowed by supportedEmulationFlags
+void CsPressButtons(PCONTROLLER_STATE state, uint32_t flags, int supportedEmulationFlags);
+void CsReleaseButtons(PCONTROLLER_STATE state, uint32_t flags, int supportedEmulationFlags);
+void CsReplaceButtons(PCONTROLLER_STATE state, uint32_t flags, int supportedEmulationFlags);
+
+// Clears the button flags and returns true if exactly the flags in combo are held
+bool CsTakeButtonCombo(PCONTROLLER_STATE state, uint32_t combo);
+
+// Each field is read atomically, but the snapshot as a whole may mix an update
+// that lands between the reads. The next update sends the rest.
+void CsGetSnapshot(PCONTROLLER_STATE state, PCONTROLLER_SNAPSHOT snapshot);
+
+// Combines other into snapshot: buttons are OR'd, triggers and sticks take the
+// value of greatest magnitude
+void CsMergeSnapshot(PCONTROLLER_SNAPSHOT snapshot, const CONTROLLER_SNAPSHOT* other);
@@ -21,6 +21,11 @@
 
 @interface ControllerSupport : NSObject
 
+// Minimum time between controller packets that only carry analog changes,
+// and between relative mouse motion packets. Button changes are always sent
+// immediately. Zero sends every update.
+@property (nonatomic) NSTimeInterval analogCoalescingInterval;
+
 -(id) initWithConfig:(StreamConfiguration*)streamConfig delegate:(id<ControllerSupportDelegate>)delegate;
 -(void) connectionEstablished;
 
@@ -41,6 +46,14 @@
 
 -(void) updateFinished:(Controller*)controller;
 
+// Relative mouse motion in host pixels from any pointer source. Motion is kept
+// with sub-pixel precision and batched per analogCoalescingInterval.
+-(void) mouseMovedWithDeltaX:(float)deltaX deltaY:(float)deltaY;
+
+// Sends batched mouse motion right away. Call this before sending a mouse button
+// or scroll event, so the event can't reach the host ahead of earlier motion.
+-(void) flushMouseMotion;
+
 -(void) rumble:(unsigned short)controllerNumber lowFreqMotor:(unsigned short)lowFreqMotor highFreqMotor:(unsigned short)highFreqMotor;
 -(void) rumbleTriggers:(uint16_t)controllerNumber leftTrigger:(uint16_t)leftTrigger rightTrigger:(uint16_t)rightTrigger;
 -(void) setMotionEventState:(uint16_t)controllerNumber motionType:(uint8_t)motionType reportRateHz:(uint16_t)reportRateHz;
@@ -50,4 +63,6 @@
 
 -(NSUInteger) getConnectedGamepadCount;
 
+-(NSString*) getMotionStatsText;
+
 @end
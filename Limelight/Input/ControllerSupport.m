@@ -8,6 +8,8 @@
 
 #import "ControllerSupport.h"
 #import "Controller.h"
+#import "MotionSampler.h"
+#include "PointerMotion.h"
 
 #import "OnScreenControls.h"
 
@@ -29,19 +31,19 @@ static const double MOUSE_SPEED_DIVISOR = 1.25;
     
     NSLock *_controllerStreamLock;
     NSMutableDictionary *_controllers;
+    dispatch_queue_t _controllerSendQueue;
+    uint64_t _controllerStateUpdates;
+    uint64_t _controllerPacketsSent;
+    MotionSampler *_motionSampler;
     id<ControllerSupportDelegate> _delegate;
     
-    float accumulatedDeltaX;
-    float accumulatedDeltaY;
+    POINTER_MOTION _pointerMotion;
     float accumulatedScrollX;
     float accumulatedScrollY;
     
     OnScreenControls *_osc;
     Controller *_oscController;
     
-#define EMULATING_SELECT     0x1
-#define EMULATING_SPECIAL    0x2
-    
     bool _oscEnabled;
     char _controllerNumbers;
     bool _multiController;
@@ -52,8 +54,6 @@ static const double MOUSE_SPEED_DIVISOR = 1.25;
 #define UPDATE_BUTTON_FLAG(controller, x, y) \
 ((y) ? [self setButtonFlag:controller flags:x] : [self clearButtonFlag:controller flags:x])
 
-#define MAX_MAGNITUDE(x, y) (abs(x) > abs(y) ? (x) : (y))
-
 -(void) rumble:(unsigned short)controllerNumber lowFreqMotor:(unsigned short)lowFreqMotor highFreqMotor:(unsigned short)highFreqMotor
 {
     Controller* controller = [_controllers objectForKey:[NSNumber numberWithInteger:controllerNumber]];
@@ -100,69 +100,22 @@ static const double MOUSE_SPEED_DIVISOR = 1.25;
         
         switch (motionType) {
             case LI_MOTION_TYPE_ACCEL:
-                [controller.accelTimer invalidate];
-                controller.accelTimer = nil;
-                                                                
-                if (reportRateHz && controller.gamepad.motion.hasGravityAndUserAcceleration) {
-                    // Reset the last motion sample
-                    GCAcceleration emptyAccelSample = {};
-                    controller.lastAccelSample = emptyAccelSample;
-                    
-                    dispatch_sync(dispatch_get_main_queue(), ^{
-                        controller.accelTimer = [NSTimer scheduledTimerWithTimeInterval:1.0 / reportRateHz repeats:YES block:^(NSTimer *timer) {
-                            // Don't send duplicate samples
-                            GCAcceleration lastAccelSample = controller.lastAccelSample;
-                            GCAcceleration accelSample = controller.gamepad.motion.acceleration;
-                            if (memcmp(&accelSample, &lastAccelSample, sizeof(accelSample)) == 0) {
-                                return;
-                            }
-                            controller.lastAccelSample = accelSample;
-                            
-                            // Convert g to m/s^2
-                            LiSendControllerMotionEvent((uint8_t)controllerNumber,
-                                                        LI_MOTION_TYPE_ACCEL,
-                                                        accelSample.x * -9.80665f,
-                                                        accelSample.y * -9.80665f,
-                                                        accelSample.z * -9.80665f);
-                        }];
-                    });
-                }
+                controller.accelReportRateHz = controller.gamepad.motion.hasGravityAndUserAcceleration ? reportRateHz : 0;
                 break;
                 
             case LI_MOTION_TYPE_GYRO:
-                [controller.gyroTimer invalidate];
-                controller.gyroTimer = nil;
-                
-                if (reportRateHz && controller.gamepad.motion.hasRotationRate) {
-                    // Reset the last motion sample
-                    GCRotationRate emptyGyroSample = {};
-                    controller.lastGyroSample = emptyGyroSample;
-                    
-                    dispatch_sync(dispatch_get_main_queue(), ^{
-                        controller.gyroTimer = [NSTimer scheduledTimerWithTimeInterval:1.0 / reportRateHz repeats:YES block:^(NSTimer *timer) {
-                            // Don't send duplicate samples
-                            GCRotationRate lastGyroSample = controller.lastGyroSample;
-                            GCRotationRate gyroSample = controller.gamepad.motion.rotationRate;
-                            if (memcmp(&gyroSample, &lastGyroSample, sizeof(gyroSample)) == 0) {
-                                return;
-                            }
-                            controller.lastGyroSample = gyroSample;
-                            
-                            // Convert rad/s to deg/s
-                            LiSendControllerMotionEvent((uint8_t)controllerNumber,
-                                                        LI_MOTION_TYPE_GYRO,
-                                                        gyroSample.x * 57.2957795f,
-                                                        gyroSample.z * 57.2957795f,
-                                                        gyroSample.y * -57.2957795f);
-                        }];
-                    });
-                }
+                controller.gyroReportRateHz = controller.gamepad.motion.hasRotationRate ? reportRateHz : 0;
                 break;
         }
         
+        [_motionSampler setController:controller
+                               number:controllerNumber
+                          accelRateHz:controller.accelReportRateHz
+                           gyroRateHz:controller.gyroReportRateHz];
+        
         // Set the motion sensor state if they require manual activation
         if (controller.gamepad.motion.sensorsRequireManualActivation) {
-            if (controller.gyroTimer || controller.accelTimer) {
+            if (controller.gyroReportRateHz || controller.accelReportRateHz) {
                 controller.gamepad.motion.sensorsActive = YES;
             }
             else {
@@ -191,129 +144,42 @@ static const double MOUSE_SPEED_DIVISOR = 1.25;
 
 -(void) updateLeftStick:(Controller*)controller x:(short)x y:(short)y
 {
-    @synchronized(controller) {
-        controller.lastLeftStickX = x;
-        controller.lastLeftStickY = y;
-    }
+    CsSetLeftStick(controller.state, x, y);
 }
 
 -(void) updateRightStick:(Controller*)controller x:(short)x y:(short)y
 {
-    @synchronized(controller) {
-        controller.lastRightStickX = x;
-        controller.lastRightStickY = y;
-    }
+    CsSetRightStick(controller.state, x, y);
 }
 
 -(void) updateLeftTrigger:(Controller*)controller left:(unsigned char)left
 {
-    @synchronized(controller) {
-        controller.lastLeftTrigger = left;
-    }
+    CsSetLeftTrigger(controller.state, left);
 }
 
 -(void) updateRightTrigger:(Controller*)controller right:(unsigned char)right
 {
-    @synchronized(controller) {
-        controller.lastRightTrigger = right;
-    }
+    CsSetRightTrigger(controller.state, right);
 }
 
 -(void) updateTriggers:(Controller*) controller left:(unsigned char)left right:(unsigned char)right
 {
-    @synchronized(controller) {
-        controller.lastLeftTrigger = left;
-        controller.lastRightTrigger = right;
-    }
-}
-
--(void) handleSpecialCombosReleased:(Controller*)controller releasedButtons:(int)releasedButtons
-{
-    if ((controller.emulatingButtonFlags & EMULATING_SELECT) && (releasedButtons & (LB_FLAG | PLAY_FLAG))) {
-        controller.lastButtonFlags &= ~BACK_FLAG;
-        controller.emulatingButtonFlags &= ~EMULATING_SELECT;
-    }
-    
-    if (controller.emulatingButtonFlags & EMULATING_SPECIAL) {
-        // If Select is emulated, we use RB+Start to emulate special, otherwise we use Start+Select
-        if (controller.supportedEmulationFlags & EMULATING_SELECT) {
-            if (releasedButtons & (RB_FLAG | PLAY_FLAG)) {
-                controller.lastButtonFlags &= ~SPECIAL_FLAG;
-                controller.emulatingButtonFlags &= ~EMULATING_SPECIAL;
-            }
-        }
-        else {
-            if (releasedButtons & (BACK_FLAG | PLAY_FLAG)) {
-                controller.lastButtonFlags &= ~SPECIAL_FLAG;
-                controller.emulatingButtonFlags &= ~EMULATING_SPECIAL;
-            }
-        }
-    }
-}
-
--(void) handleSpecialCombosPressed:(Controller*)controller pressedButtons:(int)pressedButtons
-{
-    // Special button combos for select and special
-    if (controller.lastButtonFlags & PLAY_FLAG) {
-        // If LB and start are down, trigger select
-        if (controller.lastButtonFlags & LB_FLAG) {
-            if (controller.supportedEmulationFlags & EMULATING_SELECT) {
-                controller.lastButtonFlags |= BACK_FLAG;
-                controller.lastButtonFlags &= ~(pressedButtons & (PLAY_FLAG | LB_FLAG));
-                controller.emulatingButtonFlags |= EMULATING_SELECT;
-            }
-        }
-        else if (controller.supportedEmulationFlags & EMULATING_SPECIAL) {
-            // If Select is emulated too, use RB+Start to emulate special
-            if (controller.supportedEmulationFlags & EMULATING_SELECT) {
-                if (controller.lastButtonFlags & RB_FLAG) {
-                    controller.lastButtonFlags |= SPECIAL_FLAG;
-                    controller.lastButtonFlags &= ~(pressedButtons & (PLAY_FLAG | RB_FLAG));
-                    controller.emulatingButtonFlags |= EMULATING_SPECIAL;
-                }
-            }
-            else {
-                // If Select is physical, use Start+Select to emulate special
-                if (controller.lastButtonFlags & BACK_FLAG) {
-                    controller.lastButtonFlags |= SPECIAL_FLAG;
-                    controller.lastButtonFlags &= ~(pressedButtons & (PLAY_FLAG | BACK_FLAG));
-                    controller.emulatingButtonFlags |= EMULATING_SPECIAL;
-                }
-            }
-        }
-    }
+    CsSetTriggers(controller.state, left, right);
 }
 
 -(void) updateButtonFlags:(Controller*)controller flags:(int)flags
 {
-    @synchronized(controller) {
-        controller.lastButtonFlags = flags;
-        
-        // This must be called before handleSpecialCombosPressed
-        // because we clear the original button flags there
-        int releasedButtons = (controller.lastButtonFlags ^ flags) & ~flags;
-        int pressedButtons = (controller.lastButtonFlags ^ flags) & flags;
-        
-        [self handleSpecialCombosReleased:controller releasedButtons:releasedButtons];
-        
-        [self handleSpecialCombosPressed:controller pressedButtons:pressedButtons];
-    }
+    CsReplaceButtons(controller.state, flags, controller.supportedEmulationFlags);
 }
 
 -(void) setButtonFlag:(Controller*)controller flags:(int)flags
 {
-    @synchronized(controller) {
-        controller.lastButtonFlags |= flags;
-        [self handleSpecialCombosPressed:controller pressedButtons:flags];
-    }
+    CsPressButtons(controller.state, flags, controller.supportedEmulationFlags);
 }
 
 -(void) clearButtonFlag:(Controller*)controller flags:(int)flags
 {
-    @synchronized(controller) {
-        controller.lastButtonFlags &= ~flags;
-        [self handleSpecialCombosReleased:controller releasedButtons:flags];
-    }
+    CsReleaseButtons(controller.state, flags, controller.supportedEmulationFlags);
 }
 
 -(uint16_t) getActiveGamepadMask
@@ -323,43 +189,13 @@ static const double MOUSE_SPEED_DIVISOR = 1.25;
 
 -(void) updateFinished:(Controller*)controller
 {
-    BOOL exitRequested = NO;
+    // Handle Start+Select+L1+R1 gamepad quit combo
+    BOOL exitRequested = CsTakeButtonCombo(controller.state, PLAY_FLAG | BACK_FLAG | LB_FLAG | RB_FLAG);
     
+    // The controller state itself needs no lock, but the send bookkeeping does
     [_controllerStreamLock lock];
-    @synchronized(controller) {
-        // Handle Start+Select+L1+R1 gamepad quit combo
-        if (controller.lastButtonFlags == (PLAY_FLAG | BACK_FLAG | LB_FLAG | RB_FLAG)) {
-            controller.lastButtonFlags = 0;
-            exitRequested = YES;
-        }
-        
-        // Only send controller events if we successfully reported controller arrival
-        if ([self reportControllerArrival:controller]) {
-            uint32_t buttonFlags = controller.lastButtonFlags;
-            uint8_t leftTrigger = controller.lastLeftTrigger;
-            uint8_t rightTrigger = controller.lastRightTrigger;
-            int16_t leftStickX = controller.lastLeftStickX;
-            int16_t leftStickY = controller.lastLeftStickY;
-            int16_t rightStickX = controller.lastRightStickX;
-            int16_t rightStickY = controller.lastRightStickY;
-            
-            // If this is merged with another controller, combine the inputs
-            if (controller.mergedWithController) {
-                buttonFlags |= controller.mergedWithController.lastButtonFlags;
-                leftTrigger = MAX(leftTrigger, controller.mergedWithController.lastLeftTrigger);
-                rightTrigger = MAX(rightTrigger, controller.mergedWithController.lastRightTrigger);
-                leftStickX = MAX_MAGNITUDE(leftStickX, controller.mergedWithController.lastLeftStickX);
-                leftStickY = MAX_MAGNITUDE(leftStickY, controller.mergedWithController.lastLeftStickY);
-                rightStickX = MAX_MAGNITUDE(rightStickX, controller.mergedWithController.lastRightStickX);
-                rightStickY = MAX_MAGNITUDE(rightStickY, controller.mergedWithController.lastRightStickY);
-            }
-            
-            // Player 1 is always present for OSC
-            LiSendMultiControllerEvent(_multiController ? controller.playerIndex : 0, [self getActiveGamepadMask],
-                                       buttonFlags, leftTrigger, rightTrigger,
-                                       leftStickX, leftStickY, rightStickX, rightStickY);
-        }
-    }
+    _controllerStateUpdates++;
+    [self sendControllerState:controller];
     [_controllerStreamLock unlock];
     
     if (exitRequested) {
@@ -370,6 +206,74 @@ static const double MOUSE_SPEED_DIVISOR = 1.25;
     }
 }
 
+// Must be called with _controllerStreamLock held
+-(void) sendControllerState:(Controller*)controller
+{
+    // Only send controller events if we successfully reported controller arrival
+    if (![self reportControllerArrival:controller]) {
+        return;
+    }
+    
+    CONTROLLER_SNAPSHOT snapshot;
+    CsGetSnapshot(controller.state, &snapshot);
+    
+    // If this is merged with another controller, combine the inputs
+    Controller* mergedWithController = controller.mergedWithController;
+    if (mergedWithController) {
+        CONTROLLER_SNAPSHOT mergedSnapshot;
+        CsGetSnapshot(mergedWithController.state, &mergedSnapshot);
+        CsMergeSnapshot(&snapshot, &mergedSnapshot);
+    }
+    
+    controller_sent_state_t state = {
+        .activeGamepadMask = [self getActiveGamepadMask],
+        .buttonFlags = snapshot.buttonFlags,
+        .leftTrigger = snapshot.leftTrigger,
+        .rightTrigger = snapshot.rightTrigger,
+        .leftStickX = snapshot.leftStickX,
+        .leftStickY = snapshot.leftStickY,
+        .rightStickX = snapshot.rightStickX,
+        .rightStickY = snapshot.rightStickY,
+    };
+    
+    controller_sent_state_t lastSentState = controller.lastSentState;
+    if (controller.lastSentTime != 0 && memcmp(&state, &lastSentState, sizeof(state)) == 0) {
+        // Nothing changed since the last packet
+        controller.sendPending = NO;
+        return;
+    }
+    
+    // Button and gamepad presence changes always go out immediately. Analog changes
+    // are limited to one packet per interval, carrying the latest values.
+    CFTimeInterval now = CACurrentMediaTime();
+    CFTimeInterval nextSendTime = controller.lastSentTime + _analogCoalescingInterval;
+    if (state.buttonFlags == lastSentState.buttonFlags &&
+        state.activeGamepadMask == lastSentState.activeGamepadMask &&
+        now < nextSendTime) {
+        if (!controller.sendPending) {
+            controller.sendPending = YES;
+            dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)((nextSendTime - now) * NSEC_PER_SEC)), _controllerSendQueue, ^{
+                [self->_controllerStreamLock lock];
+                if (controller.sendPending) {
+                    [self sendControllerState:controller];
+                }
+                [self->_controllerStreamLock unlock];
+            });
+        }
+        return;
+    }
+    
+    // Player 1 is always present for OSC
+    LiSendMultiControllerEvent(_multiController ? controller.playerIndex : 0, state.activeGamepadMask,
+                               state.buttonFlags, state.leftTrigger, state.rightTrigger,
+                               state.leftStickX, state.leftStickY, state.rightStickX, state.rightStickY);
+    
+    controller.lastSentState = state;
+    controller.lastSentTime = now;
+    controller.sendPending = NO;
+    _controllerPacketsSent++;
+}
+
 +(BOOL) hasKeyboardOrMouse {
     if (@available(iOS 14.0, tvOS 14.0, *)) {
         return GCMouse.mice.count > 0 || GCKeyboard.coalescedKeyboard != nil;
@@ -419,9 +323,10 @@ static const double MOUSE_SPEED_DIVISOR = 1.25;
 -(void) cleanupControllerMotion:(Controller*) controller
 {
     if (@available(iOS 14.0, tvOS 14.0, *)) {
-        // Stop sensor sampling timers
-        [controller.gyroTimer invalidate];
-        [controller.accelTimer invalidate];
+        // Stop sensor sampling
+        controller.accelReportRateHz = 0;
+        controller.gyroReportRateHz = 0;
+        [_motionSampler removeController:controller];
         
         // Disable motion sensors if they require manual activation
         if (controller.gamepad && controller.gamepad.motion && controller.gamepad.motion.sensorsRequireManualActivation) {
@@ -829,6 +734,66 @@ static const double MOUSE_SPEED_DIVISOR = 1.25;
     }
 }
 
+-(void) setAnalogCoalescingInterval:(NSTimeInterval)analogCoalescingInterval
+{
+    _analogCoalescingInterval = analogCoalescingInterval;
+    
+    // The pointer batch interval belongs to the send queue
+    dispatch_async(_controllerSendQueue, ^{
+        self->_pointerMotion.batchInterval = analogCoalescingInterval;
+    });
+}
+
+-(void) mouseMovedWithDeltaX:(float)deltaX deltaY:(float)deltaY
+{
+    if (PmAddMotion(&_pointerMotion, deltaX, deltaY)) {
+        dispatch_async(_controllerSendQueue, ^{
+            [self flushPointerMotion];
+        });
+    }
+}
+
+// Must be called on _controllerSendQueue
+-(void) flushPointerMotion
+{
+    CFTimeInterval now = CACurrentMediaTime();
+    CFTimeInterval delay = PmGetFlushDelay(&_pointerMotion, now);
+    if (delay > 0) {
+        // Let motion accumulate until the end of the batch interval
+        dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(delay * NSEC_PER_SEC)), _controllerSendQueue, ^{
+            [self flushPointerMotion];
+        });
+        return;
+    }
+    
+    [self sendPointerMotion:now];
+}
+
+-(void) flushMouseMotion
+{
+    // The send queue owns the flush state, and going through it also orders
+    // this after any flush already in progress there
+    dispatch_sync(_controllerSendQueue, ^{
+        [self sendPointerMotion:CACurrentMediaTime()];
+    });
+}
+
+// Must be called on _controllerSendQueue
+-(void) sendPointerMotion:(CFTimeInterval)now
+{
+    int16_t deltaX, deltaY;
+    BOOL flushAgain = PmFlush(&_pointerMotion, now, &deltaX, &deltaY);
+    if (deltaX != 0 || deltaY != 0) {
+        LiSendMouseMoveEvent(deltaX, deltaY);
+    }
+    
+    if (flushAgain) {
+        dispatch_async(_controllerSendQueue, ^{
+            [self flushPointerMotion];
+        });
+    }
+}
+
 -(void) unregisterMouseCallbacks:(GCMouse*)mouse API_AVAILABLE(ios(14.0)) {
     mouse.mouseInput.mouseMovedHandler = nil;
     
@@ -848,38 +813,32 @@ static const double MOUSE_SPEED_DIVISOR = 1.25;
 
 -(void) registerMouseCallbacks:(GCMouse*) mouse API_AVAILABLE(ios(14.0)) {
     mouse.mouseInput.mouseMovedHandler = ^(GCMouseInput * _Nonnull mouse, float deltaX, float deltaY) {
-        self->accumulatedDeltaX += deltaX / MOUSE_SPEED_DIVISOR;
-        self->accumulatedDeltaY += -deltaY / MOUSE_SPEED_DIVISOR;
-        
-        short truncatedDeltaX = (short)self->accumulatedDeltaX;
-        short truncatedDeltaY = (short)self->accumulatedDeltaY;
-        
-        if (truncatedDeltaX != 0 || truncatedDeltaY != 0) {
-            LiSendMouseMoveEvent(truncatedDeltaX, truncatedDeltaY);
-            
-            self->accumulatedDeltaX -= truncatedDeltaX;
-            self->accumulatedDeltaY -= truncatedDeltaY;
-        }
+        [self mouseMovedWithDeltaX:deltaX / MOUSE_SPEED_DIVISOR deltaY:-deltaY / MOUSE_SPEED_DIVISOR];
     };
     
     mouse.mouseInput.leftButton.pressedChangedHandler = ^(GCControllerButtonInput * _Nonnull button, float value, BOOL pressed) {
+        [self flushMouseMotion];
         LiSendMouseButtonEvent(pressed ? BUTTON_ACTION_PRESS : BUTTON_ACTION_RELEASE, BUTTON_LEFT);
     };
     mouse.mouseInput.middleButton.pressedChangedHandler = ^(GCControllerButtonInput * _Nonnull button, float value, BOOL pressed) {
+        [self flushMouseMotion];
         LiSendMouseButtonEvent(pressed ? BUTTON_ACTION_PRESS : BUTTON_ACTION_RELEASE, BUTTON_MIDDLE);
     };
     mouse.mouseInput.rightButton.pressedChangedHandler = ^(GCControllerButtonInput * _Nonnull button, float value, BOOL pressed) {
+        [self flushMouseMotion];
         LiSendMouseButtonEvent(pressed ? BUTTON_ACTION_PRESS : BUTTON_ACTION_RELEASE, BUTTON_RIGHT);
     };
     
     if (mouse.mouseInput.auxiliaryButtons != nil) {
         if (mouse.mouseInput.auxiliaryButtons.count >= 1) {
             mouse.mouseInput.auxiliaryButtons[0].pressedChangedHandler = ^(GCControllerButtonInput * _Nonnull button, float value, BOOL pressed) {
+                [self flushMouseMotion];
                 LiSendMouseButtonEvent(pressed ? BUTTON_ACTION_PRESS : BUTTON_ACTION_RELEASE, BUTTON_X1);
             };
         }
         if (mouse.mouseInput.auxiliaryButtons.count >= 2) {
             mouse.mouseInput.auxiliaryButtons[1].pressedChangedHandler = ^(GCControllerButtonInput * _Nonnull button, float value, BOOL pressed) {
+                [self flushMouseMotion];
                 LiSendMouseButtonEvent(pressed ? BUTTON_ACTION_PRESS : BUTTON_ACTION_RELEASE, BUTTON_X2);
             };
         }
@@ -896,6 +855,8 @@ static const double MOUSE_SPEED_DIVISOR = 1.25;
         short truncatedScrollX = (short)self->accumulatedScrollX;
         
         if (truncatedScrollX != 0) {
+            [self flushMouseMotion];
+            
             // Direction is reversed from vertical scrolling
             LiSendHighResHScrollEvent(-truncatedScrollX * 20);
             
@@ -908,6 +869,7 @@ static const double MOUSE_SPEED_DIVISOR = 1.25;
         short truncatedScrollY = (short)self->accumulatedScrollY;
         
         if (truncatedScrollY != 0) {
+            [self flushMouseMotion];
             LiSendHighResScrollEvent(truncatedScrollY * 20);
             
             self->accumulatedScrollY -= truncatedScrollY;
@@ -959,6 +921,11 @@ static const double MOUSE_SPEED_DIVISOR = 1.25;
         // If the mouse and keyboard disconnect later, it will reappear when the
         // first OSC input is received.
         LiSendMultiControllerEvent(0, 0, 0, 0, 0, 0, 0, 0, 0);
+        
+        // Make sure the next OSC update is sent even if its state matches the last one we sent
+        [_controllerStreamLock lock];
+        _oscController.lastSentTime = 0;
+        [_controllerStreamLock unlock];
     }
     
     [_osc setLevel:level];
@@ -1073,12 +1040,24 @@ static const double MOUSE_SPEED_DIVISOR = 1.25;
     return _controllers.count;
 }
 
+-(NSString*) getMotionStatsText
+{
+    return [_motionSampler getStatsText];
+}
+
 -(id) initWithConfig:(StreamConfiguration*)streamConfig delegate:(id<ControllerSupportDelegate>)delegate
 {
     self = [super init];
     
     _controllerStreamLock = [[NSLock alloc] init];
     _controllers = [[NSMutableDictionary alloc] init];
+    _controllerSendQueue = dispatch_queue_create("Controller send queue",
+                                                 dispatch_queue_attr_make_with_qos_class(DISPATCH_QUEUE_SERIAL, QOS_CLASS_USER_INTERACTIVE, 0));
+    _motionSampler = [[MotionSampler alloc] init];
+    
+    // Coalesce analog input to one packet per display refresh by default
+    _analogCoalescingInterval = 1.0 / [UIScreen mainScreen].maximumFramesPerSecond;
+    PmInit(&_pointerMotion, _analogCoalescingInterval);
     _controllerNumbers = 0;
     _multiController = streamConfig.multiController;
     _swapABXYButtons = streamConfig.swapABXYButtons;
@@ -1249,12 +1228,17 @@ static const double MOUSE_SPEED_DIVISOR = 1.25;
     
     _controllerNumbers = 0;
     
+    [_controllerStreamLock lock];
+    Log(LOG_I, @"Sent %llu controller packets for %llu controller updates", _controllerPacketsSent, _controllerStateUpdates);
+    [_controllerStreamLock unlock];
+    
     for (Controller* controller in [_controllers allValues]) {
         [self cleanupControllerHaptics:controller];
         [self cleanupControllerMotion:controller];
         [self cleanupControllerBattery:controller];
     }
     [_controllers removeAllObjects];
+    [_motionSampler stop];
     
     for (GCController* controller in [GCController controllers]) {
         if ([ControllerSupport isSupportedGamepad:controller]) {
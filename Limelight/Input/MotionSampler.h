@@ -0,0 +1,24 @@
+//
+//  MotionSampler.h
+//  Moonlight
+//
+//  Copyright © 2026 Moonlight Game Streaming Project. All rights reserved.
+//
+
+#import "Controller.h"
+
+// Polls gamepad motion sensors on a dedicated high priority queue and sends
+// the samples to the host at the rates it requested. A single timer serves
+// every controller and sensor, so each tick reads accelerometer and gyro
+// together and skips sensors that aren't due yet or haven't changed.
+@interface MotionSampler : NSObject
+
+// Rates of 0 stop reports for that sensor
+-(void) setController:(Controller*)controller number:(uint16_t)controllerNumber accelRateHz:(uint16_t)accelRateHz gyroRateHz:(uint16_t)gyroRateHz;
+-(void) removeController:(Controller*)controller;
+-(void) stop;
+
+// Requested, polled, and sent rates since the last call, or nil if no sensors are active
+-(NSString*) getStatsText;
+
+@end
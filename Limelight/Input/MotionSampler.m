@@ -0,0 +1,281 @@
+//
+//  MotionSampler.m
+//  Moonlight
+//
+//  Copyright © 2026 Moonlight Game Streaming Project. All rights reserved.
+//
+
+#import "MotionSampler.h"
+
+#include "Limelight.h"
+
+@import GameController;
+
+#define MOTION_SENSOR_ACCEL 0
+#define MOTION_SENSOR_GYRO  1
+#define MOTION_SENSOR_COUNT 2
+
+typedef struct {
+    uint16_t reportRateHz;
+    CFTimeInterval interval;
+    CFTimeInterval nextSampleTime;
+} motion_sensor_t;
+
+@interface MotionTarget : NSObject
+
+@property (nonatomic) Controller* controller;
+@property (nonatomic) uint16_t controllerNumber;
+
+@end
+
+@implementation MotionTarget {
+    @public
+    motion_sensor_t sensors[MOTION_SENSOR_COUNT];
+    GCAcceleration lastAccelSample;
+    GCRotationRate lastGyroSample;
+}
+
+@end
+
+@implementation MotionSampler {
+    dispatch_queue_t _queue;
+    dispatch_source_t _timer;
+    CFTimeInterval _tickInterval;
+    NSMutableArray<MotionTarget*>* _targets;
+    
+    // Stats since the last call to getStatsText
+    CFTimeInterval _statsStartTime;
+    uint32_t _polledSamples[MOTION_SENSOR_COUNT];
+    uint32_t _sentSamples[MOTION_SENSOR_COUNT];
+}
+
+static BOOL takeSensorSample(motion_sensor_t* sensor, CFTimeInterval now, CFTimeInterval tolerance)
+{
+    if (sensor->reportRateHz == 0 || now + tolerance < sensor->nextSampleTime) {
+        return NO;
+    }
+    
+    // Stay on the requested schedule, but don't burst to catch up after a stall
+    sensor->nextSampleTime += sensor->interval;
+    if (sensor->nextSampleTime < now) {
+        sensor->nextSampleTime = now + sensor->interval;
+    }
+    
+    return YES;
+}
+
+static void setSensorRate(motion_sensor_t* sensor, uint16_t reportRateHz)
+{
+    sensor->reportRateHz = reportRateHz;
+    sensor->interval = reportRateHz ? 1.0 / reportRateHz : 0;
+    sensor->nextSampleTime = 0;
+}
+
+-(id) init
+{
+    self = [super init];
+    
+    _queue = dispatch_queue_create("Motion sampler",
+                                   dispatch_queue_attr_make_with_qos_class(DISPATCH_QUEUE_SERIAL, QOS_CLASS_USER_INTERACTIVE, 0));
+    _targets = [[NSMutableArray alloc] init];
+    
+    // The timer stays idle until a sensor is enabled
+    __weak MotionSampler* weakSelf = self;
+    _timer = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, DISPATCH_TIMER_STRICT, _queue);
+    dispatch_source_set_event_handler(_timer, ^{
+        [weakSelf sample];
+    });
+    dispatch_source_set_timer(_timer, DISPATCH_TIME_FOREVER, DISPATCH_TIME_FOREVER, 0);
+    dispatch_resume(_timer);
+    
+    return self;
+}
+
+// Must be called on _queue
+-(MotionTarget*) targetForController:(Controller*)controller
+{
+    for (MotionTarget* target in _targets) {
+        if (target.controller == controller) {
+            return target;
+        }
+    }
+    
+    return nil;
+}
+
+// Must be called on _queue
+-(void) updateTimer
+{
+    uint16_t maxRateHz = 0;
+    for (MotionTarget* target in _targets) {
+        for (int i = 0; i < MOTION_SENSOR_COUNT; i++) {
+            maxRateHz = MAX(maxRateHz, target->sensors[i].reportRateHz);
+        }
+    }
+    
+    CFTimeInterval tickInterval = maxRateHz ? 1.0 / maxRateHz : 0;
+    if (tickInterval == _tickInterval) {
+        return;
+    }
+    
+    if (_tickInterval == 0) {
+        // Start a new stats period when sampling starts
+        _statsStartTime = CACurrentMediaTime();
+        memset(_polledSamples, 0, sizeof(_polledSamples));
+        memset(_sentSamples, 0, sizeof(_sentSamples));
+    }
+    _tickInterval = tickInterval;
+    
+    if (tickInterval == 0) {
+        dispatch_source_set_timer(_timer, DISPATCH_TIME_FOREVER, DISPATCH_TIME_FOREVER, 0);
+    }
+    else {
+        // The timer ticks at the highest requested rate. Slower sensors skip ticks.
+        uint64_t tickIntervalNs = (uint64_t)(tickInterval * NSEC_PER_SEC);
+        dispatch_source_set_timer(_timer, dispatch_time(DISPATCH_TIME_NOW, tickIntervalNs), tickIntervalNs, 0);
+    }
+}
+
+-(void) setController:(Controller*)controller number:(uint16_t)controllerNumber accelRateHz:(uint16_t)accelRateHz gyroRateHz:(uint16_t)gyroRateHz
+{
+    dispatch_async(_queue, ^{
+        MotionTarget* target = [self targetForController:controller];
+        
+        if (accelRateHz == 0 && gyroRateHz == 0) {
+            if (target != nil) {
+                [self->_targets removeObject:target];
+            }
+        }
+        else {
+            if (target == nil) {
+                target = [[MotionTarget alloc] init];
+                target.controller = controller;
+                [self->_targets addObject:target];
+            }
+            
+            target.controllerNumber = controllerNumber;
+            setSensorRate(&target->sensors[MOTION_SENSOR_ACCEL], accelRateHz);
+            setSensorRate(&target->sensors[MOTION_SENSOR_GYRO], gyroRateHz);
+            
+            // Reset the last motion samples
+            GCAcceleration emptyAccelSample = {};
+            GCRotationRate emptyGyroSample = {};
+            target->lastAccelSample = emptyAccelSample;
+            target->lastGyroSample = emptyGyroSample;
+        }
+        
+        [self updateTimer];
+    });
+}
+
+-(void) removeController:(Controller*)controller
+{
+    [self setController:controller number:0 accelRateHz:0 gyroRateHz:0];
+}
+
+-(void) stop
+{
+    dispatch_source_cancel(_timer);
+    dispatch_async(_queue, ^{
+        [self->_targets removeAllObjects];
+    });
+}
+
+-(void) sample
+{
+    if (@available(iOS 14.0, tvOS 14.0, *)) {
+        CFTimeInterval now = CACurrentMediaTime();
+        
+        // Allow for timer jitter so a sensor running at the timer rate isn't
+        // skipped when a tick fires slightly early
+        CFTimeInterval tolerance = _tickInterval / 4;
+        
+        for (MotionTarget* target in _targets) {
+            GCMotion* motion = target.controller.gamepad.motion;
+            if (motion == nil) {
+                continue;
+            }
+            
+            if (takeSensorSample(&target->sensors[MOTION_SENSOR_ACCEL], now, tolerance)) {
+                _polledSamples[MOTION_SENSOR_ACCEL]++;
+                
+                // Don't send duplicate samples
+                GCAcceleration accelSample = motion.acceleration;
+                if (memcmp(&accelSample, &target->lastAccelSample, sizeof(accelSample)) != 0) {
+                    target->lastAccelSample = accelSample;
+                    
+                    // Convert g to m/s^2
+                    LiSendControllerMotionEvent((uint8_t)target.controllerNumber,
+                                                LI_MOTION_TYPE_ACCEL,
+                                                accelSample.x * -9.80665f,
+                                                accelSample.y * -9.80665f,
+                                                accelSample.z * -9.80665f);
+                    _sentSamples[MOTION_SENSOR_ACCEL]++;
+                }
+            }
+            
+            if (takeSensorSample(&target->sensors[MOTION_SENSOR_GYRO], now, tolerance)) {
+                _polledSamples[MOTION_SENSOR_GYRO]++;
+                
+                // Don't send duplicate samples
+                GCRotationRate gyroSample = motion.rotationRate;
+                if (memcmp(&gyroSample, &target->lastGyroSample, sizeof(gyroSample)) != 0) {
+                    target->lastGyroSample = gyroSample;
+                    
+                    // Convert rad/s to deg/s
+                    LiSendControllerMotionEvent((uint8_t)target.controllerNumber,
+                                                LI_MOTION_TYPE_GYRO,
+                                                gyroSample.x * 57.2957795f,
+                                                gyroSample.z * 57.2957795f,
+                                                gyroSample.y * -57.2957795f);
+                    _sentSamples[MOTION_SENSOR_GYRO]++;
+                }
+            }
+        }
+    }
+}
+
+-(NSString*) getStatsText
+{
+    __block NSString* statsText = nil;
+    
+    dispatch_sync(_queue, ^{
+        if (self->_targets.count == 0) {
+            return;
+        }
+        
+        CFTimeInterval now = CACurrentMediaTime();
+        CFTimeInterval elapsed = now - self->_statsStartTime;
+        if (elapsed <= 0) {
+            return;
+        }
+        
+        static NSString* const sensorNames[MOTION_SENSOR_COUNT] = { @"accel", @"gyro" };
+        NSMutableArray<NSString*>* sensorStats = [[NSMutableArray alloc] init];
+        for (int i = 0; i < MOTION_SENSOR_COUNT; i++) {
+            uint32_t requestedRateHz = 0;
+            for (MotionTarget* target in self->_targets) {
+                requestedRateHz += target->sensors[i].reportRateHz;
+            }
+            
+            if (requestedRateHz != 0) {
+                [sensorStats addObject:[NSString stringWithFormat:@"%@ %u/%.0f/%.0f Hz",
+                                        sensorNames[i],
+                                        requestedRateHz,
+                                        self->_polledSamples[i] / elapsed,
+                                        self->_sentSamples[i] / elapsed]];
+            }
+        }
+        
+        statsText = [NSString stringWithFormat:@"Motion sensor requested/polled/sent rate: %@",
+                     [sensorStats componentsJoinedByString:@", "]];
+        
+        self->_statsStartTime = now;
+        memset(self->_polledSamples, 0, sizeof(self->_polledSamples));
+        memset(self->_sentSamples, 0, sizeof(self->_sentSamples));
+    });
+    
+    return statsText;
+}
+
+@end
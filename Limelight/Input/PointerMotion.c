@@ -0,0 +1,109 @@
+//
+//  PointerMotion.c
+//  Moonlight
+//
+//  Copyright © 2026 Moonlight Game Streaming Project. All rights reserved.
+//
+
+#include "PointerMotion.h"
+
+#include <math.h>
+
+#define FIXED_POINT_SCALE ((double)(1 << 24))
+
+// Shortest time a batch is assumed to cover when estimating pointer speed
+#define MIN_BATCH_DURATION 0.001
+
+void PmInit(PPOINTER_MOTION motion, double batchInterval)
+{
+    atomic_init(&motion->pendingX, 0);
+    atomic_init(&motion->pendingY, 0);
+    atomic_init(&motion->flushPending, false);
+    
+    motion->batchInterval = batchInterval;
+    motion->lastFlushTime = 0;
+    motion->remainderX = 0;
+    motion->remainderY = 0;
+    
+    motion->accelThreshold = 0;
+    motion->accelFactor = 0;
+    motion->accelMaxGain = 1;
+}
+
+void PmSetAcceleration(PPOINTER_MOTION motion, double threshold, double factor, double maxGain)
+{
+    motion->accelThreshold = threshold;
+    motion->accelFactor = factor;
+    motion->accelMaxGain = maxGain;
+}
+
+bool PmAddMotion(PPOINTER_MOTION motion, float deltaX, float deltaY)
+{
+    // Fixed point keeps the sum exact no matter how many small deltas are added
+    atomic_fetch_add_explicit(&motion->pendingX, (int64_t)llround(deltaX * FIXED_POINT_SCALE), memory_order_relaxed);
+    atomic_fetch_add_explicit(&motion->pendingY, (int64_t)llround(deltaY * FIXED_POINT_SCALE), memory_order_relaxed);
+    
+    // Only the first addition since the last flush needs to schedule one
+    return !atomic_exchange_explicit(&motion->flushPending, true, memory_order_acq_rel);
+}
+
+double PmGetFlushDelay(PPOINTER_MOTION motion, double now)
+{
+    double nextFlushTime = motion->lastFlushTime + motion->batchInterval;
+    return nextFlushTime > now ? nextFlushTime - now : 0;
+}
+
+static double getAccelerationGain(PPOINTER_MOTION motion, double distance, double now)
+{
+    if (motion->accelFactor == 0) {
+        return 1;
+    }
+    
+    double duration = fmax(now - motion->lastFlushTime, MIN_BATCH_DURATION);
+    double speed = distance / duration;
+    if (speed <= motion->accelThreshold) {
+        return 1;
+    }
+    
+    return fmin(1 + motion->accelFactor * (speed - motion->accelThreshold) / 1000, motion->accelMaxGain);
+}
+
+static int16_t takeWholePixels(double* remainder)
+{
+    double whole = trunc(*remainder);
+    
+    // Anything beyond the range of a single move is sent in a later one
+    whole = fmax(fmin(whole, INT16_MAX), -INT16_MAX);
+    *remainder -= whole;
+    
+    return (int16_t)whole;
+}
+
+bool PmFlush(PPOINTER_MOTION motion, double now, int16_t* deltaX, int16_t* deltaY)
+{
+    // Clear the pending flag before draining, so motion added during the flush
+    // schedules another one instead of being stranded
+    atomic_store_explicit(&motion->flushPending, false, memory_order_release);
+    
+    double rawX = atomic_exchange_explicit(&motion->pendingX, 0, memory_order_acq_rel) / FIXED_POINT_SCALE;
+    double rawY = atomic_exchange_explicit(&motion->pendingY, 0, memory_order_acq_rel) / FIXED_POINT_SCALE;
+    
+    double gain = getAccelerationGain(motion, hypot(rawX, rawY), now);
+    motion->remainderX += rawX * gain;
+    motion->remainderY += rawY * gain;
+    
+    *deltaX = takeWholePixels(&motion->remainderX);
+    *deltaY = takeWholePixels(&motion->remainderY);
+    
+    // Sub-pixel motion isn't sent, so it doesn't start a new batch interval
+    if (*deltaX != 0 || *deltaY != 0) {
+        motion->lastFlushTime = now;
+    }
+    
+    if (fabs(motion->remainderX) >= 1 || fabs(motion->remainderY) >= 1) {
+        // Claim the next flush ourselves, since no new motion may arrive to schedule it
+        return !atomic_exchange_explicit(&motion->flushPending, true, memory_order_acq_rel);
+    }
+    
+    return false;
+}
@@ -0,0 +1,55 @@
+//
+//  PointerMotion.h
+//  Moonlight
+//
+//  Copyright © 2026 Moonlight Game Streaming Project. All rights reserved.
+//
+
+#pragma once
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+// Accumulates relative pointer motion from any number of sources and turns it
+// into whole-pixel moves for the host. Sources add motion from any thread with
+// sub-pixel precision. A single flushing thread drains it at most once per
+// batch interval, so high polling rate mice don't send a packet per report.
+// Fractional motion is carried over between flushes, so no motion is lost to
+// truncation.
+
+typedef struct _POINTER_MOTION {
+    // Motion added since the last flush, in units of 1/2^24 pixel
+    _Atomic(int64_t) pendingX;
+    _Atomic(int64_t) pendingY;
+    atomic_bool flushPending;
+    
+    // Owned by the flushing thread
+    double batchInterval;
+    double lastFlushTime;
+    double remainderX;
+    double remainderY;
+    
+    // Optional acceleration curve. Disabled when factor is 0.
+    double accelThreshold;
+    double accelFactor;
+    double accelMaxGain;
+} POINTER_MOTION, *PPOINTER_MOTION;
+
+void PmInit(PPOINTER_MOTION motion, double batchInterval);
+
+// Speeds above threshold (pixels per second) are scaled by an additional
+// factor per 1000 pixels per second, up to maxGain
+void PmSetAcceleration(PPOINTER_MOTION motion, double threshold, double factor, double maxGain);
+
+// Returns true if the caller must schedule a flush. Safe to call from any thread.
+bool PmAddMotion(PPOINTER_MOTION motion, float deltaX, float deltaY);
+
+// Returns the time to wait before flushing to keep to the batch interval
+double PmGetFlushDelay(PPOINTER_MOTION motion, double now);
+
+// Drains pending motion into whole-pixel deltas. This may be called before the
+// batch interval is up, to send motion ahead of a button or scroll event that
+// must not overtake it. Returns true if the caller must schedule another flush
+// for motion that didn't fit in this move.
+bool PmFlush(PPOINTER_MOTION motion, double now, int16_t* deltaX, int16_t* deltaY);
@@ -26,11 +26,13 @@ static const int REFERENCE_HEIGHT = 720;
 #endif
     
     UIView* view;
+    ControllerSupport* controllerSupport;
 }
 
-- (id)initWithView:(StreamView*)view {
+- (id)initWithView:(StreamView*)view controllerSupport:(ControllerSupport*)controllerSupport {
     self = [self init];
     self->view = view;
+    self->controllerSupport = controllerSupport;
     
 #if TARGET_OS_TV
     remotePressRecognizer = [[UITapGestureRecognizer alloc] initWithTarget:self action:@selector(remoteButtonPressed:)];
@@ -54,6 +56,7 @@ static const int REFERENCE_HEIGHT = 720;
 - (void)onDragStart:(NSTimer*)timer {
     if (!touchMoved && !isDragging){
         isDragging = true;
+        [controllerSupport flushMouseMotion];
         LiSendMouseButtonEvent(BUTTON_ACTION_PRESS, BUTTON_LEFT);
     }
 }
@@ -88,18 +91,16 @@ static const int REFERENCE_HEIGHT = 720;
         if (touchLocation.x != currentLocation.x ||
             touchLocation.y != currentLocation.y)
         {
-            int deltaX = (currentLocation.x - touchLocation.x) * (REFERENCE_WIDTH / view.bounds.size.width);
-            int deltaY = (currentLocation.y - touchLocation.y) * (REFERENCE_HEIGHT / view.bounds.size.height);
+            float deltaX = (currentLocation.x - touchLocation.x) * (REFERENCE_WIDTH / view.bounds.size.width);
+            float deltaY = (currentLocation.y - touchLocation.y) * (REFERENCE_HEIGHT / view.bounds.size.height);
             
-            if (deltaX != 0 || deltaY != 0) {
-                LiSendMouseMoveEvent(deltaX, deltaY);
-                touchLocation = currentLocation;
-                
-                // If we've moved far enough to confirm this wasn't just human/machine error,
-                // mark it as such.
-                if ([self isConfirmedMove:touchLocation from:originalLocation]) {
-                    touchMoved = true;
-                }
+            [controllerSupport mouseMovedWithDeltaX:deltaX deltaY:deltaY];
+            touchLocation = currentLocation;
+            
+            // If we've moved far enough to confirm this wasn't just human/machine error,
+            // mark it as such.
+            if ([self isConfirmedMove:touchLocation from:originalLocation]) {
+                touchMoved = true;
             }
         }
     } else if ([[event allTouches] count] == 2) {
@@ -108,6 +109,7 @@ static const int REFERENCE_HEIGHT = 720;
         
         CGPoint avgLocation = CGPointMake((firstLocation.x + secondLocation.x) / 2, (firstLocation.y + secondLocation.y) / 2);
         if (touchLocation.y != avgLocation.y) {
+            [controllerSupport flushMouseMotion];
             LiSendHighResScrollEvent((avgLocation.y - touchLocation.y) * 10);
         }
 
@@ -126,17 +128,20 @@ static const int REFERENCE_HEIGHT = 720;
     dragTimer = nil;
     if (isDragging) {
         isDragging = false;
+        [controllerSupport flushMouseMotion];
         LiSendMouseButtonEvent(BUTTON_ACTION_RELEASE, BUTTON_LEFT);
     } else if (!touchMoved) {
         if (peakTouchCount == 2) {
             dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_HIGH, 0), ^{
                 Log(LOG_D, @"Sending right mouse button press");
                 
+                [self->controllerSupport flushMouseMotion];
                 LiSendMouseButtonEvent(BUTTON_ACTION_PRESS, BUTTON_RIGHT);
                 
                 // Wait 100 ms to simulate a real button press
                 usleep(100 * 1000);
                 
+                [self->controllerSupport flushMouseMotion];
                 LiSendMouseButtonEvent(BUTTON_ACTION_RELEASE, BUTTON_RIGHT);
             });
         } else if (peakTouchCount == 1) {
@@ -144,12 +149,14 @@ static const int REFERENCE_HEIGHT = 720;
                 if (!self->isDragging){
                     Log(LOG_D, @"Sending left mouse button press");
                     
+                    [self->controllerSupport flushMouseMotion];
                     LiSendMouseButtonEvent(BUTTON_ACTION_PRESS, BUTTON_LEFT);
                     
                     // Wait 100 ms to simulate a real button press
                     usleep(100 * 1000);
                 }
                 self->isDragging = false;
+                [self->controllerSupport flushMouseMotion];
                 LiSendMouseButtonEvent(BUTTON_ACTION_RELEASE, BUTTON_LEFT);
             });
         }
@@ -175,6 +182,7 @@ static const int REFERENCE_HEIGHT = 720;
     dragTimer = nil;
     if (isDragging) {
         isDragging = false;
+        [controllerSupport flushMouseMotion];
         LiSendMouseButtonEvent(BUTTON_ACTION_RELEASE, BUTTON_LEFT);
     }
     peakTouchCount = 0;
@@ -188,11 +196,13 @@ static const int REFERENCE_HEIGHT = 720;
         // Mark this as touchMoved to avoid a duplicate press on touch up
         self->touchMoved = true;
         
+        [self->controllerSupport flushMouseMotion];
         LiSendMouseButtonEvent(BUTTON_ACTION_PRESS, BUTTON_LEFT);
         
         // Wait 100 ms to simulate a real button press
         usleep(100 * 1000);
             
+        [self->controllerSupport flushMouseMotion];
         LiSendMouseButtonEvent(BUTTON_ACTION_RELEASE, BUTTON_LEFT);
     });
 }
@@ -200,6 +210,7 @@ static const int REFERENCE_HEIGHT = 720;
     Log(LOG_D, @"Holding left mouse button");
     
     isDragging = true;
+    [controllerSupport flushMouseMotion];
     LiSendMouseButtonEvent(BUTTON_ACTION_PRESS, BUTTON_LEFT);
 }
 #endif
@@ -34,8 +34,8 @@ static const double X1_MOUSE_SPEED_DIVISOR = 2.5;
     
     // Citrix X1 mouse support
     X1Mouse* x1mouse;
-    double accumulatedMouseDeltaX;
-    double accumulatedMouseDeltaY;
+    
+    ControllerSupport* controllerSupport;
     
     UIResponder* touchHandler;
     
@@ -49,6 +49,7 @@ static const double X1_MOUSE_SPEED_DIVISOR = 2.5;
 - (void) setupStreamView:(ControllerSupport*)controllerSupport
      interactionDelegate:(id<UserInteractionDelegate>)interactionDelegate
                   config:(StreamConfiguration*)streamConfig {
+    self->controllerSupport = controllerSupport;
     self->interactionDelegate = interactionDelegate;
     self->streamAspectRatio = (float)streamConfig.width / (float)streamConfig.height;
     
@@ -64,14 +65,14 @@ static const double X1_MOUSE_SPEED_DIVISOR = 2.5;
     
 #if TARGET_OS_TV
     // tvOS requires RelativeTouchHandler to manage Apple Remote input
-    self->touchHandler = [[RelativeTouchHandler alloc] initWithView:self];
+    self->touchHandler = [[RelativeTouchHandler alloc] initWithView:self controllerSupport:controllerSupport];
 #else
     // iOS uses RelativeTouchHandler or AbsoluteTouchHandler depending on user preference
     if (settings.absoluteTouchMode) {
         self->touchHandler = [[AbsoluteTouchHandler alloc] initWithView:self];
     }
     else {
-        self->touchHandler = [[RelativeTouchHandler alloc] initWithView:self];
+        self->touchHandler = [[RelativeTouchHandler alloc] initWithView:self controllerSupport:controllerSupport];
     }
     
     onScreenControls = [[OnScreenControls alloc] initWithView:self controllerSup:controllerSupport streamConfig:streamConfig];
@@ -495,6 +496,7 @@ static const double X1_MOUSE_SPEED_DIVISOR = 2.5;
                 }
                 
                 if (changedButtons & buttonFlag) {
+                    [controllerSupport flushMouseMotion];
                     LiSendMouseButtonEvent(buttonAction, i);
                 }
             }
@@ -644,6 +646,9 @@ static const double X1_MOUSE_SPEED_DIVISOR = 2.5;
     // mouse motion when using a Citrix X1 mouse.
     if (normalizedLocation.x != lastMouseX || normalizedLocation.y != lastMouseY || !isMouse) {
         if (lastMouseX != 0 || lastMouseY != 0 || !isMouse) {
+            // Relative motion batched before the switch to absolute positioning
+            // must not land after it
+            [controllerSupport flushMouseMotion];
             LiSendMousePositionEvent(normalizedLocation.x, normalizedLocation.y, videoSize.width, videoSize.height);
         }
         
@@ -709,6 +714,7 @@ static const double X1_MOUSE_SPEED_DIVISOR = 2.5;
     {
         short translationDeltaY = ((currentScrollTranslation.y - lastScrollTranslation.y) / self.bounds.size.height) * translationMultiplier;
         if (translationDeltaY != 0) {
+            [controllerSupport flushMouseMotion];
             LiSendHighResScrollEvent(translationDeltaY);
             lastScrollTranslation = currentScrollTranslation;
         }
@@ -717,6 +723,8 @@ static const double X1_MOUSE_SPEED_DIVISOR = 2.5;
     {
         short translationDeltaX = ((currentScrollTranslation.x - lastScrollTranslation.x) / self.bounds.size.width) * translationMultiplier;
         if (translationDeltaX != 0) {
+            [controllerSupport flushMouseMotion];
+            
             // Direction is reversed from vertical scrolling
             LiSendHighResHScrollEvent(-translationDeltaX);
             lastScrollTranslation = currentScrollTranslation;
@@ -744,6 +752,7 @@ static const double X1_MOUSE_SPEED_DIVISOR = 2.5;
     {
         short translationDeltaY = currentScrollTranslation.y - lastScrollTranslation.y;
         if (translationDeltaY != 0) {
+            [controllerSupport flushMouseMotion];
             LiSendScrollEvent(translationDeltaY > 0 ? 1 : -1);
         }
     }
@@ -751,6 +760,8 @@ static const double X1_MOUSE_SPEED_DIVISOR = 2.5;
     {
         short translationDeltaX = currentScrollTranslation.x - lastScrollTranslation.x;
         if (translationDeltaX != 0) {
+            [controllerSupport flushMouseMotion];
+            
             // Direction is reversed from vertical scrolling
             LiSendHScrollEvent(translationDeltaX < 0 ? 1 : -1);
         }
@@ -908,20 +919,7 @@ static const double X1_MOUSE_SPEED_DIVISOR = 2.5;
 }
 
 - (void)mouseDidMoveWithIdentifier:(NSUUID * _Nonnull)identifier deltaX:(int16_t)deltaX deltaY:(int16_t)deltaY {
-    accumulatedMouseDeltaX += deltaX / X1_MOUSE_SPEED_DIVISOR;
-    accumulatedMouseDeltaY += deltaY / X1_MOUSE_SPEED_DIVISOR;
-    
-    short shortX = (short)accumulatedMouseDeltaX;
-    short shortY = (short)accumulatedMouseDeltaY;
-    
-    if (shortX == 0 && shortY == 0) {
-        return;
-    }
-    
-    LiSendMouseMoveEvent(shortX, shortY);
-    
-    accumulatedMouseDeltaX -= shortX;
-    accumulatedMouseDeltaY -= shortY;
+    [controllerSupport mouseMovedWithDeltaX:deltaX / X1_MOUSE_SPEED_DIVISOR deltaY:deltaY / X1_MOUSE_SPEED_DIVISOR];
 }
 
 - (int) buttonFromX1ButtonCode:(enum X1MouseButton)button {
@@ -938,14 +936,17 @@ static const double X1_MOUSE_SPEED_DIVISOR = 2.5;
 }
 
 - (void)mouseDownWithIdentifier:(NSUUID * _Nonnull)identifier button:(enum X1MouseButton)button {
+    [controllerSupport flushMouseMotion];
     LiSendMouseButtonEvent(BUTTON_ACTION_PRESS, [self buttonFromX1ButtonCode:button]);
 }
 
 - (void)mouseUpWithIdentifier:(NSUUID * _Nonnull)identifier button:(enum X1MouseButton)button {
+    [controllerSupport flushMouseMotion];
     LiSendMouseButtonEvent(BUTTON_ACTION_RELEASE, [self buttonFromX1ButtonCode:button]);
 }
 
 - (void)wheelDidScrollWithIdentifier:(NSUUID * _Nonnull)identifier deltaZ:(int8_t)deltaZ {
+    [controllerSupport flushMouseMotion];
     LiSendScrollEvent(deltaZ);
 }
 
@@ -12,6 +12,7 @@
 
 @protocol AppAssetCallback <NSObject>
 
+// Called on a background queue when an app's box art on disk has changed
 - (void) receivedAssetForApp:(TemporaryApp*)app;
 
 @end
@@ -19,7 +20,13 @@
 @interface AppAssetManager : NSObject
 
 - (id) initWithCallback:(id<AppAssetCallback>)callback;
+
+// Fetches missing box art and revalidates stale box art for the host's apps
 - (void) retrieveAssetsFromHost:(TemporaryHost*)host;
+
+// Moves the app to the front of the fetch queue, e.g. because it's on screen
+- (void) prioritizeApp:(TemporaryApp*)app;
+
 - (void) stopRetrieving;
 + (NSString*) boxArtPathForApp:(TemporaryApp*)app;
 
@@ -10,14 +10,35 @@
 #import "CryptoManager.h"
 #import "Utils.h"
 #import "HttpResponse.h"
-#import "AppAssetRetriever.h"
+#import "AppAssetResponse.h"
+#import "HttpRequest.h"
+
+#include "AssetScheduler.h"
+
+#include <CommonCrypto/CommonDigest.h>
+#include <sys/xattr.h>
+
+// Box art we already have is revalidated with the host this often
+#define BOX_ART_REFRESH_INTERVAL (7 * 24 * 60 * 60)
+
+#define ETAG_XATTR "com.moonlight-stream.etag"
+#define VALIDATED_XATTR "com.moonlight-stream.validated"
 
 @implementation AppAssetManager {
-    NSOperationQueue* _opQueue;
     id<AppAssetCallback> _callback;
+    
+    // Scheduler state is only touched on _queue
+    dispatch_queue_t _queue;
+    HttpManager* _hMan;
+    TemporaryHost* _host;
+    ASSET_SCHEDULER _scheduler;
+    NSMutableDictionary<NSString*, TemporaryApp*>* _apps; // By app ID
 }
 
 static const int MAX_REQUEST_COUNT = 4;
+static const int MAX_ATTEMPTS = 5;
+static const double RETRY_BASE_DELAY = 0.5; // seconds
+static const double RETRY_MAX_DELAY = 8; // seconds
 
 + (NSString*) boxArtPathForApp:(TemporaryApp*)app {
     NSArray *paths = NSSearchPathForDirectoriesInDomains(NSCachesDirectory, NSUserDomainMask, YES);
@@ -38,31 +59,191 @@ static const int MAX_REQUEST_COUNT = 4;
 - (id) initWithCallback:(id<AppAssetCallback>)callback {
     self = [super init];
     _callback = callback;
-    _opQueue = [[NSOperationQueue alloc] init];
-    [_opQueue setMaxConcurrentOperationCount:MAX_REQUEST_COUNT];
+    _queue = dispatch_queue_create("App asset fetches", DISPATCH_QUEUE_SERIAL);
+    _apps = [[NSMutableDictionary alloc] init];
+    AsInit(&_scheduler, MAX_REQUEST_COUNT, MAX_ATTEMPTS, RETRY_BASE_DELAY, RETRY_MAX_DELAY, arc4random());
     
     return self;
 }
 
+- (void) dealloc {
+    AsDestroy(&_scheduler);
+}
+
+static void Sha256Digest(const void* data, size_t length, uint8_t digest[AS_DIGEST_LENGTH])
+{
+    CC_SHA256(data, (CC_LONG)length, digest);
+}
+
 - (void) retrieveAssetsFromHost:(TemporaryHost*)host {
-    for (TemporaryApp* app in host.appList) {
-        if (![[NSFileManager defaultManager] fileExistsAtPath:[AppAssetManager boxArtPathForApp:app]]) {
-            AppAssetRetriever* retriever = [[AppAssetRetriever alloc] init];
-            retriever.app = app;
-            retriever.host = host;
-            retriever.callback = _callback;
+    NSArray<TemporaryApp*>* apps = [host.appList allObjects];
+    
+    dispatch_async(_queue, ^{
+        if (host != self->_host) {
+            // All requests to this host go through one HttpManager, so they share
+            // its pooled session and only look up the HTTPS port once
+            self->_host = host;
+            self->_hMan = [[HttpManager alloc] initWithHost:host];
+            AsResetAttempts(&self->_scheduler);
+        }
+        
+        const char* appIds[apps.count];
+        AS_ART_STATE states[apps.count];
+        for (NSUInteger i = 0; i < apps.count; i++) {
+            TemporaryApp* app = apps[i];
+            NSString* boxArtPath = [AppAssetManager boxArtPathForApp:app];
             
-            [_opQueue addOperation:retriever];
+            appIds[i] = [app.id UTF8String];
+            if (![[NSFileManager defaultManager] fileExistsAtPath:boxArtPath]) {
+                states[i] = AS_ART_MISSING;
+            }
+            else if ([[NSDate date] timeIntervalSince1970] - [AppAssetManager lastValidatedTimeForPath:boxArtPath] > BOX_ART_REFRESH_INTERVAL) {
+                states[i] = AS_ART_STALE;
+            }
+            else {
+                states[i] = AS_ART_CURRENT;
+            }
+            self->_apps[app.id] = app;
         }
-    }
+        AsQueueApps(&self->_scheduler, appIds, states, (int)apps.count);
+        
+        [self startRequests];
+    });
+}
+
+- (void) prioritizeApp:(TemporaryApp*)app {
+    dispatch_async(_queue, ^{
+        AsPrioritize(&self->_scheduler, [app.id UTF8String]);
+    });
 }
 
 - (void) stopRetrieving {
-    [_opQueue cancelAllOperations];
+    dispatch_async(_queue, ^{
+        // Requests in flight finish, but their results only land on disk
+        AsStop(&self->_scheduler);
+        [self->_apps removeAllObjects];
+    });
+}
+
+// Must be called on _queue
+- (void) startRequests {
+    AS_REQUEST request;
+    
+    while (AsStartRequest(&_scheduler, &request)) {
+        [self fetchRequest:request];
+    }
+}
+
+// Must be called on _queue
+- (void) fetchRequest:(AS_REQUEST)request {
+    NSString* appId = [NSString stringWithUTF8String:request.appId];
+    TemporaryApp* app = _apps[appId];
+    NSString* boxArtPath = [AppAssetManager boxArtPathForApp:app];
+    
+    NSMutableURLRequest* urlRequest = [[_hMan newAppAssetRequestWithAppId:appId] mutableCopy];
+    if (urlRequest != nil && request.conditional) {
+        // Let the host tell us our copy is still current without resending it
+        NSString* etag = [AppAssetManager stringXattr:ETAG_XATTR forPath:boxArtPath];
+        if (etag != nil) {
+            [urlRequest setValue:etag forHTTPHeaderField:@"If-None-Match"];
+        }
+    }
+    
+    AppAssetResponse* appAssetResp = [[AppAssetResponse alloc] init];
+    [_hMan executeRequest:[HttpRequest requestForResponse:appAssetResp withUrlRequest:urlRequest] completion:^{
+        BOOL changed = NO;
+        BOOL success = [self handleResponse:appAssetResp forPath:boxArtPath changed:&changed];
+        
+        if (changed) {
+            [self->_callback receivedAssetForApp:app];
+        }
+        
+        dispatch_async(self->_queue, ^{
+            AS_REQUEST retryRequest = request;
+            double delay;
+            
+            switch (AsRequestFinished(&self->_scheduler, &retryRequest, success, &delay)) {
+                case AS_REQUEST_RETRY:
+                    dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(delay * NSEC_PER_SEC)), self->_queue, ^{
+                        AsRetryDue(&self->_scheduler, retryRequest.appId, retryRequest.generation);
+                        [self startRequests];
+                    });
+                    break;
+                case AS_REQUEST_GAVE_UP:
+                    Log(LOG_W, @"Giving up on box art for %@", app.name);
+                    break;
+                default:
+                    break;
+            }
+            
+            [self startRequests];
+        });
+    }];
+}
+
+// Writes new box art to disk. Art identical to what we have (by ETag or by
+// content hash) is only marked as validated. Returns NO if the request failed.
+- (BOOL) handleResponse:(AppAssetResponse*)appAssetResp forPath:(NSString*)boxArtPath changed:(BOOL*)changed {
+    *changed = NO;
+    
+    // The existing art is mapped, so it's only read if the response has to be compared with it
+    NSData* existingData = appAssetResp.httpStatusCode == 200 ? [NSData dataWithContentsOfFile:boxArtPath options:NSDataReadingMappedIfSafe error:nil] : nil;
+    AS_RESPONSE response = AsClassifyResponse((int)appAssetResp.httpStatusCode, appAssetResp.data.bytes, appAssetResp.data.length,
+                                              existingData.bytes, existingData.length, Sha256Digest);
+    if (response == AS_RESPONSE_NOT_MODIFIED) {
+        [AppAssetManager setLastValidatedTimeForPath:boxArtPath];
+        return YES;
+    }
+    else if (response == AS_RESPONSE_FAILED) {
+        return NO;
+    }
+    
+    if (response == AS_RESPONSE_CHANGED) {
+        [[NSFileManager defaultManager] createDirectoryAtPath:[boxArtPath stringByDeletingLastPathComponent] withIntermediateDirectories:YES attributes:nil error:nil];
+        if (![appAssetResp.data writeToFile:boxArtPath atomically:YES]) {
+            return NO;
+        }
+        *changed = YES;
+    }
+    
+    if (appAssetResp.etag != nil) {
+        [AppAssetManager setStringXattr:ETAG_XATTR value:appAssetResp.etag forPath:boxArtPath];
+    }
+    [AppAssetManager setLastValidatedTimeForPath:boxArtPath];
+    
+    return YES;
+}
+
++ (NSString*) stringXattr:(const char*)name forPath:(NSString*)path {
+    char value[256];
+    ssize_t length = getxattr([path fileSystemRepresentation], name, value, sizeof(value), 0, 0);
+    if (length <= 0) {
+        return nil;
+    }
+    
+    return [[NSString alloc] initWithBytes:value length:length encoding:NSUTF8StringEncoding];
+}
+
++ (void) setStringXattr:(const char*)name value:(NSString*)value forPath:(NSString*)path {
+    const char* utf8Value = [value UTF8String];
+    setxattr([path fileSystemRepresentation], name, utf8Value, strlen(utf8Value), 0, 0);
+}
+
++ (NSTimeInterval) lastValidatedTimeForPath:(NSString*)path {
+    NSString* validated = [AppAssetManager stringXattr:VALIDATED_XATTR forPath:path];
+    if (validated == nil) {
+        // Art written before we tracked validation counts from when it was written
+        NSDate* modified = [[[NSFileManager defaultManager] attributesOfItemAtPath:path error:nil] fileModificationDate];
+        return [modified timeIntervalSince1970];
+    }
+    
+    return [validated doubleValue];
 }
 
-- (void) sendCallBackForApp:(TemporaryApp*)app {
-    [_callback receivedAssetForApp:app];
++ (void) setLastValidatedTimeForPath:(NSString*)path {
+    [AppAssetManager setStringXattr:VALIDATED_XATTR
+                              value:[NSString stringWithFormat:@"%.0f", [[NSDate date] timeIntervalSince1970]]
+                            forPath:path];
 }
 
 @end
@@ -10,6 +10,7 @@
 
 @interface AppAssetResponse : NSObject <Response>
 
-
+@property (nonatomic) NSInteger httpStatusCode;
+@property (nonatomic) NSString* etag;
 
 @end
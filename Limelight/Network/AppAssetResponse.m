@@ -16,6 +16,11 @@
     self.statusMessage = @"App asset has no status message";
     self.statusCode = -1;
 }
+- (void)populateWithHTTPResponse:(NSHTTPURLResponse *)response {
+    self.httpStatusCode = response.statusCode;
+    self.etag = response.allHeaderFields[@"ETag"];
+}
+
 - (UIImage*) getImage {
     return [[UIImage alloc] initWithData:self.data];
 }
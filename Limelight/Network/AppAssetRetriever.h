@@ -1,19 +0,0 @@
-//
-//  AppAssetRetriever.h
-//  Moonlight
-//
-//  Created by Diego Waxemberg on 1/31/15.
-//  Copyright (c) 2015 Moonlight Stream. All rights reserved.
-//
-
-#import "TemporaryHost.h"
-#import "TemporaryApp.h"
-#import "AppAssetManager.h"
-
-@interface AppAssetRetriever : NSOperation
-
-@property (nonatomic) TemporaryHost* host;
-@property (nonatomic) TemporaryApp* app;
-@property (nonatomic) id<AppAssetCallback> callback;
-
-@end
@@ -9,109 +9,74 @@
 #import "AppListResponse.h"
 #import "TemporaryApp.h"
 #import "DataManager.h"
-#import <libxml2/libxml/xmlreader.h>
+
+#include "XmlResponse.h"
 
 @implementation AppListResponse {
     NSMutableSet* _appList;
 }
 @synthesize data, statusCode, statusMessage;
 
-static const char* TAG_APP = "App";
-static const char* TAG_APP_TITLE = "AppTitle";
-static const char* TAG_APP_ID = "ID";
-static const char* TAG_HDR_SUPPORTED = "IsHdrSupported";
-static const char* TAG_APP_INSTALL_PATH = "AppInstallPath";
-
 - (void)populateWithData:(NSData *)xml {
     self.data = xml;
     _appList = [[NSMutableSet alloc] init];
     [self parseData];
 }
 
-- (void) parseData {
-    xmlDocPtr docPtr = xmlParseMemory([self.data bytes], (int)[self.data length]);
-    if (docPtr == NULL) {
-        Log(LOG_W, @"An error occured trying to parse xml.");
-        return;
-    }
+// Status and apps are collected here while parsing, and only kept if the
+// whole document parses
+typedef struct {
+    __unsafe_unretained NSMutableSet* appList;
+    NSInteger statusCode;
+    char* statusMessage;
+} PARSE_STATE;
+
+static void parsedRoot(void* context, const char* statusCode, const char* statusMessage) {
+    PARSE_STATE* state = (PARSE_STATE*)context;
     
-    xmlNodePtr node = xmlDocGetRootElement(docPtr);
-    if (node == NULL) {
-        Log(LOG_W, @"No root XML element.");
-        xmlFreeDoc(docPtr);
-        return;
+    if (statusCode != NULL) {
+        state->statusCode = (NSInteger)strtoll(statusCode, NULL, 10);
     }
-    
-    xmlChar* statusStr = xmlGetProp(node, (const xmlChar*)[TAG_STATUS_CODE UTF8String]);
-    if (statusStr != NULL) {
-        int status = (int)[[NSString stringWithUTF8String:(const char*)statusStr] longLongValue];
-        xmlFree(statusStr);
-        self.statusCode = status;
+    if (statusMessage != NULL) {
+        free(state->statusMessage);
+        state->statusMessage = strdup(statusMessage);
     }
+}
+
+static void parsedApp(void* context, PXR_APP xrApp) {
+    PARSE_STATE* state = (PARSE_STATE*)context;
     
-    xmlChar* statusMsgXml = xmlGetProp(node, (const xmlChar*)[TAG_STATUS_MESSAGE UTF8String]);
-    NSString* statusMsg;
-    if (statusMsgXml != NULL) {
-        statusMsg = [NSString stringWithUTF8String:(const char*)statusMsgXml];
-        xmlFree(statusMsgXml);
-    }
-    else {
-        statusMsg = @"Server Error";
+    TemporaryApp* app = [[TemporaryApp alloc] init];
+    app.name = [NSString stringWithUTF8String:xrApp->title] ?: @"";
+    app.id = [NSString stringWithUTF8String:xrApp->id];
+    app.hdrSupported = atoi(xrApp->hdrSupported) != 0;
+    app.installPath = xrApp->installPath != NULL ? [NSString stringWithUTF8String:xrApp->installPath] : nil;
+    if (app.id != nil) {
+        [state->appList addObject:app];
     }
-    self.statusMessage = statusMsg;
+}
+
+- (void) parseData {
+    NSMutableSet* appList = [[NSMutableSet alloc] init];
+    PARSE_STATE state = { appList, self.statusCode, NULL };
+    XR_CALLBACKS callbacks = { parsedRoot, NULL, parsedApp };
     
-    node = node->children;
+    XR_RESULT result = XrParseAppList([self.data bytes], (int)[self.data length], &callbacks, &state);
+    NSString* statusMsg = state.statusMessage != NULL ? [NSString stringWithUTF8String:state.statusMessage] : @"Server Error";
+    free(state.statusMessage);
     
-    while (node != NULL) {
-        //Log(LOG_D, @"node: %s", node->name);
-        if (!xmlStrcmp(node->name, (xmlChar*)TAG_APP)) {
-            xmlNodePtr appInfoNode = node->xmlChildrenNode;
-            NSString* appName = @"";
-            NSString* appId = nil;
-            NSString* hdrSupported = @"0";
-            NSString* appInstallPath = nil;
-            while (appInfoNode != NULL) {
-                if (!xmlStrcmp(appInfoNode->name, (xmlChar*)TAG_APP_TITLE)) {
-                    xmlChar* nodeVal = xmlNodeListGetString(docPtr, appInfoNode->xmlChildrenNode, 1);
-                    if (nodeVal != NULL) {
-                        appName = [[NSString alloc] initWithCString:(const char*)nodeVal encoding:NSUTF8StringEncoding];
-                        xmlFree(nodeVal);
-                    }
-                } else if (!xmlStrcmp(appInfoNode->name, (xmlChar*)TAG_APP_ID)) {
-                    xmlChar* nodeVal = xmlNodeListGetString(docPtr, appInfoNode->xmlChildrenNode, 1);
-                    if (nodeVal != NULL) {
-                        appId = [[NSString alloc] initWithCString:(const char*)nodeVal encoding:NSUTF8StringEncoding];
-                        xmlFree(nodeVal);
-                    }
-                } else if (!xmlStrcmp(appInfoNode->name, (xmlChar*)TAG_HDR_SUPPORTED)) {
-                    xmlChar* nodeVal = xmlNodeListGetString(docPtr, appInfoNode->xmlChildrenNode, 1);
-                    if (nodeVal != NULL) {
-                        hdrSupported = [[NSString alloc] initWithCString:(const char*)nodeVal encoding:NSUTF8StringEncoding];
-                        xmlFree(nodeVal);
-                    }
-                } else if (!xmlStrcmp(appInfoNode->name, (xmlChar*)TAG_APP_INSTALL_PATH)) {
-                    xmlChar* nodeVal = xmlNodeListGetString(docPtr, appInfoNode->xmlChildrenNode, 1);
-                    if (nodeVal != NULL) {
-                        appInstallPath = [[NSString alloc] initWithCString:(const char*)nodeVal encoding:NSUTF8StringEncoding];
-                        xmlFree(nodeVal);
-                    }
-                }
-
-                appInfoNode = appInfoNode->next;
-            }
-            if (appId != nil) {
-                TemporaryApp* app = [[TemporaryApp alloc] init];
-                app.name = appName;
-                app.id = appId;
-                app.hdrSupported = [hdrSupported intValue] != 0;
-                app.installPath = appInstallPath;
-                [_appList addObject:app];
-            }
-        }
-        node = node->next;
+    if (result == XR_PARSE_ERROR) {
+        Log(LOG_W, @"An error occured trying to parse xml.");
+        return;
+    }
+    else if (result == XR_NO_ROOT) {
+        Log(LOG_W, @"No root XML element.");
+        return;
     }
     
-    xmlFreeDoc(docPtr);
+    self.statusCode = state.statusCode;
+    self.statusMessage = statusMsg;
+    _appList = appList;
     
 #ifdef ENABLE_APP_STORE_RESTRICTIONS
     // APP STORE REVIEW COMPLIANCE
@@ -0,0 +1,214 @@
+//
+//  AssetScheduler.c
+//  Moonlight
+//
+//  Copyright © 2026 Moonlight Game Streaming Project. All rights reserved.
+//
+
+#include "AssetScheduler.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+void AsInit(PASSET_SCHEDULER scheduler, int maxRequests, int maxAttempts,
+            double retryBaseDelay, double retryMaxDelay, unsigned int seed)
+{
+    memset(scheduler, 0, sizeof(*scheduler));
+    scheduler->maxRequests = maxRequests;
+    scheduler->maxAttempts = maxAttempts;
+    scheduler->retryBaseDelay = retryBaseDelay;
+    scheduler->retryMaxDelay = retryMaxDelay;
+    scheduler->seed = seed;
+}
+
+void AsDestroy(PASSET_SCHEDULER scheduler)
+{
+    free(scheduler->apps);
+    free(scheduler->queue);
+}
+
+static int findApp(PASSET_SCHEDULER scheduler, const char* appId)
+{
+    for (int i = 0; i < scheduler->appCount; i++) {
+        if (strcmp(scheduler->apps[i].appId, appId) == 0) {
+            return i;
+        }
+    }
+    
+    return -1;
+}
+
+static int addApp(PASSET_SCHEDULER scheduler, const char* appId)
+{
+    int index = findApp(scheduler, appId);
+    if (index >= 0) {
+        return index;
+    }
+    
+    if (scheduler->appCount == scheduler->appCapacity) {
+        int capacity = scheduler->appCapacity ? scheduler->appCapacity * 2 : 64;
+        PAS_APP apps = realloc(scheduler->apps, capacity * sizeof(*apps));
+        if (apps == NULL) {
+            return -1;
+        }
+        scheduler->apps = apps;
+        
+        // The queue never holds more entries than there are apps
+        int* queue = realloc(scheduler->queue, capacity * sizeof(*queue));
+        if (queue == NULL) {
+            return -1;
+        }
+        scheduler->queue = queue;
+        scheduler->appCapacity = capacity;
+    }
+    
+    index = scheduler->appCount++;
+    memset(&scheduler->apps[index], 0, sizeof(scheduler->apps[index]));
+    strncpy(scheduler->apps[index].appId, appId, AS_APP_ID_MAX_LENGTH - 1);
+    return index;
+}
+
+static void queueApp(PASSET_SCHEDULER scheduler, const char* appId, bool stale)
+{
+    int index = addApp(scheduler, appId);
+    if (index < 0) {
+        return;
+    }
+    
+    if (stale) {
+        scheduler->apps[index].stale = true;
+    }
+    
+    if (!scheduler->apps[index].queued) {
+        scheduler->apps[index].queued = true;
+        scheduler->queue[scheduler->queueLength++] = index;
+    }
+}
+
+void AsQueueApps(PASSET_SCHEDULER scheduler, const char* const* appIds, const AS_ART_STATE* states, int count)
+{
+    // Fetch missing art before revalidating art we already have
+    for (int i = 0; i < count; i++) {
+        if (states[i] == AS_ART_MISSING) {
+            queueApp(scheduler, appIds[i], false);
+        }
+    }
+    for (int i = 0; i < count; i++) {
+        if (states[i] == AS_ART_STALE) {
+            queueApp(scheduler, appIds[i], true);
+        }
+    }
+}
+
+void AsPrioritize(PASSET_SCHEDULER scheduler, const char* appId)
+{
+    int index = findApp(scheduler, appId);
+    if (index < 0 || !scheduler->apps[index].queued) {
+        return;
+    }
+    
+    for (int i = 0; i < scheduler->queueLength; i++) {
+        if (scheduler->queue[i] == index) {
+            memmove(&scheduler->queue[1], &scheduler->queue[0], i * sizeof(*scheduler->queue));
+            scheduler->queue[0] = index;
+            return;
+        }
+    }
+}
+
+void AsResetAttempts(PASSET_SCHEDULER scheduler)
+{
+    for (int i = 0; i < scheduler->appCount; i++) {
+        scheduler->apps[i].attempts = 0;
+    }
+}
+
+void AsStop(PASSET_SCHEDULER scheduler)
+{
+    scheduler->generation++;
+    scheduler->appCount = 0;
+    scheduler->queueLength = 0;
+}
+
+bool AsStartRequest(PASSET_SCHEDULER scheduler, PAS_REQUEST request)
+{
+    PAS_APP app;
+    
+    if (scheduler->requestsInFlight >= scheduler->maxRequests || scheduler->queueLength == 0) {
+        return false;
+    }
+    
+    app = &scheduler->apps[scheduler->queue[0]];
+    scheduler->queueLength--;
+    memmove(&scheduler->queue[0], &scheduler->queue[1], scheduler->queueLength * sizeof(*scheduler->queue));
+    app->queued = false;
+    
+    memcpy(request->appId, app->appId, sizeof(request->appId));
+    request->conditional = app->stale;
+    request->generation = scheduler->generation;
+    scheduler->requestsInFlight++;
+    return true;
+}
+
+AS_REQUEST_RESULT AsRequestFinished(PASSET_SCHEDULER scheduler, PAS_REQUEST request, bool success, double* retryDelay)
+{
+    PAS_APP app;
+    int index;
+    
+    scheduler->requestsInFlight--;
+    
+    if (request->generation != scheduler->generation || (index = findApp(scheduler, request->appId)) < 0) {
+        return AS_REQUEST_DONE;
+    }
+    app = &scheduler->apps[index];
+    
+    if (success) {
+        app->stale = false;
+        app->attempts = 0;
+        return AS_REQUEST_DONE;
+    }
+    
+    if (++app->attempts >= scheduler->maxAttempts) {
+        app->stale = false;
+        app->attempts = 0;
+        return AS_REQUEST_GAVE_UP;
+    }
+    
+    // Exponential backoff with jitter so retries to a struggling host spread out
+    *retryDelay = fmin(scheduler->retryBaseDelay * (1 << (app->attempts - 1)), scheduler->retryMaxDelay);
+    *retryDelay *= 0.5 + rand_r(&scheduler->seed) % 1000 / 1000.0;
+    return AS_REQUEST_RETRY;
+}
+
+void AsRetryDue(PASSET_SCHEDULER scheduler, const char* appId, uint32_t generation)
+{
+    if (generation == scheduler->generation) {
+        // The app was next in line when it failed, so it doesn't go to the back
+        queueApp(scheduler, appId, false);
+        AsPrioritize(scheduler, appId);
+    }
+}
+
+AS_RESPONSE AsClassifyResponse(int statusCode, const void* data, size_t length,
+                               const void* existing, size_t existingLength, AS_DIGEST_FN digest)
+{
+    uint8_t newDigest[AS_DIGEST_LENGTH];
+    uint8_t existingDigest[AS_DIGEST_LENGTH];
+    
+    if (statusCode == 304) {
+        return AS_RESPONSE_NOT_MODIFIED;
+    }
+    else if (statusCode != 200 || length == 0) {
+        return AS_RESPONSE_FAILED;
+    }
+    
+    // Art of a different size can't be the same, so we only hash when it could be
+    if (existing == NULL || existingLength != length) {
+        return AS_RESPONSE_CHANGED;
+    }
+    
+    digest(data, length, newDigest);
+    digest(existing, existingLength, existingDigest);
+    return memcmp(newDigest, existingDigest, AS_DIGEST_LENGTH) == 0 ? AS_RESPONSE_UNCHANGED : AS_RESPONSE_CHANGED;
+}
@@ -0,0 +1,112 @@
+//
+//  AssetScheduler.h
+//  Moonlight
+//
+//  Copyright © 2026 Moonlight Game Streaming Project. All rights reserved.
+//
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Decides which box art AppAssetManager fetches next. Missing art is fetched
+// before stale art is revalidated, apps on screen can jump the queue, only a
+// few requests are in flight at once, and failed fetches are retried with
+// exponential backoff and jitter before we give up on them.
+//
+// Not thread safe. AppAssetManager only calls it on its serial queue.
+
+#define AS_APP_ID_MAX_LENGTH 64
+#define AS_DIGEST_LENGTH 32
+
+typedef enum {
+    AS_ART_MISSING,
+    AS_ART_STALE,
+    AS_ART_CURRENT,
+} AS_ART_STATE;
+
+typedef enum {
+    AS_RESPONSE_FAILED,
+    AS_RESPONSE_NOT_MODIFIED,   // 304, so our copy is current
+    AS_RESPONSE_UNCHANGED,      // 200 with the art we already have
+    AS_RESPONSE_CHANGED,        // 200 with new art to write
+} AS_RESPONSE;
+
+typedef enum {
+    AS_REQUEST_DONE,
+    AS_REQUEST_RETRY,
+    AS_REQUEST_GAVE_UP,
+} AS_REQUEST_RESULT;
+
+typedef void (*AS_DIGEST_FN)(const void* data, size_t length, uint8_t digest[AS_DIGEST_LENGTH]);
+
+typedef struct _AS_APP {
+    char appId[AS_APP_ID_MAX_LENGTH];
+    bool queued;
+    
+    // Stale art is requested with the ETag we have
+    bool stale;
+    int attempts;
+} AS_APP, *PAS_APP;
+
+typedef struct _AS_REQUEST {
+    char appId[AS_APP_ID_MAX_LENGTH];
+    bool conditional;
+    uint32_t generation;
+} AS_REQUEST, *PAS_REQUEST;
+
+typedef struct _ASSET_SCHEDULER {
+    PAS_APP apps;
+    int appCount;
+    int appCapacity;
+    
+    // Indices into apps in the order they'll be fetched
+    int* queue;
+    int queueLength;
+    
+    int maxRequests;
+    int maxAttempts;
+    double retryBaseDelay;
+    double retryMaxDelay;
+    unsigned int seed;
+    
+    int requestsInFlight;
+    
+    // Bumped by AsStop() so results and retries from before are ignored
+    uint32_t generation;
+} ASSET_SCHEDULER, *PASSET_SCHEDULER;
+
+void AsInit(PASSET_SCHEDULER scheduler, int maxRequests, int maxAttempts,
+            double retryBaseDelay, double retryMaxDelay, unsigned int seed);
+void AsDestroy(PASSET_SCHEDULER scheduler);
+
+// Queues the missing art, then the stale art. Apps that are already queued
+// keep their place.
+void AsQueueApps(PASSET_SCHEDULER scheduler, const char* const* appIds, const AS_ART_STATE* states, int count);
+
+// Moves a queued app to the front of the queue
+void AsPrioritize(PASSET_SCHEDULER scheduler, const char* appId);
+
+// Forgets how often each app has failed, e.g. because the host changed
+void AsResetAttempts(PASSET_SCHEDULER scheduler);
+
+// Drops everything that's queued. Requests in flight finish, but their
+// results don't schedule anything.
+void AsStop(PASSET_SCHEDULER scheduler);
+
+// Takes the next app off the queue if another request may start
+bool AsStartRequest(PASSET_SCHEDULER scheduler, PAS_REQUEST request);
+
+// Returns AS_REQUEST_RETRY and the delay in seconds after which
+// AsRetryDue() should be called if a failed request is to be retried
+AS_REQUEST_RESULT AsRequestFinished(PASSET_SCHEDULER scheduler, PAS_REQUEST request, bool success, double* retryDelay);
+
+// Puts the app back at the front of the queue
+void AsRetryDue(PASSET_SCHEDULER scheduler, const char* appId, uint32_t generation);
+
+// Decides what to do with an /appasset response given the art we have, if
+// any. Identical art is detected by its digest.
+AS_RESPONSE AsClassifyResponse(int statusCode, const void* data, size_t length,
+                               const void* existing, size_t existingLength, AS_DIGEST_FN digest);
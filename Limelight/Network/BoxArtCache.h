@@ -0,0 +1,33 @@
+//
+//  BoxArtCache.h
+//  Moonlight
+//
+//  Copyright © 2026 Moonlight Game Streaming Project. All rights reserved.
+//
+
+#import <UIKit/UIKit.h>
+#import "TemporaryApp.h"
+
+// Persistent store of box art pre-scaled to the app grid's cell size and
+// pre-decoded to BGRA. Tiles live in a single memory-mapped atlas file, so
+// drawing one needs no decoding and only tiles on screen occupy memory.
+@interface BoxArtCache : NSObject
+
+- (id) initWithTileSize:(CGSize)tileSize scale:(CGFloat)scale;
+
+// Returns nil if the app has no tile yet or its box art is blank. Never touches the PNG.
+- (UIImage*) imageForApp:(TemporaryApp*)app;
+- (BOOL) containsApp:(TemporaryApp*)app;
+
+// Rebuilds the app's tile if its box art on disk has changed. This decodes
+// the PNG, so don't call it on the main thread. Returns YES if the tile changed.
+- (BOOL) updateApp:(TemporaryApp*)app;
+
+// Frees the tiles of apps that are gone. Images already handed out stay valid.
+- (void) removeApp:(TemporaryApp*)app;
+- (void) removeAppsForHost:(TemporaryHost*)host;
+
+- (void) trimResidentMemory;
+- (NSString*) getStatsText;
+
+@end
@@ -0,0 +1,597 @@
+//
+//  BoxArtCache.m
+//  Moonlight
+//
+//  Copyright © 2026 Moonlight Game Streaming Project. All rights reserved.
+//
+
+#import "BoxArtCache.h"
+#import "AppAssetManager.h"
+
+@import ImageIO;
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define ATLAS_FILE_NAME "boxart.atlas"
+#define ATLAS_MAGIC 0x41424c4d // 'MLBA'
+#define ATLAS_VERSION 1
+
+// The index is a fixed size so tiles never have to move when it fills up
+#define ATLAS_MAX_TILES 4096
+#define ATLAS_GROWTH_TILES 32
+#define ATLAS_KEY_LENGTH 200
+#define ATLAS_TILE_OFFSET (((sizeof(ATLAS_HEADER) + ATLAS_MAX_TILES * sizeof(ATLAS_ENTRY)) + 16383) & ~16383)
+
+#define ENTRY_FLAG_VALID 0x1
+#define ENTRY_FLAG_BLANK 0x2
+
+typedef struct _ATLAS_HEADER {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t tileWidth;
+    uint32_t tileHeight;
+    uint32_t tileCount;
+    uint32_t reserved[59];
+} ATLAS_HEADER, *PATLAS_HEADER;
+
+typedef struct _ATLAS_ENTRY {
+    char key[ATLAS_KEY_LENGTH];
+    
+    // Identifies the PNG this tile was built from
+    int64_t sourceMtime;
+    int64_t sourceSize;
+    
+    uint32_t flags;
+    uint32_t reserved[9];
+} ATLAS_ENTRY, *PATLAS_ENTRY;
+
+// Owns one mapping of the atlas. Images hold a reference so growing the
+// atlas (which maps it again) can't pull memory out from under them.
+@interface BoxArtMapping : NSObject {
+@public
+    uint8_t* base;
+    size_t length;
+}
+@end
+
+@implementation BoxArtMapping
+
+- (void) dealloc {
+    munmap(base, length);
+}
+
+@end
+
+// Keeps an image's tile from being reused while the image is alive. Tiles are
+// never rewritten in place; an update renders into a new slot and the old one
+// is only reused once every image reading it is gone.
+@interface BoxArtTileRef : NSObject {
+@public
+    BoxArtMapping* mapping;
+    uint32_t slot;
+    __weak BoxArtCache* cache;
+}
+@end
+
+@interface BoxArtCache ()
+- (void) releaseSlot:(uint32_t)slot;
+@end
+
+@implementation BoxArtTileRef
+
+- (void) dealloc {
+    [cache releaseSlot:slot];
+}
+
+@end
+
+static void releaseTileRef(void* info, const void* data, size_t size) {
+    CFBridgingRelease(info);
+}
+
+@implementation BoxArtCache {
+    int _fd;
+    BoxArtMapping* _mapping;
+    
+    size_t _tileWidth;
+    size_t _tileHeight;
+    size_t _tileBytes;
+    CGFloat _scale;
+    CGColorSpaceRef _colorSpace;
+    
+    // Guarded by @synchronized (self)
+    NSMutableDictionary<NSString*, NSNumber*>* _slots;
+    NSMutableSet<NSString*>* _updatingKeys;
+    NSMutableSet<NSString*>* _removedKeys;
+    NSMutableIndexSet* _freeSlots;
+    NSMutableIndexSet* _retiredSlots;
+    NSCountedSet<NSNumber*>* _slotRefs;
+    uint64_t _hits;
+    uint64_t _misses;
+}
+
+- (id) initWithTileSize:(CGSize)tileSize scale:(CGFloat)scale {
+    self = [super init];
+    
+    _tileWidth = (size_t)(tileSize.width * scale);
+    _tileHeight = (size_t)(tileSize.height * scale);
+    _tileBytes = _tileWidth * _tileHeight * 4;
+    _scale = scale;
+    _colorSpace = CGColorSpaceCreateDeviceRGB();
+    _slots = [[NSMutableDictionary alloc] init];
+    _updatingKeys = [[NSMutableSet alloc] init];
+    _removedKeys = [[NSMutableSet alloc] init];
+    _freeSlots = [[NSMutableIndexSet alloc] init];
+    _retiredSlots = [[NSMutableIndexSet alloc] init];
+    _slotRefs = [[NSCountedSet alloc] init];
+    _fd = -1;
+    
+    NSString* cachesPath = [NSSearchPathForDirectoriesInDomains(NSCachesDirectory, NSUserDomainMask, YES) objectAtIndex:0];
+    NSString* atlasPath = [cachesPath stringByAppendingPathComponent:@ATLAS_FILE_NAME];
+    
+    _fd = open([atlasPath fileSystemRepresentation], O_RDWR | O_CREAT, 0600);
+    if (_fd < 0) {
+        Log(LOG_E, @"Failed to open box art atlas: %d", errno);
+        return self;
+    }
+    
+    if (![self mapAtlas]) {
+        // Start over with an empty atlas if it's unusable
+        if (ftruncate(_fd, 0) < 0 || ![self mapAtlas]) {
+            Log(LOG_E, @"Failed to create box art atlas: %d", errno);
+            close(_fd);
+            _fd = -1;
+            return self;
+        }
+    }
+    
+    PATLAS_HEADER header = (PATLAS_HEADER)_mapping->base;
+    for (uint32_t i = 0; i < header->tileCount; i++) {
+        PATLAS_ENTRY entry = [self entryAtSlot:i];
+        entry->key[ATLAS_KEY_LENGTH - 1] = 0;
+        
+        // Slots without a key were freed. A key can also appear twice if we
+        // were killed while replacing its tile, in which case either will do.
+        NSString* key = [NSString stringWithUTF8String:entry->key];
+        if (key.length == 0 || _slots[key] != nil) {
+            [self freeEntry:entry];
+            [_freeSlots addIndex:i];
+        }
+        else {
+            _slots[key] = @(i);
+        }
+    }
+    
+    // No images exist yet, so this is the one time tiles can safely move
+    [self compactAtlas];
+    if (_mapping == nil) {
+        return self;
+    }
+    
+    header = (PATLAS_HEADER)_mapping->base;
+    Log(LOG_I, @"Opened box art atlas with %u tiles of %zux%zu", header->tileCount, _tileWidth, _tileHeight);
+    
+    return self;
+}
+
+- (void) dealloc {
+    _mapping = nil;
+    if (_fd >= 0) {
+        close(_fd);
+    }
+    CGColorSpaceRelease(_colorSpace);
+}
+
+// Maps the whole atlas file, initializing it if empty. Fails if the file is
+// from another version or tile size.
+- (BOOL) mapAtlas {
+    struct stat st;
+    if (fstat(_fd, &st) < 0) {
+        return NO;
+    }
+    
+    size_t length = st.st_size;
+    BOOL newAtlas = length == 0;
+    if (newAtlas) {
+        length = ATLAS_TILE_OFFSET + ATLAS_GROWTH_TILES * _tileBytes;
+        if (ftruncate(_fd, length) < 0) {
+            return NO;
+        }
+    }
+    else if (length < ATLAS_TILE_OFFSET) {
+        return NO;
+    }
+    
+    void* base = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_SHARED, _fd, 0);
+    if (base == MAP_FAILED) {
+        return NO;
+    }
+    
+    BoxArtMapping* mapping = [[BoxArtMapping alloc] init];
+    mapping->base = base;
+    mapping->length = length;
+    
+    PATLAS_HEADER header = (PATLAS_HEADER)base;
+    if (newAtlas) {
+        header->magic = ATLAS_MAGIC;
+        header->version = ATLAS_VERSION;
+        header->tileWidth = (uint32_t)_tileWidth;
+        header->tileHeight = (uint32_t)_tileHeight;
+        header->tileCount = 0;
+    }
+    else if (header->magic != ATLAS_MAGIC || header->version != ATLAS_VERSION ||
+             header->tileWidth != _tileWidth || header->tileHeight != _tileHeight ||
+             header->tileCount > ATLAS_MAX_TILES ||
+             ATLAS_TILE_OFFSET + header->tileCount * _tileBytes > length) {
+        return NO;
+    }
+    
+    _mapping = mapping;
+    return YES;
+}
+
+// Must be called with @synchronized (self)
+- (BOOL) growAtlas {
+    PATLAS_HEADER header = (PATLAS_HEADER)_mapping->base;
+    size_t length = ATLAS_TILE_OFFSET + MIN(header->tileCount + ATLAS_GROWTH_TILES, ATLAS_MAX_TILES) * _tileBytes;
+    if (ftruncate(_fd, length) < 0) {
+        return NO;
+    }
+    
+    void* base = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_SHARED, _fd, 0);
+    if (base == MAP_FAILED) {
+        return NO;
+    }
+    
+    // The old mapping goes away once no images reference it
+    BoxArtMapping* mapping = [[BoxArtMapping alloc] init];
+    mapping->base = base;
+    mapping->length = length;
+    _mapping = mapping;
+    return YES;
+}
+
+// Moves tiles from the end of the atlas into free slots and shrinks the file.
+// Tiles must not be referenced by any image.
+- (void) compactAtlas {
+    PATLAS_HEADER header = (PATLAS_HEADER)_mapping->base;
+    uint32_t tileCount = header->tileCount;
+    
+    if (_freeSlots.count == 0) {
+        return;
+    }
+    
+    while ([_freeSlots countOfIndexesInRange:NSMakeRange(0, tileCount)] > 0) {
+        uint32_t last = tileCount - 1;
+        if (![_freeSlots containsIndex:last]) {
+            uint32_t hole = (uint32_t)_freeSlots.firstIndex;
+            PATLAS_ENTRY entry = [self entryAtSlot:last];
+            
+            memcpy([self tileAtSlot:hole], [self tileAtSlot:last], _tileBytes);
+            memcpy([self entryAtSlot:hole], entry, sizeof(*entry));
+            _slots[[NSString stringWithUTF8String:entry->key]] = @(hole);
+            [self freeEntry:entry];
+            [_freeSlots removeIndex:hole];
+        }
+        
+        [_freeSlots removeIndex:last];
+        tileCount--;
+    }
+    
+    Log(LOG_I, @"Compacted box art atlas from %u to %u tiles", header->tileCount, tileCount);
+    header->tileCount = tileCount;
+    msync(_mapping->base, _mapping->length, MS_SYNC);
+    
+    size_t length = ATLAS_TILE_OFFSET + (tileCount + ATLAS_GROWTH_TILES) * _tileBytes;
+    if (length < _mapping->length) {
+        _mapping = nil;
+        if (ftruncate(_fd, length) < 0) {
+            Log(LOG_W, @"Failed to shrink box art atlas: %d", errno);
+        }
+        if (![self mapAtlas]) {
+            Log(LOG_E, @"Failed to map box art atlas: %d", errno);
+            close(_fd);
+            _fd = -1;
+        }
+    }
+}
+
+- (void) freeEntry:(PATLAS_ENTRY)entry {
+    memset(entry, 0, sizeof(*entry));
+}
+
+// Must be called with @synchronized (self). Returns NO if the atlas is full.
+- (BOOL) allocateSlot:(uint32_t*)slot {
+    if (_freeSlots.count > 0) {
+        *slot = (uint32_t)_freeSlots.firstIndex;
+        [_freeSlots removeIndex:*slot];
+        return YES;
+    }
+    
+    PATLAS_HEADER header = (PATLAS_HEADER)_mapping->base;
+    if (header->tileCount == ATLAS_MAX_TILES) {
+        Log(LOG_W, @"Box art atlas is full");
+        return NO;
+    }
+    
+    if (ATLAS_TILE_OFFSET + (header->tileCount + 1) * _tileBytes > _mapping->length && ![self growAtlas]) {
+        Log(LOG_E, @"Failed to grow box art atlas: %d", errno);
+        return NO;
+    }
+    
+    header = (PATLAS_HEADER)_mapping->base;
+    *slot = header->tileCount++;
+    return YES;
+}
+
+// Must be called with @synchronized (self). The slot is reused once no
+// images are reading it.
+- (void) retireSlot:(uint32_t)slot {
+    [self freeEntry:[self entryAtSlot:slot]];
+    if ([_slotRefs countForObject:@(slot)] > 0) {
+        [_retiredSlots addIndex:slot];
+    }
+    else {
+        [_freeSlots addIndex:slot];
+    }
+}
+
+- (void) releaseSlot:(uint32_t)slot {
+    @synchronized (self) {
+        [_slotRefs removeObject:@(slot)];
+        if ([_slotRefs countForObject:@(slot)] == 0 && [_retiredSlots containsIndex:slot]) {
+            [_retiredSlots removeIndex:slot];
+            [_freeSlots addIndex:slot];
+        }
+    }
+}
+
+- (PATLAS_ENTRY) entryAtSlot:(uint32_t)slot {
+    return &((PATLAS_ENTRY)(_mapping->base + sizeof(ATLAS_HEADER)))[slot];
+}
+
+- (uint8_t*) tileAtSlot:(uint32_t)slot {
+    return _mapping->base + ATLAS_TILE_OFFSET + slot * _tileBytes;
+}
+
++ (NSString*) keyForApp:(TemporaryApp*)app {
+    return [NSString stringWithFormat:@"%@/%@", app.host.uuid, app.id];
+}
+
+- (UIImage*) imageForApp:(TemporaryApp*)app {
+    NSString* key = [BoxArtCache keyForApp:app];
+    BoxArtTileRef* tileRef = [[BoxArtTileRef alloc] init];
+    uint8_t* tile;
+    
+    @synchronized (self) {
+        NSNumber* slot = _slots[key];
+        if (_mapping == nil || slot == nil || !([self entryAtSlot:slot.unsignedIntValue]->flags & ENTRY_FLAG_VALID)) {
+            _misses++;
+            return nil;
+        }
+        
+        _hits++;
+        if ([self entryAtSlot:slot.unsignedIntValue]->flags & ENTRY_FLAG_BLANK) {
+            return nil;
+        }
+        
+        tileRef->mapping = _mapping;
+        tileRef->slot = slot.unsignedIntValue;
+        tileRef->cache = self;
+        [_slotRefs addObject:slot];
+        tile = [self tileAtSlot:slot.unsignedIntValue];
+    }
+    
+    // The image reads straight out of the atlas mapping
+    CGDataProviderRef provider = CGDataProviderCreateWithData((__bridge_retained void*)tileRef, tile, _tileBytes, releaseTileRef);
+    CGImageRef cgImage = CGImageCreate(_tileWidth, _tileHeight, 8, 32, _tileWidth * 4, _colorSpace,
+                                       kCGImageAlphaPremultipliedFirst | kCGBitmapByteOrder32Little,
+                                       provider, NULL, false, kCGRenderingIntentDefault);
+    CGDataProviderRelease(provider);
+    
+    UIImage* image = [UIImage imageWithCGImage:cgImage scale:_scale orientation:UIImageOrientationUp];
+    CGImageRelease(cgImage);
+    return image;
+}
+
+- (BOOL) containsApp:(TemporaryApp*)app {
+    NSString* key = [BoxArtCache keyForApp:app];
+    
+    @synchronized (self) {
+        NSNumber* slot = _slots[key];
+        return _mapping != nil && slot != nil && ([self entryAtSlot:slot.unsignedIntValue]->flags & ENTRY_FLAG_VALID);
+    }
+}
+
+- (BOOL) updateApp:(TemporaryApp*)app {
+    NSString* key = [BoxArtCache keyForApp:app];
+    NSString* path = [AppAssetManager boxArtPathForApp:app];
+    
+    struct stat st;
+    if (stat([path fileSystemRepresentation], &st) < 0) {
+        // No box art on disk
+        return NO;
+    }
+    int64_t sourceMtime = (int64_t)st.st_mtimespec.tv_sec * 1000000000LL + st.st_mtimespec.tv_nsec;
+    
+    uint32_t slot;
+    BoxArtMapping* mapping;
+    @synchronized (self) {
+        if (_mapping == nil || [key lengthOfBytesUsingEncoding:NSUTF8StringEncoding] >= ATLAS_KEY_LENGTH ||
+            [_updatingKeys containsObject:key]) {
+            return NO;
+        }
+        
+        NSNumber* existingSlot = _slots[key];
+        if (existingSlot != nil) {
+            PATLAS_ENTRY entry = [self entryAtSlot:existingSlot.unsignedIntValue];
+            if ((entry->flags & ENTRY_FLAG_VALID) && entry->sourceMtime == sourceMtime && entry->sourceSize == st.st_size) {
+                // Already up to date
+                return NO;
+            }
+        }
+        
+        // Images may be reading the current tile, so render into a new slot
+        // and keep serving the old tile until the new one is ready
+        if (![self allocateSlot:&slot]) {
+            return NO;
+        }
+        
+        [_updatingKeys addObject:key];
+        [_removedKeys removeObject:key];
+        mapping = _mapping;
+    }
+    
+    uint32_t flags = [self renderTileFromPath:path into:mapping->base + ATLAS_TILE_OFFSET + slot * _tileBytes];
+    msync(mapping->base + ATLAS_TILE_OFFSET + slot * _tileBytes, _tileBytes, MS_ASYNC);
+    
+    @synchronized (self) {
+        [_updatingKeys removeObject:key];
+        
+        if (flags == 0 || [_removedKeys containsObject:key]) {
+            // Failed to render, or the app went away in the meantime
+            [_removedKeys removeObject:key];
+            [_freeSlots addIndex:slot];
+            return NO;
+        }
+        
+        // Write the new entry before freeing the old one, so there's always
+        // a valid entry for the key if we're killed in between
+        PATLAS_ENTRY entry = [self entryAtSlot:slot];
+        strcpy(entry->key, [key UTF8String]);
+        entry->sourceMtime = sourceMtime;
+        entry->sourceSize = st.st_size;
+        entry->flags = flags;
+        
+        NSNumber* oldSlot = _slots[key];
+        _slots[key] = @(slot);
+        if (oldSlot != nil) {
+            [self retireSlot:oldSlot.unsignedIntValue];
+        }
+    }
+    
+    return YES;
+}
+
+- (void) removeApp:(TemporaryApp*)app {
+    [self removeKey:[BoxArtCache keyForApp:app]];
+}
+
+- (void) removeAppsForHost:(TemporaryHost*)host {
+    NSString* prefix = [NSString stringWithFormat:@"%@/", host.uuid];
+    
+    @synchronized (self) {
+        for (NSString* key in [_slots allKeys]) {
+            if ([key hasPrefix:prefix]) {
+                [self removeKey:key];
+            }
+        }
+        for (NSString* key in _updatingKeys) {
+            if ([key hasPrefix:prefix]) {
+                [_removedKeys addObject:key];
+            }
+        }
+    }
+}
+
+- (void) removeKey:(NSString*)key {
+    @synchronized (self) {
+        if ([_updatingKeys containsObject:key]) {
+            [_removedKeys addObject:key];
+        }
+        
+        NSNumber* slot = _slots[key];
+        if (_mapping != nil && slot != nil) {
+            [_slots removeObjectForKey:key];
+            [self retireSlot:slot.unsignedIntValue];
+        }
+    }
+}
+
+// Decodes the PNG at a reduced size and scales it to fill the tile, matching
+// how the app view stretches its image. Returns the entry flags for the tile.
+- (uint32_t) renderTileFromPath:(NSString*)path into:(uint8_t*)tile {
+    CGImageSourceRef source = CGImageSourceCreateWithURL((__bridge CFURLRef)[NSURL fileURLWithPath:path], NULL);
+    if (source == NULL) {
+        return 0;
+    }
+    
+    // This size of image might be blank image received from GameStream.
+    // TODO: Improve no-app image detection
+    NSDictionary* properties = CFBridgingRelease(CGImageSourceCopyPropertiesAtIndex(source, 0, NULL));
+    int sourceWidth = [properties[(NSString*)kCGImagePropertyPixelWidth] intValue];
+    int sourceHeight = [properties[(NSString*)kCGImagePropertyPixelHeight] intValue];
+    if ((sourceWidth == 130 && sourceHeight == 180) || // GFE 2.0
+        (sourceWidth == 628 && sourceHeight == 888)) { // GFE 3.0
+        CFRelease(source);
+        return ENTRY_FLAG_VALID | ENTRY_FLAG_BLANK;
+    }
+    
+    NSDictionary* options = @{
+        (NSString*)kCGImageSourceCreateThumbnailFromImageAlways: @YES,
+        (NSString*)kCGImageSourceThumbnailMaxPixelSize: @(MAX(_tileWidth, _tileHeight)),
+        (NSString*)kCGImageSourceShouldCacheImmediately: @YES,
+    };
+    CGImageRef cgImage = CGImageSourceCreateThumbnailAtIndex(source, 0, (__bridge CFDictionaryRef)options);
+    CFRelease(source);
+    if (cgImage == NULL) {
+        return 0;
+    }
+    
+    CGContextRef context = CGBitmapContextCreate(tile, _tileWidth, _tileHeight, 8, _tileWidth * 4, _colorSpace,
+                                                 kCGImageAlphaPremultipliedFirst | kCGBitmapByteOrder32Little);
+    CGContextClearRect(context, CGRectMake(0, 0, _tileWidth, _tileHeight));
+    CGContextSetInterpolationQuality(context, kCGInterpolationHigh);
+    CGContextDrawImage(context, CGRectMake(0, 0, _tileWidth, _tileHeight), cgImage);
+    CGContextRelease(context);
+    CGImageRelease(cgImage);
+    
+    return ENTRY_FLAG_VALID;
+}
+
+- (void) trimResidentMemory {
+    @synchronized (self) {
+        if (_mapping != nil) {
+            // Tiles are backed by the file, so their pages can simply be dropped
+            msync(_mapping->base, _mapping->length, MS_SYNC);
+            madvise(_mapping->base + ATLAS_TILE_OFFSET, _mapping->length - ATLAS_TILE_OFFSET, MADV_DONTNEED);
+        }
+    }
+}
+
+- (size_t) residentBytes {
+    size_t pageSize = getpagesize();
+    size_t pages = (_mapping->length + pageSize - 1) / pageSize;
+    char* residency = malloc(pages);
+    size_t resident = 0;
+    
+    if (residency != NULL && mincore(_mapping->base, _mapping->length, residency) == 0) {
+        for (size_t i = 0; i < pages; i++) {
+            if (residency[i] & 1) {
+                resident += pageSize;
+            }
+        }
+    }
+    
+    free(residency);
+    return resident;
+}
+
+- (NSString*) getStatsText {
+    @synchronized (self) {
+        if (_mapping == nil) {
+            return @"Box art cache unavailable";
+        }
+        
+        uint64_t lookups = _hits + _misses;
+        return [NSString stringWithFormat:@"Box art cache: %lu of %u tiles in use, %.1f%% hit rate (%llu of %llu), %.1f of %.1f MB resident",
+                (unsigned long)_slots.count, ((PATLAS_HEADER)_mapping->base)->tileCount,
+                lookups ? (double)_hits * 100 / lookups : 0.0, _hits, lookups,
+                [self residentBytes] / 1048576.0, _mapping->length / 1048576.0];
+    }
+}
+
+@end
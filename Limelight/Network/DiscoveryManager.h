@@ -26,6 +26,8 @@
 - (void) removeHostFromDiscovery:(TemporaryHost*)host;
 - (void) pauseDiscoveryForHost:(TemporaryHost *)host;
 - (void) resumeDiscoveryForHost:(TemporaryHost *)host;
+// Polls the host right away instead of waiting out its poll interval
+- (void) pollHostNow:(TemporaryHost *)host;
 - (void) discoverHost:(NSString*)hostAddress withCallback:(void (^)(TemporaryHost*, NSString*))callback;
 
 @end
@@ -7,7 +7,6 @@
 //
 
 #import "DiscoveryManager.h"
-#import "CryptoManager.h"
 #import "HttpManager.h"
 #import "Utils.h"
 #import "DataManager.h"
@@ -15,6 +14,8 @@
 #import "ServerInfoResponse.h"
 #import "IdManager.h"
 
+@import Network;
+
 #include <Limelight.h>
 #include <arpa/inet.h>
 #include <sys/socket.h>
@@ -25,9 +26,10 @@
     NSMutableSet* _pausedHosts;
     id<DiscoveryCallback> _callback;
     MDNSManager* _mdnsMan;
-    NSOperationQueue* _opQueue;
+    NSMutableArray<DiscoveryWorker*>* _workers;
+    NSMutableArray<DiscoveryWorker*>* _drainingWorkers;
+    nw_path_monitor_t _pathMonitor;
     NSString* _uniqueId;
-    NSData* _cert;
     BOOL shouldDiscover;
 }
 
@@ -46,11 +48,10 @@
     }
     [_callback updateAllHosts:_hostQueue];
     
-    _opQueue = [[NSOperationQueue alloc] init];
+    _workers = [NSMutableArray array];
+    _drainingWorkers = [NSMutableArray array];
     _mdnsMan = [[MDNSManager alloc] initWithCallback:self];
-    [CryptoManager generateKeyPairUsingSSL];
     _uniqueId = [IdManager getUniqueId];
-    _cert = [CryptoManager readCertFromFile];
     return self;
 }
 
@@ -186,7 +187,7 @@
                     // This host was discovered over a permissible LAN address, so we can update our
                     // external address for this host.
                     struct in_addr wanAddr;
-                    int err = LiFindExternalAddressIP4("stun.moonlight-stream.org", 3478, &wanAddr.s_addr);
+                    int err = [Utils findExternalAddressIP4:&wanAddr.s_addr];
                     if (err == 0) {
                         char addrStr[INET_ADDRSTRLEN];
                         inet_ntop(AF_INET, &wanAddr, addrStr, sizeof(addrStr));
@@ -220,15 +221,79 @@
     
     Log(LOG_I, @"Starting discovery");
     shouldDiscover = YES;
+    
+    // We don't watch the network while discovery is stopped, so our
+    // cached WAN address may be stale by now
+    [Utils invalidateExternalAddress];
     [_mdnsMan searchForHosts];
     
     @synchronized (_hostQueue) {
         for (TemporaryHost* host in _hostQueue) {
             if (![_pausedHosts containsObject:host]) {
-                [_opQueue addOperation:[self createWorkerForHost:host]];
+                [self startWorkerForHost:host];
             }
         }
     }
+    
+    [self startNetworkMonitor];
+}
+
+// Must be called with _hostQueue locked
+- (void) startWorkerForHost:(TemporaryHost*)host {
+    DiscoveryWorker* worker = (DiscoveryWorker*)[self createWorkerForHost:host];
+    [_workers addObject:worker];
+    [worker startPolling];
+}
+
+// Must be called with _hostQueue locked
+- (void) stopWorkersForHost:(TemporaryHost*)host {
+    for (DiscoveryWorker* worker in [_workers copy]) {
+        if (host == nil || [worker getHost] == host) {
+            [worker cancel];
+            [_workers removeObject:worker];
+            
+            // Cancelled workers may still have requests in flight, so we keep
+            // them around for stopDiscoveryBlocking until they're done
+            [_drainingWorkers addObject:worker];
+            [worker notifyWhenFinished:^{
+                @synchronized (self->_hostQueue) {
+                    [self->_drainingWorkers removeObject:worker];
+                }
+            }];
+        }
+    }
+}
+
+- (void) startNetworkMonitor {
+    // Poll every host right away when the network changes, rather than waiting
+    // out the current poll interval or an offline host's backoff. Our WAN address
+    // may have changed too.
+    __block BOOL initialPath = YES;
+    _pathMonitor = nw_path_monitor_create();
+    nw_path_monitor_set_queue(_pathMonitor, dispatch_queue_create("Discovery network monitor", DISPATCH_QUEUE_SERIAL));
+    nw_path_monitor_set_update_handler(_pathMonitor, ^(nw_path_t path) {
+        // The first update is the current path, not a change
+        if (initialPath) {
+            initialPath = NO;
+            return;
+        }
+        
+        Log(LOG_I, @"Network changed; polling all hosts");
+        [Utils invalidateExternalAddress];
+        @synchronized (self->_hostQueue) {
+            for (DiscoveryWorker* worker in self->_workers) {
+                [worker pollNow];
+            }
+        }
+    });
+    nw_path_monitor_start(_pathMonitor);
+}
+
+- (void) stopNetworkMonitor {
+    if (_pathMonitor != nil) {
+        nw_path_monitor_cancel(_pathMonitor);
+        _pathMonitor = nil;
+    }
 }
 
 - (void) stopDiscovery {
@@ -239,7 +304,10 @@
     Log(LOG_I, @"Stopping discovery");
     shouldDiscover = NO;
     [_mdnsMan stopSearching];
-    [_opQueue cancelAllOperations];
+    [self stopNetworkMonitor];
+    @synchronized (_hostQueue) {
+        [self stopWorkersForHost:nil];
+    }
 }
 
 - (void) stopDiscoveryBlocking {
@@ -248,13 +316,23 @@
     if (shouldDiscover) {
         shouldDiscover = NO;
         [_mdnsMan stopSearching];
-        [_opQueue cancelAllOperations];
+        [self stopNetworkMonitor];
+        @synchronized (_hostQueue) {
+            [self stopWorkersForHost:nil];
+        }
     }
     
     // Ensure we always wait, just in case discovery
     // was stopped already but in an async manner that
-    // left operations in progress.
-    [_opQueue waitUntilAllOperationsAreFinished];
+    // left polls in progress. Every stopped worker is
+    // draining until its last request completes.
+    NSArray<DiscoveryWorker*>* workers;
+    @synchronized (_hostQueue) {
+        workers = [_drainingWorkers copy];
+    }
+    for (DiscoveryWorker* worker in workers) {
+        [worker waitUntilFinished];
+    }
     
     Log(LOG_I, @"All discovery workers stopped");
 }
@@ -293,7 +371,7 @@
         @synchronized (_hostQueue) {
             [_hostQueue addObject:host];
             if (shouldDiscover) {
-                [_opQueue addOperation:[self createWorkerForHost:host]];
+                [self startWorkerForHost:host];
             }
         }
         return YES;
@@ -302,11 +380,7 @@
 
 - (void) removeHostFromDiscovery:(TemporaryHost *)host {
     @synchronized (_hostQueue) {
-        for (DiscoveryWorker* worker in [_opQueue operations]) {
-            if ([worker getHost] == host) {
-                [worker cancel];
-            }
-        }
+        [self stopWorkersForHost:host];
         
         [_hostQueue removeObject:host];
         [_pausedHosts removeObject:host];
@@ -316,17 +390,23 @@
 - (void) pauseDiscoveryForHost:(TemporaryHost *)host {
     @synchronized (_hostQueue) {
         // Stop any worker for the host
-        for (DiscoveryWorker* worker in [_opQueue operations]) {
-            if ([worker getHost] == host) {
-                [worker cancel];
-            }
-        }
+        [self stopWorkersForHost:host];
         
         // Add it to the paused hosts list
         [_pausedHosts addObject:host];
     }
 }
 
+- (void) pollHostNow:(TemporaryHost *)host {
+    @synchronized (_hostQueue) {
+        for (DiscoveryWorker* worker in _workers) {
+            if ([worker getHost] == host) {
+                [worker pollNow];
+            }
+        }
+    }
+}
+
 - (void) resumeDiscoveryForHost:(TemporaryHost *)host {
     @synchronized (_hostQueue) {
         // Remove it from the paused hosts list
@@ -334,7 +414,8 @@
         
         // Start discovery again
         if (shouldDiscover) {
-            [_opQueue addOperation:[self createWorkerForHost:host]];
+            [self stopWorkersForHost:host];
+            [self startWorkerForHost:host];
         }
     }
 }
@@ -343,7 +424,7 @@
 - (void)updateHost:(TemporaryHost*)host {
     // Discover the hosts before adding to eliminate duplicates
     Log(LOG_D, @"Found host through MDNS: %@:", host.name);
-    // Since this is on a background thread, we do not need to use the opQueue
+    // Since this is on a background thread, we can wait for the worker
     DiscoveryWorker* worker = (DiscoveryWorker*)[self createWorkerForHost:host];
     [worker discoverHost];
     if ([self addHostToDiscovery:host]) {
@@ -8,10 +8,23 @@
 
 #import "TemporaryHost.h"
 
-@interface DiscoveryWorker : NSOperation
+// Polls one host for reachability. Polling is event driven: no thread is
+// held between polls, all of the host's addresses are probed concurrently,
+// and offline hosts are polled less often until they come back. The
+// scheduling is done by HostPoller.c.
+@interface DiscoveryWorker : NSObject
 
 - (id) initWithHost:(TemporaryHost*)host uniqueId:(NSString*)uniqueId;
 - (void) discoverHost;
+- (void) discoverHostWithCompletion:(void (^)(void))completion;
 - (TemporaryHost*) getHost;
 
+- (void) startPolling;
+- (void) pollNow;
+- (void) cancel;
+- (BOOL) isCancelled;
+- (void) waitUntilFinished;
+// Runs the block once the worker is cancelled and no poll or address probe is in flight
+- (void) notifyWhenFinished:(dispatch_block_t)block;
+
 @end
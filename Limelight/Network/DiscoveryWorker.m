@@ -13,31 +13,150 @@
 #import "HttpRequest.h"
 #import "DataManager.h"
 
+#include "HostPoller.h"
+
+@interface DiscoveryWorker ()
+
+- (NSArray*) getHostAddressList;
+- (void) probeAddress:(PHP_PROBE)probe;
+- (void) updateHostWithAddress:(NSString*)address serverInfoResp:(ServerInfoResponse*)serverInfoResp;
+- (void) pollerStopped;
+
+@end
+
 @implementation DiscoveryWorker {
     TemporaryHost* _host;
     NSString* _uniqueId;
+    DataManager* _dataManager;
+    
+    // The scheduling, backoff and address racing live in HostPoller.c
+    HOST_POLLER _poller;
+    BOOL _stopped;
+    dispatch_block_t _finishedBlock;
+}
+
+static void SchedulePollerCall(void* context, double delay, HP_CALL_FN fn, void* arg)
+{
+    // The block keeps the worker and its poller alive until the call runs
+    DiscoveryWorker* worker = (__bridge DiscoveryWorker*)context;
+    dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(delay * NSEC_PER_SEC)), dispatch_get_global_queue(QOS_CLASS_UTILITY, 0), ^{
+        (void)worker;
+        fn(arg);
+    });
 }
 
-static const float POLL_RATE = 2.0f; // Poll every 2 seconds
+static int GetPollerAddresses(void* context, char addresses[HP_MAX_ADDRESSES][HP_ADDRESS_MAX_LENGTH])
+{
+    DiscoveryWorker* worker = (__bridge DiscoveryWorker*)context;
+    int count = 0;
+    
+    for (NSString* address in [worker getHostAddressList]) {
+        if (count == HP_MAX_ADDRESSES) {
+            break;
+        }
+        
+        strlcpy(addresses[count++], [address UTF8String], HP_ADDRESS_MAX_LENGTH);
+    }
+    
+    return count;
+}
+
+static void ProbePollerAddress(void* context, PHP_PROBE probe)
+{
+    DiscoveryWorker* worker = (__bridge DiscoveryWorker*)context;
+    [worker probeAddress:probe];
+}
+
+static void ReportPollResult(void* context, const char* address, void* result)
+{
+    DiscoveryWorker* worker = (__bridge DiscoveryWorker*)context;
+    [worker updateHostWithAddress:address != NULL ? [NSString stringWithUTF8String:address] : nil
+                   serverInfoResp:(__bridge ServerInfoResponse*)result];
+}
+
+static void PollerStopped(void* context)
+{
+    DiscoveryWorker* worker = (__bridge DiscoveryWorker*)context;
+    [worker pollerStopped];
+}
+
+static void DiscoveryFinished(void* arg)
+{
+    void (^completion)(void) = (__bridge_transfer void (^)(void))arg;
+    completion();
+}
+
+static HOST_POLLER_CALLBACKS PollerCallbacks = {
+    SchedulePollerCall,
+    GetPollerAddresses,
+    ProbePollerAddress,
+    ReportPollResult,
+    PollerStopped,
+};
 
 - (id) initWithHost:(TemporaryHost*)host uniqueId:(NSString*)uniqueId {
     self = [super init];
     _host = host;
     _uniqueId = uniqueId;
+    
+    // Give the PC 2 tries to respond before declaring it offline if we've seen it before.
+    // If this is an unknown PC, update the status after 1 attempt to get the UI refreshed quickly.
+    HpInit(&_poller, &PollerCallbacks, (__bridge void*)self, HP_POLL_INTERVAL, HP_OFFLINE_MAX_POLL_INTERVAL,
+           HP_ADDRESS_RACE_DELAY, host.state != StateUnknown);
     return self;
 }
 
+- (void) dealloc {
+    HpDestroy(&_poller);
+}
+
 - (TemporaryHost*) getHost {
     return _host;
 }
 
-- (void)main {
-    while (!self.cancelled) {
-        [self discoverHost];
-        if (!self.cancelled) {
-            [NSThread sleepForTimeInterval:POLL_RATE];
+- (void) startPolling {
+    HpPollNow(&_poller);
+}
+
+- (void) pollNow {
+    HpPollNow(&_poller);
+}
+
+- (void) cancel {
+    HpCancel(&_poller);
+}
+
+- (BOOL) isCancelled {
+    return HpIsCancelled(&_poller);
+}
+
+- (void) waitUntilFinished {
+    HpWaitUntilFinished(&_poller);
+}
+
+- (void) notifyWhenFinished:(dispatch_block_t)block {
+    @synchronized (self) {
+        if (!_stopped) {
+            _finishedBlock = block;
+            return;
         }
     }
+    
+    dispatch_async(dispatch_get_global_queue(QOS_CLASS_UTILITY, 0), block);
+}
+
+- (void) pollerStopped {
+    dispatch_block_t block;
+    
+    @synchronized (self) {
+        _stopped = YES;
+        block = _finishedBlock;
+        _finishedBlock = nil;
+    }
+    
+    if (block != nil) {
+        dispatch_async(dispatch_get_global_queue(QOS_CLASS_UTILITY, 0), block);
+    }
 }
 
 - (NSArray*) getHostAddressList {
@@ -84,54 +203,84 @@ static const float POLL_RATE = 2.0f; // Poll every 2 seconds
 }
 
 - (void) discoverHost {
-    BOOL receivedResponse = NO;
-    NSArray *addresses = [self getHostAddressList];
+    dispatch_semaphore_t discoveryLock = dispatch_semaphore_create(0);
     
-    Log(LOG_D, @"%@ has %d unique addresses", _host.name, [addresses count]);
+    [self discoverHostWithCompletion:^{
+        dispatch_semaphore_signal(discoveryLock);
+    }];
     
-    // Give the PC 2 tries to respond before declaring it offline if we've seen it before.
-    // If this is an unknown PC, update the status after 1 attempt to get the UI refreshed quickly.
-    for (int i = 0; i < (_host.state == StateUnknown ? 1 : 2); i++) {
-        for (NSString *address in addresses) {
-            if (self.cancelled) {
-                // Get out without updating the status because
-                // it might not have finished checking the various
-                // addresses
-                return;
-            }
-            
-            ServerInfoResponse* serverInfoResp = [self requestInfoAtAddress:address cert:_host.serverCert];
-            receivedResponse = [self checkResponse:serverInfoResp];
-            if (receivedResponse) {
-                _host.activeAddress = address;
-                [serverInfoResp populateHost:_host];
-                
-                // Update the database using the response
-                DataManager *dataManager = [[DataManager alloc] init];
-                [dataManager updateHost:_host];
-                break;
-            }
-        }
+    dispatch_semaphore_wait(discoveryLock, DISPATCH_TIME_FOREVER);
+}
+
+- (void) discoverHostWithCompletion:(void (^)(void))completion {
+    HpDiscover(&_poller, DiscoveryFinished, (__bridge_retained void*)[completion copy]);
+}
+
+- (void) updateHostWithAddress:(NSString*)address serverInfoResp:(ServerInfoResponse*)serverInfoResp {
+    if (address != nil) {
+        _host.activeAddress = address;
+        [serverInfoResp populateHost:_host];
         
-        if (receivedResponse) {
-            Log(LOG_D, @"Received serverinfo response on try %d", i);
-            break;
+        // Update the database using the response. The write is deferred
+        // and skipped entirely if nothing changed since the last poll.
+        if (_dataManager == nil) {
+            _dataManager = [[DataManager alloc] init];
         }
+        [_dataManager updateHost:_host];
     }
-
-    _host.state = receivedResponse ? StateOnline : StateOffline;
-    if (receivedResponse) {
+    
+    _host.state = address != nil ? StateOnline : StateOffline;
+    if (address != nil) {
         Log(LOG_D, @"Received response from: %@\n{\n\t address:%@ \n\t localAddress:%@ \n\t externalAddress:%@ \n\t ipv6Address:%@ \n\t uuid:%@ \n\t mac:%@ \n\t pairState:%d \n\t online:%d \n\t activeAddress:%@ \n}", _host.name, _host.address, _host.localAddress, _host.externalAddress, _host.ipv6Address, _host.uuid, _host.mac, _host.pairState, _host.state, _host.activeAddress);
     }
 }
 
-- (ServerInfoResponse*) requestInfoAtAddress:(NSString*)address cert:(NSData*)cert {
-    HttpManager* hMan = [[HttpManager alloc] initWithAddress:address httpsPort:0 serverCert:cert];
+// Runs one of the poller's address probes. The poller decides which addresses
+// are probed when and which answer wins.
+- (void) probeAddress:(PHP_PROBE)probe {
+    NSString* address = [NSString stringWithUTF8String:probe->address];
+    
+    [self requestInfoAtAddress:address cert:_host.serverCert completion:^(ServerInfoResponse* serverInfoResp) {
+        BOOL reachable = serverInfoResp != nil && [self checkResponse:serverInfoResp];
+        HpProbeFinished(probe, reachable, (__bridge void*)serverInfoResp);
+    }];
+}
+
+- (void) requestInfoAtAddress:(NSString*)address cert:(NSData*)cert completion:(void (^)(ServerInfoResponse*))completion {
+    unsigned short httpsPort = _host.httpsPort;
+    
+    // Without the HTTPS port, HttpManager would block this thread while it looked
+    // it up, so we look it up with an async HTTP request first. It's remembered
+    // once the HTTPS response updates the host.
+    if (cert != nil && httpsPort == 0) {
+        HttpManager* hMan = [[HttpManager alloc] initWithAddress:address httpsPort:0 serverCert:nil];
+        ServerInfoResponse* response = [[ServerInfoResponse alloc] init];
+        [hMan executeRequest:[HttpRequest requestForResponse:response withUrlRequest:[hMan newHttpServerInfoRequest:true]]
+                  completion:^{
+            if (![response isStatusOk]) {
+                completion(response);
+                return;
+            }
+            
+            TemporaryHost* dummyHost = [[TemporaryHost alloc] init];
+            [response populateHost:dummyHost];
+            [self requestInfoAtAddress:address cert:cert httpsPort:dummyHost.httpsPort completion:completion];
+        }];
+        return;
+    }
+    
+    [self requestInfoAtAddress:address cert:cert httpsPort:httpsPort completion:completion];
+}
+
+- (void) requestInfoAtAddress:(NSString*)address cert:(NSData*)cert httpsPort:(unsigned short)httpsPort completion:(void (^)(ServerInfoResponse*))completion {
+    HttpManager* hMan = [[HttpManager alloc] initWithAddress:address httpsPort:httpsPort serverCert:cert];
     ServerInfoResponse* response = [[ServerInfoResponse alloc] init];
-    [hMan executeRequestSynchronously:[HttpRequest requestForResponse:response
-                                                       withUrlRequest:[hMan newServerInfoRequest:true]
-                                       fallbackError:401 fallbackRequest:[hMan newHttpServerInfoRequest]]];
-    return response;
+    [hMan executeRequest:[HttpRequest requestForResponse:response
+                                          withUrlRequest:[hMan newServerInfoRequest:true]
+                                           fallbackError:401 fallbackRequest:[hMan newHttpServerInfoRequest]]
+              completion:^{
+        completion(response);
+    }];
 }
 
 - (BOOL) checkResponse:(ServerInfoResponse*)response {
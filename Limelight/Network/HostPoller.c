@@ -0,0 +1,335 @@
+//
+//  HostPoller.c
+//  Moonlight
+//
+//  Copyright © 2026 Moonlight Game Streaming Project. All rights reserved.
+//
+
+#include "HostPoller.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct _HP_RACE {
+    PHOST_POLLER poller;
+    int triesLeft;
+    HP_CALL_FN done;
+    void* doneArg;
+    
+    // Guarded by the poller's mutex
+    int finishedProbes;
+    bool reported;
+    
+    // The race is freed when the last probe is done with it
+    int refs;
+    
+    int addressCount;
+    char addresses[HP_MAX_ADDRESSES][HP_ADDRESS_MAX_LENGTH];
+    HP_PROBE probes[HP_MAX_ADDRESSES];
+};
+
+typedef struct _HP_SCHEDULED_POLL {
+    PHOST_POLLER poller;
+    uint32_t generation;
+} HP_SCHEDULED_POLL, *PHP_SCHEDULED_POLL;
+
+void HpInit(PHOST_POLLER poller, PHOST_POLLER_CALLBACKS callbacks, void* context,
+            double pollInterval, double offlineMaxPollInterval, double addressRaceDelay, bool hostKnown)
+{
+    memset(poller, 0, sizeof(*poller));
+    pthread_mutex_init(&poller->mutex, NULL);
+    pthread_cond_init(&poller->idle, NULL);
+    
+    poller->callbacks = *callbacks;
+    poller->context = context;
+    poller->pollInterval = pollInterval;
+    poller->offlineMaxPollInterval = offlineMaxPollInterval;
+    poller->addressRaceDelay = addressRaceDelay;
+    poller->hostKnown = hostKnown;
+}
+
+void HpDestroy(PHOST_POLLER poller)
+{
+    pthread_cond_destroy(&poller->idle);
+    pthread_mutex_destroy(&poller->mutex);
+}
+
+// Must be called with the mutex held
+static bool shouldReportStoppedLocked(PHOST_POLLER poller)
+{
+    if (poller->cancelled && poller->active == 0 && !poller->stoppedReported) {
+        poller->stoppedReported = true;
+        return true;
+    }
+    
+    return false;
+}
+
+static void releaseActive(PHOST_POLLER poller)
+{
+    bool stopped;
+    
+    pthread_mutex_lock(&poller->mutex);
+    if (--poller->active == 0) {
+        pthread_cond_broadcast(&poller->idle);
+    }
+    stopped = shouldReportStoppedLocked(poller);
+    pthread_mutex_unlock(&poller->mutex);
+    
+    if (stopped) {
+        poller->callbacks.stopped(poller->context);
+    }
+}
+
+static void finishDiscovery(PHOST_POLLER poller, const char* address, void* result, HP_CALL_FN done, void* doneArg)
+{
+    bool cancelled;
+    
+    pthread_mutex_lock(&poller->mutex);
+    cancelled = poller->cancelled;
+    if (!cancelled) {
+        poller->hostKnown = true;
+        poller->online = address != NULL;
+    }
+    pthread_mutex_unlock(&poller->mutex);
+    
+    // Get out without updating the status because the race
+    // might not have finished checking the various addresses
+    if (!cancelled) {
+        poller->callbacks.pollResult(poller->context, address, result);
+    }
+    
+    done(doneArg);
+    releaseActive(poller);
+}
+
+static void startProbe(void* arg)
+{
+    PHP_PROBE probe = (PHP_PROBE)arg;
+    PHOST_POLLER poller = probe->race->poller;
+    bool skip;
+    
+    pthread_mutex_lock(&poller->mutex);
+    skip = probe->race->reported || poller->cancelled;
+    pthread_mutex_unlock(&poller->mutex);
+    
+    if (skip) {
+        HpProbeFinished(probe, false, NULL);
+        return;
+    }
+    
+    poller->callbacks.probe(poller->context, probe);
+}
+
+static void startRace(PHOST_POLLER poller, char addresses[HP_MAX_ADDRESSES][HP_ADDRESS_MAX_LENGTH], int addressCount,
+                      int triesLeft, HP_CALL_FN done, void* doneArg)
+{
+    PHP_RACE race;
+    
+    if (addressCount == 0 || (race = calloc(1, sizeof(*race))) == NULL) {
+        finishDiscovery(poller, NULL, NULL, done, doneArg);
+        return;
+    }
+    
+    race->poller = poller;
+    race->triesLeft = triesLeft;
+    race->done = done;
+    race->doneArg = doneArg;
+    race->refs = addressCount;
+    race->addressCount = addressCount;
+    memcpy(race->addresses, addresses, sizeof(race->addresses));
+    
+    // Every probe counts as in flight until its own completion runs,
+    // including the ones that lose the race
+    pthread_mutex_lock(&poller->mutex);
+    poller->active += addressCount;
+    pthread_mutex_unlock(&poller->mutex);
+    
+    for (int i = 0; i < addressCount; i++) {
+        race->probes[i].race = race;
+        race->probes[i].addressIndex = i;
+        race->probes[i].address = race->addresses[i];
+        poller->callbacks.schedule(poller->context, i * poller->addressRaceDelay, startProbe, &race->probes[i]);
+    }
+}
+
+void HpProbeFinished(PHP_PROBE probe, bool reachable, void* result)
+{
+    PHP_RACE race = probe->race;
+    PHOST_POLLER poller = race->poller;
+    bool report = false;
+    bool retry = false;
+    bool last;
+    
+    pthread_mutex_lock(&poller->mutex);
+    race->finishedProbes++;
+    if (!race->reported && (reachable || race->finishedProbes == race->addressCount)) {
+        race->reported = true;
+        report = true;
+        retry = !reachable && race->triesLeft > 1 && !poller->cancelled;
+    }
+    pthread_mutex_unlock(&poller->mutex);
+    
+    if (retry) {
+        startRace(poller, race->addresses, race->addressCount, race->triesLeft - 1, race->done, race->doneArg);
+    }
+    else if (report) {
+        finishDiscovery(poller, reachable ? probe->address : NULL, reachable ? result : NULL,
+                        race->done, race->doneArg);
+    }
+    
+    pthread_mutex_lock(&poller->mutex);
+    last = --race->refs == 0;
+    pthread_mutex_unlock(&poller->mutex);
+    
+    if (last) {
+        free(race);
+    }
+    
+    releaseActive(poller);
+}
+
+static void startDiscovery(PHOST_POLLER poller, HP_CALL_FN done, void* doneArg)
+{
+    char addresses[HP_MAX_ADDRESSES][HP_ADDRESS_MAX_LENGTH];
+    int addressCount;
+    int tries;
+    
+    pthread_mutex_lock(&poller->mutex);
+    tries = poller->hostKnown ? 2 : 1;
+    pthread_mutex_unlock(&poller->mutex);
+    
+    memset(addresses, 0, sizeof(addresses));
+    addressCount = poller->callbacks.getAddresses(poller->context, addresses);
+    startRace(poller, addresses, addressCount, tries, done, doneArg);
+}
+
+static void scheduledPollFired(void* arg)
+{
+    PHP_SCHEDULED_POLL scheduledPoll = (PHP_SCHEDULED_POLL)arg;
+    PHOST_POLLER poller = scheduledPoll->poller;
+    bool current;
+    
+    pthread_mutex_lock(&poller->mutex);
+    current = scheduledPoll->generation == poller->generation;
+    pthread_mutex_unlock(&poller->mutex);
+    
+    free(scheduledPoll);
+    
+    // Otherwise pollNow already ran in the meantime
+    if (current) {
+        HpPollNow(poller);
+    }
+}
+
+static void pollFinished(void* arg)
+{
+    PHOST_POLLER poller = (PHOST_POLLER)arg;
+    PHP_SCHEDULED_POLL scheduledPoll;
+    uint32_t generation;
+    double delay;
+    
+    pthread_mutex_lock(&poller->mutex);
+    poller->polling = false;
+    
+    if (poller->cancelled) {
+        pthread_mutex_unlock(&poller->mutex);
+        return;
+    }
+    
+    if (poller->pollAgain) {
+        poller->pollAgain = false;
+        delay = 0;
+    }
+    else if (poller->online) {
+        poller->offlinePolls = 0;
+        delay = poller->pollInterval;
+    }
+    else {
+        // Double the interval for each poll the host stays offline
+        delay = fmin(poller->pollInterval * (1 << (poller->offlinePolls < 4 ? poller->offlinePolls : 4)),
+                     poller->offlineMaxPollInterval);
+        poller->offlinePolls++;
+    }
+    
+    generation = ++poller->generation;
+    pthread_mutex_unlock(&poller->mutex);
+    
+    scheduledPoll = malloc(sizeof(*scheduledPoll));
+    if (scheduledPoll == NULL) {
+        return;
+    }
+    
+    scheduledPoll->poller = poller;
+    scheduledPoll->generation = generation;
+    poller->callbacks.schedule(poller->context, delay, scheduledPollFired, scheduledPoll);
+}
+
+void HpPollNow(PHOST_POLLER poller)
+{
+    pthread_mutex_lock(&poller->mutex);
+    
+    if (poller->cancelled) {
+        pthread_mutex_unlock(&poller->mutex);
+        return;
+    }
+    
+    if (poller->polling) {
+        // Poll again as soon as this one is done
+        poller->pollAgain = true;
+        pthread_mutex_unlock(&poller->mutex);
+        return;
+    }
+    
+    // This invalidates any poll that was already scheduled
+    poller->polling = true;
+    poller->generation++;
+    poller->active++;
+    pthread_mutex_unlock(&poller->mutex);
+    
+    startDiscovery(poller, pollFinished, poller);
+}
+
+void HpDiscover(PHOST_POLLER poller, HP_CALL_FN done, void* arg)
+{
+    pthread_mutex_lock(&poller->mutex);
+    poller->active++;
+    pthread_mutex_unlock(&poller->mutex);
+    
+    startDiscovery(poller, done, arg);
+}
+
+void HpCancel(PHOST_POLLER poller)
+{
+    bool stopped;
+    
+    pthread_mutex_lock(&poller->mutex);
+    poller->cancelled = true;
+    stopped = shouldReportStoppedLocked(poller);
+    pthread_mutex_unlock(&poller->mutex);
+    
+    if (stopped) {
+        poller->callbacks.stopped(poller->context);
+    }
+}
+
+bool HpIsCancelled(PHOST_POLLER poller)
+{
+    bool cancelled;
+    
+    pthread_mutex_lock(&poller->mutex);
+    cancelled = poller->cancelled;
+    pthread_mutex_unlock(&poller->mutex);
+    
+    return cancelled;
+}
+
+void HpWaitUntilFinished(PHOST_POLLER poller)
+{
+    pthread_mutex_lock(&poller->mutex);
+    while (poller->active > 0) {
+        pthread_cond_wait(&poller->idle, &poller->mutex);
+    }
+    pthread_mutex_unlock(&poller->mutex);
+}
@@ -0,0 +1,110 @@
+//
+//  HostPoller.h
+//  Moonlight
+//
+//  Copyright © 2026 Moonlight Game Streaming Project. All rights reserved.
+//
+
+#pragma once
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+// Decides when a host is polled and which of its addresses it's reachable at.
+// Polling is event driven: no thread is held between polls, all of the host's
+// addresses are probed concurrently, and offline hosts are polled less often
+// until they come back. The caller supplies the timers and the requests.
+//
+// Each address gets a head start over the next, so the preferred address wins
+// when several are reachable, but a dead address doesn't hold up the rest.
+
+#define HP_MAX_ADDRESSES 4
+#define HP_ADDRESS_MAX_LENGTH 256
+
+// What DiscoveryWorker uses, in seconds
+#define HP_POLL_INTERVAL 2.0
+#define HP_OFFLINE_MAX_POLL_INTERVAL 16.0
+#define HP_ADDRESS_RACE_DELAY 0.25
+
+typedef struct _HOST_POLLER HOST_POLLER, *PHOST_POLLER;
+typedef struct _HP_RACE HP_RACE, *PHP_RACE;
+
+typedef struct _HP_PROBE {
+    PHP_RACE race;
+    int addressIndex;
+    const char* address;
+} HP_PROBE, *PHP_PROBE;
+
+typedef void (*HP_CALL_FN)(void* arg);
+
+typedef struct _HOST_POLLER_CALLBACKS {
+    // Runs fn(arg) on another thread after the delay in seconds
+    void (*schedule)(void* context, double delay, HP_CALL_FN fn, void* arg);
+    
+    // Copies the host's addresses in order of preference and returns how many there are
+    int (*getAddresses)(void* context, char addresses[HP_MAX_ADDRESSES][HP_ADDRESS_MAX_LENGTH]);
+    
+    // Requests the server info at probe->address. HpProbeFinished() must be
+    // called exactly once when the request is done.
+    void (*probe)(void* context, PHP_PROBE probe);
+    
+    // Reports the address that won the race along with the result passed to
+    // HpProbeFinished() for it, or NULL if no address answered. This isn't
+    // called once the poller is cancelled.
+    void (*pollResult)(void* context, const char* address, void* result);
+    
+    // Called once after HpCancel() when no poll or probe is in flight anymore
+    void (*stopped)(void* context);
+} HOST_POLLER_CALLBACKS, *PHOST_POLLER_CALLBACKS;
+
+struct _HOST_POLLER {
+    pthread_mutex_t mutex;
+    pthread_cond_t idle;
+    
+    HOST_POLLER_CALLBACKS callbacks;
+    void* context;
+    
+    // In seconds
+    double pollInterval;
+    double offlineMaxPollInterval;
+    double addressRaceDelay;
+    
+    bool cancelled;
+    bool stoppedReported;
+    bool polling;
+    bool pollAgain;
+    
+    // A host we've never heard from gets 1 try per poll instead of 2, so the
+    // UI is updated quickly
+    bool hostKnown;
+    bool online;
+    int offlinePolls;
+    
+    // Bumped whenever a poll starts or is scheduled, so a scheduled poll that
+    // was overtaken by pollNow doesn't run
+    uint32_t generation;
+    
+    // Polls, discoveries and probes that haven't finished
+    int active;
+};
+
+void HpInit(PHOST_POLLER poller, PHOST_POLLER_CALLBACKS callbacks, void* context,
+            double pollInterval, double offlineMaxPollInterval, double addressRaceDelay, bool hostKnown);
+void HpDestroy(PHOST_POLLER poller);
+
+// Polls right away, or as soon as the poll in progress is done. Scheduled
+// polls follow from there until the poller is cancelled.
+void HpPollNow(PHOST_POLLER poller);
+
+// Probes the host's addresses once without scheduling any polls and calls
+// done(arg) after the result has been reported
+void HpDiscover(PHOST_POLLER poller, HP_CALL_FN done, void* arg);
+
+void HpProbeFinished(PHP_PROBE probe, bool reachable, void* result);
+
+void HpCancel(PHOST_POLLER poller);
+bool HpIsCancelled(PHOST_POLLER poller);
+
+// Blocks until no poll, discovery or probe is in flight
+void HpWaitUntilFinished(PHOST_POLLER poller);
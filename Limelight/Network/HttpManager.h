@@ -11,7 +11,7 @@
 #import "StreamConfiguration.h"
 #import "TemporaryHost.h"
 
-@interface HttpManager : NSObject <NSURLSessionDelegate>
+@interface HttpManager : NSObject
 
 - (id) initWithHost:(TemporaryHost*) host;
 - (id) initWithAddress:(NSString*) hostAddressPortString httpsPort:(unsigned short) httpsPort serverCert:(NSData*) serverCert;
@@ -31,6 +31,10 @@
 - (NSURLRequest*) newAppAssetRequestWithAppId:(NSString*)appId;
 - (void) executeRequestSynchronously:(HttpRequest*)request;
 
+// Completion is called on a background queue once the response (and any
+// fallback request) has been handled
+- (void) executeRequest:(HttpRequest*)request completion:(void (^)(void))completion;
+
 @end
 
 
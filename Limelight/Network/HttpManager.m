@@ -22,6 +22,170 @@
 #define LONG_TIMEOUT_SEC 60
 #define EXTRA_LONG_TIMEOUT_SEC 180
 
+// A long-lived URL session for one host. Reusing it across requests lets
+// NSURLSession keep connections alive and resume TLS sessions instead of
+// paying for a full handshake on every serverinfo poll and box art fetch.
+@interface HttpSession : NSObject <NSURLSessionTaskDelegate>
+
+@property (nonatomic, readonly) NSURLSession* urlSession;
+@property (nonatomic, readonly) NSData* serverCert;
+
+- (id) initWithServerCert:(NSData*)serverCert;
+
+@end
+
+// Sessions by scheme, host, and port
+static NSMutableDictionary<NSString*, HttpSession*>* sessionPool;
+static NSLock* sessionPoolLock;
+
+// Importing the client identity from the PKCS12 is expensive,
+// so we do it once per client certificate.
+static NSData* cachedIdentityP12;
+static SecIdentityRef cachedIdentity;
+static NSLock* cachedIdentityLock;
+
+static double intervalMs(NSDate* start, NSDate* end) {
+    if (start == nil || end == nil) {
+        return 0;
+    }
+    
+    return [end timeIntervalSinceDate:start] * 1000;
+}
+
+@implementation HttpSession
+
+- (id) initWithServerCert:(NSData*)serverCert {
+    self = [super init];
+    _serverCert = serverCert;
+    
+    NSURLSessionConfiguration* config = [NSURLSessionConfiguration ephemeralSessionConfiguration];
+    config.URLCache = nil;
+    config.requestCachePolicy = NSURLRequestReloadIgnoringLocalCacheData;
+    _urlSession = [NSURLSession sessionWithConfiguration:config delegate:self delegateQueue:nil];
+    
+    return self;
+}
+
+// Returns an array containing the certificate
+- (NSArray*)getCertificate:(SecIdentityRef) identity {
+    SecCertificateRef certificate = nil;
+    
+    SecIdentityCopyCertificate(identity, &certificate);
+    
+    return [[NSArray alloc] initWithObjects:(__bridge_transfer id)certificate, nil];
+}
+
+// Returns the identity
+- (SecIdentityRef)getClientCertificate {
+    NSData* p12 = [CryptoManager readP12FromFile];
+    
+    [cachedIdentityLock lock];
+    if (cachedIdentity != nil && [cachedIdentityP12 isEqualToData:p12]) {
+        SecIdentityRef identity = (SecIdentityRef)CFRetain(cachedIdentity);
+        [cachedIdentityLock unlock];
+        return identity;
+    }
+    
+    SecIdentityRef identityApp = nil;
+    CFDataRef p12Data = (__bridge CFDataRef)p12;
+
+    CFStringRef password = CFSTR("limelight");
+    const void *keys[] = { kSecImportExportPassphrase };
+    const void *values[] = { password };
+    CFDictionaryRef options = CFDictionaryCreate(NULL, keys, values, 1, NULL, NULL);
+    CFArrayRef items = nil;
+    OSStatus securityError = SecPKCS12Import(p12Data, options, &items);
+
+    if (securityError == errSecSuccess) {
+        //Log(LOG_D, @"Success opening p12 certificate. Items: %ld", CFArrayGetCount(items));
+        CFDictionaryRef identityDict = CFArrayGetValueAtIndex(items, 0);
+        identityApp = (SecIdentityRef)CFRetain(CFDictionaryGetValue(identityDict, kSecImportItemIdentity));
+        CFRelease(items);
+        
+        if (cachedIdentity != nil) {
+            CFRelease(cachedIdentity);
+        }
+        cachedIdentity = (SecIdentityRef)CFRetain(identityApp);
+        cachedIdentityP12 = p12;
+    } else {
+        Log(LOG_E, @"Error opening Certificate.");
+    }
+    [cachedIdentityLock unlock];
+    
+    CFRelease(options);
+    CFRelease(password);
+    
+    return identityApp;
+}
+
+- (void)URLSession:(NSURLSession *)session didReceiveChallenge:(NSURLAuthenticationChallenge *)challenge completionHandler:(nonnull void (^)(NSURLSessionAuthChallengeDisposition, NSURLCredential * __nullable))completionHandler {
+    // Allow untrusted server certificates
+    if([challenge.protectionSpace.authenticationMethod isEqualToString:NSURLAuthenticationMethodServerTrust])
+    {
+        if (SecTrustGetCertificateCount(challenge.protectionSpace.serverTrust) != 1) {
+            Log(LOG_E, @"Server certificate count mismatch");
+            completionHandler(NSURLSessionAuthChallengePerformDefaultHandling, NULL);
+            return;
+        }
+        
+        SecCertificateRef actualCert = SecTrustGetCertificateAtIndex(challenge.protectionSpace.serverTrust, 0);
+        if (actualCert == nil) {
+            Log(LOG_E, @"Server certificate parsing error");
+            completionHandler(NSURLSessionAuthChallengePerformDefaultHandling, NULL);
+            return;
+        }
+        
+        CFDataRef actualCertData = SecCertificateCopyData(actualCert);
+        if (actualCertData == nil) {
+            Log(LOG_E, @"Server certificate data parsing error");
+            completionHandler(NSURLSessionAuthChallengePerformDefaultHandling, NULL);
+            return;
+        }
+        
+        if (!CFEqual(actualCertData, (__bridge CFDataRef)_serverCert)) {
+            Log(LOG_E, @"Server certificate mismatch");
+            CFRelease(actualCertData);
+            completionHandler(NSURLSessionAuthChallengePerformDefaultHandling, NULL);
+            return;
+        }
+        
+        CFRelease(actualCertData);
+        
+        // Allow TLS handshake to proceed
+        completionHandler(NSURLSessionAuthChallengeUseCredential,
+                          [NSURLCredential credentialForTrust: challenge.protectionSpace.serverTrust]);
+    }
+    // Respond to client certificate challenge with our certificate
+    else if ([challenge.protectionSpace.authenticationMethod isEqualToString:NSURLAuthenticationMethodClientCertificate])
+    {
+        SecIdentityRef identity = [self getClientCertificate];
+        NSArray* certArray = [self getCertificate:identity];
+        NSURLCredential* newCredential = [NSURLCredential credentialWithIdentity:identity certificates:certArray persistence:NSURLCredentialPersistencePermanent];
+        CFRelease(identity);
+        completionHandler(NSURLSessionAuthChallengeUseCredential, newCredential);
+    }
+    else
+    {
+        completionHandler(NSURLSessionAuthChallengePerformDefaultHandling, NULL);
+    }
+}
+
+- (void)URLSession:(NSURLSession *)session task:(NSURLSessionTask *)task didFinishCollectingMetrics:(NSURLSessionTaskMetrics *)metrics {
+    for (NSURLSessionTaskTransactionMetrics* transaction in metrics.transactionMetrics) {
+        // Only log the path, since query strings can carry keys
+        Log(LOG_D, @"Request timing for %@: DNS %.1f ms, connect %.1f ms, TLS %.1f ms, TTFB %.1f ms, total %.1f ms (%@ connection)",
+            transaction.request.URL.path,
+            intervalMs(transaction.domainLookupStartDate, transaction.domainLookupEndDate),
+            intervalMs(transaction.connectStartDate, transaction.connectEndDate),
+            intervalMs(transaction.secureConnectionStartDate, transaction.secureConnectionEndDate),
+            intervalMs(transaction.requestStartDate, transaction.responseStartDate),
+            intervalMs(transaction.fetchStartDate, transaction.responseEndDate),
+            transaction.reusedConnection ? @"reused" : @"new");
+    }
+}
+
+@end
+
 @implementation HttpManager {
     NSString* _urlSafeHostName;
     NSString* _baseHTTPURL;
@@ -33,11 +197,37 @@
     NSString* _baseHTTPSURL;
 }
 
-+ (NSData*) fixXmlVersion:(NSData*) xmlData {
-    NSString* dataString = [[NSString alloc] initWithData:xmlData encoding:NSUTF8StringEncoding];
-    NSString* xmlString = [dataString stringByReplacingOccurrencesOfString:@"UTF-16" withString:@"UTF-8" options:NSCaseInsensitiveSearch range:NSMakeRange(0, [dataString length])];
++ (void) initialize {
+    if (self == [HttpManager class]) {
+        sessionPool = [[NSMutableDictionary alloc] init];
+        sessionPoolLock = [[NSLock alloc] init];
+        cachedIdentityLock = [[NSLock alloc] init];
+    }
+}
+
+// Creates a task on the shared session for the request's host, replacing the
+// session if the pinned server certificate has changed
+- (NSURLSessionDataTask*) newDataTaskWithRequest:(NSURLRequest*)request completionHandler:(void (^)(NSData*, NSURLResponse*, NSError*))completionHandler {
+    NSURL* url = request.URL;
+    NSString* sessionKey = [NSString stringWithFormat:@"%@://%@:%@", url.scheme, url.host, url.port];
+    BOOL pinsCert = [url.scheme isEqualToString:@"https"];
+    
+    // Tasks are created under the lock so a session can't be invalidated under us
+    [sessionPoolLock lock];
+    HttpSession* session = sessionPool[sessionKey];
+    if (session != nil && pinsCert && !(session.serverCert == _serverCert || [session.serverCert isEqualToData:_serverCert])) {
+        // Let requests already using the old certificate finish
+        [session.urlSession finishTasksAndInvalidate];
+        session = nil;
+    }
+    if (session == nil) {
+        session = [[HttpSession alloc] initWithServerCert:pinsCert ? _serverCert : nil];
+        sessionPool[sessionKey] = session;
+    }
+    NSURLSessionDataTask* task = [session.urlSession dataTaskWithRequest:request completionHandler:completionHandler];
+    [sessionPoolLock unlock];
     
-    return [xmlString dataUsingEncoding:NSUTF8StringEncoding];
+    return task;
 }
 
 - (void) setServerCert:(NSData*) serverCert {
@@ -106,6 +296,16 @@
 }
 
 - (void) executeRequestSynchronously:(HttpRequest*)request {
+    dispatch_semaphore_t requestLock = dispatch_semaphore_create(0);
+    
+    [self executeRequest:request completion:^{
+        dispatch_semaphore_signal(requestLock);
+    }];
+    
+    dispatch_semaphore_wait(requestLock, DISPATCH_TIME_FOREVER);
+}
+
+- (void) executeRequest:(HttpRequest*)request completion:(void (^)(void))completion {
     // This is a special case to handle failure of HTTPS port fetching
     if (!request.request) {
         if (request.response) {
@@ -113,41 +313,36 @@
             request.response.statusMessage = @"Host is unreachable";
         }
         
+        completion();
         return;
     }
-
-    __block NSData* requestResp = nil;
-    __block NSError* respError = nil;
-    __block dispatch_semaphore_t requestLock = dispatch_semaphore_create(0);
     
     Log(LOG_D, @"Making Request: %@", request);
-    NSURLSession* urlSession = [NSURLSession sessionWithConfiguration:[NSURLSessionConfiguration ephemeralSessionConfiguration] delegate:self delegateQueue:nil];
-    [[urlSession dataTaskWithRequest:request.request completionHandler:^(NSData * __nullable data, NSURLResponse * __nullable response, NSError * __nullable error) {
-        
+    [[self newDataTaskWithRequest:request.request completionHandler:^(NSData * __nullable data, NSURLResponse * __nullable response, NSError * __nullable error) {
         if (error != NULL) {
             Log(LOG_D, @"Connection error: %@", error);
-            respError = error;
         }
         else {
             Log(LOG_D, @"Received response: %@", response);
-
-            if (data != NULL) {
-                Log(LOG_D, @"\n\nReceived data: %@\n\n", [[NSString alloc] initWithData:data encoding:NSUTF8StringEncoding]);
-                if ([[NSString alloc] initWithData:data encoding:NSUTF8StringEncoding] != nil) {
-                    requestResp = [HttpManager fixXmlVersion:data];
-                } else {
-                    requestResp = data;
-                }
-            }
         }
         
-        dispatch_semaphore_signal(requestLock);
+        // Don't parse on the session's delegate queue, since that would hold up
+        // every other request to this host
+        dispatch_async(dispatch_get_global_queue(QOS_CLASS_UTILITY, 0), ^{
+            if ([response isKindOfClass:[NSHTTPURLResponse class]] &&
+                [request.response respondsToSelector:@selector(populateWithHTTPResponse:)]) {
+                [request.response populateWithHTTPResponse:(NSHTTPURLResponse*)response];
+            }
+            
+            [self handleResponseData:data error:error forRequest:request completion:completion];
+        });
     }] resume];
-    
-    dispatch_semaphore_wait(requestLock, DISPATCH_TIME_FOREVER);
-    [urlSession invalidateAndCancel];
-    
+}
+
+- (void) handleResponseData:(NSData*)requestResp error:(NSError*)respError forRequest:(HttpRequest*)request completion:(void (^)(void))completion {
     if (!respError && request.response) {
+        // The XML parsers handle the bogus UTF-16 declaration themselves,
+        // so the body is passed through untouched
         [request.response populateWithData:requestResp];
         
         // If the fallback error code was detected, issue the fallback request
@@ -156,7 +351,8 @@
             request.request = request.fallbackRequest;
             request.fallbackError = 0;
             request.fallbackRequest = NULL;
-            [self executeRequestSynchronously:request];
+            [self executeRequest:request completion:completion];
+            return;
         }
     }
     else if (respError && [respError code] == NSURLErrorServerCertificateUntrusted) {
@@ -171,13 +367,16 @@
             request.request = request.fallbackRequest;
             request.fallbackError = 0;
             request.fallbackRequest = NULL;
-            [self executeRequestSynchronously:request];
+            [self executeRequest:request completion:completion];
+            return;
         }
     }
     else if (respError && request.response) {
         request.response.statusCode = [respError code];
         request.response.statusMessage = [respError localizedDescription];
     }
+    
+    completion();
 }
 
 - (NSURLRequest*) createRequestFromString:(NSString*) urlString timeout:(int)timeout {
@@ -301,7 +500,11 @@
     }
     
     NSString* urlString = [NSString stringWithFormat:@"%@/appasset?uniqueid=%@&appid=%@&AssetType=2&AssetIdx=0", _baseHTTPSURL, _uniqueId, appId];
-    return [self createRequestFromString:urlString timeout:NORMAL_TIMEOUT_SEC];
+    NSMutableURLRequest* request = [[self createRequestFromString:urlString timeout:NORMAL_TIMEOUT_SEC] mutableCopy];
+    
+    // Box art is fetched in bulk, so let requests queue up on the open connection
+    [request setHTTPShouldUsePipelining:YES];
+    return request;
 }
 
 - (NSString*) bytesToHex:(NSData*)data {
@@ -313,92 +516,4 @@
     return hex;
 }
 
-// Returns an array containing the certificate
-- (NSArray*)getCertificate:(SecIdentityRef) identity {
-    SecCertificateRef certificate = nil;
-    
-    SecIdentityCopyCertificate(identity, &certificate);
-    
-    return [[NSArray alloc] initWithObjects:(__bridge_transfer id)certificate, nil];
-}
-
-// Returns the identity
-- (SecIdentityRef)getClientCertificate {
-    SecIdentityRef identityApp = nil;
-    CFDataRef p12Data = (__bridge CFDataRef)[CryptoManager readP12FromFile];
-
-    CFStringRef password = CFSTR("limelight");
-    const void *keys[] = { kSecImportExportPassphrase };
-    const void *values[] = { password };
-    CFDictionaryRef options = CFDictionaryCreate(NULL, keys, values, 1, NULL, NULL);
-    CFArrayRef items = nil;
-    OSStatus securityError = SecPKCS12Import(p12Data, options, &items);
-
-    if (securityError == errSecSuccess) {
-        //Log(LOG_D, @"Success opening p12 certificate. Items: %ld", CFArrayGetCount(items));
-        CFDictionaryRef identityDict = CFArrayGetValueAtIndex(items, 0);
-        identityApp = (SecIdentityRef)CFRetain(CFDictionaryGetValue(identityDict, kSecImportItemIdentity));
-        CFRelease(items);
-    } else {
-        Log(LOG_E, @"Error opening Certificate.");
-    }
-    
-    CFRelease(options);
-    CFRelease(password);
-    
-    return identityApp;
-}
-
-- (void)URLSession:(NSURLSession *)session didReceiveChallenge:(NSURLAuthenticationChallenge *)challenge completionHandler:(nonnull void (^)(NSURLSessionAuthChallengeDisposition, NSURLCredential * __nullable))completionHandler {
-    // Allow untrusted server certificates
-    if([challenge.protectionSpace.authenticationMethod isEqualToString:NSURLAuthenticationMethodServerTrust])
-    {
-        if (SecTrustGetCertificateCount(challenge.protectionSpace.serverTrust) != 1) {
-            Log(LOG_E, @"Server certificate count mismatch");
-            completionHandler(NSURLSessionAuthChallengePerformDefaultHandling, NULL);
-            return;
-        }
-        
-        SecCertificateRef actualCert = SecTrustGetCertificateAtIndex(challenge.protectionSpace.serverTrust, 0);
-        if (actualCert == nil) {
-            Log(LOG_E, @"Server certificate parsing error");
-            completionHandler(NSURLSessionAuthChallengePerformDefaultHandling, NULL);
-            return;
-        }
-        
-        CFDataRef actualCertData = SecCertificateCopyData(actualCert);
-        if (actualCertData == nil) {
-            Log(LOG_E, @"Server certificate data parsing error");
-            completionHandler(NSURLSessionAuthChallengePerformDefaultHandling, NULL);
-            return;
-        }
-        
-        if (!CFEqual(actualCertData, (__bridge CFDataRef)_serverCert)) {
-            Log(LOG_E, @"Server certificate mismatch");
-            CFRelease(actualCertData);
-            completionHandler(NSURLSessionAuthChallengePerformDefaultHandling, NULL);
-            return;
-        }
-        
-        CFRelease(actualCertData);
-        
-        // Allow TLS handshake to proceed
-        completionHandler(NSURLSessionAuthChallengeUseCredential,
-                          [NSURLCredential credentialForTrust: challenge.protectionSpace.serverTrust]);
-    }
-    // Respond to client certificate challenge with our certificate
-    else if ([challenge.protectionSpace.authenticationMethod isEqualToString:NSURLAuthenticationMethodClientCertificate])
-    {
-        SecIdentityRef identity = [self getClientCertificate];
-        NSArray* certArray = [self getCertificate:identity];
-        NSURLCredential* newCredential = [NSURLCredential credentialWithIdentity:identity certificates:certArray persistence:NSURLCredentialPersistencePermanent];
-        CFRelease(identity);
-        completionHandler(NSURLSessionAuthChallengeUseCredential, newCredential);
-    }
-    else
-    {
-        completionHandler(NSURLSessionAuthChallengePerformDefaultHandling, NULL);
-    }
-}
-
 @end
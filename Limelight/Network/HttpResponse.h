@@ -13,6 +13,11 @@ static NSString* TAG_STATUS_MESSAGE = @"status_message";
 
 - (void) populateWithData:(NSData*)data;
 
+@optional
+// Called before populateWithData: for responses that need the HTTP status or headers
+- (void) populateWithHTTPResponse:(NSHTTPURLResponse*)response;
+
+@required
 @property (nonatomic) NSInteger statusCode;
 @property (nonatomic) NSString* statusMessage;
 @property (nonatomic) NSData* data;
@@ -8,7 +8,8 @@
 
 #import "HttpResponse.h"
 #import "TemporaryApp.h"
-#import <libxml2/libxml/xmlreader.h>
+
+#include "XmlResponse.h"
 
 @implementation HttpResponse {
     NSMutableDictionary* _elements;
@@ -38,36 +39,54 @@
     return self.statusCode == 200;
 }
 
+// Status and elements are collected here while parsing, and only kept if the
+// whole document parses
+typedef struct {
+    __unsafe_unretained NSMutableDictionary* elements;
+    NSInteger statusCode;
+    char* statusMessage;
+} PARSE_STATE;
+
+static void parsedRoot(void* context, const char* statusCode, const char* statusMessage) {
+    PARSE_STATE* state = (PARSE_STATE*)context;
+    
+    if (statusCode != NULL) {
+        state->statusCode = (NSInteger)strtoll(statusCode, NULL, 10);
+    }
+    if (statusMessage != NULL) {
+        free(state->statusMessage);
+        state->statusMessage = strdup(statusMessage);
+    }
+}
+
+static void parsedElement(void* context, const char* name, const char* value) {
+    PARSE_STATE* state = (PARSE_STATE*)context;
+    
+    [state->elements setObject:([NSString stringWithUTF8String:value] ?: @"") forKey:[NSString stringWithUTF8String:name]];
+}
+
 - (void) parseData {
     _elements = [[NSMutableDictionary alloc] init];
-    xmlDocPtr docPtr = xmlParseMemory([self.data bytes], (int)[self.data length]);
-    if (docPtr == NULL) {
+    
+    NSMutableDictionary* elements = [[NSMutableDictionary alloc] init];
+    PARSE_STATE state = { elements, self.statusCode, NULL };
+    XR_CALLBACKS callbacks = { parsedRoot, parsedElement, NULL };
+    
+    XR_RESULT result = XrParseElements([self.data bytes], (int)[self.data length], &callbacks, &state);
+    NSString* statusMsg = state.statusMessage != NULL ? [NSString stringWithUTF8String:state.statusMessage] : @"Server Error";
+    free(state.statusMessage);
+    
+    if (result == XR_PARSE_ERROR) {
         Log(LOG_W, @"An error occured trying to parse xml.");
         return;
     }
-    
-    xmlNodePtr node = xmlDocGetRootElement(docPtr);
-    if (node == NULL) {
+    else if (result == XR_NO_ROOT) {
         Log(LOG_W, @"No root XML element.");
-        xmlFreeDoc(docPtr);
         return;
     }
-
-    xmlChar* statusStr = xmlGetProp(node, (const xmlChar*)[TAG_STATUS_CODE UTF8String]);
-    if (statusStr != NULL) {
-        int status = (int)[[NSString stringWithUTF8String:(const char*)statusStr] longLongValue];
-        xmlFree(statusStr);
-        self.statusCode = status;
-    }
     
-    xmlChar* statusMsgXml = xmlGetProp(node, (const xmlChar*)[TAG_STATUS_MESSAGE UTF8String]);
-    if (statusMsgXml != NULL) {
-        self.statusMessage = [NSString stringWithUTF8String:(const char*)statusMsgXml];
-        xmlFree(statusMsgXml);
-    }
-    else {
-        self.statusMessage = @"Server Error";
-    }
+    self.statusCode = state.statusCode;
+    self.statusMessage = statusMsg;
     
     if (self.statusCode == -1 && [self.statusMessage isEqualToString:@"Invalid"]) {
         // Special case handling an audio capture error which GFE doesn't
@@ -75,25 +94,8 @@
         self.statusCode = 418;
         self.statusMessage = @"Missing audio capture device. Reinstalling GeForce Experience should resolve this error.";
     }
-
-    node = node->children;
-    
-    while (node != NULL) {
-        xmlChar* nodeVal = xmlNodeListGetString(docPtr, node->xmlChildrenNode, 1);
-        
-        NSString* value;
-        if (nodeVal == NULL) {
-            value = @"";
-        } else {
-            value = [[NSString alloc] initWithCString:(const char*)nodeVal encoding:NSUTF8StringEncoding];
-        }
-        NSString* key = [[NSString alloc] initWithCString:(const char*)node->name encoding:NSUTF8StringEncoding];
-        [_elements setObject:value forKey:key];
-        xmlFree(nodeVal);
-        node = node->next;
-    }
     
-    xmlFreeDoc(docPtr);
+    _elements = elements;
     
     Log(LOG_D, @"Parsed XML data: %@", _elements);
 }
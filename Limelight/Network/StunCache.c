@@ -0,0 +1,105 @@
+//
+//  StunCache.c
+//  Moonlight
+//
+//  Copyright © 2026 Moonlight Game Streaming Project. All rights reserved.
+//
+
+#include "StunCache.h"
+
+#include <string.h>
+#include <time.h>
+
+static double getMonotonicTime(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1000000000.0;
+}
+
+void ScInit(PSTUN_CACHE cache, STUN_LOOKUP_FN lookup, const char* stunServer, unsigned short stunPort,
+            double ttl, double failureTtl)
+{
+    memset(cache, 0, sizeof(*cache));
+    pthread_mutex_init(&cache->mutex, NULL);
+    pthread_cond_init(&cache->lookupDone, NULL);
+    
+    cache->lookup = lookup;
+    strncpy(cache->stunServer, stunServer, sizeof(cache->stunServer) - 1);
+    cache->stunPort = stunPort;
+    cache->ttl = ttl;
+    cache->failureTtl = failureTtl;
+}
+
+void ScDestroy(PSTUN_CACHE cache)
+{
+    pthread_cond_destroy(&cache->lookupDone);
+    pthread_mutex_destroy(&cache->mutex);
+}
+
+void ScSetServer(PSTUN_CACHE cache, const char* stunServer, unsigned short stunPort)
+{
+    pthread_mutex_lock(&cache->mutex);
+    memset(cache->stunServer, 0, sizeof(cache->stunServer));
+    strncpy(cache->stunServer, stunServer, sizeof(cache->stunServer) - 1);
+    cache->stunPort = stunPort;
+    cache->valid = false;
+    cache->generation++;
+    pthread_mutex_unlock(&cache->mutex);
+}
+
+void ScInvalidate(PSTUN_CACHE cache)
+{
+    pthread_mutex_lock(&cache->mutex);
+    cache->valid = false;
+    cache->generation++;
+    pthread_mutex_unlock(&cache->mutex);
+}
+
+int ScFindExternalAddressIP4(PSTUN_CACHE cache, unsigned int* wanAddr)
+{
+    int err;
+    
+    pthread_mutex_lock(&cache->mutex);
+    
+    for (;;) {
+        if (cache->valid && getMonotonicTime() < cache->expiryTime) {
+            // Cached result (or the one we just waited for)
+            *wanAddr = cache->wanAddr;
+            err = cache->error;
+            pthread_mutex_unlock(&cache->mutex);
+            return err;
+        }
+        
+        if (!cache->lookupInProgress) {
+            break;
+        }
+        
+        // Share the lookup that's already running
+        pthread_cond_wait(&cache->lookupDone, &cache->mutex);
+    }
+    
+    char stunServer[STUN_SERVER_MAX_LENGTH];
+    unsigned short stunPort = cache->stunPort;
+    uint32_t generation = cache->generation;
+    memcpy(stunServer, cache->stunServer, sizeof(stunServer));
+    cache->lookupInProgress = true;
+    pthread_mutex_unlock(&cache->mutex);
+    
+    unsigned int lookupAddr = 0;
+    err = cache->lookup(stunServer, stunPort, &lookupAddr);
+    
+    pthread_mutex_lock(&cache->mutex);
+    cache->lookupInProgress = false;
+    if (generation == cache->generation) {
+        cache->valid = true;
+        cache->error = err;
+        cache->wanAddr = lookupAddr;
+        cache->expiryTime = getMonotonicTime() + (err == 0 ? cache->ttl : cache->failureTtl);
+    }
+    pthread_cond_broadcast(&cache->lookupDone);
+    pthread_mutex_unlock(&cache->mutex);
+    
+    *wanAddr = lookupAddr;
+    return err;
+}
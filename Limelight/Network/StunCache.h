@@ -0,0 +1,56 @@
+//
+//  StunCache.h
+//  Moonlight
+//
+//  Copyright © 2026 Moonlight Game Streaming Project. All rights reserved.
+//
+
+#pragma once
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+// Caches our WAN address as reported by a STUN server. Concurrent callers share
+// a single in-flight lookup, and results are reused until they expire or the
+// cache is invalidated (e.g. because the network changed).
+
+typedef int (*STUN_LOOKUP_FN)(const char* stunServer, unsigned short stunPort, unsigned int* wanAddr);
+
+#define STUN_SERVER_MAX_LENGTH 256
+
+typedef struct _STUN_CACHE {
+    pthread_mutex_t mutex;
+    pthread_cond_t lookupDone;
+    
+    STUN_LOOKUP_FN lookup;
+    char stunServer[STUN_SERVER_MAX_LENGTH];
+    unsigned short stunPort;
+    
+    // How long successful and failed lookups are reused, in seconds
+    double ttl;
+    double failureTtl;
+    
+    bool valid;
+    int error;
+    unsigned int wanAddr;
+    double expiryTime;
+    
+    bool lookupInProgress;
+    
+    // Bumped on invalidation so a lookup that started before it isn't cached
+    uint32_t generation;
+} STUN_CACHE, *PSTUN_CACHE;
+
+void ScInit(PSTUN_CACHE cache, STUN_LOOKUP_FN lookup, const char* stunServer, unsigned short stunPort,
+            double ttl, double failureTtl);
+void ScDestroy(PSTUN_CACHE cache);
+
+// Changing the server invalidates the cache
+void ScSetServer(PSTUN_CACHE cache, const char* stunServer, unsigned short stunPort);
+
+void ScInvalidate(PSTUN_CACHE cache);
+
+// Returns 0 and the WAN address in network byte order, or the lookup's error.
+// Blocks if a lookup is needed or another caller's lookup is in progress.
+int ScFindExternalAddressIP4(PSTUN_CACHE cache, unsigned int* wanAddr);
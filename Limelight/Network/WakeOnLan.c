@@ -0,0 +1,84 @@
+//
+//  WakeOnLan.c
+//  Moonlight
+//
+//  Copyright © 2026 Moonlight Game Streaming Project. All rights reserved.
+//
+
+#include "WakeOnLan.h"
+
+#include <ctype.h>
+#include <string.h>
+
+#define DEFAULT_HTTP_PORT 47989
+
+static const unsigned short staticPorts[] = {
+    9, // Standard WOL port (privileged port)
+    47009, // Port opened by Moonlight Internet Hosting Tool for WoL (non-privileged port)
+};
+
+static const unsigned short dynamicPorts[] = {
+    47998, 47999, 48000, 48002, 48010, // Ports opened by GFE/Sunshine
+};
+
+_Static_assert(sizeof(staticPorts) / sizeof(staticPorts[0]) + sizeof(dynamicPorts) / sizeof(dynamicPorts[0]) == WOL_MAX_PORTS,
+               "WOL_MAX_PORTS is out of date");
+
+static int hexValue(char c)
+{
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    c = (char)tolower((unsigned char)c);
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    return -1;
+}
+
+bool WolParseMac(const char* macString, uint8_t mac[WOL_MAC_LENGTH])
+{
+    int length = 0;
+    
+    for (const char* p = macString; *p != 0;) {
+        if (*p == ':') {
+            p++;
+            continue;
+        }
+        
+        int high = hexValue(p[0]);
+        int low = high >= 0 ? hexValue(p[1]) : -1;
+        if (low < 0 || length == WOL_MAC_LENGTH) {
+            return false;
+        }
+        
+        mac[length++] = (uint8_t)(high << 4 | low);
+        p += 2;
+    }
+    
+    return length == WOL_MAC_LENGTH;
+}
+
+void WolCreatePayload(const uint8_t mac[WOL_MAC_LENGTH], uint8_t payload[WOL_PAYLOAD_LENGTH])
+{
+    memset(payload, 0xFF, 6);
+    for (int i = 0; i < 16; i++) {
+        memcpy(&payload[6 + i * WOL_MAC_LENGTH], mac, WOL_MAC_LENGTH);
+    }
+}
+
+int WolGetPorts(unsigned short basePort, unsigned short ports[WOL_MAX_PORTS])
+{
+    int count = 0;
+    
+    for (size_t i = 0; i < sizeof(staticPorts) / sizeof(staticPorts[0]); i++) {
+        ports[count++] = staticPorts[i];
+    }
+    
+    // Offset the WoL dynamic ports by the base port
+    for (size_t i = 0; i < sizeof(dynamicPorts) / sizeof(dynamicPorts[0]); i++) {
+        ports[count++] = (unsigned short)((int)dynamicPorts[i] - DEFAULT_HTTP_PORT + basePort);
+    }
+    
+    return count;
+}
@@ -0,0 +1,31 @@
+//
+//  WakeOnLan.h
+//  Moonlight
+//
+//  Copyright © 2026 Moonlight Game Streaming Project. All rights reserved.
+//
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Builds Wake-on-LAN magic packets and works out where to send them. Sending
+// is left to the caller.
+
+#define WOL_MAC_LENGTH 6
+
+// 6 bytes of 0xFF followed by 16 copies of the MAC address
+#define WOL_PAYLOAD_LENGTH (6 + 16 * WOL_MAC_LENGTH)
+
+#define WOL_MAX_PORTS 7
+
+// Parses a MAC address like "00:1A:2B:3C:4D:5E". The colons are optional.
+// Returns false if the string isn't exactly 6 hex bytes.
+bool WolParseMac(const char* macString, uint8_t mac[WOL_MAC_LENGTH]);
+
+void WolCreatePayload(const uint8_t mac[WOL_MAC_LENGTH], uint8_t payload[WOL_PAYLOAD_LENGTH]);
+
+// Fills in the UDP ports to wake a host on, given its base HTTP port, and
+// returns how many there are
+int WolGetPorts(unsigned short basePort, unsigned short ports[WOL_MAX_PORTS]);
@@ -8,8 +8,31 @@
 
 #import "TemporaryHost.h"
 
+@class DiscoveryManager;
+
+// Outcome of waking one of a host's addresses
+@interface WakeOnLanResult : NSObject
+
+@property (nonatomic, readonly) NSString* address;
+@property (nonatomic, readonly) int resolvedAddresses;
+@property (nonatomic, readonly) int packetsSent;
+@property (nonatomic, readonly) int packetsFailed;
+
+@end
+
 @interface WakeOnLanManager : NSObject
 
-+ (void) wakeHost:(TemporaryHost*)host;
+// Resolves all of the host's addresses in parallel, then sends several bursts of
+// magic packets to each. The completion runs on a background queue once the last
+// burst has been sent.
++ (void) wakeHost:(TemporaryHost*)host completion:(void (^)(NSArray<WakeOnLanResult*>* results))completion;
+
+// Waits for discovery to see the host online, reporting how long it took. The
+// host is polled every couple of seconds meanwhile rather than on discovery's
+// offline backoff. The completion runs on a background queue.
++ (void) waitForHost:(TemporaryHost*)host discoveryManager:(DiscoveryManager*)discMan timeout:(NSTimeInterval)timeout completion:(void (^)(BOOL online, NSTimeInterval elapsed))completion;
+
+// Returns nil if the host's MAC address is missing or malformed
++ (NSData*) createPayload:(TemporaryHost*)host;
 
 @end
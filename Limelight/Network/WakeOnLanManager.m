@@ -7,24 +7,59 @@
 //
 
 #import "WakeOnLanManager.h"
+#import "DiscoveryManager.h"
 #import "Utils.h"
+#import "WakeOnLan.h"
 #import <CoreFoundation/CoreFoundation.h>
 #import <sys/socket.h>
 #import <netinet/in.h>
 #import <arpa/inet.h>
 #import <netdb.h>
 
-@implementation WakeOnLanManager
+// Wi-Fi drops broadcast frames readily, so each target gets several bursts
+#define WOL_BURST_COUNT 3
+#define WOL_BURST_INTERVAL 0.25
+
+#define WOL_ONLINE_POLL_INTERVAL 0.5
+
+// Discovery backs off to polling an offline host every 16 seconds, so we ask it
+// to poll more often while we wait
+#define WOL_ONLINE_PROBE_INTERVAL 2.0
+
+@interface WakeOnLanResult ()
+
+@property (nonatomic) NSString* address;
+@property (nonatomic) int resolvedAddresses;
+@property (nonatomic) int packetsSent;
+@property (nonatomic) int packetsFailed;
+
+@end
+
+@implementation WakeOnLanResult
+@end
+
+// A host address and what it resolved to
+@interface WakeOnLanTarget : NSObject {
+@public
+    unsigned short basePort;
+    struct addrinfo* addrs;
+}
+
+@property (nonatomic) WakeOnLanResult* result;
+
+@end
+
+@implementation WakeOnLanTarget
 
-static const int numStaticPorts = 2;
-static const int staticPorts[numStaticPorts] = {
-    9, // Standard WOL port (privileged port)
-    47009, // Port opened by Moonlight Internet Hosting Tool for WoL (non-privileged port)
-};
-static const int numDynamicPorts = 5;
-static const int dynamicPorts[numDynamicPorts] = {
-    47998, 47999, 48000, 48002, 48010, // Ports opened by GFE/Sunshine
-};
+- (void) dealloc {
+    if (addrs != NULL) {
+        freeaddrinfo(addrs);
+    }
+}
+
+@end
+
+@implementation WakeOnLanManager
 
 + (void) populateAddress:(struct sockaddr_storage*)addr withPort:(unsigned short)port {
     if (addr->ss_family == AF_INET) {
@@ -37,76 +72,127 @@ static const int dynamicPorts[numDynamicPorts] = {
     }
 }
 
-+ (void) wakeHost:(TemporaryHost*)host {
++ (void) wakeHost:(TemporaryHost*)host completion:(void (^)(NSArray<WakeOnLanResult*>* results))completion {
     NSData* wolPayload = [WakeOnLanManager createPayload:host];
-    
-    for (int i = 0; i < 5; i++) {
-        NSString* address;
-        struct addrinfo hints, *res, *curr;
-        
-        // try all ip addresses
-        if (i == 0 && host.localAddress != nil) {
-            address = host.localAddress;
-        } else if (i == 1 && host.externalAddress != nil) {
-            address = host.externalAddress;
-        } else if (i == 2 && host.address != nil) {
-            address = host.address;
-        } else if (i == 3 && host.ipv6Address != nil) {
-            address = host.ipv6Address;
-        } else if (i == 4) {
-            address = @"255.255.255.255";
-        } else {
-            // Requested address wasn't present
-            continue;
+    if (wolPayload == nil) {
+        Log(LOG_E, @"Invalid MAC address for WOL: %@", host.mac);
+        if (completion != nil) {
+            dispatch_async(dispatch_get_global_queue(QOS_CLASS_UTILITY, 0), ^{
+                completion(@[]);
+            });
         }
+        return;
+    }
+    
+    // try all ip addresses
+    NSMutableArray<NSString*>* addresses = [[NSMutableArray alloc] init];
+    if (host.localAddress != nil) {
+        [addresses addObject:host.localAddress];
+    }
+    if (host.externalAddress != nil) {
+        [addresses addObject:host.externalAddress];
+    }
+    if (host.address != nil) {
+        [addresses addObject:host.address];
+    }
+    if (host.ipv6Address != nil) {
+        [addresses addObject:host.ipv6Address];
+    }
+    [addresses addObject:@"255.255.255.255"];
+    
+    // Resolve them all at once rather than waiting on each DNS lookup in turn
+    NSMutableArray<WakeOnLanTarget*>* targets = [[NSMutableArray alloc] init];
+    dispatch_group_t resolveGroup = dispatch_group_create();
+    for (NSString* address in addresses) {
+        WakeOnLanTarget* target = [[WakeOnLanTarget alloc] init];
+        target.result = [[WakeOnLanResult alloc] init];
+        target.result.address = address;
+        [targets addObject:target];
         
-        // Get the raw address and base port from the address+port string
-        NSString* rawAddress = [Utils addressPortStringToAddress:address];
-        unsigned short basePort = [Utils addressPortStringToPort:address];
-        
-        memset(&hints, 0, sizeof(hints));
-        hints.ai_family = AF_UNSPEC;
-        hints.ai_flags = AI_ADDRCONFIG;
-        if (getaddrinfo([rawAddress UTF8String], NULL, &hints, &res) != 0 || res == NULL) {
-            // Failed to resolve address
-            Log(LOG_E, @"Failed to resolve WOL address");
-            continue;
-        }
+        dispatch_group_async(resolveGroup, dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0), ^{
+            // Get the raw address and base port from the address+port string
+            NSString* rawAddress = [Utils addressPortStringToAddress:address];
+            target->basePort = [Utils addressPortStringToPort:address];
+            
+            struct addrinfo hints, *res;
+            memset(&hints, 0, sizeof(hints));
+            hints.ai_family = AF_UNSPEC;
+            hints.ai_socktype = SOCK_DGRAM;
+            hints.ai_flags = AI_ADDRCONFIG;
+            if (rawAddress == nil || getaddrinfo([rawAddress UTF8String], NULL, &hints, &res) != 0 || res == NULL) {
+                // Failed to resolve address
+                Log(LOG_E, @"Failed to resolve WOL address: %@", address);
+                return;
+            }
+            
+            target->addrs = res;
+            for (struct addrinfo* curr = res; curr != NULL; curr = curr->ai_next) {
+                target.result.resolvedAddresses++;
+            }
+        });
+    }
+    
+    dispatch_queue_t wolQueue = dispatch_queue_create("Wake-on-LAN", DISPATCH_QUEUE_SERIAL);
+    dispatch_group_notify(resolveGroup, wolQueue, ^{
+        // One socket per address family is shared by every target and burst
+        int ipv4Socket = [WakeOnLanManager createSocketForFamily:AF_INET];
+        int ipv6Socket = [WakeOnLanManager createSocketForFamily:AF_INET6];
         
-        // Try all addresses that this DNS name resolves to. We have
-        // to create a new socket each time because the addresses
-        // may be different address families.
-        for (curr = res; curr != NULL; curr = curr->ai_next) {
-            int wolSocket;
-            int val;
+        [WakeOnLanManager sendBurst:0 toTargets:targets ipv4Socket:ipv4Socket ipv6Socket:ipv6Socket payload:wolPayload onQueue:wolQueue completion:^{
+            if (ipv4Socket >= 0) {
+                close(ipv4Socket);
+            }
+            if (ipv6Socket >= 0) {
+                close(ipv6Socket);
+            }
+            
+            NSMutableArray<WakeOnLanResult*>* results = [[NSMutableArray alloc] init];
+            for (WakeOnLanTarget* target in targets) {
+                Log(LOG_I, @"WOL to %@: %d addresses, %d packets sent, %d failed",
+                    target.result.address, target.result.resolvedAddresses, target.result.packetsSent, target.result.packetsFailed);
+                [results addObject:target.result];
+            }
             
-            wolSocket = socket(curr->ai_family, SOCK_DGRAM, IPPROTO_UDP);
+            if (completion != nil) {
+                completion(results);
+            }
+        }];
+    });
+}
+
++ (int) createSocketForFamily:(int)family {
+    int wolSocket = socket(family, SOCK_DGRAM, IPPROTO_UDP);
+    if (wolSocket < 0) {
+        // This is expected for IPv6 on networks without it
+        Log(LOG_W, @"Failed to create WOL socket for address family %d: %d", family, errno);
+        return -1;
+    }
+    
+    int val = 1;
+    setsockopt(wolSocket, SOL_SOCKET, SO_BROADCAST, &val, sizeof(val));
+    
+    return wolSocket;
+}
+
++ (void) sendBurst:(int)burst toTargets:(NSArray<WakeOnLanTarget*>*)targets ipv4Socket:(int)ipv4Socket ipv6Socket:(int)ipv6Socket
+           payload:(NSData*)wolPayload onQueue:(dispatch_queue_t)queue completion:(void (^)(void))completion {
+    for (WakeOnLanTarget* target in targets) {
+        unsigned short ports[WOL_MAX_PORTS];
+        int portCount = WolGetPorts(target->basePort, ports);
+        
+        for (struct addrinfo* curr = target->addrs; curr != NULL; curr = curr->ai_next) {
+            int wolSocket = curr->ai_family == AF_INET ? ipv4Socket : (curr->ai_family == AF_INET6 ? ipv6Socket : -1);
             if (wolSocket < 0) {
-                Log(LOG_E, @"Failed to create WOL socket");
+                target.result.packetsFailed += portCount;
                 continue;
             }
             
-            val = 1;
-            setsockopt(wolSocket, SOL_SOCKET, SO_BROADCAST, &val, sizeof(val));
-            
             struct sockaddr_storage addr;
             memset(&addr, 0, sizeof(addr));
             memcpy(&addr, curr->ai_addr, curr->ai_addrlen);
             
-            for (int j = 0; j < numStaticPorts; j++) {
-                [WakeOnLanManager populateAddress:&addr withPort:staticPorts[j]];
-                long err = sendto(wolSocket,
-                                 [wolPayload bytes],
-                                 [wolPayload length],
-                                 0,
-                                 (struct sockaddr*)&addr,
-                                 curr->ai_addrlen);
-                Log(LOG_I, @"Sending WOL packet to port %u returned: %ld", staticPorts[j], err);
-            }
-            
-            for (int j = 0; j < numDynamicPorts; j++) {
-                // Offset the WoL dynamic ports by the base port
-                unsigned short port = ((int)dynamicPorts[j] - 47989) + basePort;
+            for (int j = 0; j < portCount; j++) {
+                unsigned short port = ports[j];
                 
                 [WakeOnLanManager populateAddress:&addr withPort:port];
                 long err = sendto(wolSocket,
@@ -115,37 +201,63 @@ static const int dynamicPorts[numDynamicPorts] = {
                                  0,
                                  (struct sockaddr*)&addr,
                                  curr->ai_addrlen);
-                Log(LOG_I, @"Sending WOL packet to port %u returned: %ld", port, err);
+                if (err < 0) {
+                    Log(LOG_D, @"Sending WOL packet to %@ port %u failed: %d", target.result.address, port, errno);
+                    target.result.packetsFailed++;
+                }
+                else {
+                    target.result.packetsSent++;
+                }
             }
-            
-            close(wolSocket);
         }
-        freeaddrinfo(res);
+    }
+    
+    if (burst + 1 < WOL_BURST_COUNT) {
+        dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(WOL_BURST_INTERVAL * NSEC_PER_SEC)), queue, ^{
+            [WakeOnLanManager sendBurst:burst + 1 toTargets:targets ipv4Socket:ipv4Socket ipv6Socket:ipv6Socket payload:wolPayload onQueue:queue completion:completion];
+        });
+    }
+    else {
+        completion();
     }
 }
 
-+ (NSData*) createPayload:(TemporaryHost*)host {
-    NSMutableData* payload = [[NSMutableData alloc] initWithCapacity:102];
-    
-    // 6 bytes of FF
-    UInt8 header = 0xFF;
-    for (int i = 0; i < 6; i++) {
-        [payload appendBytes:&header length:1];
++ (void) waitForHost:(TemporaryHost*)host discoveryManager:(DiscoveryManager*)discMan timeout:(NSTimeInterval)timeout completion:(void (^)(BOOL online, NSTimeInterval elapsed))completion {
+    [WakeOnLanManager pollHost:host discoveryManager:discMan startTime:[NSDate date] nextProbe:0 timeout:timeout completion:completion];
+}
+
++ (void) pollHost:(TemporaryHost*)host discoveryManager:(DiscoveryManager*)discMan startTime:(NSDate*)startTime nextProbe:(NSTimeInterval)nextProbe
+          timeout:(NSTimeInterval)timeout completion:(void (^)(BOOL online, NSTimeInterval elapsed))completion {
+    NSTimeInterval elapsed = -[startTime timeIntervalSinceNow];
+    if (host.state == StateOnline) {
+        completion(YES, elapsed);
     }
-    
-    // 16 repitiions of MAC address
-    NSData* macAddress = [self macStringToBytes:host.mac];
-    for (int j = 0; j < 16; j++) {
-        [payload appendData:macAddress];
+    else if (elapsed >= timeout) {
+        completion(NO, elapsed);
+    }
+    else {
+        if (elapsed >= nextProbe) {
+            // host.state only changes when discovery polls the host
+            [discMan pollHostNow:host];
+            nextProbe = elapsed + WOL_ONLINE_PROBE_INTERVAL;
+        }
+        
+        dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(WOL_ONLINE_POLL_INTERVAL * NSEC_PER_SEC)), dispatch_get_global_queue(QOS_CLASS_UTILITY, 0), ^{
+            [WakeOnLanManager pollHost:host discoveryManager:discMan startTime:startTime nextProbe:nextProbe timeout:timeout completion:completion];
+        });
     }
-    
-    return payload;
 }
 
-+ (NSData*) macStringToBytes:(NSString*)mac {
-    NSString* macString = [mac stringByReplacingOccurrencesOfString:@":" withString:@""];
-    Log(LOG_D, @"MAC: %@", macString);
-    return [Utils hexToBytes:macString];
++ (NSData*) createPayload:(TemporaryHost*)host {
+    uint8_t mac[WOL_MAC_LENGTH];
+    uint8_t payload[WOL_PAYLOAD_LENGTH];
+    
+    if (host.mac == nil || !WolParseMac([host.mac UTF8String], mac)) {
+        return nil;
+    }
+    
+    WolCreatePayload(mac, payload);
+    return [NSData dataWithBytes:payload length:sizeof(payload)];
 }
 
 @end
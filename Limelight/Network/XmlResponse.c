@@ -0,0 +1,217 @@
+//
+//  XmlResponse.c
+//  Moonlight
+//
+//  Copyright © 2026 Moonlight Game Streaming Project. All rights reserved.
+//
+
+#include "XmlResponse.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include <libxml/xmlreader.h>
+
+#define PARSE_OPTIONS (XML_PARSE_IGNORE_ENC | XML_PARSE_NONET | XML_PARSE_NOWARNING | XML_PARSE_NOERROR)
+
+enum {
+    APP_FIELD_ID,
+    APP_FIELD_TITLE,
+    APP_FIELD_HDR_SUPPORTED,
+    APP_FIELD_INSTALL_PATH,
+    APP_FIELD_COUNT
+};
+
+static const char* TAG_STATUS_CODE = "status_code";
+static const char* TAG_STATUS_MESSAGE = "status_message";
+static const char* TAG_APP = "App";
+static const char* APP_FIELD_TAGS[APP_FIELD_COUNT] = { "ID", "AppTitle", "IsHdrSupported", "AppInstallPath" };
+
+static xmlTextReaderPtr openReader(const void* data, int length)
+{
+    if (data == NULL) {
+        return NULL;
+    }
+    
+    return xmlReaderForMemory(data, length, NULL, "UTF-8", PARSE_OPTIONS);
+}
+
+static void reportRoot(xmlTextReaderPtr reader, PXR_CALLBACKS callbacks, void* context)
+{
+    xmlChar* statusCode = xmlTextReaderGetAttribute(reader, (const xmlChar*)TAG_STATUS_CODE);
+    xmlChar* statusMessage = xmlTextReaderGetAttribute(reader, (const xmlChar*)TAG_STATUS_MESSAGE);
+    
+    callbacks->root(context, (const char*)statusCode, (const char*)statusMessage);
+    
+    if (statusCode != NULL) {
+        xmlFree(statusCode);
+    }
+    if (statusMessage != NULL) {
+        xmlFree(statusMessage);
+    }
+}
+
+static bool isTextNode(int nodeType)
+{
+    return nodeType == XML_READER_TYPE_TEXT || nodeType == XML_READER_TYPE_CDATA ||
+           nodeType == XML_READER_TYPE_WHITESPACE || nodeType == XML_READER_TYPE_SIGNIFICANT_WHITESPACE;
+}
+
+// Reads the text directly inside the element the reader is on, skipping any
+// child elements, and leaves the reader on the element's end tag. Returns NULL
+// if there's no text. *ret is set to what xmlTextReaderRead() last returned.
+static xmlChar* readElementText(xmlTextReaderPtr reader, int* ret)
+{
+    int depth = xmlTextReaderDepth(reader);
+    xmlChar* text = NULL;
+    
+    *ret = 1;
+    if (xmlTextReaderIsEmptyElement(reader)) {
+        return NULL;
+    }
+    
+    while ((*ret = xmlTextReaderRead(reader)) == 1) {
+        int nodeType = xmlTextReaderNodeType(reader);
+        int nodeDepth = xmlTextReaderDepth(reader);
+        
+        if (nodeType == XML_READER_TYPE_END_ELEMENT && nodeDepth == depth) {
+            return text;
+        }
+        else if (nodeDepth == depth + 1 && isTextNode(nodeType)) {
+            text = xmlStrcat(text, xmlTextReaderConstValue(reader));
+        }
+    }
+    
+    if (text != NULL) {
+        xmlFree(text);
+    }
+    return NULL;
+}
+
+static XR_RESULT finishParse(xmlTextReaderPtr reader, int ret, bool foundRoot)
+{
+    xmlFreeTextReader(reader);
+    
+    if (ret != 0) {
+        return XR_PARSE_ERROR;
+    }
+    else if (!foundRoot) {
+        return XR_NO_ROOT;
+    }
+    
+    return XR_OK;
+}
+
+XR_RESULT XrParseElements(const void* data, int length, PXR_CALLBACKS callbacks, void* context)
+{
+    xmlTextReaderPtr reader = openReader(data, length);
+    bool foundRoot = false;
+    int ret;
+    
+    if (reader == NULL) {
+        return XR_PARSE_ERROR;
+    }
+    
+    while ((ret = xmlTextReaderRead(reader)) == 1) {
+        if (xmlTextReaderNodeType(reader) != XML_READER_TYPE_ELEMENT) {
+            continue;
+        }
+        
+        int depth = xmlTextReaderDepth(reader);
+        if (depth == 0) {
+            foundRoot = true;
+            reportRoot(reader, callbacks, context);
+        }
+        else if (depth == 1) {
+            // Names come from the reader's dictionary, so they outlive the read
+            const xmlChar* name = xmlTextReaderConstName(reader);
+            xmlChar* value = readElementText(reader, &ret);
+            if (ret != 1) {
+                break;
+            }
+            
+            callbacks->element(context, (const char*)name, value != NULL ? (const char*)value : "");
+            if (value != NULL) {
+                xmlFree(value);
+            }
+        }
+    }
+    
+    return finishParse(reader, ret, foundRoot);
+}
+
+static void clearAppFields(xmlChar* fields[APP_FIELD_COUNT])
+{
+    for (int i = 0; i < APP_FIELD_COUNT; i++) {
+        if (fields[i] != NULL) {
+            xmlFree(fields[i]);
+            fields[i] = NULL;
+        }
+    }
+}
+
+XR_RESULT XrParseAppList(const void* data, int length, PXR_CALLBACKS callbacks, void* context)
+{
+    xmlTextReaderPtr reader = openReader(data, length);
+    xmlChar* fields[APP_FIELD_COUNT] = { NULL };
+    bool foundRoot = false;
+    bool inApp = false;
+    int ret;
+    
+    if (reader == NULL) {
+        return XR_PARSE_ERROR;
+    }
+    
+    // Each app is reported as its end tag goes by
+    while ((ret = xmlTextReaderRead(reader)) == 1) {
+        int nodeType = xmlTextReaderNodeType(reader);
+        int depth = xmlTextReaderDepth(reader);
+        
+        if (nodeType == XML_READER_TYPE_ELEMENT) {
+            const xmlChar* name = xmlTextReaderConstName(reader);
+            
+            if (depth == 0) {
+                foundRoot = true;
+                reportRoot(reader, callbacks, context);
+            }
+            else if (depth == 1 && xmlStrEqual(name, (const xmlChar*)TAG_APP) && !xmlTextReaderIsEmptyElement(reader)) {
+                inApp = true;
+                clearAppFields(fields);
+            }
+            else if (depth == 2 && inApp) {
+                for (int i = 0; i < APP_FIELD_COUNT; i++) {
+                    if (!xmlStrEqual(name, (const xmlChar*)APP_FIELD_TAGS[i])) {
+                        continue;
+                    }
+                    
+                    xmlChar* value = readElementText(reader, &ret);
+                    if (value != NULL) {
+                        if (fields[i] != NULL) {
+                            xmlFree(fields[i]);
+                        }
+                        fields[i] = value;
+                    }
+                    break;
+                }
+                if (ret != 1) {
+                    break;
+                }
+            }
+        }
+        else if (nodeType == XML_READER_TYPE_END_ELEMENT && depth == 1 && inApp) {
+            inApp = false;
+            
+            if (fields[APP_FIELD_ID] != NULL) {
+                XR_APP app;
+                app.id = (const char*)fields[APP_FIELD_ID];
+                app.title = fields[APP_FIELD_TITLE] != NULL ? (const char*)fields[APP_FIELD_TITLE] : "";
+                app.hdrSupported = fields[APP_FIELD_HDR_SUPPORTED] != NULL ? (const char*)fields[APP_FIELD_HDR_SUPPORTED] : "0";
+                app.installPath = (const char*)fields[APP_FIELD_INSTALL_PATH];
+                callbacks->app(context, &app);
+            }
+        }
+    }
+    
+    clearAppFields(fields);
+    return finishParse(reader, ret, foundRoot);
+}
@@ -0,0 +1,45 @@
+//
+//  XmlResponse.h
+//  Moonlight
+//
+//  Copyright © 2026 Moonlight Game Streaming Project. All rights reserved.
+//
+
+#pragma once
+
+// Streams a host's XML response once with xmlTextReader instead of building a
+// DOM for it. Values are the text directly inside an element, as the DOM walk
+// with xmlNodeListGetString() used to read them.
+//
+// GFE declares UTF-16 but actually sends UTF-8, so the encoding declaration
+// is ignored and the body is always read as UTF-8.
+
+typedef enum {
+    XR_OK,
+    XR_PARSE_ERROR,
+    XR_NO_ROOT,
+} XR_RESULT;
+
+typedef struct _XR_APP {
+    const char* id;
+    const char* title;          // "" if missing
+    const char* hdrSupported;   // "0" if missing
+    const char* installPath;    // NULL if missing
+} XR_APP, *PXR_APP;
+
+// The strings passed to the callbacks are only valid during the call, and
+// they're passed before the whole document has been parsed, so the caller
+// must throw away what it collected unless XR_OK is returned
+typedef struct _XR_CALLBACKS {
+    // The root's status_code and status_message attributes, NULL if missing
+    void (*root)(void* context, const char* statusCode, const char* statusMessage);
+    
+    // Each child of the root, for XrParseElements()
+    void (*element)(void* context, const char* name, const char* value);
+    
+    // Each App child of the root that has an ID, for XrParseAppList()
+    void (*app)(void* context, PXR_APP app);
+} XR_CALLBACKS, *PXR_CALLBACKS;
+
+XR_RESULT XrParseElements(const void* data, int length, PXR_CALLBACKS callbacks, void* context);
+XR_RESULT XrParseAppList(const void* data, int length, PXR_CALLBACKS callbacks, void* context);
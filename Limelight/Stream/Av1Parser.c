@@ -0,0 +1,365 @@
+//
+//  Av1Parser.c
+//  Moonlight
+//
+//  Copyright © 2026 Moonlight Game Streaming Project. All rights reserved.
+//
+
+#include "Av1Parser.h"
+
+#include <string.h>
+
+#define OBU_SEQUENCE_HEADER 1
+#define OBU_METADATA 5
+
+#define CP_BT_709 1
+#define CP_UNSPECIFIED 2
+#define TC_UNSPECIFIED 2
+#define TC_SRGB 13
+#define MC_IDENTITY 0
+#define MC_UNSPECIFIED 2
+#define CSP_UNKNOWN 0
+
+typedef struct _BIT_READER {
+    const uint8_t* data;
+    size_t length;
+    size_t bitOffset;
+    bool overrun;
+} BIT_READER, *PBIT_READER;
+
+static uint32_t readBits(PBIT_READER reader, int bits)
+{
+    uint32_t value = 0;
+    
+    for (int i = 0; i < bits; i++) {
+        size_t byteOffset = reader->bitOffset >> 3;
+        if (byteOffset >= reader->length) {
+            reader->overrun = true;
+            return 0;
+        }
+        
+        value = (value << 1) | ((reader->data[byteOffset] >> (7 - (reader->bitOffset & 7))) & 1);
+        reader->bitOffset++;
+    }
+    
+    return value;
+}
+
+static uint32_t readUvlc(PBIT_READER reader)
+{
+    int leadingZeros = 0;
+    
+    while (!readBits(reader, 1)) {
+        if (reader->overrun || ++leadingZeros >= 32) {
+            reader->overrun = true;
+            return 0;
+        }
+    }
+    
+    return (uint32_t)((1ULL << leadingZeros) - 1) + readBits(reader, leadingZeros);
+}
+
+// Reads the OBU header at data and returns the total length of the OBU or 0 if it is malformed
+static size_t readObuHeader(const uint8_t* data, size_t length, int* type, size_t* payloadOffset)
+{
+    size_t offset = 0;
+    uint8_t obuHeader = data[offset++];
+    
+    // obu_forbidden_bit
+    if (obuHeader & 0x80) {
+        return 0;
+    }
+    
+    *type = (obuHeader >> 3) & 0xF;
+    
+    // obu_extension_header
+    if (obuHeader & 0x04) {
+        offset++;
+    }
+    
+    size_t obuSize;
+    if (obuHeader & 0x02) {
+        // obu_size is leb128() coded
+        obuSize = 0;
+        for (int i = 0; ; i++) {
+            if (i == 8 || offset >= length) {
+                return 0;
+            }
+            
+            uint8_t leb128Byte = data[offset++];
+            obuSize |= (uint64_t)(leb128Byte & 0x7F) << (i * 7);
+            if (!(leb128Byte & 0x80)) {
+                break;
+            }
+        }
+    }
+    else {
+        // OBUs without a size field extend to the end of the data
+        if (offset > length) {
+            return 0;
+        }
+        obuSize = length - offset;
+    }
+    
+    if (offset > length || obuSize > length - offset) {
+        return 0;
+    }
+    
+    *payloadOffset = offset;
+    return offset + obuSize;
+}
+
+static void readColorConfig(PBIT_READER reader, PAV1_SEQUENCE_HEADER seqHeader)
+{
+    bool highBitDepth = readBits(reader, 1);
+    if (seqHeader->profile == 2 && highBitDepth) {
+        seqHeader->bitDepth = readBits(reader, 1) ? 12 : 10;
+    }
+    else {
+        seqHeader->bitDepth = highBitDepth ? 10 : 8;
+    }
+    
+    seqHeader->monochrome = seqHeader->profile != 1 && readBits(reader, 1);
+    
+    if (readBits(reader, 1)) { // color_description_present_flag
+        seqHeader->colorPrimaries = readBits(reader, 8);
+        seqHeader->transferCharacteristics = readBits(reader, 8);
+        seqHeader->matrixCoefficients = readBits(reader, 8);
+    }
+    else {
+        seqHeader->colorPrimaries = CP_UNSPECIFIED;
+        seqHeader->transferCharacteristics = TC_UNSPECIFIED;
+        seqHeader->matrixCoefficients = MC_UNSPECIFIED;
+    }
+    
+    seqHeader->chromaSamplePosition = CSP_UNKNOWN;
+    
+    if (seqHeader->monochrome) {
+        seqHeader->colorRange = readBits(reader, 1);
+        seqHeader->chromaSubsamplingX = 1;
+        seqHeader->chromaSubsamplingY = 1;
+        return;
+    }
+    else if (seqHeader->colorPrimaries == CP_BT_709 &&
+             seqHeader->transferCharacteristics == TC_SRGB &&
+             seqHeader->matrixCoefficients == MC_IDENTITY) {
+        seqHeader->colorRange = 1;
+        seqHeader->chromaSubsamplingX = 0;
+        seqHeader->chromaSubsamplingY = 0;
+        return;
+    }
+    
+    seqHeader->colorRange = readBits(reader, 1);
+    if (seqHeader->profile == 0) {
+        seqHeader->chromaSubsamplingX = 1;
+        seqHeader->chromaSubsamplingY = 1;
+    }
+    else if (seqHeader->profile == 1) {
+        seqHeader->chromaSubsamplingX = 0;
+        seqHeader->chromaSubsamplingY = 0;
+    }
+    else if (seqHeader->bitDepth == 12) {
+        seqHeader->chromaSubsamplingX = readBits(reader, 1);
+        seqHeader->chromaSubsamplingY = seqHeader->chromaSubsamplingX ? readBits(reader, 1) : 0;
+    }
+    else {
+        seqHeader->chromaSubsamplingX = 1;
+        seqHeader->chromaSubsamplingY = 0;
+    }
+    
+    if (seqHeader->chromaSubsamplingX && seqHeader->chromaSubsamplingY) {
+        seqHeader->chromaSamplePosition = readBits(reader, 2);
+    }
+    
+    // We don't need anything after the color config (separate_uv_delta_q onwards)
+}
+
+// Decodes sequence_header_obu() up to and including color_config()
+static bool readSequenceHeader(const uint8_t* payload, size_t length, PAV1_SEQUENCE_HEADER seqHeader)
+{
+    BIT_READER reader = { payload, length, 0, false };
+    
+    seqHeader->profile = readBits(&reader, 3);
+    readBits(&reader, 1); // still_picture
+    bool reducedStillPictureHeader = readBits(&reader, 1);
+    
+    if (reducedStillPictureHeader) {
+        seqHeader->level = readBits(&reader, 5);
+        seqHeader->tier = 0;
+    }
+    else {
+        bool decoderModelInfoPresent = false;
+        int bufferDelayLength = 0;
+        
+        if (readBits(&reader, 1)) { // timing_info_present_flag
+            readBits(&reader, 32); // num_units_in_display_tick
+            readBits(&reader, 32); // time_scale
+            if (readBits(&reader, 1)) { // equal_picture_interval
+                readUvlc(&reader); // num_ticks_per_picture_minus_1
+            }
+            
+            decoderModelInfoPresent = readBits(&reader, 1);
+            if (decoderModelInfoPresent) {
+                bufferDelayLength = readBits(&reader, 5) + 1;
+                readBits(&reader, 32); // num_units_in_decoding_tick
+                readBits(&reader, 5); // buffer_removal_time_length_minus_1
+                readBits(&reader, 5); // frame_presentation_time_length_minus_1
+            }
+        }
+        
+        bool initialDisplayDelayPresent = readBits(&reader, 1);
+        int operatingPoints = readBits(&reader, 5) + 1;
+        for (int i = 0; i < operatingPoints; i++) {
+            readBits(&reader, 12); // operating_point_idc
+            int levelIdx = readBits(&reader, 5);
+            int tier = levelIdx > 7 ? readBits(&reader, 1) : 0;
+            
+            // av1C describes the first operating point
+            if (i == 0) {
+                seqHeader->level = levelIdx;
+                seqHeader->tier = tier;
+            }
+            
+            if (decoderModelInfoPresent && readBits(&reader, 1)) { // decoder_model_present_for_this_op
+                readBits(&reader, bufferDelayLength); // decoder_buffer_delay
+                readBits(&reader, bufferDelayLength); // encoder_buffer_delay
+                readBits(&reader, 1); // low_delay_mode_flag
+            }
+            
+            if (initialDisplayDelayPresent && readBits(&reader, 1)) { // initial_display_delay_present_for_this_op
+                readBits(&reader, 4); // initial_display_delay_minus_1
+            }
+        }
+    }
+    
+    int frameWidthBits = readBits(&reader, 4) + 1;
+    int frameHeightBits = readBits(&reader, 4) + 1;
+    seqHeader->maxFrameWidth = readBits(&reader, frameWidthBits) + 1;
+    seqHeader->maxFrameHeight = readBits(&reader, frameHeightBits) + 1;
+    
+    if (!reducedStillPictureHeader && readBits(&reader, 1)) { // frame_id_numbers_present_flag
+        readBits(&reader, 4); // delta_frame_id_length_minus_2
+        readBits(&reader, 3); // additional_frame_id_length_minus_1
+    }
+    
+    readBits(&reader, 1); // use_128x128_superblock
+    readBits(&reader, 1); // enable_filter_intra
+    readBits(&reader, 1); // enable_intra_edge_filter
+    
+    if (!reducedStillPictureHeader) {
+        readBits(&reader, 1); // enable_interintra_compound
+        readBits(&reader, 1); // enable_masked_compound
+        readBits(&reader, 1); // enable_warped_motion
+        readBits(&reader, 1); // enable_dual_filter
+        
+        bool enableOrderHint = readBits(&reader, 1);
+        if (enableOrderHint) {
+            readBits(&reader, 1); // enable_jnt_comp
+            readBits(&reader, 1); // enable_ref_frame_mvs
+        }
+        
+        int forceScreenContentTools = 2; // SELECT_SCREEN_CONTENT_TOOLS
+        if (!readBits(&reader, 1)) { // seq_choose_screen_content_tools
+            forceScreenContentTools = readBits(&reader, 1);
+        }
+        
+        if (forceScreenContentTools > 0 && !readBits(&reader, 1)) { // seq_choose_integer_mv
+            readBits(&reader, 1); // seq_force_integer_mv
+        }
+        
+        if (enableOrderHint) {
+            readBits(&reader, 3); // order_hint_bits_minus_1
+        }
+    }
+    
+    readBits(&reader, 1); // enable_superres
+    readBits(&reader, 1); // enable_cdef
+    readBits(&reader, 1); // enable_restoration
+    
+    readColorConfig(&reader, seqHeader);
+    
+    return !reader.overrun;
+}
+
+bool Av1ParseTemporalUnit(const uint8_t* data, size_t length, PAV1_SEQUENCE_HEADER seqHeader)
+{
+    bool foundSequenceHeader = false;
+    size_t offset;
+    
+    memset(seqHeader, 0, sizeof(*seqHeader));
+    seqHeader->configLength = AV1_CONFIG_HEADER_SIZE;
+    
+    // Find and decode the sequence header. Other OBUs are skipped without looking at their payload.
+    for (offset = 0; offset < length; ) {
+        int type;
+        size_t payloadOffset;
+        size_t obuLength = readObuHeader(&data[offset], length - offset, &type, &payloadOffset);
+        if (obuLength == 0) {
+            return false;
+        }
+        
+        if (type == OBU_SEQUENCE_HEADER) {
+            // FFmpeg rejects temporal units with more than one sequence header and so do we
+            if (foundSequenceHeader || obuLength == payloadOffset) {
+                return false;
+            }
+            
+            if (!readSequenceHeader(&data[offset + payloadOffset], obuLength - payloadOffset, seqHeader)) {
+                return false;
+            }
+            
+            seqHeader->obuOffset = offset;
+            seqHeader->obuLength = obuLength;
+            seqHeader->configLength += obuLength;
+            foundSequenceHeader = true;
+        }
+        else if (type == OBU_METADATA) {
+            if (obuLength == payloadOffset) {
+                return false;
+            }
+            
+            seqHeader->configLength += obuLength;
+        }
+        
+        offset += obuLength;
+    }
+    
+    return foundSequenceHeader;
+}
+
+void Av1WriteCodecConfiguration(const uint8_t* data, size_t length, PAV1_SEQUENCE_HEADER seqHeader,
+                                uint8_t* config)
+{
+    size_t configLength;
+    size_t offset;
+    
+    // Write the av1C header
+    config[0] = 0x81; // marker and version
+    config[1] = (uint8_t)((seqHeader->profile << 5) | seqHeader->level);
+    config[2] = (uint8_t)((seqHeader->tier << 7) |
+                          ((seqHeader->bitDepth > 8) << 6) |
+                          ((seqHeader->bitDepth == 12) << 5) |
+                          (seqHeader->monochrome << 4) |
+                          (seqHeader->chromaSubsamplingX << 3) |
+                          (seqHeader->chromaSubsamplingY << 2) |
+                          seqHeader->chromaSamplePosition);
+    config[3] = 0; // no initial_presentation_delay
+    configLength = AV1_CONFIG_HEADER_SIZE;
+    
+    // The sequence header OBU comes first in configOBUs, followed by any metadata OBUs
+    memcpy(&config[configLength], &data[seqHeader->obuOffset], seqHeader->obuLength);
+    configLength += seqHeader->obuLength;
+    
+    for (offset = 0; offset < length; ) {
+        int type;
+        size_t payloadOffset;
+        size_t obuLength = readObuHeader(&data[offset], length - offset, &type, &payloadOffset);
+        
+        if (type == OBU_METADATA) {
+            memcpy(&config[configLength], &data[offset], obuLength);
+            configLength += obuLength;
+        }
+        
+        offset += obuLength;
+    }
+}
@@ -0,0 +1,53 @@
+//
+//  Av1Parser.h
+//  Moonlight
+//
+//  Copyright © 2026 Moonlight Game Streaming Project. All rights reserved.
+//
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Minimal AV1 bitstream parser for building format descriptions. Only the
+// sequence header OBU is decoded; every other OBU is skipped by its size.
+
+#define AV1_CONFIG_HEADER_SIZE 4
+
+typedef struct _AV1_SEQUENCE_HEADER {
+    int profile;
+    int level;
+    int tier;
+    int bitDepth;
+    bool monochrome;
+    int chromaSubsamplingX;
+    int chromaSubsamplingY;
+    int chromaSamplePosition;
+    int colorPrimaries;
+    int transferCharacteristics;
+    int matrixCoefficients;
+    int colorRange;
+    int maxFrameWidth;
+    int maxFrameHeight;
+    
+    // Location of the whole sequence header OBU within the temporal unit
+    size_t obuOffset;
+    size_t obuLength;
+    
+    // Size of the av1C payload: the header, the sequence header OBU and any metadata OBUs
+    size_t configLength;
+} AV1_SEQUENCE_HEADER, *PAV1_SEQUENCE_HEADER;
+
+// Parses the sequence header in a temporal unit.
+// Returns false if the data is malformed or doesn't contain exactly one sequence header.
+bool Av1ParseTemporalUnit(const uint8_t* data, size_t length, PAV1_SEQUENCE_HEADER seqHeader);
+
+// Writes the AV1 Codec Configuration Box (av1C) payload for a temporal unit that was
+// parsed by Av1ParseTemporalUnit() to config, which must hold seqHeader->configLength
+// bytes. The box matches the output of FFmpeg's ff_isom_write_av1c() with
+// write_seq_header set: the 4 byte header followed by the sequence header OBU and
+// any metadata OBUs.
+void Av1WriteCodecConfiguration(const uint8_t* data, size_t length, PAV1_SEQUENCE_HEADER seqHeader,
+                                uint8_t* config);
@@ -21,6 +21,8 @@ typedef struct {
     int framesWithHostProcessingLatency;
     int maxHostProcessingLatency;
     int minHostProcessingLatency;
+    int totalDecodeQueueDepth;
+    int maxDecodeQueueDepth;
 } video_stats_t;
 
 @interface Connection : NSOperation <NSStreamDelegate>
@@ -16,6 +16,8 @@
 
 #include "Limelight.h"
 #include "opus_multistream.h"
+#include "PcmRing.h"
+#include "SeqLock.h"
 
 @implementation Connection {
     SERVER_INFORMATION _serverInfo;
@@ -34,24 +36,30 @@ static OpusMSDecoder* opusDecoder;
 static id<ConnectionCallbacks> _callbacks;
 static int lastFrameNumber;
 static int activeVideoFormat;
+static int videoBitrate;
 static video_stats_t currentVideoStats;
 static video_stats_t lastVideoStats;
-static NSLock* videoStatsLock;
+static SEQ_LOCK videoStatsSeqLock;
 
 static SDL_AudioDeviceID audioDevice;
 static OPUS_MULTISTREAM_CONFIGURATION audioConfig;
 static void* audioBuffer;
 static int audioFrameSize;
+static PCM_RING audioRing;
+static bool audioRingInitialized;
 
 static VideoDecoderRenderer* renderer;
 
 int DrDecoderSetup(int videoFormat, int width, int height, int redrawRate, void* context, int drFlags)
 {
-    [renderer setupWithVideoFormat:videoFormat width:width height:height frameRate:redrawRate];
+    [renderer setupWithVideoFormat:videoFormat width:width height:height frameRate:redrawRate bitrate:videoBitrate];
     lastFrameNumber = 0;
     activeVideoFormat = videoFormat;
     memset(&currentVideoStats, 0, sizeof(currentVideoStats));
-    memset(&lastVideoStats, 0, sizeof(lastVideoStats));
+    
+    // The UI may be reading the stats of the last session
+    video_stats_t emptyStats = {};
+    SeqLockWrite(&videoStatsSeqLock, &lastVideoStats, &emptyStats, sizeof(lastVideoStats));
     return 0;
 }
 
@@ -67,17 +75,12 @@ void DrStop(void)
 
 -(BOOL) getVideoStats:(video_stats_t*)stats
 {
-    // We return lastVideoStats because it is a complete 1 second window
-    [videoStatsLock lock];
-    if (lastVideoStats.endTime != 0) {
-        memcpy(stats, &lastVideoStats, sizeof(*stats));
-        [videoStatsLock unlock];
-        return YES;
-    }
+    // We return lastVideoStats because it is a complete 1 second window.
+    // The decode thread never waits for us, so we may have to retry the copy.
+    SeqLockRead(&videoStatsSeqLock, stats, &lastVideoStats, sizeof(*stats));
     
-    // No stats yet
-    [videoStatsLock unlock];
-    return NO;
+    // No stats yet if endTime is zero
+    return stats->endTime != 0;
 }
 
 -(NSString*) getActiveCodecName
@@ -109,15 +112,12 @@ void DrStop(void)
     }
 }
 
-int DrSubmitDecodeUnit(PDECODE_UNIT decodeUnit)
+// This function takes ownership of the frame handle. LiCompleteVideoFrame() will be
+// called exactly once for it, either here or by the renderer once the decoder has
+// released its last reference to the picture data in the decode unit.
+void DrSubmitDecodeUnit(VIDEO_FRAME_HANDLE frameHandle, PDECODE_UNIT decodeUnit)
 {
-    int offset = 0;
     int ret;
-    unsigned char* data = (unsigned char*) malloc(decodeUnit->fullLength);
-    if (data == NULL) {
-        // A frame was lost due to OOM condition
-        return DR_NEED_IDR;
-    }
     
     CFTimeInterval now = CACurrentMediaTime();
     if (!lastFrameNumber) {
@@ -129,9 +129,7 @@ int DrSubmitDecodeUnit(PDECODE_UNIT decodeUnit)
         if (now - currentVideoStats.startTime >= 1.0f) {
             currentVideoStats.endTime = now;
             
-            [videoStatsLock lock];
-            lastVideoStats = currentVideoStats;
-            [videoStatsLock unlock];
+            SeqLockWrite(&videoStatsSeqLock, &lastVideoStats, &currentVideoStats, sizeof(lastVideoStats));
             
             memset(&currentVideoStats, 0, sizeof(currentVideoStats));
             currentVideoStats.startTime = now;
@@ -156,6 +154,13 @@ int DrSubmitDecodeUnit(PDECODE_UNIT decodeUnit)
         currentVideoStats.totalHostProcessingLatency += decodeUnit->frameHostProcessingLatency;
     }
     
+    // Frames waiting behind this one in common-c's decode unit queue
+    int decodeQueueDepth = LiGetPendingVideoFrames();
+    currentVideoStats.totalDecodeQueueDepth += decodeQueueDepth;
+    if (decodeQueueDepth > currentVideoStats.maxDecodeQueueDepth) {
+        currentVideoStats.maxDecodeQueueDepth = decodeQueueDepth;
+    }
+    
     currentVideoStats.receivedFrames++;
     currentVideoStats.totalFrames++;
 
@@ -168,23 +173,23 @@ int DrSubmitDecodeUnit(PDECODE_UNIT decodeUnit)
                                     bufferType:entry->bufferType
                                      decodeUnit:decodeUnit];
             if (ret != DR_OK) {
-                free(data);
-                return ret;
+                LiCompleteVideoFrame(frameHandle, ret);
+                return;
             }
         }
-        else {
-            memcpy(&data[offset], entry->data, entry->length);
-            offset += entry->length;
-        }
 
         entry = entry->next;
     }
 
-    // This function will take our picture data buffer
-    return [renderer submitDecodeBuffer:data
-                                 length:offset
-                             bufferType:BUFFER_TYPE_PICDATA
-                             decodeUnit:decodeUnit];
+    // The picture data is submitted by reference to the buffers in the decode unit,
+    // so the renderer takes ownership of the frame handle from here.
+    [renderer submitDecodeUnit:decodeUnit frameHandle:frameHandle];
+}
+
+// Runs on SDL's audio thread whenever the device needs more samples
+static void AudioDeviceCallback(void* userdata, Uint8* stream, int len)
+{
+    PcmRingRead(&audioRing, (int16_t*)stream, len / (sizeof(short) * audioConfig.channelCount));
 }
 
 int ArInit(int audioConfiguration, POPUS_MULTISTREAM_CONFIGURATION opusConfig, void* context, int flags)
@@ -202,6 +207,17 @@ int ArInit(int audioConfiguration, POPUS_MULTISTREAM_CONFIGURATION opusConfig, v
     want.format = AUDIO_S16;
     want.channels = opusConfig->channelCount;
     want.samples = opusConfig->samplesPerFrame;
+    want.callback = AudioDeviceCallback;
+    
+    // Aim for 3 packets of buffered audio, which covers a full device buffer
+    // plus a packet of network jitter on either side.
+    audioConfig = *opusConfig;
+    if (!PcmRingInit(&audioRing, opusConfig->channelCount, opusConfig->samplesPerFrame * 3)) {
+        Log(LOG_E, @"Failed to allocate audio ring buffer");
+        ArCleanup();
+        return -1;
+    }
+    audioRingInitialized = true;
 
     audioDevice = SDL_OpenAudioDevice(NULL, 0, &want, &have, 0);
     if (audioDevice == 0) {
@@ -210,7 +226,6 @@ int ArInit(int audioConfiguration, POPUS_MULTISTREAM_CONFIGURATION opusConfig, v
         return -1;
     }
     
-    audioConfig = *opusConfig;
     audioFrameSize = opusConfig->samplesPerFrame * sizeof(short) * opusConfig->channelCount;
     audioBuffer = SDL_malloc(audioFrameSize);
     if (audioBuffer == NULL) {
@@ -248,10 +263,21 @@ void ArCleanup(void)
     }
     
     if (audioDevice != 0) {
+        // This waits for the audio callback to finish, so the ring is safe to free below
         SDL_CloseAudioDevice(audioDevice);
         audioDevice = 0;
     }
     
+    if (audioRingInitialized) {
+        PCM_RING_STATS ringStats;
+        PcmRingGetStats(&audioRing, &ringStats);
+        Log(LOG_I, @"Audio ring: %u underruns, %u frames dropped, %u frames duplicated, %u frames overflowed",
+            ringStats.underruns, ringStats.droppedFrames, ringStats.duplicatedFrames, ringStats.overflowFrames);
+        
+        PcmRingDestroy(&audioRing);
+        audioRingInitialized = false;
+    }
+    
     if (audioBuffer != NULL) {
         SDL_free(audioBuffer);
         audioBuffer = NULL;
@@ -264,26 +290,12 @@ void ArDecodeAndPlaySample(char* sampleData, int sampleLength)
 {
     int decodeLen;
     
-    // Don't queue if there's already more than 30 ms of audio data waiting
-    // in Moonlight's audio queue.
-    if (LiGetPendingAudioDuration() > 30) {
-        return;
-    }
-    
     decodeLen = opus_multistream_decode(opusDecoder, (unsigned char *)sampleData, sampleLength,
                                         (short*)audioBuffer, audioConfig.samplesPerFrame, 0);
     if (decodeLen > 0) {
-        // Provide backpressure on the queue to ensure too many frames don't build up
-        // in SDL's audio queue.
-        while (SDL_GetQueuedAudioSize(audioDevice) / audioFrameSize > 10) {
-            SDL_Delay(1);
-        }
-        
-        if (SDL_QueueAudio(audioDevice,
-                           audioBuffer,
-                           sizeof(short) * decodeLen * audioConfig.channelCount) < 0) {
-            Log(LOG_E, @"Failed to queue audio sample: %s\n", SDL_GetError());
-        }
+        // The audio callback smoothly speeds up or slows down playback to keep the
+        // ring near its target level, so we never need to wait or drop packets here.
+        PcmRingWrite(&audioRing, (const int16_t*)audioBuffer, decodeLen);
     }
 }
 
@@ -379,10 +391,6 @@ void ClSetControllerLED(uint16_t controllerNumber, uint8_t r, uint8_t g, uint8_t
         initLock = [[NSLock alloc] init];
     }
     
-    if (videoStatsLock == nil) {
-        videoStatsLock = [[NSLock alloc] init];
-    }
-    
     NSString *rawAddress = [Utils addressPortStringToAddress:config.host];
     strncpy(_hostString,
             [rawAddress cStringUsingEncoding:NSUTF8StringEncoding],
@@ -414,6 +422,7 @@ void ClSetControllerLED(uint16_t controllerNumber, uint8_t r, uint8_t g, uint8_t
 
     renderer = myRenderer;
     _callbacks = callbacks;
+    videoBitrate = config.bitRate;
 
     LiInitializeStreamConfiguration(&_streamConfig);
     _streamConfig.width = config.width;
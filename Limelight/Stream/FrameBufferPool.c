@@ -0,0 +1,278 @@
+//
+//  FrameBufferPool.c
+//  Moonlight
+//
+//  Copyright © 2026 Moonlight Game Streaming Project. All rights reserved.
+//
+
+#include "FrameBufferPool.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Size classes are powers of two from 64 bytes to 128 MB
+#define FBP_MIN_CLASS_SHIFT 6
+#define FBP_MAX_CLASS_SHIFT 27
+#define FBP_CLASS_COUNT (FBP_MAX_CLASS_SHIFT - FBP_MIN_CLASS_SHIFT + 1)
+
+// Buffers larger than this are rare (IDR frames), so we only keep a couple around
+#define FBP_SMALL_CLASS_MAX_SIZE 4096
+#define FBP_SMALL_CLASS_MAX_FREE 64
+#define FBP_LARGE_CLASS_MAX_FREE 2
+
+// Number of small buffers to preallocate for per-frame bookkeeping
+#define FBP_PREALLOCATED_SMALL_BUFFERS 16
+
+typedef union _FBP_BUFFER_HEADER {
+    struct {
+        PFRAME_BUFFER_POOL pool;
+        union _FBP_BUFFER_HEADER* next;
+        int sizeClass;
+    } info;
+    
+    // Keep the buffer following the header suitably aligned for any type
+    max_align_t alignment;
+} FBP_BUFFER_HEADER, *PFBP_BUFFER_HEADER;
+
+struct _FRAME_BUFFER_POOL {
+    pthread_mutex_t lock;
+    int refCount;
+    bool released;
+    
+    PFBP_BUFFER_HEADER freeLists[FBP_CLASS_COUNT];
+    int freeCounts[FBP_CLASS_COUNT];
+    
+    FRAME_BUFFER_POOL_STATS stats;
+};
+
+static size_t classToSize(int sizeClass)
+{
+    return (size_t)1 << (sizeClass + FBP_MIN_CLASS_SHIFT);
+}
+
+// Returns -1 if the request is too large to be pooled
+static int sizeToClass(size_t size)
+{
+    for (int i = 0; i < FBP_CLASS_COUNT; i++) {
+        if (classToSize(i) >= size) {
+            return i;
+        }
+    }
+    
+    return -1;
+}
+
+static int maxFreeForClass(int sizeClass)
+{
+    return classToSize(sizeClass) <= FBP_SMALL_CLASS_MAX_SIZE ?
+        FBP_SMALL_CLASS_MAX_FREE : FBP_LARGE_CLASS_MAX_FREE;
+}
+
+// Must be called with the pool lock held
+static void drainFreeLists(PFRAME_BUFFER_POOL pool)
+{
+    for (int i = 0; i < FBP_CLASS_COUNT; i++) {
+        while (pool->freeLists[i] != NULL) {
+            PFBP_BUFFER_HEADER header = pool->freeLists[i];
+            pool->freeLists[i] = header->info.next;
+            pool->stats.bytesHeld -= classToSize(i);
+            free(header);
+        }
+        
+        pool->freeCounts[i] = 0;
+    }
+}
+
+static void destroyPool(PFRAME_BUFFER_POOL pool)
+{
+    pthread_mutex_destroy(&pool->lock);
+    free(pool);
+}
+
+// Must be called with the pool lock held
+static bool preallocateBuffers(PFRAME_BUFFER_POOL pool, size_t size, int count)
+{
+    int sizeClass = sizeToClass(size + sizeof(FBP_BUFFER_HEADER));
+    if (sizeClass < 0) {
+        return false;
+    }
+    
+    for (int i = 0; i < count && pool->freeCounts[sizeClass] < maxFreeForClass(sizeClass); i++) {
+        PFBP_BUFFER_HEADER header = malloc(classToSize(sizeClass));
+        if (header == NULL) {
+            return false;
+        }
+        
+        header->info.pool = pool;
+        header->info.sizeClass = sizeClass;
+        header->info.next = pool->freeLists[sizeClass];
+        pool->freeLists[sizeClass] = header;
+        pool->freeCounts[sizeClass]++;
+        
+        pool->stats.bytesHeld += classToSize(sizeClass);
+        if (pool->stats.bytesHeld > pool->stats.highWaterBytes) {
+            pool->stats.highWaterBytes = pool->stats.bytesHeld;
+        }
+    }
+    
+    return true;
+}
+
+PFRAME_BUFFER_POOL FbpCreatePool(int width, int height, int fps, int bitrateKbps, bool copiesFrames)
+{
+    PFRAME_BUFFER_POOL pool = calloc(1, sizeof(*pool));
+    if (pool == NULL) {
+        return NULL;
+    }
+    
+    if (pthread_mutex_init(&pool->lock, NULL) != 0) {
+        free(pool);
+        return NULL;
+    }
+    
+    pool->refCount = 1;
+    
+    // IDR frames are commonly several times the size of an average frame at the
+    // target bitrate, but they are bounded in practice by the size of the raw
+    // 4:2:0 picture. Anything larger is allocated on demand and kept for reuse.
+    size_t averageFrameSize = fps > 0 ? ((size_t)bitrateKbps * 1000 / 8) / fps : 0;
+    size_t idrFrameSize = averageFrameSize * 8;
+    size_t rawFrameSize = (size_t)width * height * 3 / 2;
+    if (idrFrameSize > rawFrameSize) {
+        idrFrameSize = rawFrameSize;
+    }
+    
+    // Failure to preallocate is not fatal, since buffers are allocated on demand anyway
+    pthread_mutex_lock(&pool->lock);
+    preallocateBuffers(pool, 0, FBP_PREALLOCATED_SMALL_BUFFERS);
+    if (copiesFrames && idrFrameSize != 0) {
+        preallocateBuffers(pool, idrFrameSize, 1);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    
+    return pool;
+}
+
+void FbpReleasePool(PFRAME_BUFFER_POOL pool)
+{
+    bool destroy;
+    
+    if (pool == NULL) {
+        return;
+    }
+    
+    pthread_mutex_lock(&pool->lock);
+    pool->released = true;
+    drainFreeLists(pool);
+    destroy = --pool->refCount == 0;
+    pthread_mutex_unlock(&pool->lock);
+    
+    if (destroy) {
+        destroyPool(pool);
+    }
+}
+
+void* FbpAllocate(PFRAME_BUFFER_POOL pool, size_t size)
+{
+    PFBP_BUFFER_HEADER header;
+    int sizeClass = sizeToClass(size + sizeof(FBP_BUFFER_HEADER));
+    
+    if (pool == NULL || sizeClass < 0) {
+        // Unpooled allocation
+        header = malloc(sizeof(FBP_BUFFER_HEADER) + size);
+        if (header == NULL) {
+            return NULL;
+        }
+        
+        header->info.pool = NULL;
+        header->info.sizeClass = -1;
+        return header + 1;
+    }
+    
+    pthread_mutex_lock(&pool->lock);
+    
+    pool->stats.allocations++;
+    
+    header = pool->freeLists[sizeClass];
+    if (header != NULL) {
+        pool->freeLists[sizeClass] = header->info.next;
+        pool->freeCounts[sizeClass]--;
+        pool->stats.hits++;
+    }
+    else {
+        header = malloc(classToSize(sizeClass));
+        if (header == NULL) {
+            pthread_mutex_unlock(&pool->lock);
+            return NULL;
+        }
+        
+        header->info.pool = pool;
+        header->info.sizeClass = sizeClass;
+        
+        pool->stats.bytesHeld += classToSize(sizeClass);
+        if (pool->stats.bytesHeld > pool->stats.highWaterBytes) {
+            pool->stats.highWaterBytes = pool->stats.bytesHeld;
+        }
+    }
+    
+    // Outstanding buffers keep the pool alive
+    pool->refCount++;
+    
+    pthread_mutex_unlock(&pool->lock);
+    
+    return header + 1;
+}
+
+void FbpFree(void* buffer)
+{
+    PFBP_BUFFER_HEADER header;
+    PFRAME_BUFFER_POOL pool;
+    bool destroy;
+    
+    if (buffer == NULL) {
+        return;
+    }
+    
+    header = (PFBP_BUFFER_HEADER)buffer - 1;
+    pool = header->info.pool;
+    if (pool == NULL) {
+        free(header);
+        return;
+    }
+    
+    pthread_mutex_lock(&pool->lock);
+    
+    int sizeClass = header->info.sizeClass;
+    if (!pool->released && pool->freeCounts[sizeClass] < maxFreeForClass(sizeClass)) {
+        header->info.next = pool->freeLists[sizeClass];
+        pool->freeLists[sizeClass] = header;
+        pool->freeCounts[sizeClass]++;
+    }
+    else {
+        // The free list is full or the pool is going away
+        pool->stats.bytesHeld -= classToSize(sizeClass);
+        free(header);
+    }
+    
+    destroy = --pool->refCount == 0;
+    
+    pthread_mutex_unlock(&pool->lock);
+    
+    if (destroy) {
+        destroyPool(pool);
+    }
+}
+
+void FbpGetStats(PFRAME_BUFFER_POOL pool, PFRAME_BUFFER_POOL_STATS stats)
+{
+    if (pool == NULL) {
+        memset(stats, 0, sizeof(*stats));
+        return;
+    }
+    
+    pthread_mutex_lock(&pool->lock);
+    *stats = pool->stats;
+    pthread_mutex_unlock(&pool->lock);
+}
@@ -0,0 +1,50 @@
+//
+//  FrameBufferPool.h
+//  Moonlight
+//
+//  Copyright © 2026 Moonlight Game Streaming Project. All rights reserved.
+//
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// A thread-safe pool of reusable buffers for per-frame allocations on the
+// video path. Requests are rounded up to a power-of-two size class, and freed
+// buffers are kept on a per-class free list for reuse instead of being
+// returned to the heap. Buffers may be freed on any thread and may outlive
+// the pool's creator reference.
+
+typedef struct _FRAME_BUFFER_POOL FRAME_BUFFER_POOL, *PFRAME_BUFFER_POOL;
+
+typedef struct _FRAME_BUFFER_POOL_STATS {
+    // Total buffer requests and how many were satisfied from a free list
+    uint64_t allocations;
+    uint64_t hits;
+    
+    // Bytes currently allocated from the heap by the pool (in use or free)
+    size_t bytesHeld;
+    
+    // Largest value of bytesHeld seen over the life of the pool
+    size_t highWaterBytes;
+} FRAME_BUFFER_POOL_STATS, *PFRAME_BUFFER_POOL_STATS;
+
+// Creates a pool with buffers preallocated for a stream with the given parameters.
+// A buffer big enough for an IDR frame is only preallocated if copiesFrames is set,
+// since most streams never need one. Returns NULL if the pool could not be allocated.
+PFRAME_BUFFER_POOL FbpCreatePool(int width, int height, int fps, int bitrateKbps, bool copiesFrames);
+
+// Releases the creator's reference on the pool. Outstanding buffers remain valid
+// and the pool is destroyed once the last of them is freed.
+void FbpReleasePool(PFRAME_BUFFER_POOL pool);
+
+// Returns a buffer of at least size bytes or NULL on allocation failure.
+// A NULL pool is permitted and falls back to a plain heap allocation.
+void* FbpAllocate(PFRAME_BUFFER_POOL pool, size_t size);
+
+// Returns a buffer from FbpAllocate() to the pool it was allocated from
+void FbpFree(void* buffer);
+
+void FbpGetStats(PFRAME_BUFFER_POOL pool, PFRAME_BUFFER_POOL_STATS stats);
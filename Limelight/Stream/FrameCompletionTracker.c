@@ -0,0 +1,175 @@
+//
+//  FrameCompletionTracker.c
+//  Moonlight
+//
+//  Copyright © 2026 Moonlight Game Streaming Project. All rights reserved.
+//
+
+#include "FrameCompletionTracker.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <time.h>
+
+struct _FRAME_COMPLETION_TRACKER {
+    pthread_mutex_t lock;
+    pthread_cond_t idle;
+    
+    FRAME_COMPLETE_FN completeFn;
+    int outstandingFrames;
+    bool released;
+    bool abandoned;
+};
+
+static void destroyTracker(PFRAME_COMPLETION_TRACKER tracker)
+{
+    pthread_cond_destroy(&tracker->idle);
+    pthread_mutex_destroy(&tracker->lock);
+    free(tracker);
+}
+
+PFRAME_COMPLETION_TRACKER FctCreate(FRAME_COMPLETE_FN completeFn)
+{
+    PFRAME_COMPLETION_TRACKER tracker = calloc(1, sizeof(*tracker));
+    if (tracker == NULL) {
+        return NULL;
+    }
+    
+    if (pthread_mutex_init(&tracker->lock, NULL) != 0) {
+        free(tracker);
+        return NULL;
+    }
+    if (pthread_cond_init(&tracker->idle, NULL) != 0) {
+        pthread_mutex_destroy(&tracker->lock);
+        free(tracker);
+        return NULL;
+    }
+    
+    tracker->completeFn = completeFn;
+    return tracker;
+}
+
+void FctRelease(PFRAME_COMPLETION_TRACKER tracker)
+{
+    bool destroy;
+    
+    if (tracker == NULL) {
+        return;
+    }
+    
+    pthread_mutex_lock(&tracker->lock);
+    tracker->released = true;
+    destroy = tracker->outstandingFrames == 0;
+    pthread_mutex_unlock(&tracker->lock);
+    
+    if (destroy) {
+        destroyTracker(tracker);
+    }
+}
+
+void FctTrack(PFRAME_COMPLETION_TRACKER tracker)
+{
+    pthread_mutex_lock(&tracker->lock);
+    tracker->outstandingFrames++;
+    pthread_mutex_unlock(&tracker->lock);
+}
+
+void FctComplete(PFRAME_COMPLETION_TRACKER tracker, void* frameHandle, int drStatus)
+{
+    bool destroy;
+    
+    pthread_mutex_lock(&tracker->lock);
+    
+    // The lock is held across the callback, so a waiter that times out
+    // can't abandon the frame while it is being completed.
+    if (!tracker->abandoned) {
+        tracker->completeFn(frameHandle, drStatus);
+    }
+    
+    if (--tracker->outstandingFrames == 0) {
+        pthread_cond_broadcast(&tracker->idle);
+    }
+    destroy = tracker->released && tracker->outstandingFrames == 0;
+    
+    pthread_mutex_unlock(&tracker->lock);
+    
+    if (destroy) {
+        destroyTracker(tracker);
+    }
+}
+
+// Must be called with the lock held
+static void waitForIdleLocked(PFRAME_COMPLETION_TRACKER tracker, int timeoutMs)
+{
+    struct timespec deadline;
+    
+    // pthread_cond_timedwait() takes an absolute time on the realtime clock
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += timeoutMs / 1000;
+    deadline.tv_nsec += (long)(timeoutMs % 1000) * 1000000;
+    if (deadline.tv_nsec >= 1000000000) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000;
+    }
+    
+    while (tracker->outstandingFrames != 0) {
+        if (pthread_cond_timedwait(&tracker->idle, &tracker->lock, &deadline) == ETIMEDOUT) {
+            break;
+        }
+    }
+}
+
+bool FctWaitForIdle(PFRAME_COMPLETION_TRACKER tracker, int timeoutMs)
+{
+    bool idle;
+    
+    pthread_mutex_lock(&tracker->lock);
+    waitForIdleLocked(tracker, timeoutMs);
+    idle = tracker->outstandingFrames == 0;
+    pthread_mutex_unlock(&tracker->lock);
+    
+    return idle;
+}
+
+int FctGetOutstandingFrames(PFRAME_COMPLETION_TRACKER tracker)
+{
+    int outstandingFrames;
+    
+    pthread_mutex_lock(&tracker->lock);
+    outstandingFrames = tracker->outstandingFrames;
+    pthread_mutex_unlock(&tracker->lock);
+    
+    return outstandingFrames;
+}
+
+void FctDrainQueue(PSPSC_QUEUE queue, FRAME_RELEASE_FN releaseFn, void* context)
+{
+    void* element = malloc(queue->elementSize);
+    if (element == NULL) {
+        return;
+    }
+    
+    while (SpscQueuePop(queue, element)) {
+        releaseFn(context, element);
+    }
+    
+    free(element);
+}
+
+int FctFinish(PFRAME_COMPLETION_TRACKER tracker, int timeoutMs)
+{
+    int abandonedFrames;
+    
+    // Waiting and abandoning under one hold of the lock means a frame is
+    // either completed or abandoned, never both
+    pthread_mutex_lock(&tracker->lock);
+    waitForIdleLocked(tracker, timeoutMs);
+    abandonedFrames = tracker->outstandingFrames;
+    if (abandonedFrames != 0) {
+        tracker->abandoned = true;
+    }
+    pthread_mutex_unlock(&tracker->lock);
+    
+    return abandonedFrames;
+}
@@ -0,0 +1,52 @@
+//
+//  FrameCompletionTracker.h
+//  Moonlight
+//
+//  Copyright © 2026 Moonlight Game Streaming Project. All rights reserved.
+//
+
+#pragma once
+
+#include <stdbool.h>
+
+#include "SpscQueue.h"
+
+// Counts video frames whose completion has been handed to another owner (the
+// decoder, for picture data submitted by reference), so the renderer can wait
+// for all of them to be completed before the connection is torn down.
+//
+// The tracker is reference counted. Each outstanding frame keeps it alive, so
+// a frame may be completed after the creator has released its reference.
+
+typedef void (*FRAME_COMPLETE_FN)(void* frameHandle, int drStatus);
+typedef void (*FRAME_RELEASE_FN)(void* context, void* element);
+
+typedef struct _FRAME_COMPLETION_TRACKER FRAME_COMPLETION_TRACKER, *PFRAME_COMPLETION_TRACKER;
+
+// Returns NULL if the tracker could not be allocated
+PFRAME_COMPLETION_TRACKER FctCreate(FRAME_COMPLETE_FN completeFn);
+
+// Releases the creator's reference on the tracker
+void FctRelease(PFRAME_COMPLETION_TRACKER tracker);
+
+// Registers a frame that will be completed later with FctComplete()
+void FctTrack(PFRAME_COMPLETION_TRACKER tracker);
+
+// Completes a tracked frame. This may be called on any thread.
+void FctComplete(PFRAME_COMPLETION_TRACKER tracker, void* frameHandle, int drStatus);
+
+// Waits up to timeoutMs for all tracked frames to be completed.
+// Returns false if frames are still outstanding after the timeout.
+bool FctWaitForIdle(PFRAME_COMPLETION_TRACKER tracker, int timeoutMs);
+
+int FctGetOutstandingFrames(PFRAME_COMPLETION_TRACKER tracker);
+
+// Hands every element left in a queue that nobody will consume anymore to
+// releaseFn. Must be called on the queue's consumer thread.
+void FctDrainQueue(PSPSC_QUEUE queue, FRAME_RELEASE_FN releaseFn, void* context);
+
+// Waits up to timeoutMs for all tracked frames to be completed, then abandons
+// any that are still outstanding: they are dropped without calling completeFn
+// when they complete, since the connection is gone by then. Returns the number
+// of frames abandoned.
+int FctFinish(PFRAME_COMPLETION_TRACKER tracker, int timeoutMs);
@@ -0,0 +1,241 @@
+//
+//  FrameTimingLog.c
+//  Moonlight
+//
+//  Copyright © 2026 Moonlight Game Streaming Project. All rights reserved.
+//
+
+#include "FrameTimingLog.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define SUB_BUCKET_COUNT (1 << LATENCY_HISTOGRAM_SUB_BUCKET_BITS)
+#define MAX_HISTOGRAM_VALUE ((1ULL << LATENCY_HISTOGRAM_MAX_BITS) - 1)
+
+static const double k_Percentiles[] = { 50, 95, 99 };
+
+static int getMostSignificantBit(uint64_t value)
+{
+    int msb = 0;
+    
+    while (value >>= 1) {
+        msb++;
+    }
+    
+    return msb;
+}
+
+static size_t getBucketIndex(uint64_t value)
+{
+    if (value < SUB_BUCKET_COUNT) {
+        return (size_t)value;
+    }
+    
+    // Each power of two gets its own group of sub-buckets
+    int shift = getMostSignificantBit(value) - LATENCY_HISTOGRAM_SUB_BUCKET_BITS;
+    size_t subBucket = (size_t)(value >> shift) & (SUB_BUCKET_COUNT - 1);
+    return ((size_t)(shift + 1) << LATENCY_HISTOGRAM_SUB_BUCKET_BITS) + subBucket;
+}
+
+// Returns the largest value that maps to the bucket
+static uint64_t getBucketValue(size_t index)
+{
+    if (index < SUB_BUCKET_COUNT) {
+        return index;
+    }
+    
+    int shift = (int)(index >> LATENCY_HISTOGRAM_SUB_BUCKET_BITS) - 1;
+    uint64_t subBucket = index & (SUB_BUCKET_COUNT - 1);
+    return ((SUB_BUCKET_COUNT + subBucket + 1) << shift) - 1;
+}
+
+void LhRecord(PLATENCY_HISTOGRAM histogram, uint64_t valueUs)
+{
+    if (valueUs > MAX_HISTOGRAM_VALUE) {
+        valueUs = MAX_HISTOGRAM_VALUE;
+    }
+    
+    histogram->buckets[getBucketIndex(valueUs)]++;
+    histogram->count++;
+    histogram->totalUs += valueUs;
+    if (valueUs > histogram->maxUs) {
+        histogram->maxUs = valueUs;
+    }
+}
+
+uint64_t LhGetPercentile(const LATENCY_HISTOGRAM* histogram, double percent)
+{
+    if (histogram->count == 0) {
+        return 0;
+    }
+    
+    // Find the bucket containing the value with this rank
+    uint64_t rank = (uint64_t)(percent / 100.0 * histogram->count + 0.5);
+    if (rank == 0) {
+        rank = 1;
+    }
+    
+    uint64_t seen = 0;
+    for (size_t i = 0; i < LATENCY_HISTOGRAM_BUCKETS; i++) {
+        seen += histogram->buckets[i];
+        if (seen >= rank) {
+            uint64_t value = getBucketValue(i);
+            return value < histogram->maxUs ? value : histogram->maxUs;
+        }
+    }
+    
+    return histogram->maxUs;
+}
+
+bool FtlInit(PFRAME_TIMING_LOG log, size_t capacity)
+{
+    memset(log, 0, sizeof(*log));
+    
+    log->slots = calloc(capacity, sizeof(*log->slots));
+    if (log->slots == NULL) {
+        return false;
+    }
+    
+    log->capacity = capacity;
+    for (size_t i = 0; i < capacity; i++) {
+        atomic_init(&log->slots[i].sequence, 0);
+    }
+    atomic_init(&log->framesRecorded, 0);
+    
+    return true;
+}
+
+void FtlDestroy(PFRAME_TIMING_LOG log)
+{
+    free(log->slots);
+    log->slots = NULL;
+}
+
+const char* FtlGetStageName(FRAME_STAGE stage)
+{
+    switch (stage) {
+        case FRAME_STAGE_RECEIVE:
+            return "receive";
+        case FRAME_STAGE_POLL:
+            return "poll";
+        case FRAME_STAGE_SUBMIT:
+            return "submit";
+        case FRAME_STAGE_ENQUEUE:
+            return "enqueue";
+        case FRAME_STAGE_DISPLAY:
+            return "display";
+        default:
+            return "unknown";
+    }
+}
+
+static uint64_t getIntervalUs(double start, double end)
+{
+    return end > start ? (uint64_t)((end - start) * 1000000.0 + 0.5) : 0;
+}
+
+void FtlRecordFrame(PFRAME_TIMING_LOG log, const FRAME_TIMING* timing)
+{
+    uint64_t index = atomic_load_explicit(&log->framesRecorded, memory_order_relaxed);
+    PFRAME_TIMING_SLOT slot = &log->slots[index % log->capacity];
+    
+    // Readers that see a zero sequence skip the slot
+    atomic_store_explicit(&slot->sequence, 0, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    slot->timing = *timing;
+    atomic_store_explicit(&slot->sequence, index + 1, memory_order_release);
+    atomic_store_explicit(&log->framesRecorded, index + 1, memory_order_release);
+    
+    for (int stage = FRAME_STAGE_POLL; stage < FRAME_STAGE_COUNT; stage++) {
+        LhRecord(&log->stageHistograms[stage],
+                 getIntervalUs(timing->stageTimes[stage - 1], timing->stageTimes[stage]));
+    }
+    LhRecord(&log->stageHistograms[FRAME_STAGE_RECEIVE],
+             getIntervalUs(timing->stageTimes[FRAME_STAGE_RECEIVE], timing->stageTimes[FRAME_STAGE_DISPLAY]));
+}
+
+size_t FtlGetRecentFrames(PFRAME_TIMING_LOG log, PFRAME_TIMING frames, size_t maxFrames)
+{
+    uint64_t end = atomic_load_explicit(&log->framesRecorded, memory_order_acquire);
+    uint64_t count = end < log->capacity ? end : log->capacity;
+    if (count > maxFrames) {
+        count = maxFrames;
+    }
+    
+    size_t copied = 0;
+    for (uint64_t index = end - count; index < end; index++) {
+        PFRAME_TIMING_SLOT slot = &log->slots[index % log->capacity];
+        
+        // Skip slots that were overwritten while we were copying them
+        if (atomic_load_explicit(&slot->sequence, memory_order_acquire) != index + 1) {
+            continue;
+        }
+        frames[copied] = slot->timing;
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&slot->sequence, memory_order_relaxed) != index + 1) {
+            continue;
+        }
+        
+        copied++;
+    }
+    
+    return copied;
+}
+
+bool FtlWriteCsv(PFRAME_TIMING_LOG log, FILE* file)
+{
+    PFRAME_TIMING frames = malloc(log->capacity * sizeof(*frames));
+    if (frames == NULL) {
+        return false;
+    }
+    
+    size_t frameCount = FtlGetRecentFrames(log, frames, log->capacity);
+    
+    fprintf(file, "frame_number,frame_type");
+    for (int stage = 0; stage < FRAME_STAGE_COUNT; stage++) {
+        fprintf(file, ",%s_time", FtlGetStageName(stage));
+    }
+    fprintf(file, "\n");
+    
+    for (size_t i = 0; i < frameCount; i++) {
+        fprintf(file, "%u,%d", frames[i].frameNumber, frames[i].frameType);
+        for (int stage = 0; stage < FRAME_STAGE_COUNT; stage++) {
+            fprintf(file, ",%.6f", frames[i].stageTimes[stage]);
+        }
+        fprintf(file, "\n");
+    }
+    
+    free(frames);
+    return !ferror(file);
+}
+
+static void writeHistogramJson(FILE* file, const char* name, const LATENCY_HISTOGRAM* histogram)
+{
+    fprintf(file, "    \"%s\": { \"count\": %llu, \"mean_us\": %llu, \"max_us\": %llu",
+            name,
+            (unsigned long long)histogram->count,
+            (unsigned long long)(histogram->count ? histogram->totalUs / histogram->count : 0),
+            (unsigned long long)histogram->maxUs);
+    for (size_t i = 0; i < sizeof(k_Percentiles) / sizeof(k_Percentiles[0]); i++) {
+        fprintf(file, ", \"p%g_us\": %llu", k_Percentiles[i],
+                (unsigned long long)LhGetPercentile(histogram, k_Percentiles[i]));
+    }
+    fprintf(file, " }");
+}
+
+bool FtlWriteJson(PFRAME_TIMING_LOG log, FILE* file)
+{
+    fprintf(file, "{\n  \"frames\": %llu,\n  \"stages\": {\n",
+            (unsigned long long)atomic_load(&log->framesRecorded));
+    
+    // Each stage's histogram covers the time since the previous stage
+    for (int stage = FRAME_STAGE_POLL; stage < FRAME_STAGE_COUNT; stage++) {
+        writeHistogramJson(file, FtlGetStageName(stage), &log->stageHistograms[stage]);
+        fprintf(file, ",\n");
+    }
+    writeHistogramJson(file, "total", &log->stageHistograms[FRAME_STAGE_RECEIVE]);
+    fprintf(file, "\n  }\n}\n");
+    
+    return !ferror(file);
+}
@@ -0,0 +1,94 @@
+//
+//  FrameTimingLog.h
+//  Moonlight
+//
+//  Copyright © 2026 Moonlight Game Streaming Project. All rights reserved.
+//
+
+#pragma once
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// Records when each video frame passes through each stage of the pipeline.
+// The most recent frames are kept in a fixed-size ring and every frame is
+// added to log-bucketed latency histograms for percentile queries.
+
+typedef enum {
+    // The frame was reassembled from the network by common-c
+    FRAME_STAGE_RECEIVE,
+    // The frame was taken from common-c's decode unit queue
+    FRAME_STAGE_POLL,
+    // The frame was converted and handed to the display link
+    FRAME_STAGE_SUBMIT,
+    // The frame was enqueued on the display layer
+    FRAME_STAGE_ENQUEUE,
+    // The display refresh where the frame is expected to appear
+    FRAME_STAGE_DISPLAY,
+    FRAME_STAGE_COUNT
+} FRAME_STAGE;
+
+// Values below 2^LATENCY_HISTOGRAM_SUB_BUCKET_BITS microseconds are exact and larger
+// values are bucketed with 1/16 (about 6%) relative precision up to about 67 seconds.
+#define LATENCY_HISTOGRAM_SUB_BUCKET_BITS 4
+#define LATENCY_HISTOGRAM_MAX_BITS 26
+#define LATENCY_HISTOGRAM_BUCKETS ((LATENCY_HISTOGRAM_MAX_BITS - LATENCY_HISTOGRAM_SUB_BUCKET_BITS + 1) << LATENCY_HISTOGRAM_SUB_BUCKET_BITS)
+
+typedef struct _LATENCY_HISTOGRAM {
+    uint64_t count;
+    uint64_t totalUs;
+    uint64_t maxUs;
+    uint32_t buckets[LATENCY_HISTOGRAM_BUCKETS];
+} LATENCY_HISTOGRAM, *PLATENCY_HISTOGRAM;
+
+void LhRecord(PLATENCY_HISTOGRAM histogram, uint64_t valueUs);
+
+// Returns the value in microseconds below which the given percent of the values fall
+uint64_t LhGetPercentile(const LATENCY_HISTOGRAM* histogram, double percent);
+
+typedef struct _FRAME_TIMING {
+    uint32_t frameNumber;
+    int frameType;
+    
+    // CACurrentMediaTime() seconds for each stage
+    double stageTimes[FRAME_STAGE_COUNT];
+} FRAME_TIMING, *PFRAME_TIMING;
+
+typedef struct _FRAME_TIMING_SLOT {
+    // Index of the frame in the slot plus one, or zero while it is being written
+    _Atomic(uint64_t) sequence;
+    FRAME_TIMING timing;
+} FRAME_TIMING_SLOT, *PFRAME_TIMING_SLOT;
+
+// There must be only one thread calling FtlRecordFrame(). The ring can be
+// read concurrently from other threads, but the histograms can't.
+typedef struct _FRAME_TIMING_LOG {
+    PFRAME_TIMING_SLOT slots;
+    size_t capacity;
+    _Atomic(uint64_t) framesRecorded;
+    
+    // Time spent reaching each stage from the previous one. The
+    // FRAME_STAGE_RECEIVE entry holds the total from receive to display.
+    LATENCY_HISTOGRAM stageHistograms[FRAME_STAGE_COUNT];
+} FRAME_TIMING_LOG, *PFRAME_TIMING_LOG;
+
+// Returns false on allocation failure
+bool FtlInit(PFRAME_TIMING_LOG log, size_t capacity);
+void FtlDestroy(PFRAME_TIMING_LOG log);
+
+const char* FtlGetStageName(FRAME_STAGE stage);
+
+void FtlRecordFrame(PFRAME_TIMING_LOG log, const FRAME_TIMING* timing);
+
+// Copies up to maxFrames of the most recent frames in the ring, oldest first.
+// Returns the number of frames copied.
+size_t FtlGetRecentFrames(PFRAME_TIMING_LOG log, PFRAME_TIMING frames, size_t maxFrames);
+
+// Exports the frames in the ring as CSV with one row per frame
+bool FtlWriteCsv(PFRAME_TIMING_LOG log, FILE* file);
+
+// Exports per-stage histogram summaries as JSON
+bool FtlWriteJson(PFRAME_TIMING_LOG log, FILE* file);
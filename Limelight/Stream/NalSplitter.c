@@ -0,0 +1,293 @@
+//
+//  NalSplitter.c
+//  Moonlight
+//
+//  Copyright © 2026 Moonlight Game Streaming Project. All rights reserved.
+//
+
+#include "NalSplitter.h"
+
+#if defined(__aarch64__) || defined(__ARM_NEON)
+#define NAL_HAVE_NEON 1
+#include <arm_neon.h>
+#elif defined(__x86_64__) || defined(__i386__) || defined(_M_X64)
+#define NAL_HAVE_X86 1
+#include <immintrin.h>
+#endif
+
+// The vector kernels load 2 bytes past the end of each block
+#define START_CODE_OVERREAD 2
+
+static size_t findStartCodeScalar(const uint8_t* data, size_t length)
+{
+    size_t i = 0;
+    
+    // Use the third byte of the candidate start code to skip ahead, since
+    // any value above 1 rules out a start code in the next 3 positions.
+    while (i + 2 < length) {
+        if (data[i + 2] > 1) {
+            i += 3;
+        }
+        else if (data[i + 1] != 0) {
+            i += 2;
+        }
+        else if (data[i] != 0 || data[i + 2] != 1) {
+            i++;
+        }
+        else {
+            return i;
+        }
+    }
+    
+    return length;
+}
+
+#if NAL_HAVE_X86
+
+static size_t findStartCodeSse2(const uint8_t* data, size_t length)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i one = _mm_set1_epi8(1);
+    size_t i = 0;
+    
+    for (; i + 16 + START_CODE_OVERREAD <= length; i += 16) {
+        __m128i b0 = _mm_loadu_si128((const __m128i*)&data[i]);
+        __m128i b1 = _mm_loadu_si128((const __m128i*)&data[i + 1]);
+        __m128i b2 = _mm_loadu_si128((const __m128i*)&data[i + 2]);
+        
+        __m128i match = _mm_and_si128(_mm_and_si128(_mm_cmpeq_epi8(b0, zero),
+                                                    _mm_cmpeq_epi8(b1, zero)),
+                                      _mm_cmpeq_epi8(b2, one));
+        int mask = _mm_movemask_epi8(match);
+        if (mask != 0) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+    
+    return i + findStartCodeScalar(&data[i], length - i);
+}
+
+__attribute__((target("avx2")))
+static size_t findStartCodeAvx2(const uint8_t* data, size_t length)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i one = _mm256_set1_epi8(1);
+    size_t i = 0;
+    
+    for (; i + 32 + START_CODE_OVERREAD <= length; i += 32) {
+        __m256i b0 = _mm256_loadu_si256((const __m256i*)&data[i]);
+        __m256i b1 = _mm256_loadu_si256((const __m256i*)&data[i + 1]);
+        __m256i b2 = _mm256_loadu_si256((const __m256i*)&data[i + 2]);
+        
+        __m256i match = _mm256_and_si256(_mm256_and_si256(_mm256_cmpeq_epi8(b0, zero),
+                                                          _mm256_cmpeq_epi8(b1, zero)),
+                                         _mm256_cmpeq_epi8(b2, one));
+        unsigned int mask = (unsigned int)_mm256_movemask_epi8(match);
+        if (mask != 0) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+    
+    return i + findStartCodeSse2(&data[i], length - i);
+}
+
+#endif
+
+#if NAL_HAVE_NEON
+
+static size_t findStartCodeNeon(const uint8_t* data, size_t length)
+{
+    const uint8x16_t zero = vdupq_n_u8(0);
+    const uint8x16_t one = vdupq_n_u8(1);
+    size_t i = 0;
+    
+    for (; i + 16 + START_CODE_OVERREAD <= length; i += 16) {
+        uint8x16_t b0 = vld1q_u8(&data[i]);
+        uint8x16_t b1 = vld1q_u8(&data[i + 1]);
+        uint8x16_t b2 = vld1q_u8(&data[i + 2]);
+        
+        uint8x16_t match = vandq_u8(vandq_u8(vceqq_u8(b0, zero), vceqq_u8(b1, zero)),
+                                    vceqq_u8(b2, one));
+        
+        // NEON has no movemask, so narrow each byte of the match vector to a nibble
+        uint64_t mask = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(match), 4)), 0);
+        if (mask != 0) {
+            return i + (__builtin_ctzll(mask) >> 2);
+        }
+    }
+    
+    return i + findStartCodeScalar(&data[i], length - i);
+}
+
+#endif
+
+bool NalIsKernelSupported(NAL_KERNEL kernel)
+{
+    switch (kernel) {
+        case NAL_KERNEL_SCALAR:
+            return true;
+#if NAL_HAVE_X86
+        case NAL_KERNEL_SSE2:
+            return __builtin_cpu_supports("sse2");
+        case NAL_KERNEL_AVX2:
+            return __builtin_cpu_supports("avx2");
+#endif
+#if NAL_HAVE_NEON
+        case NAL_KERNEL_NEON:
+            return true;
+#endif
+        default:
+            return false;
+    }
+}
+
+const char* NalGetKernelName(NAL_KERNEL kernel)
+{
+    switch (kernel) {
+        case NAL_KERNEL_SCALAR:
+            return "scalar";
+        case NAL_KERNEL_SSE2:
+            return "SSE2";
+        case NAL_KERNEL_AVX2:
+            return "AVX2";
+        case NAL_KERNEL_NEON:
+            return "NEON";
+        default:
+            return "unknown";
+    }
+}
+
+NAL_KERNEL NalGetBestKernel(void)
+{
+    if (NalIsKernelSupported(NAL_KERNEL_NEON)) {
+        return NAL_KERNEL_NEON;
+    }
+    else if (NalIsKernelSupported(NAL_KERNEL_AVX2)) {
+        return NAL_KERNEL_AVX2;
+    }
+    else if (NalIsKernelSupported(NAL_KERNEL_SSE2)) {
+        return NAL_KERNEL_SSE2;
+    }
+    else {
+        return NAL_KERNEL_SCALAR;
+    }
+}
+
+size_t NalFindStartCode(NAL_KERNEL kernel, const uint8_t* data, size_t length)
+{
+    switch (kernel) {
+#if NAL_HAVE_X86
+        case NAL_KERNEL_SSE2:
+            return findStartCodeSse2(data, length);
+        case NAL_KERNEL_AVX2:
+            return findStartCodeAvx2(data, length);
+#endif
+#if NAL_HAVE_NEON
+        case NAL_KERNEL_NEON:
+            return findStartCodeNeon(data, length);
+#endif
+        default:
+            return findStartCodeScalar(data, length);
+    }
+}
+
+typedef struct _SPLIT_CONTEXT {
+    PNAL_UNIT units;
+    size_t maxUnits;
+    size_t count;
+} SPLIT_CONTEXT, *PSPLIT_CONTEXT;
+
+static void storeNalUnit(void* context, size_t offset, size_t length)
+{
+    PSPLIT_CONTEXT ctx = (PSPLIT_CONTEXT)context;
+    
+    if (ctx->count < ctx->maxUnits) {
+        ctx->units[ctx->count].offset = offset;
+        ctx->units[ctx->count].length = length;
+    }
+    
+    ctx->count++;
+}
+
+size_t NalSplitAnnexB(NAL_KERNEL kernel, const uint8_t* data, size_t length, PNAL_UNIT units, size_t maxUnits)
+{
+    NAL_SPLITTER splitter;
+    SPLIT_CONTEXT ctx = { units, maxUnits, 0 };
+    
+    NalSplitterInit(&splitter, kernel);
+    NalSplitterFeed(&splitter, data, length, storeNalUnit, &ctx);
+    NalSplitterFinish(&splitter, storeNalUnit, &ctx);
+    
+    return ctx.count;
+}
+
+void NalSplitterInit(PNAL_SPLITTER splitter, NAL_KERNEL kernel)
+{
+    splitter->kernel = kernel;
+    splitter->position = 0;
+    splitter->lastStart = 0;
+    splitter->haveStart = false;
+    splitter->trailingZeros = 0;
+}
+
+static void foundStartCode(PNAL_SPLITTER splitter, size_t startOffset,
+                           NalUnitCallback callback, void* context)
+{
+    if (splitter->haveStart) {
+        callback(context, splitter->lastStart, startOffset - splitter->lastStart);
+    }
+    
+    splitter->lastStart = startOffset;
+    splitter->haveStart = true;
+}
+
+void NalSplitterFeed(PNAL_SPLITTER splitter, const uint8_t* data, size_t length,
+                     NalUnitCallback callback, void* context)
+{
+    size_t i;
+    
+    if (length == 0) {
+        return;
+    }
+    
+    // Check for a start code that began in the previous buffer. The vector
+    // kernels only find start codes that lie entirely within this buffer.
+    if (splitter->trailingZeros >= 2 && data[0] == 1) {
+        foundStartCode(splitter, splitter->position - 2, callback, context);
+    }
+    else if (splitter->trailingZeros >= 1 && length >= 2 && data[0] == 0 && data[1] == 1) {
+        foundStartCode(splitter, splitter->position - 1, callback, context);
+    }
+    
+    i = 0;
+    for (;;) {
+        size_t offset = NalFindStartCode(splitter->kernel, &data[i], length - i);
+        if (offset == length - i) {
+            break;
+        }
+        
+        foundStartCode(splitter, splitter->position + i + offset, callback, context);
+        i += offset + 3;
+    }
+    
+    // Remember up to 2 trailing zero bytes for the next buffer
+    if (length >= 2) {
+        splitter->trailingZeros = data[length - 1] != 0 ? 0 : (data[length - 2] != 0 ? 1 : 2);
+    }
+    else if (data[0] == 0) {
+        splitter->trailingZeros = splitter->trailingZeros >= 1 ? 2 : 1;
+    }
+    else {
+        splitter->trailingZeros = 0;
+    }
+    
+    splitter->position += length;
+}
+
+void NalSplitterFinish(PNAL_SPLITTER splitter, NalUnitCallback callback, void* context)
+{
+    if (splitter->haveStart) {
+        callback(context, splitter->lastStart, splitter->position - splitter->lastStart);
+        splitter->haveStart = false;
+    }
+}
@@ -0,0 +1,68 @@
+//
+//  NalSplitter.h
+//  Moonlight
+//
+//  Copyright © 2026 Moonlight Game Streaming Project. All rights reserved.
+//
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Splits H.264/HEVC Annex B bitstreams into NAL units. The start code search
+// uses NEON on ARM and SSE2 or AVX2 on x86, with a portable scalar fallback.
+//
+// A NAL unit is reported as the offset of its 00 00 01 start code and its
+// length up to the next start code, so the start code is included. A zero
+// byte preceding a 4-byte start code is reported as trailing data of the
+// previous NAL unit.
+
+typedef enum {
+    NAL_KERNEL_SCALAR,
+    NAL_KERNEL_SSE2,
+    NAL_KERNEL_AVX2,
+    NAL_KERNEL_NEON,
+    NAL_KERNEL_COUNT
+} NAL_KERNEL;
+
+typedef struct _NAL_UNIT {
+    size_t offset;
+    size_t length;
+} NAL_UNIT, *PNAL_UNIT;
+
+typedef void (*NalUnitCallback)(void* context, size_t offset, size_t length);
+
+// Incremental splitter for data that arrives in several buffers. Start codes
+// that straddle buffer boundaries are handled. Offsets are relative to the
+// first byte passed to NalSplitterFeed() after NalSplitterInit().
+typedef struct _NAL_SPLITTER {
+    NAL_KERNEL kernel;
+    size_t position;
+    size_t lastStart;
+    bool haveStart;
+    int trailingZeros;
+} NAL_SPLITTER, *PNAL_SPLITTER;
+
+bool NalIsKernelSupported(NAL_KERNEL kernel);
+const char* NalGetKernelName(NAL_KERNEL kernel);
+
+// Returns the fastest kernel supported by the current CPU
+NAL_KERNEL NalGetBestKernel(void);
+
+// Returns the offset of the first start code in data or length if there is none
+size_t NalFindStartCode(NAL_KERNEL kernel, const uint8_t* data, size_t length);
+
+// Splits contiguous Annex B data. Returns the total number of NAL units found,
+// but only the first maxUnits of them are stored in units.
+size_t NalSplitAnnexB(NAL_KERNEL kernel, const uint8_t* data, size_t length, PNAL_UNIT units, size_t maxUnits);
+
+void NalSplitterInit(PNAL_SPLITTER splitter, NAL_KERNEL kernel);
+
+// Invokes the callback for every NAL unit that is known to be complete
+void NalSplitterFeed(PNAL_SPLITTER splitter, const uint8_t* data, size_t length,
+                     NalUnitCallback callback, void* context);
+
+// Invokes the callback for the final NAL unit, which runs to the end of the data
+void NalSplitterFinish(PNAL_SPLITTER splitter, NalUnitCallback callback, void* context);
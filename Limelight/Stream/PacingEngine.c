@@ -0,0 +1,149 @@
+//
+//  PacingEngine.c
+//  Moonlight
+//
+//  Copyright © 2026 Moonlight Game Streaming Project. All rights reserved.
+//
+
+#include "PacingEngine.h"
+
+#include <math.h>
+#include <string.h>
+
+// Weight of each new sample in the smoothed jitter (same as RFC 3550)
+#define JITTER_GAIN (1.0 / 16.0)
+
+// The peak jitter halves about every second at 60 FPS
+#define PEAK_JITTER_DECAY 0.99
+
+// Jitter below this fraction of a frame interval is absorbed by display timing slack
+#define NEGLIGIBLE_JITTER_FRACTION 0.25
+
+// A frame that is this many frame intervals later than the host usually sends
+// them causes a visible stutter
+#define UNDERRUN_INTERVALS 0.5
+
+// A gap this many frame intervals long means the host stopped sending frames
+// (static content, a paused game, etc.) rather than that frames were delayed
+#define IDLE_GAP_INTERVALS 4.0
+
+// How long the depth must be stable before we try a lower depth
+#define DEPTH_DECREASE_DELAY 5.0
+
+// How long an underrun keeps the depth raised
+#define UNDERRUN_HOLD_TIME 10.0
+
+void PeInit(PPACING_ENGINE engine, int frameRate, int maxDepth)
+{
+    memset(engine, 0, sizeof(*engine));
+    engine->frameInterval = 1.0 / (frameRate > 0 ? frameRate : 60);
+    engine->maxDepth = maxDepth;
+    
+    // Assume the host renders at the stream frame rate until we see otherwise
+    engine->arrivalInterval = engine->frameInterval;
+    
+    // Start with the single frame of slack that fixed pacing always used
+    engine->targetDepth = maxDepth > 0 ? 1 : 0;
+}
+
+void PeRecordArrival(PPACING_ENGINE engine, double arrivalTime)
+{
+    double gap = arrivalTime - engine->lastArrivalTime;
+    
+    // Idle gaps say nothing about network jitter, so they're left out of the estimate
+    if (engine->lastArrivalTime != 0 && gap < engine->frameInterval * IDLE_GAP_INTERVALS) {
+        if (engine->arrivalSamples == 0) {
+            // The first gap is all we know about the host's frame rate, and
+            // there's nothing to measure it against yet
+            engine->arrivalInterval = gap;
+        }
+        else {
+            // Measured against the host's own frame spacing, so a host rendering
+            // below the stream frame rate isn't mistaken for a jittery one
+            double deviation = fabs(gap - engine->arrivalInterval);
+            
+            // A plain average until there are enough samples for the smoothed
+            // one, so the host's frame rate is learned within a few frames
+            double gain = fmax(JITTER_GAIN, 1.0 / (engine->arrivalSamples + 1));
+            
+            engine->arrivalInterval += (gap - engine->arrivalInterval) * gain;
+            engine->jitter += (deviation - engine->jitter) * JITTER_GAIN;
+            engine->peakJitter = fmax(engine->peakJitter * PEAK_JITTER_DECAY, deviation);
+        }
+        engine->arrivalSamples++;
+    }
+    
+    engine->lastArrivalTime = arrivalTime;
+}
+
+void PeRecordRttVariance(PPACING_ENGINE engine, double rttVariance)
+{
+    // Variance is measured over the round trip, but frames only travel one way
+    engine->networkJitter = rttVariance / 2;
+}
+
+void PeRecordRefresh(PPACING_ENGINE engine, double now, int newFrame)
+{
+    if (!newFrame) {
+        return;
+    }
+    
+    // A refresh without a frame is only an underrun if a frame was due, which
+    // depends on how often the host is actually sending them. We can't tell that
+    // until the next frame shows up, so gaps are judged once they end. Longer
+    // gaps are the host going idle, not frames arriving late.
+    double gap = now - engine->lastFrameTime;
+    if (engine->lastFrameTime != 0 &&
+        gap >= engine->arrivalInterval + engine->frameInterval * UNDERRUN_INTERVALS &&
+        gap < engine->frameInterval * IDLE_GAP_INTERVALS) {
+        // We ran dry, so hold back one more frame than we were for a while
+        engine->underruns++;
+        engine->underrunDepth = engine->targetDepth + 1;
+        if (engine->underrunDepth > engine->maxDepth) {
+            engine->underrunDepth = engine->maxDepth;
+        }
+        engine->underrunTime = now;
+    }
+    
+    engine->lastFrameTime = now;
+}
+
+static int getJitterDepth(PPACING_ENGINE engine)
+{
+    // The smoothed jitter misses bursts and the peak overreacts to single outliers,
+    // so we use the midpoint of the two.
+    double jitter = fmax((engine->jitter + engine->peakJitter) / 2, engine->networkJitter);
+    
+    if (jitter < engine->frameInterval * NEGLIGIBLE_JITTER_FRACTION) {
+        return 0;
+    }
+    
+    return (int)ceil(jitter / engine->frameInterval);
+}
+
+int PeGetTargetDepth(PPACING_ENGINE engine, double now)
+{
+    int depth = getJitterDepth(engine);
+    
+    // Underruns are the ground truth that our estimate was too low
+    if (now - engine->underrunTime < UNDERRUN_HOLD_TIME && engine->underrunDepth > depth) {
+        depth = engine->underrunDepth;
+    }
+    
+    if (depth > engine->maxDepth) {
+        depth = engine->maxDepth;
+    }
+    
+    if (depth > engine->targetDepth) {
+        // Add latency immediately to avoid stutter
+        engine->targetDepth = depth;
+        engine->lastDepthChangeTime = now;
+    }
+    else if (depth < engine->targetDepth && now - engine->lastDepthChangeTime >= DEPTH_DECREASE_DELAY) {
+        // Give latency back one frame at a time once things have been stable
+        engine->targetDepth--;
+        engine->lastDepthChangeTime = now;
+    }
+    
+    return engine->targetDepth;
+}
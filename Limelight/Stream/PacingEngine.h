@@ -0,0 +1,60 @@
+//
+//  PacingEngine.h
+//  Moonlight
+//
+//  Copyright © 2026 Moonlight Game Streaming Project. All rights reserved.
+//
+
+#pragma once
+
+#include <stdint.h>
+
+// Chooses how many decoded frames to hold back for frame pacing. Holding frames
+// absorbs jitter in frame arrival at the cost of one frame interval of latency
+// each, so we only hold as many as the observed jitter calls for.
+//
+// All times are in seconds on the caller's clock. The engine does no I/O and
+// reads no clocks itself, so the same inputs always give the same decisions.
+
+typedef struct _PACING_ENGINE {
+    double frameInterval;
+    int maxDepth;
+    
+    // Smoothed and peak deviation of frame arrival from the host's frame spacing
+    double lastArrivalTime;
+    double jitter;
+    double peakJitter;
+    
+    // Smoothed time between frames, which is longer than the frame interval
+    // when the host renders slower than the stream frame rate
+    double arrivalInterval;
+    uint32_t arrivalSamples;
+    
+    // One-way jitter implied by the host's RTT variance
+    double networkJitter;
+    
+    int targetDepth;
+    double lastDepthChangeTime;
+    double lastFrameTime;
+    
+    // Depth to hold after the last underrun, and when it happened
+    int underrunDepth;
+    double underrunTime;
+    uint32_t underruns;
+} PACING_ENGINE, *PPACING_ENGINE;
+
+void PeInit(PPACING_ENGINE engine, int frameRate, int maxDepth);
+
+// Called with the time each frame became ready for display, in order
+void PeRecordArrival(PPACING_ENGINE engine, double arrivalTime);
+
+// Called periodically with the RTT variance reported by LiGetEstimatedRttInfo()
+void PeRecordRttVariance(PPACING_ENGINE engine, double rttVariance);
+
+// Called on each display refresh. newFrame is set if a frame was shown on this
+// refresh. A frame shown late after a run of refreshes without one counts as an
+// underrun, unless the gap was long enough that the host was just idle.
+void PeRecordRefresh(PPACING_ENGINE engine, double now, int newFrame);
+
+// Returns the number of frames to keep queued after this refresh
+int PeGetTargetDepth(PPACING_ENGINE engine, double now);
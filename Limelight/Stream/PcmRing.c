@@ -0,0 +1,209 @@
+//
+//  PcmRing.c
+//  Moonlight
+//
+//  Copyright © 2026 Moonlight Game Streaming Project. All rights reserved.
+//
+
+#include "PcmRing.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// Room for bursts well beyond the high watermark
+#define CAPACITY_TARGET_MULTIPLE 8
+
+// Output frames per correction step. At 48 kHz these adjust the playback rate
+// by about 0.4% and 3% respectively.
+#define SLOW_CORRECTION_INTERVAL 256
+#define FAST_CORRECTION_INTERVAL 32
+
+bool PcmRingInit(PPCM_RING ring, int channels, size_t targetFrames)
+{
+    memset(ring, 0, sizeof(*ring));
+    
+    if (channels <= 0 || channels > PCM_RING_MAX_CHANNELS || targetFrames == 0) {
+        return false;
+    }
+    
+    size_t capacity = 1;
+    while (capacity < targetFrames * CAPACITY_TARGET_MULTIPLE) {
+        capacity <<= 1;
+    }
+    
+    ring->samples = malloc(capacity * channels * sizeof(int16_t));
+    if (ring->samples == NULL) {
+        return false;
+    }
+    
+    atomic_init(&ring->readPosition, 0);
+    atomic_init(&ring->writePosition, 0);
+    atomic_init(&ring->underruns, 0);
+    atomic_init(&ring->overflowFrames, 0);
+    atomic_init(&ring->droppedFrames, 0);
+    atomic_init(&ring->duplicatedFrames, 0);
+    
+    ring->capacityFrames = capacity;
+    ring->channels = channels;
+    ring->targetFrames = targetFrames;
+    ring->lowWatermark = targetFrames / 2;
+    ring->highWatermark = targetFrames * 2;
+    
+    // Don't start playback until we've buffered up to the target
+    ring->refilling = true;
+    
+    return true;
+}
+
+void PcmRingDestroy(PPCM_RING ring)
+{
+    free(ring->samples);
+    ring->samples = NULL;
+}
+
+void PcmRingWrite(PPCM_RING ring, const int16_t* samples, size_t frames)
+{
+    size_t writePosition = atomic_load_explicit(&ring->writePosition, memory_order_relaxed);
+    size_t readPosition = atomic_load_explicit(&ring->readPosition, memory_order_acquire);
+    size_t freeFrames = ring->capacityFrames - (writePosition - readPosition);
+    
+    if (frames > freeFrames) {
+        atomic_fetch_add_explicit(&ring->overflowFrames, (uint32_t)(frames - freeFrames), memory_order_relaxed);
+        frames = freeFrames;
+    }
+    
+    // Copy in up to two pieces if we wrap around the end of the buffer
+    size_t offset = writePosition & (ring->capacityFrames - 1);
+    size_t firstFrames = ring->capacityFrames - offset;
+    if (firstFrames > frames) {
+        firstFrames = frames;
+    }
+    
+    memcpy(&ring->samples[offset * ring->channels], samples,
+           firstFrames * ring->channels * sizeof(int16_t));
+    memcpy(ring->samples, &samples[firstFrames * ring->channels],
+           (frames - firstFrames) * ring->channels * sizeof(int16_t));
+    
+    // Publish the frames to the consumer
+    atomic_store_explicit(&ring->writePosition, writePosition + frames, memory_order_release);
+}
+
+static const int16_t* getFrame(PPCM_RING ring, size_t position)
+{
+    return &ring->samples[(position & (ring->capacityFrames - 1)) * ring->channels];
+}
+
+void PcmRingRead(PPCM_RING ring, int16_t* samples, size_t frames)
+{
+    size_t readPosition = atomic_load_explicit(&ring->readPosition, memory_order_relaxed);
+    size_t writePosition = atomic_load_explicit(&ring->writePosition, memory_order_acquire);
+    size_t queuedFrames = writePosition - readPosition;
+    int channels = ring->channels;
+    
+    if (ring->refilling) {
+        if (queuedFrames < ring->targetFrames) {
+            memset(samples, 0, frames * channels * sizeof(int16_t));
+            return;
+        }
+        
+        ring->refilling = false;
+    }
+    
+    // Start correcting when we leave the band around the target, and keep going
+    // until we're back at the target
+    if (queuedFrames > ring->highWatermark) {
+        ring->correction = PCM_RING_CORRECTION_DROP;
+    }
+    else if (queuedFrames < ring->lowWatermark) {
+        ring->correction = PCM_RING_CORRECTION_INSERT;
+    }
+    else if ((ring->correction == PCM_RING_CORRECTION_DROP && queuedFrames <= ring->targetFrames) ||
+             (ring->correction == PCM_RING_CORRECTION_INSERT && queuedFrames >= ring->targetFrames)) {
+        ring->correction = PCM_RING_CORRECTION_NONE;
+    }
+    
+    // Pick a correction rate for this callback based on how far we are from the target
+    uint32_t correctionInterval = 0;
+    bool dropFrames = ring->correction == PCM_RING_CORRECTION_DROP;
+    if (dropFrames && queuedFrames > ring->highWatermark * 2) {
+        correctionInterval = FAST_CORRECTION_INTERVAL;
+    }
+    else if (ring->correction != PCM_RING_CORRECTION_NONE) {
+        correctionInterval = SLOW_CORRECTION_INTERVAL;
+    }
+    
+    const int16_t* previousFrame = ring->lastFrame;
+    size_t i;
+    for (i = 0; i < frames; i++) {
+        int16_t* outputFrame = &samples[i * channels];
+        
+        if (queuedFrames == 0) {
+            // Fill the rest with silence and wait for the ring to refill
+            memset(outputFrame, 0, (frames - i) * channels * sizeof(int16_t));
+            atomic_fetch_add_explicit(&ring->underruns, 1, memory_order_relaxed);
+            ring->refilling = true;
+            ring->correction = PCM_RING_CORRECTION_NONE;
+            break;
+        }
+        
+        const int16_t* frame = getFrame(ring, readPosition);
+        
+        if (correctionInterval != 0 && ++ring->correctionCounter >= correctionInterval) {
+            ring->correctionCounter = 0;
+            
+            if (dropFrames && queuedFrames >= 2) {
+                // Merge two frames into one
+                const int16_t* nextFrame = getFrame(ring, readPosition + 1);
+                for (int ch = 0; ch < channels; ch++) {
+                    outputFrame[ch] = (int16_t)(((int32_t)frame[ch] + nextFrame[ch]) / 2);
+                }
+                readPosition += 2;
+                queuedFrames -= 2;
+                atomic_fetch_add_explicit(&ring->droppedFrames, 1, memory_order_relaxed);
+            }
+            else if (!dropFrames) {
+                // Insert a frame halfway between the last one and this one
+                for (int ch = 0; ch < channels; ch++) {
+                    outputFrame[ch] = (int16_t)(((int32_t)previousFrame[ch] + frame[ch]) / 2);
+                }
+                atomic_fetch_add_explicit(&ring->duplicatedFrames, 1, memory_order_relaxed);
+            }
+            else {
+                memcpy(outputFrame, frame, channels * sizeof(int16_t));
+                readPosition++;
+                queuedFrames--;
+            }
+        }
+        else {
+            memcpy(outputFrame, frame, channels * sizeof(int16_t));
+            readPosition++;
+            queuedFrames--;
+        }
+        
+        previousFrame = outputFrame;
+    }
+    
+    // Remember the last frame we played for interpolation in the next callback
+    if (i > 0) {
+        memcpy(ring->lastFrame, &samples[(i - 1) * channels], channels * sizeof(int16_t));
+    }
+    
+    // Hand the space back to the producer
+    atomic_store_explicit(&ring->readPosition, readPosition, memory_order_release);
+}
+
+size_t PcmRingGetQueuedFrames(PPCM_RING ring)
+{
+    size_t readPosition = atomic_load_explicit(&ring->readPosition, memory_order_acquire);
+    size_t writePosition = atomic_load_explicit(&ring->writePosition, memory_order_acquire);
+    
+    return writePosition - readPosition;
+}
+
+void PcmRingGetStats(PPCM_RING ring, PPCM_RING_STATS stats)
+{
+    stats->underruns = atomic_load_explicit(&ring->underruns, memory_order_relaxed);
+    stats->overflowFrames = atomic_load_explicit(&ring->overflowFrames, memory_order_relaxed);
+    stats->droppedFrames = atomic_load_explicit(&ring->droppedFrames, memory_order_relaxed);
+    stats->duplicatedFrames = atomic_load_explicit(&ring->duplicatedFrames, memory_order_relaxed);
+}
@@ -0,0 +1,86 @@
+//
+//  PcmRing.h
+//  Moonlight
+//
+//  Copyright © 2026 Moonlight Game Streaming Project. All rights reserved.
+//
+
+#pragma once
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// A lock-free ring of interleaved 16-bit PCM for one producer (the audio
+// receive thread) and one consumer (the audio device callback).
+//
+// The consumer keeps the fill level near a target by occasionally merging two
+// frames into one or inserting an interpolated frame, which is inaudible
+// compared to dropping whole packets. After an underrun, output stays silent
+// until the ring has refilled to the target.
+//
+// Once the fill level leaves the band around the target, correction continues
+// until it is back at the target. The level moves a whole packet at a time, so
+// stopping at the edge of the band would leave it one late packet away from
+// the next underrun.
+
+#define PCM_RING_MAX_CHANNELS 8
+#define PCM_RING_CACHE_LINE_SIZE 64
+
+typedef enum {
+    PCM_RING_CORRECTION_NONE,
+    PCM_RING_CORRECTION_DROP,
+    PCM_RING_CORRECTION_INSERT,
+} PCM_RING_CORRECTION;
+
+typedef struct _PCM_RING_STATS {
+    uint32_t underruns;
+    uint32_t overflowFrames;
+    uint32_t droppedFrames;
+    uint32_t duplicatedFrames;
+} PCM_RING_STATS, *PPCM_RING_STATS;
+
+typedef struct _PCM_RING {
+    // Written only by the consumer
+    _Atomic(size_t) readPosition;
+    char readPadding[PCM_RING_CACHE_LINE_SIZE - sizeof(size_t)];
+    
+    // Written only by the producer
+    _Atomic(size_t) writePosition;
+    char writePadding[PCM_RING_CACHE_LINE_SIZE - sizeof(size_t)];
+    
+    int16_t* samples;
+    size_t capacityFrames;
+    int channels;
+    
+    size_t targetFrames;
+    size_t lowWatermark;
+    size_t highWatermark;
+    
+    // Consumer state
+    bool refilling;
+    PCM_RING_CORRECTION correction;
+    uint32_t correctionCounter;
+    int16_t lastFrame[PCM_RING_MAX_CHANNELS];
+    
+    _Atomic(uint32_t) underruns;
+    _Atomic(uint32_t) overflowFrames;
+    _Atomic(uint32_t) droppedFrames;
+    _Atomic(uint32_t) duplicatedFrames;
+} PCM_RING, *PPCM_RING;
+
+// The fill level is kept between half and twice targetFrames. Returns false on
+// allocation failure or an unsupported channel count.
+bool PcmRingInit(PPCM_RING ring, int channels, size_t targetFrames);
+void PcmRingDestroy(PPCM_RING ring);
+
+// Producer only. Frames that don't fit are discarded and counted as overflow.
+void PcmRingWrite(PPCM_RING ring, const int16_t* samples, size_t frames);
+
+// Consumer only. Always fills all frames, using silence if the ring runs dry.
+void PcmRingRead(PPCM_RING ring, int16_t* samples, size_t frames);
+
+// Safe to call from any thread
+size_t PcmRingGetQueuedFrames(PPCM_RING ring);
+void PcmRingGetStats(PPCM_RING ring, PPCM_RING_STATS stats);
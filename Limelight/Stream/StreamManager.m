@@ -25,6 +25,7 @@
     UIView* _renderView;
     id<ConnectionCallbacks> _callbacks;
     Connection* _connection;
+    VideoDecoderRenderer* _renderer;
 }
 
 - (id) initWithConfig:(StreamConfiguration*)config renderView:(UIView*)view connectionCallbacks:(id<ConnectionCallbacks>)callbacks {
@@ -99,8 +100,8 @@
     
     // Initializing the renderer must be done on the main thread
     dispatch_async(dispatch_get_main_queue(), ^{
-        VideoDecoderRenderer* renderer = [[VideoDecoderRenderer alloc] initWithView:self->_renderView callbacks:self->_callbacks streamAspectRatio:(float)self->_config.width / (float)self->_config.height useFramePacing:self->_config.useFramePacing];
-        self->_connection = [[Connection alloc] initWithConfig:self->_config renderer:renderer connectionCallbacks:self->_callbacks];
+        self->_renderer = [[VideoDecoderRenderer alloc] initWithView:self->_renderView callbacks:self->_callbacks streamAspectRatio:(float)self->_config.width / (float)self->_config.height useFramePacing:self->_config.useFramePacing];
+        self->_connection = [[Connection alloc] initWithConfig:self->_config renderer:self->_renderer connectionCallbacks:self->_callbacks];
         NSOperationQueue* opQueue = [[NSOperationQueue alloc] init];
         [opQueue addOperation:self->_connection];
     });
@@ -147,6 +148,20 @@
     return TRUE;
 }
 
+static void appendLatencyPercentiles(NSMutableString* string, FRAME_STAGE from, FRAME_STAGE to, const LATENCY_HISTOGRAM* histogram)
+{
+    if (histogram->count == 0) {
+        return;
+    }
+    
+    [string appendFormat:@"\n%@ to %s p50/p95/p99: %.2f/%.2f/%.2f ms",
+     [NSString stringWithUTF8String:FtlGetStageName(from)].capitalizedString,
+     FtlGetStageName(to),
+     LhGetPercentile(histogram, 50) / 1000.0,
+     LhGetPercentile(histogram, 95) / 1000.0,
+     LhGetPercentile(histogram, 99) / 1000.0];
+}
+
 - (NSString*) getStatsOverlayText {
     video_stats_t stats;
     
@@ -178,15 +193,65 @@
         hostProcessingString = @"";
     }
     
+    NSString* decodeQueueString;
+    if (stats.receivedFrames != 0) {
+        decodeQueueString = [NSString stringWithFormat:@"\nDecode queue depth avg/max: %.1f/%d frames",
+                             (float)stats.totalDecodeQueueDepth / stats.receivedFrames,
+                             stats.maxDecodeQueueDepth];
+    }
+    else {
+        decodeQueueString = @"";
+    }
+    
+    pipeline_stats_t pipelineStats;
+    NSString* pipelineString;
+    if ([_renderer getPipelineStats:&pipelineStats] && pipelineStats.frames != 0) {
+        pipelineString = [NSString stringWithFormat:@"\nFrame preparation time avg/max: %.2f/%.2f ms\nDisplay queue delay avg/max: %.2f/%.2f ms\nDisplay layer enqueue time avg/max: %.2f/%.2f ms",
+                          pipelineStats.totalPrepTime / pipelineStats.frames * 1000,
+                          pipelineStats.maxPrepTime * 1000,
+                          pipelineStats.totalQueueTime / pipelineStats.frames * 1000,
+                          pipelineStats.maxQueueTime * 1000,
+                          pipelineStats.totalEnqueueTime / pipelineStats.frames * 1000,
+                          pipelineStats.maxEnqueueTime * 1000];
+        if (_config.useFramePacing) {
+            pipelineString = [pipelineString stringByAppendingFormat:@"\nFrame pacing buffer: %d frames (%u underruns)",
+                              pipelineStats.pacingDepth,
+                              pipelineStats.pacingUnderruns];
+        }
+    }
+    else {
+        pipelineString = @"";
+    }
+    
+    // Show the tail of each stage since averages hide occasional stutters
+    NSMutableString* percentileString = [NSMutableString string];
+    for (int stage = FRAME_STAGE_POLL; stage < FRAME_STAGE_COUNT; stage++) {
+        appendLatencyPercentiles(percentileString, stage - 1, stage,
+                                 [_renderer getLatencyHistogramForStage:stage]);
+    }
+    
+    // The receive histogram covers the whole pipeline
+    appendLatencyPercentiles(percentileString, FRAME_STAGE_RECEIVE, FRAME_STAGE_DISPLAY,
+                             [_renderer getLatencyHistogramForStage:FRAME_STAGE_RECEIVE]);
+    
+    uint32_t formatDescCacheHits, formatDescCacheMisses;
+    [_renderer getFormatDescriptionCacheHits:&formatDescCacheHits misses:&formatDescCacheMisses];
+    NSString* formatDescCacheString = [NSString stringWithFormat:@"\nFormat description cache hits/misses: %u/%u",
+                                       formatDescCacheHits, formatDescCacheMisses];
+    
     float interval = stats.endTime - stats.startTime;
-    return [NSString stringWithFormat:@"Video stream: %dx%d %.2f FPS (Codec: %@)\nFrames dropped by your network connection: %.2f%%\nAverage network latency: %@%@",
+    return [NSString stringWithFormat:@"Video stream: %dx%d %.2f FPS (Codec: %@)\nFrames dropped by your network connection: %.2f%%\nAverage network latency: %@%@%@%@%@%@",
             _config.width,
             _config.height,
             stats.totalFrames / interval,
             [_connection getActiveCodecName],
             stats.networkDroppedFrames / interval,
             latencyString,
-            hostProcessingString];
+            hostProcessingString,
+            decodeQueueString,
+            pipelineString,
+            percentileString,
+            formatDescCacheString];
 }
 
 @end
@@ -11,16 +11,54 @@
 #import "ConnectionCallbacks.h"
 
 #include "Limelight.h"
+#include "FrameTimingLog.h"
+
+// Per-stage timestamps of a frame, in CACurrentMediaTime() seconds
+typedef struct {
+    // The frame was reassembled by common-c
+    CFTimeInterval receiveTime;
+    // LiWaitForNextVideoFrame() returned the frame on the decode prep thread
+    CFTimeInterval pollTime;
+    // The sample buffer was ready to be handed to the display link
+    CFTimeInterval preparedTime;
+    // The sample buffer was enqueued on the display layer
+    CFTimeInterval enqueueTime;
+    // The display refresh where the frame is expected to appear
+    CFTimeInterval displayTime;
+} frame_timestamps_t;
+
+typedef struct {
+    CFTimeInterval startTime;
+    CFTimeInterval endTime;
+    int frames;
+    CFTimeInterval totalPrepTime;
+    CFTimeInterval maxPrepTime;
+    CFTimeInterval totalQueueTime;
+    CFTimeInterval maxQueueTime;
+    // Time spent inside enqueueSampleBuffer: on the main thread
+    CFTimeInterval totalEnqueueTime;
+    CFTimeInterval maxEnqueueTime;
+    // Frames held back by frame pacing and the total number of pacing underruns
+    int pacingDepth;
+    uint32_t pacingUnderruns;
+} pipeline_stats_t;
 
 @interface VideoDecoderRenderer : NSObject
 
 - (id)initWithView:(UIView*)view callbacks:(id<ConnectionCallbacks>)callbacks streamAspectRatio:(float)aspectRatio useFramePacing:(BOOL)useFramePacing;
 
-- (void)setupWithVideoFormat:(int)videoFormat width:(int)videoWidth height:(int)videoHeight frameRate:(int)frameRate;
+- (void)setupWithVideoFormat:(int)videoFormat width:(int)videoWidth height:(int)videoHeight frameRate:(int)frameRate bitrate:(int)bitrate;
 - (void)start;
 - (void)stop;
 - (void)setHdrMode:(BOOL)enabled;
 
+// Must be called on the main thread
+- (BOOL)getPipelineStats:(pipeline_stats_t*)stats;
+- (const LATENCY_HISTOGRAM*)getLatencyHistogramForStage:(FRAME_STAGE)stage;
+
+- (void)getFormatDescriptionCacheHits:(uint32_t*)hits misses:(uint32_t*)misses;
+
 - (int)submitDecodeBuffer:(unsigned char *)data length:(int)length bufferType:(int)bufferType decodeUnit:(PDECODE_UNIT)du;
+- (void)submitDecodeUnit:(PDECODE_UNIT)du frameHandle:(VIDEO_FRAME_HANDLE)frameHandle;
 
 @end
@@ -9,15 +9,48 @@
 #import "VideoDecoderRenderer.h"
 #import "StreamView.h"
 
-#include <libavcodec/avcodec.h>
-#include <libavcodec/cbs.h>
-#include <libavcodec/cbs_av1.h>
-#include <libavformat/avio.h>
-#include <libavutil/mem.h>
+#include "Av1Parser.h"
+#include "FrameBufferPool.h"
+#include "FrameCompletionTracker.h"
+#include "NalSplitter.h"
+#include "PacingEngine.h"
+#include "SpscQueue.h"
 
-// Private libavformat API for writing the AV1 Codec Configuration Box
-extern int ff_isom_write_av1c(AVIOContext *pb, const uint8_t *buf, int size,
-                              int write_seq_header);
+// Enough for several frames of jitter at high frame rates
+#define PREPARED_FRAME_QUEUE_SIZE 16
+
+// Per-frame timings of the last 4096 frames are kept for export
+#define FRAME_TIMING_LOG_SIZE 4096
+
+// Most frames the pacing engine may hold back to absorb jitter
+#define PACING_MAX_DEPTH 3
+
+// Maximum number of format descriptions kept for reuse across IDR frames
+#define FORMAT_DESC_CACHE_SIZE 8
+
+// How long -stop waits for the decoder to release frames after a flush
+#define FRAME_COMPLETION_TIMEOUT_MS 1000
+
+typedef struct _FRAME_COMPLETION_CONTEXT {
+    PFRAME_COMPLETION_TRACKER tracker;
+    VIDEO_FRAME_HANDLE frameHandle;
+    int drStatus;
+} FRAME_COMPLETION_CONTEXT, *PFRAME_COMPLETION_CONTEXT;
+
+// A frame that is ready to be enqueued on the display layer
+typedef struct _PREPARED_FRAME {
+    CMSampleBufferRef sampleBuffer;
+    PFRAME_COMPLETION_CONTEXT completionCtx;
+    int frameType;
+    int frameNumber;
+    frame_timestamps_t timestamps;
+} PREPARED_FRAME, *PPREPARED_FRAME;
+
+// Releasing the sample buffer completes the frame once CoreMedia is done with it
+static void ReleasePreparedFrame(void* context, void* element)
+{
+    CFRelease(((PPREPARED_FRAME)element)->sampleBuffer);
+}
 
 @implementation VideoDecoderRenderer {
     StreamView* _view;
@@ -32,9 +65,35 @@ extern int ff_isom_write_av1c(AVIOContext *pb, const uint8_t *buf, int size,
     NSData *masteringDisplayColorVolume;
     NSData *contentLightLevelInfo;
     CMVideoFormatDescriptionRef formatDesc;
+    NSMutableDictionary<NSData*, id>* formatDescCache;
+    atomic_uint _formatDescCacheHits;
+    atomic_uint _formatDescCacheMisses;
     
     CADisplayLink* _displayLink;
     BOOL framePacing;
+    
+    PFRAME_BUFFER_POOL framePool;
+    NAL_KERNEL nalKernel;
+    
+    // Frames whose completion belongs to CoreMedia until it releases their picture data
+    PFRAME_COMPLETION_TRACKER _completionTracker;
+    
+    // Decode prep thread state
+    NSThread* _decodePrepThread;
+    dispatch_semaphore_t _decodePrepThreadExited;
+    atomic_bool _stopping;
+    atomic_bool _resetFormatDescription;
+    CFTimeInterval _currentReceiveTime;
+    CFTimeInterval _currentPollTime;
+    SPSC_QUEUE _preparedFrameQueue;
+    
+    // Only accessed on the main thread
+    BOOL _waitingForIdrFrame;
+    pipeline_stats_t _currentPipelineStats;
+    pipeline_stats_t _lastPipelineStats;
+    FRAME_TIMING_LOG _frameTimingLog;
+    PACING_ENGINE _pacingEngine;
+    CFTimeInterval _lastRttVarianceTime;
 }
 
 - (void)reinitializeDisplayLayer
@@ -71,10 +130,12 @@ extern int ff_isom_write_av1c(AVIOContext *pb, const uint8_t *buf, int size,
         [_view.layer addSublayer:displayLayer];
     }
     
-    if (formatDesc != nil) {
-        CFRelease(formatDesc);
-        formatDesc = nil;
-    }
+    // The format description is owned by the decode prep thread,
+    // so it will free it before preparing the next frame.
+    atomic_store(&_resetFormatDescription, true);
+    
+    // Frames that were already prepared for the old decoder can't be decoded until the next IDR frame
+    _waitingForIdrFrame = YES;
 }
 
 - (id)initWithView:(StreamView*)view callbacks:(id<ConnectionCallbacks>)callbacks streamAspectRatio:(float)aspectRatio useFramePacing:(BOOL)useFramePacing
@@ -87,20 +148,76 @@ extern int ff_isom_write_av1c(AVIOContext *pb, const uint8_t *buf, int size,
     framePacing = useFramePacing;
     
     parameterSetBuffers = [[NSMutableArray alloc] init];
+    formatDescCache = [[NSMutableDictionary alloc] init];
+    
+    atomic_init(&_stopping, false);
+    atomic_init(&_formatDescCacheHits, 0);
+    atomic_init(&_formatDescCacheMisses, 0);
+    atomic_init(&_resetFormatDescription, false);
+    if (!SpscQueueInit(&_preparedFrameQueue, PREPARED_FRAME_QUEUE_SIZE, sizeof(PREPARED_FRAME))) {
+        return nil;
+    }
+    if (!FtlInit(&_frameTimingLog, FRAME_TIMING_LOG_SIZE)) {
+        SpscQueueDestroy(&_preparedFrameQueue);
+        return nil;
+    }
     
     [self reinitializeDisplayLayer];
     
     return self;
 }
 
-- (void)setupWithVideoFormat:(int)videoFormat width:(int)videoWidth height:(int)videoHeight frameRate:(int)frameRate
+- (void)setupWithVideoFormat:(int)videoFormat width:(int)videoWidth height:(int)videoHeight frameRate:(int)frameRate bitrate:(int)bitrate
 {
     self->videoFormat = videoFormat;
     self->frameRate = frameRate;
+    
+    // Buffers still referenced by the old display layer keep the old pool alive.
+    // Picture data is submitted by reference, so only AV1 ever copies a whole frame
+    // (to parse the sequence header of IDR frames that span multiple buffers).
+    FbpReleasePool(framePool);
+    framePool = FbpCreatePool(videoWidth, videoHeight, frameRate, bitrate, (videoFormat & VIDEO_FORMAT_MASK_AV1) != 0);
+    
+    PeInit(&_pacingEngine, frameRate, PACING_MAX_DEPTH);
+    _lastRttVarianceTime = 0;
+    
+    nalKernel = NalGetBestKernel();
+    Log(LOG_I, @"Using %s NAL start code scanner", NalGetKernelName(nalKernel));
+}
+
+- (void)dealloc
+{
+    // Complete any frames that never made it to the display layer
+    FctDrainQueue(&_preparedFrameQueue, ReleasePreparedFrame, NULL);
+    SpscQueueDestroy(&_preparedFrameQueue);
+    FtlDestroy(&_frameTimingLog);
+    
+    if (formatDesc != NULL) {
+        CFRelease(formatDesc);
+    }
+    
+    FctRelease(_completionTracker);
+    FbpReleasePool(framePool);
+}
+
+static void CompleteVideoFrame(void* frameHandle, int drStatus)
+{
+    LiCompleteVideoFrame((VIDEO_FRAME_HANDLE)frameHandle, drStatus);
 }
 
 - (void)start
 {
+    atomic_store(&_stopping, false);
+    _completionTracker = FctCreate(CompleteVideoFrame);
+    _decodePrepThreadExited = dispatch_semaphore_create(0);
+    
+    // Bitstream conversion and sample buffer creation happen on a dedicated thread,
+    // so UI work on the main thread doesn't delay video frames.
+    _decodePrepThread = [[NSThread alloc] initWithTarget:self selector:@selector(decodePrepThreadMain) object:nil];
+    _decodePrepThread.name = @"Video decode prep";
+    _decodePrepThread.qualityOfService = NSQualityOfServiceUserInteractive;
+    [_decodePrepThread start];
+    
     _displayLink = [CADisplayLink displayLinkWithTarget:self selector:@selector(displayLinkCallback:)];
     if (@available(iOS 15.0, tvOS 15.0, *)) {
         _displayLink.preferredFrameRateRange = CAFrameRateRangeMake(self->frameRate, self->frameRate, self->frameRate);
@@ -112,37 +229,266 @@ extern int ff_isom_write_av1c(AVIOContext *pb, const uint8_t *buf, int size,
 }
 
 // TODO: Refactor this
-int DrSubmitDecodeUnit(PDECODE_UNIT decodeUnit);
+void DrSubmitDecodeUnit(VIDEO_FRAME_HANDLE frameHandle, PDECODE_UNIT decodeUnit);
 
-- (void)displayLinkCallback:(CADisplayLink *)sender
+- (void)decodePrepThreadMain
 {
     VIDEO_FRAME_HANDLE handle;
     PDECODE_UNIT du;
     
-    while (LiPollNextVideoFrame(&handle, &du)) {
-        LiCompleteVideoFrame(handle, DrSubmitDecodeUnit(du));
-        
-        if (framePacing) {
-            // Calculate the actual display refresh rate
-            double displayRefreshRate = 1 / (_displayLink.targetTimestamp - _displayLink.timestamp);
+    // This returns false when the stream is stopping
+    while (!atomic_load(&_stopping) && LiWaitForNextVideoFrame(&handle, &du)) {
+        @autoreleasepool {
+            _currentPollTime = CACurrentMediaTime();
             
-            // Only pace frames if the display refresh rate is >= 90% of our stream frame rate.
-            // Battery saver, accessibility settings, or device thermals can cause the actual
-            // refresh rate of the display to drop below the physical maximum.
-            if (displayRefreshRate >= frameRate * 0.9f) {
-                // Keep one pending frame to smooth out gaps due to
-                // network jitter at the cost of 1 frame of latency
-                if (LiGetPendingVideoFrames() == 1) {
-                    break;
-                }
+            // common-c timestamps frames with its own millisecond clock, so we
+            // convert using the time the frame has spent waiting for us.
+            _currentReceiveTime = _currentPollTime - (LiGetMillis() - du->receiveTimeMs) / 1000.0;
+            
+            // DrSubmitDecodeUnit() is responsible for completing the frame
+            DrSubmitDecodeUnit(handle, du);
+        }
+    }
+    
+    dispatch_semaphore_signal(_decodePrepThreadExited);
+}
+
+- (void)displayLinkCallback:(CADisplayLink *)sender
+{
+    PREPARED_FRAME frame;
+    CFTimeInterval now = CACurrentMediaTime();
+    BOOL pacing = NO;
+    BOOL newFrame = NO;
+    int targetDepth = 0;
+    
+    if (framePacing) {
+        // Calculate the actual display refresh rate
+        double displayRefreshRate = 1 / (_displayLink.targetTimestamp - _displayLink.timestamp);
+        
+        // Only pace frames if the display refresh rate is >= 90% of our stream frame rate.
+        // Battery saver, accessibility settings, or device thermals can cause the actual
+        // refresh rate of the display to drop below the physical maximum.
+        if (displayRefreshRate >= frameRate * 0.9f) {
+            uint32_t rtt, rttVariance;
+            if (now - _lastRttVarianceTime >= 1.0 && LiGetEstimatedRttInfo(&rtt, &rttVariance)) {
+                PeRecordRttVariance(&_pacingEngine, rttVariance / 1000.0);
+                _lastRttVarianceTime = now;
             }
+            
+            // Keep enough pending frames to smooth out gaps due to network
+            // jitter at the cost of 1 frame of latency for each frame
+            targetDepth = PeGetTargetDepth(&_pacingEngine, now);
+            pacing = YES;
         }
     }
+    
+    while (SpscQueuePop(&_preparedFrameQueue, &frame)) {
+        PeRecordArrival(&_pacingEngine, frame.timestamps.preparedTime);
+        [self enqueuePreparedFrame:&frame];
+        newFrame = YES;
+        
+        if (pacing && SpscQueueSize(&_preparedFrameQueue) <= targetDepth) {
+            break;
+        }
+    }
+    
+    if (pacing) {
+        PeRecordRefresh(&_pacingEngine, now, newFrame);
+    }
+    
+    _currentPipelineStats.pacingDepth = targetDepth;
+    _currentPipelineStats.pacingUnderruns = _pacingEngine.underruns;
+}
+
+// Must be called on the main thread
+- (void)enqueuePreparedFrame:(PPREPARED_FRAME)frame
+{
+    // Check for previous decoder errors before doing anything
+    if (displayLayer.status == AVQueuedSampleBufferRenderingStatusFailed) {
+        Log(LOG_E, @"Display layer rendering failed: %@", displayLayer.error);
+        
+        // Recreate the display layer. We are already on the main thread,
+        // so this is safe to do right here.
+        [self reinitializeDisplayLayer];
+        
+        // Request an IDR frame to initialize the new decoder. The completion context
+        // stays valid until the sample buffer is released.
+        frame->completionCtx->drStatus = DR_NEED_IDR;
+        CFRelease(frame->sampleBuffer);
+        return;
+    }
+    
+    if (_waitingForIdrFrame) {
+        if (frame->frameType != FRAME_TYPE_IDR) {
+            frame->completionCtx->drStatus = DR_NEED_IDR;
+            CFRelease(frame->sampleBuffer);
+            return;
+        }
+        
+        _waitingForIdrFrame = NO;
+    }
+    
+    // Enqueue the next frame
+    CFTimeInterval enqueueStartTime = CACurrentMediaTime();
+    [self->displayLayer enqueueSampleBuffer:frame->sampleBuffer];
+    frame->timestamps.enqueueTime = CACurrentMediaTime();
+    frame->timestamps.displayTime = MAX(_displayLink.targetTimestamp, frame->timestamps.enqueueTime);
+    
+    if (frame->frameType == FRAME_TYPE_IDR) {
+        // Ensure the layer is visible now
+        self->displayLayer.hidden = NO;
+        
+        // Tell our parent VC to hide the progress indicator
+        [self->_callbacks videoContentShown];
+    }
+    
+    [self updatePipelineStats:&frame->timestamps enqueueDuration:frame->timestamps.enqueueTime - enqueueStartTime];
+    
+    FRAME_TIMING timing = {
+        .frameNumber = frame->frameNumber,
+        .frameType = frame->frameType,
+        .stageTimes = {
+            [FRAME_STAGE_RECEIVE] = frame->timestamps.receiveTime,
+            [FRAME_STAGE_POLL] = frame->timestamps.pollTime,
+            [FRAME_STAGE_SUBMIT] = frame->timestamps.preparedTime,
+            [FRAME_STAGE_ENQUEUE] = frame->timestamps.enqueueTime,
+            [FRAME_STAGE_DISPLAY] = frame->timestamps.displayTime,
+        },
+    };
+    FtlRecordFrame(&_frameTimingLog, &timing);
+    
+    // The frame is completed when the decoder releases the sample buffer
+    CFRelease(frame->sampleBuffer);
+}
+
+- (void)updatePipelineStats:(frame_timestamps_t*)timestamps enqueueDuration:(CFTimeInterval)enqueueTime
+{
+    CFTimeInterval prepTime = timestamps->preparedTime - timestamps->pollTime;
+    CFTimeInterval queueTime = timestamps->enqueueTime - timestamps->preparedTime;
+    
+    if (_currentPipelineStats.startTime == 0) {
+        _currentPipelineStats.startTime = timestamps->enqueueTime;
+    }
+    else if (timestamps->enqueueTime - _currentPipelineStats.startTime >= 1.0) {
+        // Flip stats roughly every second
+        _currentPipelineStats.endTime = timestamps->enqueueTime;
+        _lastPipelineStats = _currentPipelineStats;
+        
+        memset(&_currentPipelineStats, 0, sizeof(_currentPipelineStats));
+        _currentPipelineStats.startTime = timestamps->enqueueTime;
+    }
+    
+    _currentPipelineStats.frames++;
+    _currentPipelineStats.totalPrepTime += prepTime;
+    _currentPipelineStats.totalQueueTime += queueTime;
+    _currentPipelineStats.totalEnqueueTime += enqueueTime;
+    if (prepTime > _currentPipelineStats.maxPrepTime) {
+        _currentPipelineStats.maxPrepTime = prepTime;
+    }
+    if (queueTime > _currentPipelineStats.maxQueueTime) {
+        _currentPipelineStats.maxQueueTime = queueTime;
+    }
+    if (enqueueTime > _currentPipelineStats.maxEnqueueTime) {
+        _currentPipelineStats.maxEnqueueTime = enqueueTime;
+    }
+}
+
+- (BOOL)getPipelineStats:(pipeline_stats_t*)stats
+{
+    // We return the last complete 1 second window
+    if (_lastPipelineStats.endTime != 0) {
+        *stats = _lastPipelineStats;
+        return YES;
+    }
+    
+    return NO;
+}
+
+- (const LATENCY_HISTOGRAM*)getLatencyHistogramForStage:(FRAME_STAGE)stage
+{
+    return &_frameTimingLog.stageHistograms[stage];
+}
+
+- (void)exportFrameTimings
+{
+    NSString* cachesDir = [NSSearchPathForDirectoriesInDomains(NSCachesDirectory, NSUserDomainMask, YES) firstObject];
+    NSString* csvPath = [cachesDir stringByAppendingPathComponent:@"FrameTimings.csv"];
+    NSString* jsonPath = [cachesDir stringByAppendingPathComponent:@"FrameTimings.json"];
+    
+    FILE* csvFile = fopen(csvPath.fileSystemRepresentation, "w");
+    FILE* jsonFile = fopen(jsonPath.fileSystemRepresentation, "w");
+    if (csvFile == NULL || jsonFile == NULL) {
+        Log(LOG_E, @"Failed to open frame timing export files: %d", errno);
+    }
+    else if (FtlWriteCsv(&_frameTimingLog, csvFile) && FtlWriteJson(&_frameTimingLog, jsonFile)) {
+        Log(LOG_I, @"Frame timings exported to %@ and %@", csvPath, jsonPath);
+    }
+    else {
+        Log(LOG_E, @"Failed to export frame timings");
+    }
+    
+    if (csvFile != NULL) {
+        fclose(csvFile);
+    }
+    if (jsonFile != NULL) {
+        fclose(jsonFile);
+    }
 }
 
 - (void)stop
 {
-    [_displayLink invalidate];
+    // Wake the decode prep thread and wait for it to finish with the current frame
+    if (_decodePrepThread != nil) {
+        atomic_store(&_stopping, true);
+        LiWakeWaitForVideoFrame();
+        dispatch_semaphore_wait(_decodePrepThreadExited, DISPATCH_TIME_FOREVER);
+        _decodePrepThread = nil;
+    }
+    
+    // Frames submitted by reference are completed when CoreMedia releases their picture
+    // data, and that has to happen before common-c tears down the connection after we
+    // return. The display link and display layer belong to the main thread, so we stop
+    // them there. Nothing on the main thread waits for DrStop(), so this can't deadlock.
+    dispatch_block_t stopDisplay = ^{
+        [self->_displayLink invalidate];
+        
+        // Frames still waiting to be paced hold sample buffers too. The display link
+        // was their only consumer, so release them here or the wait below times out.
+        FctDrainQueue(&self->_preparedFrameQueue, ReleasePreparedFrame, NULL);
+        
+        [self->displayLayer flushAndRemoveImage];
+    };
+    if ([NSThread isMainThread]) {
+        stopDisplay();
+    }
+    else {
+        dispatch_sync(dispatch_get_main_queue(), stopDisplay);
+    }
+    
+    if (_completionTracker != NULL) {
+        // The decoder may release the last sample buffers asynchronously after the flush.
+        // Completing them after the connection is gone is worse than leaking them.
+        int abandonedFrames = FctFinish(_completionTracker, FRAME_COMPLETION_TIMEOUT_MS);
+        if (abandonedFrames != 0) {
+            Log(LOG_E, @"%d video frames were not released by the decoder; abandoned them", abandonedFrames);
+        }
+        
+        FctRelease(_completionTracker);
+        _completionTracker = NULL;
+    }
+    
+    FRAME_BUFFER_POOL_STATS poolStats;
+    FbpGetStats(framePool, &poolStats);
+    Log(LOG_I, @"Frame buffer pool: %llu allocations, %.1f%% hit rate, %zu bytes held (high-water mark: %zu bytes)",
+        poolStats.allocations,
+        poolStats.allocations ? 100.0 * poolStats.hits / poolStats.allocations : 0.0,
+        poolStats.bytesHeld,
+        poolStats.highWaterBytes);
+    
+    // Frames are recorded on the main thread, so export from there once the display link is gone
+    dispatch_async(dispatch_get_main_queue(), ^{
+        [self exportFrameTimings];
+    });
 }
 
 #define NALU_START_PREFIX_SIZE 3
@@ -182,65 +528,9 @@ int DrSubmitDecodeUnit(PDECODE_UNIT decodeUnit);
     }
 }
 
-- (NSData*)getAv1CodecConfigurationBox:(NSData*)frameData  {
-    AVIOContext* ioctx = NULL;
-    int err;
-    
-    err = avio_open_dyn_buf(&ioctx);
-    if (err < 0) {
-        Log(LOG_E, @"avio_open_dyn_buf() failed: %d", err);
-        return nil;
-    }
-
-    // Submit the IDR frame to write the av1C blob
-    err = ff_isom_write_av1c(ioctx, (uint8_t*)frameData.bytes, (int)frameData.length, 1);
-    if (err < 0) {
-        Log(LOG_E, @"ff_isom_write_av1c() failed: %d", err);
-        // Fall-through to close and free buffer
-    }
-    
-    // Close the dynbuf and get the underlying buffer back (which we must free)
-    uint8_t* av1cBuf = NULL;
-    int av1cBufLen = avio_close_dyn_buf(ioctx, &av1cBuf);
-    
-    Log(LOG_I, @"av1C block is %d bytes", av1cBufLen);
-    
-    // Only return data if ff_isom_write_av1c() was successful
-    NSData* data = nil;
-    if (err >= 0 && av1cBufLen > 0) {
-        data = [NSData dataWithBytes:av1cBuf length:av1cBufLen];
-    }
-    else {
-        data = nil;
-    }
-    
-    av_free(av1cBuf);
-    return data;
-}
-
 // Much of this logic comes from Chrome
-- (CMVideoFormatDescriptionRef)createAV1FormatDescriptionForIDRFrame:(NSData*)frameData {
+- (CMVideoFormatDescriptionRef)createAV1FormatDescriptionForSequenceHeader:(PAV1_SEQUENCE_HEADER)seqHeader codecConfiguration:(NSData*)av1c {
     NSMutableDictionary* extensions = [[NSMutableDictionary alloc] init];
-
-    CodedBitstreamContext* cbsCtx = NULL;
-    int err = ff_cbs_init(&cbsCtx, AV_CODEC_ID_AV1, NULL);
-    if (err < 0) {
-        Log(LOG_E, @"ff_cbs_init() failed: %d", err);
-        return nil;
-    }
-    
-    AVPacket avPacket = {};
-    avPacket.data = (uint8_t*)frameData.bytes;
-    avPacket.size = (int)frameData.length;
-    
-    // Read the sequence header OBU
-    CodedBitstreamFragment cbsFrag = {};
-    err = ff_cbs_read_packet(cbsCtx, &cbsFrag, &avPacket);
-    if (err < 0) {
-        Log(LOG_E, @"ff_cbs_read_packet() failed: %d", err);
-        ff_cbs_close(&cbsCtx);
-        return nil;
-    }
     
 #define SET_CFSTR_EXTENSION(key, value) extensions[(__bridge NSString*)key] = (__bridge NSString*)(value)
 #define SET_EXTENSION(key, value) extensions[(__bridge NSString*)key] = (value)
@@ -251,16 +541,7 @@ int DrSubmitDecodeUnit(PDECODE_UNIT decodeUnit);
     // https://developer.apple.com/library/archive/qa/qa1183/_index.html
     SET_EXTENSION(kCMFormatDescriptionExtension_Depth, @24);
     
-    CodedBitstreamAV1Context* bitstreamCtx = (CodedBitstreamAV1Context*)cbsCtx->priv_data;
-    AV1RawSequenceHeader* seqHeader = bitstreamCtx->sequence_header;
-    if (seqHeader == NULL) {
-        Log(LOG_E, @"AV1 sequence header not found in IDR frame!");
-        ff_cbs_fragment_free(&cbsFrag);
-        ff_cbs_close(&cbsCtx);
-        return nil;
-    }
-    
-    switch (seqHeader->color_config.color_primaries) {
+    switch (seqHeader->colorPrimaries) {
         case 1: // CP_BT_709
             SET_CFSTR_EXTENSION(kCMFormatDescriptionExtension_ColorPrimaries,
                                 kCMFormatDescriptionColorPrimaries_ITU_R_709_2);
@@ -277,11 +558,11 @@ int DrSubmitDecodeUnit(PDECODE_UNIT decodeUnit);
             break;
             
         default:
-            Log(LOG_W, @"Unsupported color_primaries value: %d", seqHeader->color_config.color_primaries);
+            Log(LOG_W, @"Unsupported color_primaries value: %d", seqHeader->colorPrimaries);
             break;
     }
     
-    switch (seqHeader->color_config.transfer_characteristics) {
+    switch (seqHeader->transferCharacteristics) {
         case 1: // TC_BT_709
         case 6: // TC_BT_601
             SET_CFSTR_EXTENSION(kCMFormatDescriptionExtension_TransferFunction,
@@ -315,11 +596,11 @@ int DrSubmitDecodeUnit(PDECODE_UNIT decodeUnit);
             break;
             
         default:
-            Log(LOG_W, @"Unsupported transfer_characteristics value: %d", seqHeader->color_config.transfer_characteristics);
+            Log(LOG_W, @"Unsupported transfer_characteristics value: %d", seqHeader->transferCharacteristics);
             break;
     }
     
-    switch (seqHeader->color_config.matrix_coefficients) {
+    switch (seqHeader->matrixCoefficients) {
         case 1: // MC_BT_709
             SET_CFSTR_EXTENSION(kCMFormatDescriptionExtension_YCbCrMatrix,
                                 kCMFormatDescriptionYCbCrMatrix_ITU_R_709_2);
@@ -341,16 +622,16 @@ int DrSubmitDecodeUnit(PDECODE_UNIT decodeUnit);
             break;
             
         default:
-            Log(LOG_W, @"Unsupported matrix_coefficients value: %d", seqHeader->color_config.matrix_coefficients);
+            Log(LOG_W, @"Unsupported matrix_coefficients value: %d", seqHeader->matrixCoefficients);
             break;
     }
     
-    SET_EXTENSION(kCMFormatDescriptionExtension_FullRangeVideo, @(seqHeader->color_config.color_range == 1));
+    SET_EXTENSION(kCMFormatDescriptionExtension_FullRangeVideo, @(seqHeader->colorRange == 1));
     
     // Progressive content
     SET_EXTENSION(kCMFormatDescriptionExtension_FieldCount, @(1));
     
-    switch (seqHeader->color_config.chroma_sample_position) {
+    switch (seqHeader->chromaSamplePosition) {
         case 1: // CSP_VERTICAL
             SET_CFSTR_EXTENSION(kCMFormatDescriptionExtension_ChromaLocationTopField,
                                 kCMFormatDescriptionChromaLocation_Left);
@@ -362,7 +643,7 @@ int DrSubmitDecodeUnit(PDECODE_UNIT decodeUnit);
             break;
             
         default:
-            Log(LOG_W, @"Unsupported chroma_sample_position value: %d", seqHeader->color_config.chroma_sample_position);
+            Log(LOG_W, @"Unsupported chroma_sample_position value: %d", seqHeader->chromaSamplePosition);
             break;
     }
     
@@ -378,9 +659,9 @@ int DrSubmitDecodeUnit(PDECODE_UNIT decodeUnit);
     // https://source.chromium.org/chromium/chromium/src/+/main:media/gpu/mac/vt_config_util.mm;drc=977dc02c431b4979e34c7792bc3d646f649dacb4;l=155
     extensions[(__bridge NSString*)kCMFormatDescriptionExtension_SampleDescriptionExtensionAtoms] =
     @{
-        @"av1C" : [self getAv1CodecConfigurationBox:frameData],
+        @"av1C" : av1c,
     };
-    extensions[@"BitsPerComponent"] = @(bitstreamCtx->bit_depth);
+    extensions[@"BitsPerComponent"] = @(seqHeader->bitDepth);
     
 #undef SET_EXTENSION
 #undef SET_CFSTR_EXTENSION
@@ -388,7 +669,7 @@ int DrSubmitDecodeUnit(PDECODE_UNIT decodeUnit);
     // AV1 doesn't have a special format description function like H.264 and HEVC have, so we just use the generic one
     CMVideoFormatDescriptionRef formatDesc = NULL;
     OSStatus status = CMVideoFormatDescriptionCreate(kCFAllocatorDefault, kCMVideoCodecType_AV1,
-                                                     bitstreamCtx->frame_width, bitstreamCtx->frame_height,
+                                                     seqHeader->maxFrameWidth, seqHeader->maxFrameHeight,
                                                      (__bridge CFDictionaryRef)extensions,
                                                      &formatDesc);
     if (status != noErr) {
@@ -396,185 +677,413 @@ int DrSubmitDecodeUnit(PDECODE_UNIT decodeUnit);
         formatDesc = NULL;
     }
     
-    ff_cbs_fragment_free(&cbsFrag);
-    ff_cbs_close(&cbsCtx);
     return formatDesc;
 }
 
-// This function must free data for bufferType == BUFFER_TYPE_PICDATA
+// Parameter set NALUs are only read during this call. The caller retains ownership of data.
 - (int)submitDecodeBuffer:(unsigned char *)data length:(int)length bufferType:(int)bufferType decodeUnit:(PDECODE_UNIT)du
+{
+    // We construct a new format description object each time we receive an IDR frame
+    if (du->frameType == FRAME_TYPE_IDR) {
+        if (bufferType == BUFFER_TYPE_VPS || bufferType == BUFFER_TYPE_SPS || bufferType == BUFFER_TYPE_PPS) {
+            // Add new parameter set into the parameter set array
+            int startLen = data[2] == 0x01 ? 3 : 4;
+            [parameterSetBuffers addObject:[NSData dataWithBytes:&data[startLen] length:length - startLen]];
+        }
+    }
+    
+    // No frame data to submit for these NALUs
+    return DR_OK;
+}
+
+- (NSData*)formatDescriptionCacheKeyForData:(NSArray<NSData*>*)codecData
+{
+    NSMutableData* key = [NSMutableData dataWithBytes:&videoFormat length:sizeof(videoFormat)];
+    
+    // HDR metadata is baked into the format description too. Each component is
+    // length-prefixed so different splits of the same bytes can't collide.
+    NSArray<NSData*>* components = [codecData arrayByAddingObjectsFromArray:@[masteringDisplayColorVolume ?: [NSData data],
+                                                                               contentLightLevelInfo ?: [NSData data]]];
+    for (NSData* component in components) {
+        uint32_t componentLength = (uint32_t)component.length;
+        [key appendBytes:&componentLength length:sizeof(componentLength)];
+        [key appendData:component];
+    }
+    
+    return key;
+}
+
+// Returns a retained format description or NULL on a cache miss
+- (CMVideoFormatDescriptionRef)copyCachedFormatDescriptionForKey:(NSData*)key
+{
+    CMVideoFormatDescriptionRef cachedFormatDesc = (__bridge CMVideoFormatDescriptionRef)formatDescCache[key];
+    if (cachedFormatDesc == NULL) {
+        atomic_fetch_add(&_formatDescCacheMisses, 1);
+        return NULL;
+    }
+    
+    atomic_fetch_add(&_formatDescCacheHits, 1);
+    return (CMVideoFormatDescriptionRef)CFRetain(cachedFormatDesc);
+}
+
+- (void)cacheFormatDescription:(CMVideoFormatDescriptionRef)desc forKey:(NSData*)key
+{
+    // A stream only cycles through a handful of formats (HDR toggles, resolution changes),
+    // so we just start over if we ever hit the limit.
+    if (formatDescCache.count >= FORMAT_DESC_CACHE_SIZE) {
+        [formatDescCache removeAllObjects];
+    }
+    
+    formatDescCache[key] = (__bridge id)desc;
+}
+
+- (void)getFormatDescriptionCacheHits:(uint32_t*)hits misses:(uint32_t*)misses
+{
+    *hits = atomic_load(&_formatDescCacheHits);
+    *misses = atomic_load(&_formatDescCacheMisses);
+}
+
+- (void)updateFormatDescriptionForIDRFrame:(PDECODE_UNIT)du
 {
     OSStatus status;
     
-    // Construct a new format description object each time we receive an IDR frame
-    if (du->frameType == FRAME_TYPE_IDR) {
-        if (bufferType != BUFFER_TYPE_PICDATA) {
-            if (bufferType == BUFFER_TYPE_VPS || bufferType == BUFFER_TYPE_SPS || bufferType == BUFFER_TYPE_PPS) {
-                // Add new parameter set into the parameter set array
-                int startLen = data[2] == 0x01 ? 3 : 4;
-                [parameterSetBuffers addObject:[NSData dataWithBytes:&data[startLen] length:length - startLen]];
-            }
-            
-            // Data is NOT to be freed here. It's a direct usage of the caller's buffer.
-            
-            // No frame data to submit for these NALUs
-            return DR_OK;
+    NSData* cacheKey;
+    
+    // Free the old format description
+    if (formatDesc != NULL) {
+        CFRelease(formatDesc);
+        formatDesc = NULL;
+    }
+    
+    if (videoFormat & (VIDEO_FORMAT_MASK_H264 | VIDEO_FORMAT_MASK_H265)) {
+        // Most IDR frames repeat the parameter sets of the last one, so we can usually
+        // reuse an existing format description rather than constructing a new one.
+        cacheKey = [self formatDescriptionCacheKeyForData:parameterSetBuffers];
+        formatDesc = [self copyCachedFormatDescriptionForKey:cacheKey];
+        if (formatDesc != NULL) {
+            [parameterSetBuffers removeAllObjects];
+            return;
+        }
+    }
+    
+    if (videoFormat & VIDEO_FORMAT_MASK_H264) {
+        // Construct parameter set arrays for the format description
+        size_t parameterSetCount = [parameterSetBuffers count];
+        const uint8_t* parameterSetPointers[parameterSetCount];
+        size_t parameterSetSizes[parameterSetCount];
+        for (int i = 0; i < parameterSetCount; i++) {
+            NSData* parameterSet = parameterSetBuffers[i];
+            parameterSetPointers[i] = parameterSet.bytes;
+            parameterSetSizes[i] = parameterSet.length;
         }
         
-        // Create the new format description when we get the first picture data buffer of an IDR frame.
-        // This is the only way we know that there is no more CSD for this frame.
-        //
-        // NB: This logic depends on the fact that we submit all picture data in one buffer!
+        Log(LOG_I, @"Constructing new H264 format description");
+        status = CMVideoFormatDescriptionCreateFromH264ParameterSets(kCFAllocatorDefault,
+                                                                     parameterSetCount,
+                                                                     parameterSetPointers,
+                                                                     parameterSetSizes,
+                                                                     NAL_LENGTH_PREFIX_SIZE,
+                                                                     &formatDesc);
+        if (status != noErr) {
+            Log(LOG_E, @"Failed to create H264 format description: %d", (int)status);
+            formatDesc = NULL;
+        }
         
-        // Free the old format description
-        if (formatDesc != NULL) {
-            CFRelease(formatDesc);
+        // Free parameter set buffers after submission
+        [parameterSetBuffers removeAllObjects];
+    }
+    else if (videoFormat & VIDEO_FORMAT_MASK_H265) {
+        // Construct parameter set arrays for the format description
+        size_t parameterSetCount = [parameterSetBuffers count];
+        const uint8_t* parameterSetPointers[parameterSetCount];
+        size_t parameterSetSizes[parameterSetCount];
+        for (int i = 0; i < parameterSetCount; i++) {
+            NSData* parameterSet = parameterSetBuffers[i];
+            parameterSetPointers[i] = parameterSet.bytes;
+            parameterSetSizes[i] = parameterSet.length;
+        }
+        
+        Log(LOG_I, @"Constructing new HEVC format description");
+        
+        NSMutableDictionary* videoFormatParams = [[NSMutableDictionary alloc] init];
+        
+        if (contentLightLevelInfo) {
+            [videoFormatParams setObject:contentLightLevelInfo forKey:(__bridge NSString*)kCMFormatDescriptionExtension_ContentLightLevelInfo];
+        }
+        
+        if (masteringDisplayColorVolume) {
+            [videoFormatParams setObject:masteringDisplayColorVolume forKey:(__bridge NSString*)kCMFormatDescriptionExtension_MasteringDisplayColorVolume];
+        }
+        
+        status = CMVideoFormatDescriptionCreateFromHEVCParameterSets(kCFAllocatorDefault,
+                                                                     parameterSetCount,
+                                                                     parameterSetPointers,
+                                                                     parameterSetSizes,
+                                                                     NAL_LENGTH_PREFIX_SIZE,
+                                                                     (__bridge CFDictionaryRef)videoFormatParams,
+                                                                     &formatDesc);
+        
+        if (status != noErr) {
+            Log(LOG_E, @"Failed to create HEVC format description: %d", (int)status);
             formatDesc = NULL;
         }
         
-        if (videoFormat & VIDEO_FORMAT_MASK_H264) {
-            // Construct parameter set arrays for the format description
-            size_t parameterSetCount = [parameterSetBuffers count];
-            const uint8_t* parameterSetPointers[parameterSetCount];
-            size_t parameterSetSizes[parameterSetCount];
-            for (int i = 0; i < parameterSetCount; i++) {
-                NSData* parameterSet = parameterSetBuffers[i];
-                parameterSetPointers[i] = parameterSet.bytes;
-                parameterSetSizes[i] = parameterSet.length;
+        // Free parameter set buffers after submission
+        [parameterSetBuffers removeAllObjects];
+    }
+    else if (videoFormat & VIDEO_FORMAT_MASK_AV1) {
+        // The AV1 parser needs the whole frame in a single contiguous buffer. We only
+        // pay for a copy on IDR frames and only when the frame spans more than one buffer.
+        const uint8_t* frameData;
+        size_t frameLength;
+        unsigned char* frameCopy = NULL;
+        PLENTRY entry = du->bufferList;
+        if (entry != NULL && entry->next == NULL) {
+            frameData = (const uint8_t*)entry->data;
+            frameLength = entry->length;
+        }
+        else {
+            frameCopy = FbpAllocate(framePool, du->fullLength);
+            if (frameCopy == NULL) {
+                // A frame was lost due to OOM condition
+                return;
             }
             
-            Log(LOG_I, @"Constructing new H264 format description");
-            status = CMVideoFormatDescriptionCreateFromH264ParameterSets(kCFAllocatorDefault,
-                                                                         parameterSetCount,
-                                                                         parameterSetPointers,
-                                                                         parameterSetSizes,
-                                                                         NAL_LENGTH_PREFIX_SIZE,
-                                                                         &formatDesc);
-            if (status != noErr) {
-                Log(LOG_E, @"Failed to create H264 format description: %d", (int)status);
-                formatDesc = NULL;
+            int offset = 0;
+            for (; entry != NULL; entry = entry->next) {
+                if (entry->bufferType == BUFFER_TYPE_PICDATA) {
+                    memcpy(&frameCopy[offset], entry->data, entry->length);
+                    offset += entry->length;
+                }
             }
-            
-            // Free parameter set buffers after submission
-            [parameterSetBuffers removeAllObjects];
+            frameData = frameCopy;
+            frameLength = offset;
         }
-        else if (videoFormat & VIDEO_FORMAT_MASK_H265) {
-            // Construct parameter set arrays for the format description
-            size_t parameterSetCount = [parameterSetBuffers count];
-            const uint8_t* parameterSetPointers[parameterSetCount];
-            size_t parameterSetSizes[parameterSetCount];
-            for (int i = 0; i < parameterSetCount; i++) {
-                NSData* parameterSet = parameterSetBuffers[i];
-                parameterSetPointers[i] = parameterSet.bytes;
-                parameterSetSizes[i] = parameterSet.length;
-            }
-            
-            Log(LOG_I, @"Constructing new HEVC format description");
-            
-            NSMutableDictionary* videoFormatParams = [[NSMutableDictionary alloc] init];
+        
+        // The av1C box only holds the sequence header and metadata OBUs, so the parser
+        // tells us how big it is before we allocate it
+        AV1_SEQUENCE_HEADER seqHeader;
+        uint8_t* av1cBuffer = NULL;
+        if (Av1ParseTemporalUnit(frameData, frameLength, &seqHeader) &&
+            (av1cBuffer = FbpAllocate(framePool, seqHeader.configLength)) != NULL) {
+            Av1WriteCodecConfiguration(frameData, frameLength, &seqHeader, av1cBuffer);
+            NSData* av1c = [NSData dataWithBytes:av1cBuffer length:seqHeader.configLength];
             
-            if (contentLightLevelInfo) {
-                [videoFormatParams setObject:contentLightLevelInfo forKey:(__bridge NSString*)kCMFormatDescriptionExtension_ContentLightLevelInfo];
+            // av1C holds the sequence header and any metadata OBUs, which together with the
+            // HDR metadata determine everything in the format description.
+            cacheKey = [self formatDescriptionCacheKeyForData:@[av1c]];
+            formatDesc = [self copyCachedFormatDescriptionForKey:cacheKey];
+            if (formatDesc == NULL) {
+                Log(LOG_I, @"Constructing new AV1 format description (av1C block is %zu bytes)", seqHeader.configLength);
+                formatDesc = [self createAV1FormatDescriptionForSequenceHeader:&seqHeader codecConfiguration:av1c];
             }
-            
-            if (masteringDisplayColorVolume) {
-                [videoFormatParams setObject:masteringDisplayColorVolume forKey:(__bridge NSString*)kCMFormatDescriptionExtension_MasteringDisplayColorVolume];
+            else {
+                // Don't cache it again below
+                cacheKey = nil;
             }
-            
-            status = CMVideoFormatDescriptionCreateFromHEVCParameterSets(kCFAllocatorDefault,
-                                                                         parameterSetCount,
-                                                                         parameterSetPointers,
-                                                                         parameterSetSizes,
-                                                                         NAL_LENGTH_PREFIX_SIZE,
-                                                                         (__bridge CFDictionaryRef)videoFormatParams,
-                                                                         &formatDesc);
-            
-            if (status != noErr) {
-                Log(LOG_E, @"Failed to create HEVC format description: %d", (int)status);
-                formatDesc = NULL;
+        }
+        else {
+            Log(LOG_E, @"Failed to parse AV1 sequence header in IDR frame!");
+        }
+        
+        // The format description doesn't reference the frame data
+        FbpFree(av1cBuffer);
+        FbpFree(frameCopy);
+    }
+    else {
+        // Unsupported codec!
+        abort();
+    }
+    
+    if (formatDesc != NULL && cacheKey != nil) {
+        [self cacheFormatDescription:formatDesc forKey:cacheKey];
+    }
+}
+
+// Completes the frame with the status stored in the context and frees the context
+static void CompleteFrame(PFRAME_COMPLETION_CONTEXT ctx)
+{
+    FctComplete(ctx->tracker, ctx->frameHandle, ctx->drStatus);
+    FbpFree(ctx);
+}
+
+// Called by CoreMedia when the last reference to a frame's picture data is released
+static void FreeFrameBlock(void* refCon, void* doomedMemoryBlock, size_t sizeInBytes)
+{
+    // The buffers in the decode unit are freed by common-c here
+    CompleteFrame((PFRAME_COMPLETION_CONTEXT)refCon);
+}
+
+// Returns a block buffer that references the picture data of the decode unit in place.
+// The block buffer takes ownership of the frame handle in completionCtx and completes the
+// frame with the status stored in completionCtx when it is freed. If this returns NULL,
+// the frame has already been completed.
+- (CMBlockBufferRef)createDataBlockBufferForDecodeUnit:(PDECODE_UNIT)du completionContext:(PFRAME_COMPLETION_CONTEXT)completionCtx
+{
+    OSStatus status;
+    CMBlockBufferRef blockBuffer;
+    BOOL ownsFrame = NO;
+    
+    status = CMBlockBufferCreateEmpty(NULL, 0, 0, &blockBuffer);
+    if (status != noErr) {
+        Log(LOG_E, @"CMBlockBufferCreateEmpty failed: %d", (int)status);
+        completionCtx->drStatus = DR_NEED_IDR;
+        CompleteFrame(completionCtx);
+        return NULL;
+    }
+    
+    for (PLENTRY entry = du->bufferList; entry != NULL; entry = entry->next) {
+        if (entry->bufferType != BUFFER_TYPE_PICDATA) {
+            continue;
+        }
+        
+        if (!ownsFrame) {
+            // The first picture data buffer carries the frame completion callback.
+            // All buffers are released together when the block buffer is destroyed.
+            CMBlockBufferCustomBlockSource blockSource = {
+                .version = kCMBlockBufferCustomBlockSourceVersion,
+                .FreeBlock = FreeFrameBlock,
+                .refCon = completionCtx,
+            };
+            status = CMBlockBufferAppendMemoryBlock(blockBuffer, entry->data, entry->length,
+                                                    kCFAllocatorNull, &blockSource,
+                                                    0, entry->length, 0);
+            if (status == noErr) {
+                ownsFrame = YES;
             }
-            
-            // Free parameter set buffers after submission
-            [parameterSetBuffers removeAllObjects];
         }
-        else if (videoFormat & VIDEO_FORMAT_MASK_AV1) {
-            NSData* fullFrameData = [NSData dataWithBytesNoCopy:data length:length freeWhenDone:NO];
-            
-            Log(LOG_I, @"Constructing new AV1 format description");
-            formatDesc = [self createAV1FormatDescriptionForIDRFrame:fullFrameData];
+        else {
+            status = CMBlockBufferAppendMemoryBlock(blockBuffer, entry->data, entry->length,
+                                                    kCFAllocatorNull, NULL,
+                                                    0, entry->length, 0);
+        }
+        
+        if (status != noErr) {
+            Log(LOG_E, @"CMBlockBufferAppendMemoryBlock failed: %d", (int)status);
+            break;
+        }
+    }
+    
+    if (status == noErr && !ownsFrame) {
+        Log(LOG_E, @"Decode unit contains no picture data");
+        status = kCMBlockBufferEmptyBBufErr;
+    }
+    
+    if (status != noErr) {
+        if (ownsFrame) {
+            // The completion callback will run when the block buffer is freed
+            completionCtx->drStatus = DR_NEED_IDR;
         }
         else {
-            // Unsupported codec!
-            abort();
+            completionCtx->drStatus = DR_NEED_IDR;
+            CompleteFrame(completionCtx);
         }
+        
+        CFRelease(blockBuffer);
+        return NULL;
+    }
+    
+    return blockBuffer;
+}
+
+typedef struct _ANNEXB_CONVERSION_CONTEXT {
+    __unsafe_unretained VideoDecoderRenderer* renderer;
+    CMBlockBufferRef frameBlockBuffer;
+    CMBlockBufferRef dataBlockBuffer;
+} ANNEXB_CONVERSION_CONTEXT, *PANNEXB_CONVERSION_CONTEXT;
+
+static void AppendAnnexBNalUnit(void* context, size_t offset, size_t length)
+{
+    PANNEXB_CONVERSION_CONTEXT ctx = (PANNEXB_CONVERSION_CONTEXT)context;
+    
+    // Skip a start code with no data after it
+    if (length <= NALU_START_PREFIX_SIZE) {
+        return;
+    }
+    
+    [ctx->renderer updateAnnexBBufferForRange:ctx->frameBlockBuffer dataBlock:ctx->dataBlockBuffer offset:(int)offset length:(int)length];
+}
+
+// The picture data is referenced in place, so this function takes ownership of the frame handle.
+// LiCompleteVideoFrame() is called once the decoder has released the last reference to the data.
+// This runs on the decode prep thread. The finished sample buffer is handed to the display link.
+- (void)submitDecodeUnit:(PDECODE_UNIT)du frameHandle:(VIDEO_FRAME_HANDLE)frameHandle
+{
+    OSStatus status;
+    
+    // The display layer was recreated, so we need a new IDR frame for the new decoder
+    if (atomic_exchange(&_resetFormatDescription, false) && formatDesc != NULL) {
+        CFRelease(formatDesc);
+        formatDesc = NULL;
+    }
+    
+    if (du->frameType == FRAME_TYPE_IDR) {
+        // Create the new format description when we get the picture data of an IDR frame.
+        // This is the only way we know that there is no more CSD for this frame.
+        [self updateFormatDescriptionForIDRFrame:du];
     }
     
     if (formatDesc == NULL) {
         // Can't decode if we haven't gotten our parameter sets yet
-        free(data);
-        return DR_NEED_IDR;
+        LiCompleteVideoFrame(frameHandle, DR_NEED_IDR);
+        return;
     }
     
-    // Check for previous decoder errors before doing anything
-    if (displayLayer.status == AVQueuedSampleBufferRenderingStatusFailed) {
-        Log(LOG_E, @"Display layer rendering failed: %@", displayLayer.error);
-        
-        // Recreate the display layer. We are already on the main thread,
-        // so this is safe to do right here.
-        [self reinitializeDisplayLayer];
-        
-        // Request an IDR frame to initialize the new decoder
-        free(data);
-        return DR_NEED_IDR;
+    PFRAME_COMPLETION_CONTEXT completionCtx = _completionTracker != NULL ? FbpAllocate(framePool, sizeof(*completionCtx)) : NULL;
+    if (completionCtx == NULL) {
+        // A frame was lost due to OOM condition
+        LiCompleteVideoFrame(frameHandle, DR_NEED_IDR);
+        return;
     }
     
+    completionCtx->tracker = _completionTracker;
+    completionCtx->frameHandle = frameHandle;
+    completionCtx->drStatus = DR_OK;
+    FctTrack(_completionTracker);
+    
     // Now we're decoding actual frame data here
     CMBlockBufferRef frameBlockBuffer;
     CMBlockBufferRef dataBlockBuffer;
     
-    status = CMBlockBufferCreateWithMemoryBlock(NULL, data, length, kCFAllocatorDefault, NULL, 0, length, 0, &dataBlockBuffer);
-    if (status != noErr) {
-        Log(LOG_E, @"CMBlockBufferCreateWithMemoryBlock failed: %d", (int)status);
-        free(data);
-        return DR_NEED_IDR;
+    dataBlockBuffer = [self createDataBlockBufferForDecodeUnit:du completionContext:completionCtx];
+    if (dataBlockBuffer == NULL) {
+        return;
     }
     
-    // From now on, CMBlockBuffer owns the data pointer and will free it when it's dereferenced
+    // From now on, the data block buffer owns the frame handle and will complete it when it's dereferenced
     
     status = CMBlockBufferCreateEmpty(NULL, 0, 0, &frameBlockBuffer);
     if (status != noErr) {
         Log(LOG_E, @"CMBlockBufferCreateEmpty failed: %d", (int)status);
+        completionCtx->drStatus = DR_NEED_IDR;
         CFRelease(dataBlockBuffer);
-        return DR_NEED_IDR;
+        return;
     }
     
     // H.264 and HEVC formats require NAL prefix fixups from Annex B to length-delimited
     if (videoFormat & (VIDEO_FORMAT_MASK_H264 | VIDEO_FORMAT_MASK_H265)) {
-        int lastOffset = -1;
-        for (int i = 0; i < length - NALU_START_PREFIX_SIZE; i++) {
-            // Search for a NALU
-            if (data[i] == 0 && data[i+1] == 0 && data[i+2] == 1) {
-                // It's the start of a new NALU
-                if (lastOffset != -1) {
-                    // We've seen a start before this so enqueue that NALU
-                    [self updateAnnexBBufferForRange:frameBlockBuffer dataBlock:dataBlockBuffer offset:lastOffset length:i - lastOffset];
-                }
-                
-                lastOffset = i;
-            }
-        }
+        NAL_SPLITTER splitter;
+        ANNEXB_CONVERSION_CONTEXT conversionCtx = { self, frameBlockBuffer, dataBlockBuffer };
         
-        if (lastOffset != -1) {
-            // Enqueue the remaining data
-            [self updateAnnexBBufferForRange:frameBlockBuffer dataBlock:dataBlockBuffer offset:lastOffset length:length - lastOffset];
+        // Start codes may straddle the boundary between two picture data buffers,
+        // so we feed all of them through the same splitter.
+        NalSplitterInit(&splitter, nalKernel);
+        for (PLENTRY entry = du->bufferList; entry != NULL; entry = entry->next) {
+            if (entry->bufferType == BUFFER_TYPE_PICDATA) {
+                NalSplitterFeed(&splitter, (uint8_t*)entry->data, entry->length, AppendAnnexBNalUnit, &conversionCtx);
+            }
         }
+        NalSplitterFinish(&splitter, AppendAnnexBNalUnit, &conversionCtx);
     }
     else {
         // For formats that require no length-changing fixups, just append a reference to the raw data block
-        status = CMBlockBufferAppendBufferReference(frameBlockBuffer, dataBlockBuffer, 0, length, 0);
+        status = CMBlockBufferAppendBufferReference(frameBlockBuffer, dataBlockBuffer, 0, CMBlockBufferGetDataLength(dataBlockBuffer), 0);
         if (status != noErr) {
             Log(LOG_E, @"CMBlockBufferAppendBufferReference failed: %d", (int)status);
-            return DR_NEED_IDR;
+            completionCtx->drStatus = DR_NEED_IDR;
+            CFRelease(dataBlockBuffer);
+            CFRelease(frameBlockBuffer);
+            return;
         }
     }
         
@@ -589,28 +1098,34 @@ int DrSubmitDecodeUnit(PDECODE_UNIT decodeUnit);
                                   &sampleBuffer);
     if (status != noErr) {
         Log(LOG_E, @"CMSampleBufferCreate failed: %d", (int)status);
+        completionCtx->drStatus = DR_NEED_IDR;
         CFRelease(dataBlockBuffer);
         CFRelease(frameBlockBuffer);
-        return DR_NEED_IDR;
+        return;
     }
 
-    // Enqueue the next frame
-    [self->displayLayer enqueueSampleBuffer:sampleBuffer];
-    
-    if (du->frameType == FRAME_TYPE_IDR) {
-        // Ensure the layer is visible now
-        self->displayLayer.hidden = NO;
-        
-        // Tell our parent VC to hide the progress indicator
-        [self->_callbacks videoContentShown];
-    }
-    
-    // Dereference the buffers
+    // The sample buffer holds the references we need from here
     CFRelease(dataBlockBuffer);
     CFRelease(frameBlockBuffer);
-    CFRelease(sampleBuffer);
     
-    return DR_OK;
+    PREPARED_FRAME frame = {
+        .sampleBuffer = sampleBuffer,
+        .completionCtx = completionCtx,
+        .frameType = du->frameType,
+        .frameNumber = du->frameNumber,
+        .timestamps = {
+            .receiveTime = _currentReceiveTime,
+            .pollTime = _currentPollTime,
+            .preparedTime = CACurrentMediaTime(),
+        },
+    };
+    
+    // Hand the frame off to the display link. The queue takes our sample buffer reference.
+    if (!SpscQueuePush(&_preparedFrameQueue, &frame)) {
+        Log(LOG_W, @"Prepared frame queue is full; dropping frame");
+        completionCtx->drStatus = DR_NEED_IDR;
+        CFRelease(sampleBuffer);
+    }
 }
 
 - (void)setHdrMode:(BOOL)enabled {
@@ -8,6 +8,7 @@
 
 #import <UIKit/UIKit.h>
 #import "TemporaryApp.h"
+#import "BoxArtCache.h"
 
 @protocol AppCallback <NSObject>
 
@@ -22,7 +23,7 @@
 @interface UIAppView : UIButton
 #endif
 
-- (id) initWithApp:(TemporaryApp*)app cache:(NSCache*)cache andCallback:(id<AppCallback>)callback;
+- (id) initWithApp:(TemporaryApp*)app cache:(BoxArtCache*)cache andCallback:(id<AppCallback>)callback;
 - (void) updateAppImage;
 
 @end
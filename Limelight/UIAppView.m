@@ -7,7 +7,6 @@
 //
 
 #import "UIAppView.h"
-#import "AppAssetManager.h"
 
 static const float REFRESH_CYCLE = 1.0f;
 
@@ -16,13 +15,13 @@ static const float REFRESH_CYCLE = 1.0f;
     UILabel* _appLabel;
     UIImageView* _appOverlay;
     UIImageView* _appImage;
-    NSCache* _artCache;
+    BoxArtCache* _artCache;
     id<AppCallback> _callback;
 }
 
 static UIImage* noImage;
 
-- (id) initWithApp:(TemporaryApp*)app cache:(NSCache*)cache andCallback:(id<AppCallback>)callback {
+- (id) initWithApp:(TemporaryApp*)app cache:(BoxArtCache*)cache andCallback:(id<AppCallback>)callback {
     self = [super init];
     _app = app;
     _callback = callback;
@@ -126,25 +125,11 @@ static UIImage* noImage;
     
     BOOL noAppImage = false;
     
-    // First check the memory cache
-    UIImage* appImage = [_artCache objectForKey:_app];
-    if (appImage == nil) {
-        // Next try to load from the on disk cache
-        appImage = [UIImage imageWithContentsOfFile:[AppAssetManager boxArtPathForApp:_app]];
-        if (appImage != nil) {
-            [_artCache setObject:appImage forKey:_app];
-        }
-    }
-    
+    // The cache hands back pre-decoded tiles and filters out blank box art.
+    // It never loads from disk here on the main thread.
+    UIImage* appImage = [_artCache imageForApp:_app];
     if (appImage != nil) {
-        // This size of image might be blank image received from GameStream.
-        // TODO: Improve no-app image detection
-        if (!(appImage.size.width == 130.f && appImage.size.height == 180.f) && // GFE 2.0
-            !(appImage.size.width == 628.f && appImage.size.height == 888.f)) { // GFE 3.0
-            [_appImage setImage:appImage];
-        } else {
-            noAppImage = true;
-        }
+        [_appImage setImage:appImage];
     } else {
         noAppImage = true;
     }
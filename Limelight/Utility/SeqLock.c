@@ -0,0 +1,79 @@
+//
+//  SeqLock.c
+//  Moonlight
+//
+//  Copyright © 2026 Moonlight Game Streaming Project. All rights reserved.
+//
+
+#include "SeqLock.h"
+
+#include <sched.h>
+
+// The protected data is copied with relaxed atomic accesses, since readers may copy
+// it while the writer is changing it. Plain memcpy() would make that a data race.
+#define WORD_ALIGNED(dest, src) ((((uintptr_t)(dest) | (uintptr_t)(src)) & (sizeof(uint32_t) - 1)) == 0)
+
+static void copyToShared(void* dest, const void* src, size_t size)
+{
+    size_t i = 0;
+    
+    if (WORD_ALIGNED(dest, src)) {
+        for (; i + sizeof(uint32_t) <= size; i += sizeof(uint32_t)) {
+            __atomic_store_n((uint32_t*)((uint8_t*)dest + i), *(const uint32_t*)((const uint8_t*)src + i), __ATOMIC_RELAXED);
+        }
+    }
+    for (; i < size; i++) {
+        __atomic_store_n((uint8_t*)dest + i, ((const uint8_t*)src)[i], __ATOMIC_RELAXED);
+    }
+}
+
+static void copyFromShared(void* dest, const void* src, size_t size)
+{
+    size_t i = 0;
+    
+    if (WORD_ALIGNED(dest, src)) {
+        for (; i + sizeof(uint32_t) <= size; i += sizeof(uint32_t)) {
+            *(uint32_t*)((uint8_t*)dest + i) = __atomic_load_n((const uint32_t*)((const uint8_t*)src + i), __ATOMIC_RELAXED);
+        }
+    }
+    for (; i < size; i++) {
+        ((uint8_t*)dest)[i] = __atomic_load_n((const uint8_t*)src + i, __ATOMIC_RELAXED);
+    }
+}
+
+void SeqLockInit(PSEQ_LOCK lock)
+{
+    atomic_init(&lock->sequence, 0);
+}
+
+void SeqLockWrite(PSEQ_LOCK lock, void* dest, const void* src, size_t size)
+{
+    uint32_t sequence = atomic_load_explicit(&lock->sequence, memory_order_relaxed);
+    
+    // An odd sequence number tells readers that a write is in progress
+    atomic_store_explicit(&lock->sequence, sequence + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    
+    copyToShared(dest, src, size);
+    
+    atomic_store_explicit(&lock->sequence, sequence + 2, memory_order_release);
+}
+
+void SeqLockRead(PSEQ_LOCK lock, void* dest, const void* src, size_t size)
+{
+    for (;;) {
+        uint32_t startSequence = atomic_load_explicit(&lock->sequence, memory_order_acquire);
+        if (startSequence & 1) {
+            // The writer is never blocked, so it will be done momentarily
+            sched_yield();
+            continue;
+        }
+        
+        copyFromShared(dest, src, size);
+        
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&lock->sequence, memory_order_relaxed) == startSequence) {
+            return;
+        }
+    }
+}
@@ -0,0 +1,28 @@
+//
+//  SeqLock.h
+//  Moonlight
+//
+//  Copyright © 2026 Moonlight Game Streaming Project. All rights reserved.
+//
+
+#pragma once
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// A sequence lock for publishing small plain-old-data snapshots. Writers never
+// wait for readers; readers retry if a write happened while they were copying.
+// Concurrent writers must be serialized by the caller.
+
+typedef struct _SEQ_LOCK {
+    _Atomic(uint32_t) sequence;
+} SEQ_LOCK, *PSEQ_LOCK;
+
+void SeqLockInit(PSEQ_LOCK lock);
+
+// Copies size bytes from src into the protected data at dest
+void SeqLockWrite(PSEQ_LOCK lock, void* dest, const void* src, size_t size);
+
+// Copies a consistent snapshot of the protected data at src into dest
+void SeqLockRead(PSEQ_LOCK lock, void* dest, const void* src, size_t size);
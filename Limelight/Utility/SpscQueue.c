@@ -0,0 +1,77 @@
+//
+//  SpscQueue.c
+//  Moonlight
+//
+//  Copyright © 2026 Moonlight Game Streaming Project. All rights reserved.
+//
+
+#include "SpscQueue.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+bool SpscQueueInit(PSPSC_QUEUE queue, size_t capacity, size_t elementSize)
+{
+    size_t roundedCapacity = 1;
+    while (roundedCapacity < capacity) {
+        roundedCapacity <<= 1;
+    }
+    
+    memset(queue, 0, sizeof(*queue));
+    atomic_init(&queue->head, 0);
+    atomic_init(&queue->tail, 0);
+    queue->capacity = roundedCapacity;
+    queue->elementSize = elementSize;
+    queue->elements = malloc(roundedCapacity * elementSize);
+    
+    return queue->elements != NULL;
+}
+
+void SpscQueueDestroy(PSPSC_QUEUE queue)
+{
+    free(queue->elements);
+    queue->elements = NULL;
+}
+
+bool SpscQueuePush(PSPSC_QUEUE queue, const void* element)
+{
+    size_t tail = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+    size_t head = atomic_load_explicit(&queue->head, memory_order_acquire);
+    
+    if (tail - head == queue->capacity) {
+        return false;
+    }
+    
+    memcpy(&queue->elements[(tail & (queue->capacity - 1)) * queue->elementSize],
+           element, queue->elementSize);
+    
+    // Publish the element to the consumer
+    atomic_store_explicit(&queue->tail, tail + 1, memory_order_release);
+    return true;
+}
+
+bool SpscQueuePop(PSPSC_QUEUE queue, void* element)
+{
+    size_t head = atomic_load_explicit(&queue->head, memory_order_relaxed);
+    size_t tail = atomic_load_explicit(&queue->tail, memory_order_acquire);
+    
+    if (head == tail) {
+        return false;
+    }
+    
+    memcpy(element,
+           &queue->elements[(head & (queue->capacity - 1)) * queue->elementSize],
+           queue->elementSize);
+    
+    // Hand the slot back to the producer
+    atomic_store_explicit(&queue->head, head + 1, memory_order_release);
+    return true;
+}
+
+size_t SpscQueueSize(PSPSC_QUEUE queue)
+{
+    size_t head = atomic_load_explicit(&queue->head, memory_order_acquire);
+    size_t tail = atomic_load_explicit(&queue->tail, memory_order_acquire);
+    
+    return tail - head;
+}
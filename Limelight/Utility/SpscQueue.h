@@ -0,0 +1,45 @@
+//
+//  SpscQueue.h
+//  Moonlight
+//
+//  Copyright © 2026 Moonlight Game Streaming Project. All rights reserved.
+//
+
+#pragma once
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// A lock-free bounded queue for exactly one producer thread and one consumer
+// thread. Elements are fixed-size and copied in and out by value.
+
+#define SPSC_CACHE_LINE_SIZE 64
+
+typedef struct _SPSC_QUEUE {
+    // Written only by the consumer
+    _Atomic(size_t) head;
+    char headPadding[SPSC_CACHE_LINE_SIZE - sizeof(size_t)];
+    
+    // Written only by the producer
+    _Atomic(size_t) tail;
+    char tailPadding[SPSC_CACHE_LINE_SIZE - sizeof(size_t)];
+    
+    size_t capacity;
+    size_t elementSize;
+    uint8_t* elements;
+} SPSC_QUEUE, *PSPSC_QUEUE;
+
+// The capacity is rounded up to a power of two. Returns false on allocation failure.
+bool SpscQueueInit(PSPSC_QUEUE queue, size_t capacity, size_t elementSize);
+void SpscQueueDestroy(PSPSC_QUEUE queue);
+
+// Producer only. Returns false if the queue is full.
+bool SpscQueuePush(PSPSC_QUEUE queue, const void* element);
+
+// Consumer only. Returns false if the queue is empty.
+bool SpscQueuePop(PSPSC_QUEUE queue, void* element);
+
+// Safe to call from either side, but the result may be stale by the time it's used
+size_t SpscQueueSize(PSPSC_QUEUE queue);
@@ -27,6 +27,9 @@ FOUNDATION_EXPORT NSString *const deviceName;
 + (NSData*) hexToBytes:(NSString*) hex;
 + (void) addHelpOptionToDialog:(UIAlertController*)dialog;
 + (BOOL) isActiveNetworkVPN;
++ (int) findExternalAddressIP4:(unsigned int*)wanAddr;
++ (void) invalidateExternalAddress;
++ (void) setStunServer:(NSString*)stunServer port:(unsigned short)stunPort;
 + (BOOL) parseAddressPortString:(NSString*)addressPort address:(NSRange*)address port:(NSRange*)port;
 + (NSString*) addressPortStringToAddress:(NSString*)addressPort;
 + (unsigned short) addressPortStringToPort:(NSString*)addressPort;
@@ -7,6 +7,9 @@
 //
 
 #import "Utils.h"
+#import "StunCache.h"
+
+#include <Limelight.h>
 
 #include <arpa/inet.h>
 #include <netinet/in.h>
@@ -15,6 +18,22 @@
 @implementation Utils
 NSString *const deviceName = @"roth";
 
+#define STUN_SERVER "stun.moonlight-stream.org"
+#define STUN_PORT 3478
+
+// Our WAN address only changes with the network, so it is reused across
+// discovered hosts. Failures are retried sooner than successes.
+#define STUN_CACHE_TTL 300
+#define STUN_CACHE_FAILURE_TTL 30
+
+static STUN_CACHE stunCache;
+
++ (void) initialize {
+    if (self == [Utils class]) {
+        ScInit(&stunCache, LiFindExternalAddressIP4, STUN_SERVER, STUN_PORT, STUN_CACHE_TTL, STUN_CACHE_FAILURE_TTL);
+    }
+}
+
 + (NSData*) randomBytes:(NSInteger)length {
     char* bytes = malloc(length);
     arc4random_buf(bytes, length);
@@ -64,6 +83,18 @@ NSString *const deviceName = @"roth";
     return NO;
 }
 
++ (int) findExternalAddressIP4:(unsigned int*)wanAddr {
+    return ScFindExternalAddressIP4(&stunCache, wanAddr);
+}
+
++ (void) invalidateExternalAddress {
+    ScInvalidate(&stunCache);
+}
+
++ (void) setStunServer:(NSString*)stunServer port:(unsigned short)stunPort {
+    ScSetServer(&stunCache, [stunServer UTF8String], stunPort);
+}
+
 #if !TARGET_OS_TV
 + (void) launchUrl:(NSString*)urlString {
     [[UIApplication sharedApplication] openURL:[NSURL URLWithString:urlString] options:@{} completionHandler:nil];
@@ -5,8 +5,6 @@
 //  Copyright (c) 2014 Moonlight Stream. All rights reserved.
 //
 
-@import ImageIO;
-
 #import "MainFrameViewController.h"
 #import "CryptoManager.h"
 #import "HttpManager.h"
@@ -16,8 +14,10 @@
 #import "UIComputerView.h"
 #import "UIAppView.h"
 #import "DataManager.h"
+#import "AppListDiff.h"
 #import "TemporarySettings.h"
 #import "WakeOnLanManager.h"
+#import "BoxArtCache.h"
 #import "AppListResponse.h"
 #import "ServerInfoResponse.h"
 #import "StreamFrameViewController.h"
@@ -42,7 +42,6 @@
     TemporaryHost* _selectedHost;
     BOOL _showHiddenApps;
     NSString* _uniqueId;
-    NSData* _clientCert;
     DiscoveryManager* _discMan;
     AppAssetManager* _appManager;
     StreamConfiguration* _streamConfig;
@@ -51,7 +50,8 @@
     UIScrollView* hostScrollView;
     FrontViewPosition currentPosition;
     NSArray* _sortedAppList;
-    NSCache* _boxArtCache;
+    NSMutableSet<NSString*>* _updatedAppKeys;
+    BoxArtCache* _boxArtCache;
     bool _background;
 #if TARGET_OS_TV
     UITapGestureRecognizer* _menuRecognizer;
@@ -59,6 +59,9 @@
 }
 static NSMutableSet* hostList;
 
+// How long to watch for a host to come online after waking it
+static const NSTimeInterval WOL_WAKE_TIMEOUT = 120;
+
 - (void)startPairing:(NSString *)PIN {
     // Needs to be synchronous to ensure the alert is shown before any potential
     // failure callback could be invoked.
@@ -211,76 +214,27 @@ static NSMutableSet* hostList;
 
 - (void) updateAppEntry:(TemporaryApp*)app forHost:(TemporaryHost*)host {
     DataManager* database = [[DataManager alloc] init];
-    NSMutableSet* newHostAppList = [NSMutableSet setWithSet:host.appList];
-
-    for (TemporaryApp* savedApp in newHostAppList) {
-        if ([app.id isEqualToString:savedApp.id]) {
-            savedApp.name = app.name;
-            savedApp.hdrSupported = app.hdrSupported;
-            savedApp.hidden = app.hidden;
-            
-            host.appList = newHostAppList;
-
-            [database updateAppsForExistingHost:host];
-            return;
-        }
-    }
+    [database updateAppsForExistingHost:host withDiff:[[AppListDiff alloc] initWithInsertedApps:@[]
+                                                                                    deletedApps:@[]
+                                                                                    updatedApps:@[app]]];
 }
     
 - (void) updateApplist:(NSSet*) newList forHost:(TemporaryHost*)host {
-    DataManager* database = [[DataManager alloc] init];
-    NSMutableSet* newHostAppList = [NSMutableSet setWithSet:host.appList];
-    
-    for (TemporaryApp* app in newList) {
-        BOOL appAlreadyInList = NO;
-        for (TemporaryApp* savedApp in newHostAppList) {
-            if ([app.id isEqualToString:savedApp.id]) {
-                savedApp.name = app.name;
-                savedApp.hdrSupported = app.hdrSupported;
-                // Don't propagate hidden, because we want the local data to prevail
-                appAlreadyInList = YES;
-                break;
-            }
-        }
-        if (!appAlreadyInList) {
-            app.host = host;
-            [newHostAppList addObject:app];
-        }
-    }
+    AppListDiff* diff = [AppListDiff mergeAppList:newList intoHost:host];
+    Log(LOG_I, @"App list changes: %lu added, %lu removed, %lu updated",
+        (unsigned long)diff.insertedApps.count, (unsigned long)diff.deletedApps.count, (unsigned long)diff.updatedApps.count);
     
-    BOOL appWasRemoved;
-    do {
-        appWasRemoved = NO;
-        
-        for (TemporaryApp* app in newHostAppList) {
-            appWasRemoved = YES;
-            for (TemporaryApp* mergedApp in newList) {
-                if ([mergedApp.id isEqualToString:app.id]) {
-                    appWasRemoved = NO;
-                    break;
-                }
-            }
-            if (appWasRemoved) {
-                // Removing the app mutates the list we're iterating (which isn't legal).
-                // We need to jump out of this loop and restart enumeration.
-                
-                [newHostAppList removeObject:app];
-                
-                // It's important to remove the app record from the database
-                // since we'll have a constraint violation now that appList
-                // doesn't have this app in it.
-                [database removeApp:app];
-                
-                break;
-            }
-        }
-        
-        // Keep looping until the list is no longer being mutated
-    } while (appWasRemoved);
+    for (TemporaryApp* app in diff.updatedApps) {
+        [_updatedAppKeys addObject:[AppListDiff keyForApp:app]];
+    }
+    for (TemporaryApp* app in diff.deletedApps) {
+        [_boxArtCache removeApp:app];
+    }
     
-    host.appList = newHostAppList;
-
-    [database updateAppsForExistingHost:host];
+    if (![diff isEmpty]) {
+        DataManager* database = [[DataManager alloc] init];
+        [database updateAppsForExistingHost:host withDiff:diff];
+    }
     
     // This host may be eligible for a shortcut now that the app list
     // has been populated
@@ -307,8 +261,8 @@ static NSMutableSet* hostList;
 }
 
 - (void) receivedAssetForApp:(TemporaryApp*)app {
-    // Update the box art cache now so we don't have to do it
-    // on the main thread
+    // We're called on a background queue, so update the box art
+    // cache now so we don't have to do it on the main thread
     [self updateBoxArtCacheForApp:app];
     
     dispatch_async(dispatch_get_main_queue(), ^{
@@ -419,7 +373,10 @@ static NSMutableSet* hostList;
                     Log(LOG_I, @"Trying to pair");
                     // Polling the server while pairing causes the server to screw up
                     [self->_discMan stopDiscoveryBlocking];
-                    PairManager* pMan = [[PairManager alloc] initWithManager:hMan clientCert:self->_clientCert callback:self];
+                    if (![CryptoManager isKeyPairReady]) {
+                        Log(LOG_I, @"Waiting for client certificate generation");
+                    }
+                    PairManager* pMan = [[PairManager alloc] initWithManager:hMan clientCert:[CryptoManager readCertFromFile] callback:self];
                     [self->_opQueue addOperation:pMan];
                 }
                 else {
@@ -479,9 +436,16 @@ static NSMutableSet* hostList;
             if (host.mac == nil || [host.mac isEqualToString:@"00:00:00:00:00:00"]) {
                 wolAlert.message = @"Host MAC unknown, unable to send WOL Packet";
             } else {
-                dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
-                    [WakeOnLanManager wakeHost:host];
-                });
+                [WakeOnLanManager wakeHost:host completion:^(NSArray<WakeOnLanResult*>* results) {
+                    [WakeOnLanManager waitForHost:host discoveryManager:self->_discMan timeout:WOL_WAKE_TIMEOUT completion:^(BOOL online, NSTimeInterval elapsed) {
+                        if (online) {
+                            Log(LOG_I, @"%@ came online %.1f seconds after WOL", host.name, elapsed);
+                        }
+                        else {
+                            Log(LOG_W, @"%@ did not come online within %.0f seconds of WOL", host.name, elapsed);
+                        }
+                    }];
+                }];
                 wolAlert.message = @"Successfully sent wake-up request. It may take a few moments for the PC to wake. If it never wakes up, ensure it's properly configured for Wake-on-LAN.";
             }
             [[self activeViewController] presentViewController:wolAlert animated:YES completion:nil];
@@ -542,6 +506,7 @@ static NSMutableSet* hostList;
 #endif
     [longClickAlert addAction:[UIAlertAction actionWithTitle:@"Remove Host" style:UIAlertActionStyleDestructive handler:^(UIAlertAction* action) {
         [self->_discMan removeHostFromDiscovery:host];
+        [self->_boxArtCache removeAppsForHost:host];
         DataManager* dataMan = [[DataManager alloc] init];
         [dataMan removeHost:host];
         @synchronized(hostList) {
@@ -963,10 +928,10 @@ static NSMutableSet* hostList;
     // Set the current position to the center
     currentPosition = FrontViewPositionLeft;
     
-    // Set up crypto
-    [CryptoManager generateKeyPairUsingSSL];
+    // Set up crypto. The client identity is generated in the background and
+    // only waited on when we actually need it for pairing.
+    [CryptoManager prewarmKeyPair];
     _uniqueId = [IdManager getUniqueId];
-    _clientCert = [CryptoManager readCertFromFile];
 
     _appManager = [[AppAssetManager alloc] initWithCallback:self];
     _opQueue = [[NSOperationQueue alloc] init];
@@ -976,7 +941,11 @@ static NSMutableSet* hostList;
         hostList = [[NSMutableSet alloc] init];
     }
     
-    _boxArtCache = [[NSCache alloc] init];
+    // Box art tiles are stored at the size of a grid cell
+    _updatedAppKeys = [[NSMutableSet alloc] init];
+    
+    _boxArtCache = [[BoxArtCache alloc] initWithTileSize:((UICollectionViewFlowLayout*)self.collectionView.collectionViewLayout).itemSize
+                                                   scale:[UIScreen mainScreen].scale];
         
     hostScrollView = [[ComputerScrollView alloc] init];
     hostScrollView.frame = CGRectMake(0, self.navigationController.navigationBar.frame.origin.y + self.navigationController.navigationBar.frame.size.height, self.view.frame.size.width, self.view.frame.size.height / 2);
@@ -1147,8 +1116,9 @@ static NSMutableSet* hostList;
     // you cannot restart an NSOperation when it is finished
     [_discMan stopDiscovery];
     
-    // Purge the box art cache
-    [_boxArtCache removeAllObjects];
+    // Release box art memory while we're not showing it
+    Log(LOG_I, @"%@", [_boxArtCache getStatsText]);
+    [_boxArtCache trimResidentMemory];
     
     // Remove our lifetime observers to avoid triggering them
     // while streaming
@@ -1235,12 +1205,14 @@ static NSMutableSet* hostList;
             prevEdge = compView.frame.origin.x + compView.frame.size.width;
             [hostScrollView addSubview:compView];
             
-            // Start jobs to decode the box art in advance
-            for (TemporaryApp* app in comp.appList) {
-                dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_LOW, 0), ^{
+            // Build box art tiles in advance. Apps whose tiles are already
+            // current cost only a stat() of their PNG.
+            NSSet* appList = comp.appList;
+            dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_LOW, 0), ^{
+                for (TemporaryApp* app in appList) {
                     [self updateBoxArtCacheForApp:app];
-                });
-            }
+                }
+            });
         }
     }
     
@@ -1273,51 +1245,8 @@ static NSMutableSet* hostList;
     }
 }
 
-// This function forces immediate decoding of the UIImage, rather
-// than the default lazy decoding that results in janky scrolling.
-+ (UIImage*) loadBoxArtForCaching:(TemporaryApp*)app {
-    UIImage* boxArt;
-    
-    NSData* imageData = [NSData dataWithContentsOfFile:[AppAssetManager boxArtPathForApp:app]];
-    if (imageData == nil) {
-        // No box art on disk
-        return nil;
-    }
-    
-    CGImageSourceRef source = CGImageSourceCreateWithData((__bridge CFDataRef)imageData, NULL);
-    CGImageRef cgImage = CGImageSourceCreateImageAtIndex(source, 0, nil);
-    
-    size_t width = CGImageGetWidth(cgImage);
-    size_t height = CGImageGetHeight(cgImage);
-    
-    CGColorSpaceRef colorSpace = CGColorSpaceCreateDeviceRGB();
-    CGContextRef imageContext =  CGBitmapContextCreate(NULL, width, height, 8, width * 4, colorSpace,
-                                                       kCGImageAlphaPremultipliedFirst | kCGBitmapByteOrder32Little);
-    CGColorSpaceRelease(colorSpace);
-
-    CGContextDrawImage(imageContext, CGRectMake(0, 0, width, height), cgImage);
-    
-    CGImageRef outputImage = CGBitmapContextCreateImage(imageContext);
-
-    boxArt = [UIImage imageWithCGImage:outputImage];
-    
-    CGImageRelease(outputImage);
-    CGContextRelease(imageContext);
-    
-    CGImageRelease(cgImage);
-    CFRelease(source);
-    
-    return boxArt;
-}
-
 - (void) updateBoxArtCacheForApp:(TemporaryApp*)app {
-    if ([_boxArtCache objectForKey:app] == nil) {
-        UIImage* image = [MainFrameViewController loadBoxArtForCaching:app];
-        if (image != nil) {
-            // Add the image to our cache if it was present
-            [_boxArtCache setObject:image forKey:app];
-        }
-    }
+    [_boxArtCache updateApp:app];
 }
 
 - (void) updateAppsForHost:(TemporaryHost*)host {
@@ -1326,6 +1255,8 @@ static NSMutableSet* hostList;
         return;
     }
     
+    NSArray* oldAppList = _sortedAppList;
+    
     _sortedAppList = [host.appList allObjects];
     _sortedAppList = [_sortedAppList sortedArrayUsingSelector:@selector(compareName:)];
     
@@ -1340,7 +1271,74 @@ static NSMutableSet* hostList;
     }
     
     [hostScrollView removeFromSuperview];
-    [self.collectionView reloadData];
+    
+    if (oldAppList == nil || [self.collectionView numberOfItemsInSection:0] != oldAppList.count) {
+        // Nothing of this host's is on screen yet to animate from
+        [self.collectionView reloadData];
+    }
+    else {
+        [self animateAppListFrom:oldAppList to:_sortedAppList];
+    }
+    [_updatedAppKeys removeAllObjects];
+}
+
+// Applies the difference between two app lists to the grid as one batch of
+// inserts, deletes, and moves, so unchanged cells stay put instead of flashing
+- (void) animateAppListFrom:(NSArray<TemporaryApp*>*)oldAppList to:(NSArray<TemporaryApp*>*)newAppList {
+    NSMutableDictionary<NSString*, NSNumber*>* oldIndexes = [[NSMutableDictionary alloc] initWithCapacity:oldAppList.count];
+    for (NSUInteger i = 0; i < oldAppList.count; i++) {
+        oldIndexes[[AppListDiff keyForApp:oldAppList[i]]] = @(i);
+    }
+    
+    NSMutableArray<NSIndexPath*>* insertedPaths = [[NSMutableArray alloc] init];
+    NSMutableArray<NSIndexPath*>* deletedPaths = [[NSMutableArray alloc] init];
+    NSMutableArray<NSIndexPath*>* reloadedPaths = [[NSMutableArray alloc] init];
+    NSMutableArray<NSArray<NSIndexPath*>*>* movedPaths = [[NSMutableArray alloc] init];
+    
+    for (NSUInteger i = 0; i < newAppList.count; i++) {
+        NSString* key = [AppListDiff keyForApp:newAppList[i]];
+        NSNumber* oldIndex = oldIndexes[key];
+        NSIndexPath* newPath = [NSIndexPath indexPathForItem:i inSection:0];
+        
+        if (oldIndex == nil) {
+            [insertedPaths addObject:newPath];
+            continue;
+        }
+        
+        [oldIndexes removeObjectForKey:key];
+        if (oldIndex.unsignedIntegerValue != i) {
+            [movedPaths addObject:@[[NSIndexPath indexPathForItem:oldIndex.unsignedIntegerValue inSection:0], newPath]];
+        }
+        if (oldAppList[oldIndex.unsignedIntegerValue] != newAppList[i] || [_updatedAppKeys containsObject:key]) {
+            // The cell may be showing stale data for this app
+            [reloadedPaths addObject:newPath];
+        }
+    }
+    
+    for (NSNumber* oldIndex in [oldIndexes allValues]) {
+        [deletedPaths addObject:[NSIndexPath indexPathForItem:oldIndex.unsignedIntegerValue inSection:0]];
+    }
+    
+    if (insertedPaths.count == 0 && deletedPaths.count == 0 && movedPaths.count == 0) {
+        // Apps updated in place refresh their own cells
+        if (reloadedPaths.count != 0) {
+            [self.collectionView reloadItemsAtIndexPaths:reloadedPaths];
+        }
+        return;
+    }
+    
+    [self.collectionView performBatchUpdates:^{
+        [self.collectionView deleteItemsAtIndexPaths:deletedPaths];
+        [self.collectionView insertItemsAtIndexPaths:insertedPaths];
+        for (NSArray<NSIndexPath*>* move in movedPaths) {
+            [self.collectionView moveItemAtIndexPath:move[0] toIndexPath:move[1]];
+        }
+    } completion:^(BOOL finished) {
+        // Moved cells can't be reloaded in the same batch
+        if (reloadedPaths.count != 0) {
+            [self.collectionView reloadItemsAtIndexPaths:reloadedPaths];
+        }
+    }];
 }
 
 - (UICollectionViewCell *)collectionView:(UICollectionView *)collectionView cellForItemAtIndexPath:(NSIndexPath *)indexPath {
@@ -1348,6 +1346,17 @@ static NSMutableSet* hostList;
     
     TemporaryApp* app = _sortedAppList[indexPath.row];
     UIAppView* appView = [[UIAppView alloc] initWithApp:app cache:_boxArtCache andCallback:self];
+    [_appManager prioritizeApp:app];
+    if (![_boxArtCache containsApp:app]) {
+        // Build the tile off the main thread and show it once it's ready
+        dispatch_async(dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0), ^{
+            if ([self->_boxArtCache updateApp:app]) {
+                dispatch_async(dispatch_get_main_queue(), ^{
+                    [appView updateAppImage];
+                });
+            }
+        });
+    }
     
     if (appView.bounds.size.width > 10.0) {
         CGFloat scale = cell.bounds.size.width / appView.bounds.size.width;
@@ -1392,8 +1401,8 @@ static NSMutableSet* hostList;
 {
     [super didReceiveMemoryWarning];
     
-    // Purge the box art cache on low memory
-    [_boxArtCache removeAllObjects];
+    // Release box art memory on low memory
+    [_boxArtCache trimResidentMemory];
 }
 
 - (void)touchesBegan:(NSSet *)touches withEvent:(UIEvent *)event {
@@ -255,6 +255,10 @@
 
 - (void)updateStatsOverlay {
     NSString* overlayText = [self->_streamMan getStatsOverlayText];
+    NSString* motionStatsText = [self->_controllerSupport getMotionStatsText];
+    if (overlayText != nil && motionStatsText != nil) {
+        overlayText = [overlayText stringByAppendingFormat:@"\n%@", motionStatsText];
+    }
     
     dispatch_async(dispatch_get_main_queue(), ^{
         [self updateOverlayText:overlayText];
@@ -0,0 +1,712 @@
+//
+//  AppAssetBenchmark.c
+//  Moonlight
+//
+//  Copyright © 2026 Moonlight Game Streaming Project. All rights reserved.
+//
+//  Fetches box art for 300 apps from a stand-in /appasset server on the
+//  loopback interface the way AppAssetManager does: the scheduler runs on one
+//  thread like its serial queue, each request runs on its own thread like the
+//  URL session's, and the response is classified and written to an in-memory
+//  cache before the result goes back to the scheduler. The server answers
+//  some requests with a 503 and never has art for one app, and it answers
+//  requests whose If-None-Match matches with a 304.
+//
+//  Reports the time, the requests and what came back for a cold cache and for
+//  revalidating stale art with matching ETags, with ETags the host forgot, and
+//  with some of the art changed. Retry delays are scaled down so giving up on
+//  an app doesn't take seconds.
+//
+
+#include "AssetScheduler.h"
+#include "TestCommon.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <openssl/sha.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#define APP_COUNT 300
+#define FIRST_VISIBLE_APP 150
+#define VISIBLE_APP_COUNT 12
+#define MIN_ART_SIZE (16 * 1024)
+#define MAX_ART_SIZE (160 * 1024)
+#define ETAG_MAX_LENGTH 64
+
+// What AppAssetManager uses
+#define MAX_REQUEST_COUNT 4
+#define MAX_ATTEMPTS 5
+#define RETRY_BASE_DELAY 0.5
+#define RETRY_MAX_DELAY 8
+
+#define RETRY_TIME_SCALE 0.02
+
+// Time the host takes to look up the art before it answers
+#define SERVER_LATENCY_MS 2
+
+// Every FLAKY_APP_INTERVALth app fails its first FLAKY_FAILURES requests,
+// and the server never has art for BROKEN_APP
+#define FLAKY_APP_INTERVAL 10
+#define FLAKY_FAILURES 2
+#define BROKEN_APP 7
+
+// Every CHANGED_APP_INTERVALth app gets new art, half of them the same size
+#define CHANGED_APP_INTERVAL 10
+#define CHANGED_APP_OFFSET 3
+
+typedef struct _ASSET_SERVER {
+    int sock;
+    unsigned short port;
+    pthread_t thread;
+    atomic_bool stop;
+    atomic_int connections;
+    
+    pthread_mutex_t mutex;
+    uint8_t* art[APP_COUNT];
+    size_t artLength[APP_COUNT];
+    int version[APP_COUNT];
+    
+    // 503s left to send, or -1 to always send one
+    int failuresLeft[APP_COUNT];
+    
+    // Changes every ETag, like a host that doesn't keep them
+    int etagEpoch;
+} ASSET_SERVER, *PASSET_SERVER;
+
+typedef struct _CONNECTION {
+    PASSET_SERVER server;
+    int fd;
+} CONNECTION, *PCONNECTION;
+
+typedef struct _HTTP_RESPONSE {
+    int statusCode;
+    char etag[ETAG_MAX_LENGTH];
+    char* buffer;
+    size_t length;
+    const uint8_t* body;
+    size_t bodyLength;
+} HTTP_RESPONSE, *PHTTP_RESPONSE;
+
+// Stands in for the box art files and their xattrs
+typedef struct _CACHED_ART {
+    uint8_t* data;
+    size_t length;
+    char etag[ETAG_MAX_LENGTH];
+    bool stale;
+    double validatedTime;
+} CACHED_ART, *PCACHED_ART;
+
+typedef struct _ASSET_BENCH ASSET_BENCH, *PASSET_BENCH;
+
+typedef struct _FETCH {
+    PASSET_BENCH bench;
+    pthread_t thread;
+    AS_REQUEST request;
+    char etag[ETAG_MAX_LENGTH];
+    bool success;
+    struct _FETCH* next;
+} FETCH, *PFETCH;
+
+typedef struct _RETRY_TIMER {
+    double dueTime;
+    char appId[AS_APP_ID_MAX_LENGTH];
+    uint32_t generation;
+} RETRY_TIMER, *PRETRY_TIMER;
+
+struct _ASSET_BENCH {
+    PASSET_SERVER server;
+    char appIds[APP_COUNT][AS_APP_ID_MAX_LENGTH];
+    CACHED_ART cache[APP_COUNT];
+    
+    // Only touched on the thread running the scheduler
+    ASSET_SCHEDULER scheduler;
+    RETRY_TIMER timers[APP_COUNT];
+    int timerCount;
+    int requests;
+    int retries;
+    int gaveUp;
+    
+    pthread_mutex_t mutex;
+    pthread_cond_t finishedCond;
+    PFETCH finished;
+    
+    atomic_int failed;
+    atomic_int notModified;
+    atomic_int unchanged;
+    atomic_int written;
+    atomic_llong bytesReceived;
+};
+
+static atomic_int digestCount;
+
+static void sha256Digest(const void* data, size_t length, uint8_t digest[AS_DIGEST_LENGTH])
+{
+    SHA256(data, length, digest);
+    digestCount++;
+}
+
+static void makeArt(PASSET_SERVER server, int app, size_t length)
+{
+    static const uint8_t pngSignature[] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+    uint32_t state = app * 7919 + server->version[app] * 104729 + 1;
+    
+    free(server->art[app]);
+    server->art[app] = malloc(length);
+    CHECK(server->art[app] != NULL);
+    server->artLength[app] = length;
+    
+    for (size_t i = 0; i < length; i++) {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        server->art[app][i] = (uint8_t)state;
+    }
+    memcpy(server->art[app], pngSignature, sizeof(pngSignature));
+}
+
+static bool sendAll(int fd, const void* data, size_t length)
+{
+    while (length > 0) {
+        ssize_t sent = send(fd, data, length, MSG_NOSIGNAL);
+        if (sent <= 0) {
+            return false;
+        }
+        data = (const uint8_t*)data + sent;
+        length -= sent;
+    }
+    
+    return true;
+}
+
+static void sendStatus(int fd, const char* status, const char* etag)
+{
+    char header[256];
+    
+    snprintf(header, sizeof(header), "HTTP/1.1 %s\r\n%s%s%sContent-Length: 0\r\nConnection: close\r\n\r\n",
+             status, etag ? "ETag: " : "", etag ? etag : "", etag ? "\r\n" : "");
+    sendAll(fd, header, strlen(header));
+}
+
+static void answerRequest(PASSET_SERVER server, int fd, const char* request)
+{
+    const char* appIdParam = strstr(request, "appid=");
+    const char* ifNoneMatch = strstr(request, "If-None-Match: ");
+    int app = appIdParam != NULL ? atoi(appIdParam + strlen("appid=")) : -1;
+    char etag[ETAG_MAX_LENGTH];
+    char header[256];
+    const uint8_t* art;
+    size_t artLength;
+    
+    TestSleepMs(SERVER_LATENCY_MS);
+    
+    if (app < 0 || app >= APP_COUNT) {
+        sendStatus(fd, "404 Not Found", NULL);
+        return;
+    }
+    
+    pthread_mutex_lock(&server->mutex);
+    if (server->failuresLeft[app] != 0) {
+        if (server->failuresLeft[app] > 0) {
+            server->failuresLeft[app]--;
+        }
+        pthread_mutex_unlock(&server->mutex);
+        sendStatus(fd, "503 Service Unavailable", NULL);
+        return;
+    }
+    snprintf(etag, sizeof(etag), "\"%d-%d-%d\"", server->etagEpoch, app, server->version[app]);
+    
+    // The art doesn't change while requests are in flight
+    art = server->art[app];
+    artLength = server->artLength[app];
+    pthread_mutex_unlock(&server->mutex);
+    
+    if (ifNoneMatch != NULL && strncmp(ifNoneMatch + strlen("If-None-Match: "), etag, strlen(etag)) == 0) {
+        sendStatus(fd, "304 Not Modified", etag);
+        return;
+    }
+    
+    snprintf(header, sizeof(header),
+             "HTTP/1.1 200 OK\r\nContent-Type: image/png\r\nContent-Length: %zu\r\nETag: %s\r\nConnection: close\r\n\r\n",
+             artLength, etag);
+    if (sendAll(fd, header, strlen(header))) {
+        sendAll(fd, art, artLength);
+    }
+}
+
+static void* connectionThread(void* arg)
+{
+    PCONNECTION connection = (PCONNECTION)arg;
+    char request[4096];
+    size_t length = 0;
+    ssize_t received;
+    
+    while (length < sizeof(request) - 1 &&
+           (received = recv(connection->fd, request + length, sizeof(request) - 1 - length, 0)) > 0) {
+        length += received;
+        request[length] = 0;
+        if (strstr(request, "\r\n\r\n") != NULL) {
+            break;
+        }
+    }
+    request[length] = 0;
+    
+    answerRequest(connection->server, connection->fd, request);
+    
+    close(connection->fd);
+    connection->server->connections--;
+    free(connection);
+    return NULL;
+}
+
+static void* serverThread(void* arg)
+{
+    PASSET_SERVER server = (PASSET_SERVER)arg;
+    
+    while (!server->stop) {
+        struct pollfd pfd = { server->sock, POLLIN, 0 };
+        PCONNECTION connection;
+        pthread_t thread;
+        int fd;
+        
+        if (poll(&pfd, 1, 50) <= 0 || (fd = accept(server->sock, NULL, NULL)) < 0) {
+            continue;
+        }
+        
+        connection = malloc(sizeof(*connection));
+        CHECK(connection != NULL);
+        connection->server = server;
+        connection->fd = fd;
+        server->connections++;
+        CHECK(pthread_create(&thread, NULL, connectionThread, connection) == 0);
+        pthread_detach(thread);
+    }
+    
+    return NULL;
+}
+
+static void startServer(PASSET_SERVER server)
+{
+    struct sockaddr_in addr;
+    socklen_t addrLength = sizeof(addr);
+    
+    memset(server, 0, sizeof(*server));
+    pthread_mutex_init(&server->mutex, NULL);
+    
+    for (int app = 0; app < APP_COUNT; app++) {
+        makeArt(server, app, MIN_ART_SIZE + (app * 2654435761u) % (MAX_ART_SIZE - MIN_ART_SIZE));
+    }
+    
+    server->sock = socket(AF_INET, SOCK_STREAM, 0);
+    CHECK(server->sock >= 0);
+    
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    CHECK(bind(server->sock, (struct sockaddr*)&addr, sizeof(addr)) == 0);
+    CHECK(listen(server->sock, 64) == 0);
+    CHECK(getsockname(server->sock, (struct sockaddr*)&addr, &addrLength) == 0);
+    server->port = ntohs(addr.sin_port);
+    
+    CHECK(pthread_create(&server->thread, NULL, serverThread, server) == 0);
+}
+
+static void stopServer(PASSET_SERVER server)
+{
+    server->stop = true;
+    pthread_join(server->thread, NULL);
+    while (server->connections > 0) {
+        TestSleepMs(1);
+    }
+    
+    close(server->sock);
+    for (int app = 0; app < APP_COUNT; app++) {
+        free(server->art[app]);
+    }
+    pthread_mutex_destroy(&server->mutex);
+}
+
+static bool httpGet(unsigned short port, const char* appId, const char* etag, PHTTP_RESPONSE response)
+{
+    struct sockaddr_in addr;
+    char request[512];
+    size_t capacity = 64 * 1024;
+    ssize_t received;
+    char* headerEnd;
+    char* etagHeader;
+    int fd;
+    
+    memset(response, 0, sizeof(*response));
+    
+    fd = socket(AF_INET, SOCK_STREAM, 0);
+    CHECK(fd >= 0);
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(port);
+    if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+        close(fd);
+        return false;
+    }
+    
+    snprintf(request, sizeof(request),
+             "GET /appasset?uniqueid=0123456789ABCDEF&appid=%s&AssetType=2&AssetIdx=0 HTTP/1.1\r\n"
+             "Host: 127.0.0.1\r\n%s%s%sConnection: close\r\n\r\n",
+             appId, etag[0] ? "If-None-Match: " : "", etag, etag[0] ? "\r\n" : "");
+    if (!sendAll(fd, request, strlen(request))) {
+        close(fd);
+        return false;
+    }
+    
+    response->buffer = malloc(capacity + 1);
+    CHECK(response->buffer != NULL);
+    while ((received = recv(fd, response->buffer + response->length, capacity - response->length, 0)) > 0) {
+        response->length += received;
+        if (response->length == capacity) {
+            capacity *= 2;
+            response->buffer = realloc(response->buffer, capacity + 1);
+            CHECK(response->buffer != NULL);
+        }
+    }
+    close(fd);
+    response->buffer[response->length] = 0;
+    
+    headerEnd = strstr(response->buffer, "\r\n\r\n");
+    if (headerEnd == NULL || sscanf(response->buffer, "HTTP/1.1 %d", &response->statusCode) != 1) {
+        free(response->buffer);
+        return false;
+    }
+    *headerEnd = 0;
+    
+    etagHeader = strstr(response->buffer, "\r\nETag: ");
+    if (etagHeader != NULL) {
+        etagHeader += strlen("\r\nETag: ");
+        snprintf(response->etag, sizeof(response->etag), "%.*s", (int)strcspn(etagHeader, "\r"), etagHeader);
+    }
+    
+    response->body = (const uint8_t*)headerEnd + 4;
+    response->bodyLength = response->length - (headerEnd + 4 - response->buffer);
+    return true;
+}
+
+// Does what handleResponse:forPath:changed: does with the box art file
+static bool handleResponse(PASSET_BENCH bench, PCACHED_ART cached, PHTTP_RESPONSE response)
+{
+    switch (AsClassifyResponse(response->statusCode, response->body, response->bodyLength,
+                               cached->data, cached->length, sha256Digest)) {
+        case AS_RESPONSE_FAILED:
+            bench->failed++;
+            return false;
+        case AS_RESPONSE_NOT_MODIFIED:
+            bench->notModified++;
+            cached->stale = false;
+            cached->validatedTime = TestGetTime();
+            return true;
+        case AS_RESPONSE_UNCHANGED:
+            bench->unchanged++;
+            break;
+        case AS_RESPONSE_CHANGED:
+            free(cached->data);
+            cached->data = malloc(response->bodyLength);
+            CHECK(cached->data != NULL);
+            memcpy(cached->data, response->body, response->bodyLength);
+            cached->length = response->bodyLength;
+            bench->written++;
+            break;
+    }
+    
+    if (response->etag[0]) {
+        memcpy(cached->etag, response->etag, sizeof(cached->etag));
+    }
+    cached->stale = false;
+    cached->validatedTime = TestGetTime();
+    return true;
+}
+
+static void* fetchThread(void* arg)
+{
+    PFETCH fetch = (PFETCH)arg;
+    PASSET_BENCH bench = fetch->bench;
+    HTTP_RESPONSE response;
+    
+    fetch->success = false;
+    if (httpGet(bench->server->port, fetch->request.appId, fetch->etag, &response)) {
+        bench->bytesReceived += response.length;
+        fetch->success = handleResponse(bench, &bench->cache[atoi(fetch->request.appId)], &response);
+        free(response.buffer);
+    }
+    
+    pthread_mutex_lock(&bench->mutex);
+    fetch->next = bench->finished;
+    bench->finished = fetch;
+    pthread_cond_signal(&bench->finishedCond);
+    pthread_mutex_unlock(&bench->mutex);
+    return NULL;
+}
+
+static void startRequests(PASSET_BENCH bench)
+{
+    AS_REQUEST request;
+    
+    while (AsStartRequest(&bench->scheduler, &request)) {
+        PFETCH fetch = calloc(1, sizeof(*fetch));
+        CHECK(fetch != NULL);
+        fetch->bench = bench;
+        fetch->request = request;
+        if (request.conditional) {
+            memcpy(fetch->etag, bench->cache[atoi(request.appId)].etag, sizeof(fetch->etag));
+        }
+        
+        bench->requests++;
+        CHECK(pthread_create(&fetch->thread, NULL, fetchThread, fetch) == 0);
+    }
+}
+
+static void fetchFinished(PASSET_BENCH bench, PFETCH fetch)
+{
+    PRETRY_TIMER timer;
+    double delay;
+    
+    pthread_join(fetch->thread, NULL);
+    
+    switch (AsRequestFinished(&bench->scheduler, &fetch->request, fetch->success, &delay)) {
+        case AS_REQUEST_RETRY:
+            CHECK(bench->timerCount < APP_COUNT);
+            timer = &bench->timers[bench->timerCount++];
+            timer->dueTime = TestGetTime() + delay * RETRY_TIME_SCALE;
+            memcpy(timer->appId, fetch->request.appId, sizeof(timer->appId));
+            timer->generation = fetch->request.generation;
+            bench->retries++;
+            break;
+        case AS_REQUEST_GAVE_UP:
+            bench->gaveUp++;
+            break;
+        default:
+            break;
+    }
+    
+    free(fetch);
+    startRequests(bench);
+}
+
+static void waitUntil(PASSET_BENCH bench, double time)
+{
+    double now = TestGetTime();
+    struct timespec ts;
+    
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    ts.tv_sec += (time_t)(time - now);
+    ts.tv_nsec += (long)((time - now - (time_t)(time - now)) * 1000000000.0);
+    if (ts.tv_nsec >= 1000000000) {
+        ts.tv_sec++;
+        ts.tv_nsec -= 1000000000;
+    }
+    pthread_cond_timedwait(&bench->finishedCond, &bench->mutex, &ts);
+}
+
+// Runs the scheduler until every app has art or was given up on
+static void runQueue(PASSET_BENCH bench)
+{
+    startRequests(bench);
+    
+    pthread_mutex_lock(&bench->mutex);
+    while (bench->finished != NULL || bench->timerCount > 0 || bench->scheduler.requestsInFlight > 0) {
+        PFETCH fetch = bench->finished;
+        int next = -1;
+        
+        if (fetch != NULL) {
+            bench->finished = fetch->next;
+            pthread_mutex_unlock(&bench->mutex);
+            fetchFinished(bench, fetch);
+            pthread_mutex_lock(&bench->mutex);
+            continue;
+        }
+        
+        for (int i = 0; i < bench->timerCount; i++) {
+            if (next < 0 || bench->timers[i].dueTime < bench->timers[next].dueTime) {
+                next = i;
+            }
+        }
+        
+        if (next >= 0 && bench->timers[next].dueTime <= TestGetTime()) {
+            RETRY_TIMER timer = bench->timers[next];
+            
+            bench->timers[next] = bench->timers[--bench->timerCount];
+            pthread_mutex_unlock(&bench->mutex);
+            AsRetryDue(&bench->scheduler, timer.appId, timer.generation);
+            startRequests(bench);
+            pthread_mutex_lock(&bench->mutex);
+        }
+        else if (next >= 0) {
+            waitUntil(bench, bench->timers[next].dueTime);
+        }
+        else {
+            pthread_cond_wait(&bench->finishedCond, &bench->mutex);
+        }
+    }
+    pthread_mutex_unlock(&bench->mutex);
+}
+
+static void checkCache(PASSET_BENCH bench)
+{
+    PASSET_SERVER server = bench->server;
+    
+    for (int app = 0; app < APP_COUNT; app++) {
+        PCACHED_ART cached = &bench->cache[app];
+        
+        if (app == BROKEN_APP) {
+            CHECK(cached->data == NULL);
+            continue;
+        }
+        CHECK(!cached->stale);
+        CHECK_EQ(cached->length, server->artLength[app]);
+        CHECK(memcmp(cached->data, server->art[app], cached->length) == 0);
+    }
+}
+
+static void runScenario(PASSET_BENCH bench, const char* name, int maxRequests, bool prioritize)
+{
+    PASSET_SERVER server = bench->server;
+    const char* appIds[APP_COUNT];
+    AS_ART_STATE states[APP_COUNT];
+    double startTime;
+    double elapsed;
+    double visibleTime = 0;
+    
+    bench->requests = bench->retries = bench->gaveUp = 0;
+    bench->failed = bench->notModified = bench->unchanged = bench->written = 0;
+    bench->bytesReceived = 0;
+    digestCount = 0;
+    
+    pthread_mutex_lock(&server->mutex);
+    for (int app = 0; app < APP_COUNT; app++) {
+        server->failuresLeft[app] = app % FLAKY_APP_INTERVAL == 0 ? FLAKY_FAILURES : 0;
+    }
+    server->failuresLeft[BROKEN_APP] = -1;
+    pthread_mutex_unlock(&server->mutex);
+    
+    for (int app = 0; app < APP_COUNT; app++) {
+        PCACHED_ART cached = &bench->cache[app];
+        
+        appIds[app] = bench->appIds[app];
+        states[app] = cached->data == NULL ? AS_ART_MISSING : cached->stale ? AS_ART_STALE : AS_ART_CURRENT;
+        cached->validatedTime = 0;
+    }
+    
+    AsInit(&bench->scheduler, maxRequests, MAX_ATTEMPTS, RETRY_BASE_DELAY, RETRY_MAX_DELAY, 1);
+    
+    startTime = TestGetTime();
+    AsQueueApps(&bench->scheduler, appIds, states, APP_COUNT);
+    if (prioritize) {
+        // The cells on screen ask in turn, so the last one asking goes first
+        for (int i = VISIBLE_APP_COUNT - 1; i >= 0; i--) {
+            AsPrioritize(&bench->scheduler, appIds[FIRST_VISIBLE_APP + i]);
+        }
+    }
+    runQueue(bench);
+    elapsed = TestGetTime() - startTime;
+    
+    for (int i = 0; i < VISIBLE_APP_COUNT; i++) {
+        double validatedTime = bench->cache[FIRST_VISIBLE_APP + i].validatedTime - startTime;
+        visibleTime = validatedTime > visibleTime ? validatedTime : visibleTime;
+    }
+    
+    printf("  %-34s %6.0f %7.0f %5d %5d %5d %4d %7.1f %6d %7d %9d\n", name,
+           elapsed * 1000, visibleTime * 1000, bench->requests, bench->retries, bench->notModified,
+           bench->gaveUp, bench->bytesReceived / 1000000.0, digestCount, bench->written, bench->unchanged);
+    
+    CHECK_EQ(bench->gaveUp, 1);
+    CHECK_EQ(bench->timerCount, 0);
+    checkCache(bench);
+    AsDestroy(&bench->scheduler);
+}
+
+static void clearCache(PASSET_BENCH bench)
+{
+    for (int app = 0; app < APP_COUNT; app++) {
+        free(bench->cache[app].data);
+        memset(&bench->cache[app], 0, sizeof(bench->cache[app]));
+    }
+}
+
+static void markCacheStale(PASSET_BENCH bench)
+{
+    for (int app = 0; app < APP_COUNT; app++) {
+        bench->cache[app].stale = bench->cache[app].data != NULL;
+    }
+}
+
+int main(void)
+{
+    ASSET_SERVER server;
+    ASSET_BENCH bench;
+    pthread_condattr_t condAttr;
+    int changedApps = 0;
+    
+    startServer(&server);
+    
+    memset(&bench, 0, sizeof(bench));
+    bench.server = &server;
+    for (int app = 0; app < APP_COUNT; app++) {
+        snprintf(bench.appIds[app], sizeof(bench.appIds[app]), "%d", app);
+    }
+    pthread_mutex_init(&bench.mutex, NULL);
+    pthread_condattr_init(&condAttr);
+    pthread_condattr_setclock(&condAttr, CLOCK_MONOTONIC);
+    pthread_cond_init(&bench.finishedCond, &condAttr);
+    pthread_condattr_destroy(&condAttr);
+    
+    printf("%d apps, %d ms server latency, every %dth app fails twice and app %d always fails\n",
+           APP_COUNT, SERVER_LATENCY_MS, FLAKY_APP_INTERVAL, BROKEN_APP);
+    printf("  %-34s %6s %7s %5s %5s %5s %4s %7s %6s %7s %9s\n", "", "ms", "visible", "reqs", "retry",
+           "304", "gave", "MB in", "hashed", "written", "unchanged");
+    
+    runScenario(&bench, "cold cache, 1 request at a time", 1, true);
+    CHECK_EQ(bench.written, APP_COUNT - 1);
+    clearCache(&bench);
+    
+    runScenario(&bench, "cold cache, not prioritized", MAX_REQUEST_COUNT, false);
+    CHECK_EQ(bench.written, APP_COUNT - 1);
+    clearCache(&bench);
+    
+    runScenario(&bench, "cold cache", MAX_REQUEST_COUNT, true);
+    CHECK_EQ(bench.written, APP_COUNT - 1);
+    CHECK_EQ(digestCount, 0);
+    
+    markCacheStale(&bench);
+    runScenario(&bench, "stale, ETags match", MAX_REQUEST_COUNT, true);
+    CHECK_EQ(bench.notModified, APP_COUNT - 1);
+    CHECK_EQ(bench.bytesReceived < APP_COUNT * 1000, true);
+    
+    // Same art under new ETags, so every response is hashed and nothing is written
+    pthread_mutex_lock(&server.mutex);
+    server.etagEpoch++;
+    pthread_mutex_unlock(&server.mutex);
+    markCacheStale(&bench);
+    runScenario(&bench, "stale, host forgot ETags", MAX_REQUEST_COUNT, true);
+    CHECK_EQ(bench.unchanged, APP_COUNT - 1);
+    CHECK_EQ(bench.written, 0);
+    CHECK_EQ(digestCount, 2 * (APP_COUNT - 1));
+    
+    pthread_mutex_lock(&server.mutex);
+    for (int app = CHANGED_APP_OFFSET; app < APP_COUNT; app += CHANGED_APP_INTERVAL) {
+        server.version[app]++;
+        makeArt(&server, app, server.artLength[app] + (changedApps++ % 2 ? 1000 : 0));
+    }
+    pthread_mutex_unlock(&server.mutex);
+    markCacheStale(&bench);
+    runScenario(&bench, "stale, 10% of the art changed", MAX_REQUEST_COUNT, true);
+    CHECK_EQ(bench.written, changedApps);
+    CHECK_EQ(bench.notModified, APP_COUNT - 1 - changedApps);
+    CHECK_EQ(digestCount, 2 * ((changedApps + 1) / 2));
+    
+    clearCache(&bench);
+    pthread_cond_destroy(&bench.finishedCond);
+    pthread_mutex_destroy(&bench.mutex);
+    stopServer(&server);
+    return 0;
+}
@@ -0,0 +1,294 @@
+//
+//  AssetSchedulerTest.c
+//  Moonlight
+//
+//  Copyright © 2026 Moonlight Game Streaming Project. All rights reserved.
+//
+//  Checks the order box art is fetched in, the request limit, the retry
+//  backoff and how /appasset responses are classified.
+//
+
+#include "AssetScheduler.h"
+#include "TestCommon.h"
+
+#include <string.h>
+
+#define MAX_REQUESTS 4
+#define MAX_ATTEMPTS 5
+#define RETRY_BASE_DELAY 0.5
+#define RETRY_MAX_DELAY 8
+
+static int digestCalls;
+
+// Any function of the content will do here
+static void testDigest(const void* data, size_t length, uint8_t digest[AS_DIGEST_LENGTH])
+{
+    uint64_t hash = 14695981039346656037ULL;
+    
+    for (size_t i = 0; i < length; i++) {
+        hash = (hash ^ ((const uint8_t*)data)[i]) * 1099511628211ULL;
+    }
+    
+    for (int i = 0; i < AS_DIGEST_LENGTH; i++) {
+        digest[i] = (uint8_t)(hash >> (i % 8 * 8));
+    }
+    digestCalls++;
+}
+
+static void initScheduler(PASSET_SCHEDULER scheduler)
+{
+    AsInit(scheduler, MAX_REQUESTS, MAX_ATTEMPTS, RETRY_BASE_DELAY, RETRY_MAX_DELAY, 1);
+}
+
+static void startRequest(PASSET_SCHEDULER scheduler, PAS_REQUEST request, const char* appId, bool conditional)
+{
+    CHECK(AsStartRequest(scheduler, request));
+    CHECK(strcmp(request->appId, appId) == 0);
+    CHECK_EQ(request->conditional, conditional);
+}
+
+static void testMissingBeforeStale(void)
+{
+    static const char* appIds[] = { "1", "2", "3", "4", "5" };
+    static const AS_ART_STATE states[] = { AS_ART_STALE, AS_ART_MISSING, AS_ART_CURRENT, AS_ART_MISSING, AS_ART_STALE };
+    ASSET_SCHEDULER scheduler;
+    AS_REQUEST request;
+    
+    initScheduler(&scheduler);
+    AsQueueApps(&scheduler, appIds, states, 5);
+    
+    // Queuing the same apps again doesn't change their places
+    AsQueueApps(&scheduler, appIds, states, 5);
+    CHECK_EQ(scheduler.queueLength, 4);
+    
+    // Stale art is revalidated with a conditional request
+    startRequest(&scheduler, &request, "2", false);
+    startRequest(&scheduler, &request, "4", false);
+    startRequest(&scheduler, &request, "1", true);
+    startRequest(&scheduler, &request, "5", true);
+    CHECK_EQ(scheduler.requestsInFlight, 4);
+    
+    AsDestroy(&scheduler);
+}
+
+static void testPrioritize(void)
+{
+    static const char* appIds[] = { "1", "2", "3", "4" };
+    static const AS_ART_STATE states[] = { AS_ART_MISSING, AS_ART_MISSING, AS_ART_MISSING, AS_ART_STALE };
+    ASSET_SCHEDULER scheduler;
+    AS_REQUEST request;
+    
+    initScheduler(&scheduler);
+    AsQueueApps(&scheduler, appIds, states, 4);
+    
+    // Apps that scroll on screen go first, the last one first
+    AsPrioritize(&scheduler, "3");
+    AsPrioritize(&scheduler, "4");
+    AsPrioritize(&scheduler, "unknown");
+    
+    startRequest(&scheduler, &request, "4", true);
+    
+    // An app in flight can't be prioritized
+    AsPrioritize(&scheduler, "4");
+    startRequest(&scheduler, &request, "3", false);
+    startRequest(&scheduler, &request, "1", false);
+    startRequest(&scheduler, &request, "2", false);
+    CHECK(!AsStartRequest(&scheduler, &request));
+    
+    AsDestroy(&scheduler);
+}
+
+static void testRequestLimit(void)
+{
+    const char* appIds[300];
+    AS_ART_STATE states[300];
+    char names[300][8];
+    AS_REQUEST requests[MAX_REQUESTS];
+    AS_REQUEST request;
+    ASSET_SCHEDULER scheduler;
+    double delay;
+    int fetched = 0;
+    
+    for (int i = 0; i < 300; i++) {
+        snprintf(names[i], sizeof(names[i]), "%d", i);
+        appIds[i] = names[i];
+        states[i] = AS_ART_MISSING;
+    }
+    
+    initScheduler(&scheduler);
+    AsQueueApps(&scheduler, appIds, states, 300);
+    
+    for (int i = 0; i < MAX_REQUESTS; i++) {
+        CHECK(AsStartRequest(&scheduler, &requests[i]));
+    }
+    CHECK(!AsStartRequest(&scheduler, &request));
+    
+    // Each finished request makes room for exactly one more
+    while (scheduler.requestsInFlight > 0) {
+        int slot = fetched % MAX_REQUESTS;
+        CHECK_EQ(AsRequestFinished(&scheduler, &requests[slot], true, &delay), AS_REQUEST_DONE);
+        fetched++;
+        if (AsStartRequest(&scheduler, &requests[slot])) {
+            CHECK(!AsStartRequest(&scheduler, &request));
+            CHECK(strcmp(requests[slot].appId, names[fetched + MAX_REQUESTS - 1]) == 0);
+        }
+    }
+    CHECK_EQ(fetched, 300);
+    
+    AsDestroy(&scheduler);
+}
+
+static void testRetryBackoff(void)
+{
+    static const char* appIds[] = { "1" };
+    static const AS_ART_STATE states[] = { AS_ART_STALE };
+    ASSET_SCHEDULER scheduler;
+    AS_REQUEST request;
+    double delay;
+    
+    initScheduler(&scheduler);
+    AsQueueApps(&scheduler, appIds, states, 1);
+    
+    for (int attempt = 1; attempt < MAX_ATTEMPTS; attempt++) {
+        double base = RETRY_BASE_DELAY * (1 << (attempt - 1));
+        if (base > RETRY_MAX_DELAY) {
+            base = RETRY_MAX_DELAY;
+        }
+        
+        // A retry keeps revalidating with the ETag
+        startRequest(&scheduler, &request, "1", true);
+        CHECK_EQ(AsRequestFinished(&scheduler, &request, false, &delay), AS_REQUEST_RETRY);
+        CHECK(delay >= base * 0.5 && delay < base * 1.5);
+        
+        // Nothing is queued until the retry is due
+        CHECK(!AsStartRequest(&scheduler, &request));
+        AsRetryDue(&scheduler, "1", request.generation);
+    }
+    
+    startRequest(&scheduler, &request, "1", true);
+    CHECK_EQ(AsRequestFinished(&scheduler, &request, false, &delay), AS_REQUEST_GAVE_UP);
+    CHECK(!AsStartRequest(&scheduler, &request));
+    
+    // Next time around the app starts over, and a success resets its attempts
+    AsQueueApps(&scheduler, appIds, states, 1);
+    startRequest(&scheduler, &request, "1", true);
+    CHECK_EQ(AsRequestFinished(&scheduler, &request, false, &delay), AS_REQUEST_RETRY);
+    AsRetryDue(&scheduler, "1", request.generation);
+    startRequest(&scheduler, &request, "1", true);
+    CHECK_EQ(AsRequestFinished(&scheduler, &request, true, &delay), AS_REQUEST_DONE);
+    CHECK_EQ(scheduler.apps[0].attempts, 0);
+    CHECK(!scheduler.apps[0].stale);
+    
+    AsDestroy(&scheduler);
+}
+
+static void testRetryGoesFirst(void)
+{
+    static const char* appIds[] = { "1", "2", "3" };
+    static const AS_ART_STATE states[] = { AS_ART_MISSING, AS_ART_MISSING, AS_ART_MISSING };
+    ASSET_SCHEDULER scheduler;
+    AS_REQUEST request;
+    double delay;
+    
+    initScheduler(&scheduler);
+    AsQueueApps(&scheduler, appIds, states, 3);
+    
+    startRequest(&scheduler, &request, "1", false);
+    CHECK_EQ(AsRequestFinished(&scheduler, &request, false, &delay), AS_REQUEST_RETRY);
+    AsRetryDue(&scheduler, "1", request.generation);
+    
+    startRequest(&scheduler, &request, "1", false);
+    startRequest(&scheduler, &request, "2", false);
+    startRequest(&scheduler, &request, "3", false);
+    
+    AsDestroy(&scheduler);
+}
+
+static void testRetryJitter(void)
+{
+    static const char* appIds[] = { "1" };
+    static const AS_ART_STATE states[] = { AS_ART_MISSING };
+    ASSET_SCHEDULER scheduler;
+    AS_REQUEST request;
+    double minDelay = RETRY_BASE_DELAY * 2;
+    double maxDelay = 0;
+    double delay;
+    
+    // First retries of many apps spread out over half to one and a half times the base delay
+    initScheduler(&scheduler);
+    for (int i = 0; i < 1000; i++) {
+        AsQueueApps(&scheduler, appIds, states, 1);
+        CHECK(AsStartRequest(&scheduler, &request));
+        CHECK_EQ(AsRequestFinished(&scheduler, &request, false, &delay), AS_REQUEST_RETRY);
+        AsResetAttempts(&scheduler);
+        
+        minDelay = delay < minDelay ? delay : minDelay;
+        maxDelay = delay > maxDelay ? delay : maxDelay;
+    }
+    
+    CHECK(minDelay >= RETRY_BASE_DELAY * 0.5 && minDelay < RETRY_BASE_DELAY * 0.6);
+    CHECK(maxDelay < RETRY_BASE_DELAY * 1.5 && maxDelay > RETRY_BASE_DELAY * 1.4);
+    
+    AsDestroy(&scheduler);
+}
+
+static void testStop(void)
+{
+    static const char* appIds[] = { "1", "2" };
+    static const AS_ART_STATE states[] = { AS_ART_MISSING, AS_ART_MISSING };
+    ASSET_SCHEDULER scheduler;
+    AS_REQUEST request;
+    double delay;
+    
+    initScheduler(&scheduler);
+    AsQueueApps(&scheduler, appIds, states, 2);
+    CHECK(AsStartRequest(&scheduler, &request));
+    
+    AsStop(&scheduler);
+    CHECK(!AsStartRequest(&scheduler, &request));
+    
+    // The request in flight finishes, but its failure isn't retried
+    CHECK_EQ(AsRequestFinished(&scheduler, &request, false, &delay), AS_REQUEST_DONE);
+    CHECK_EQ(scheduler.requestsInFlight, 0);
+    
+    // Nor is a retry that was due from before
+    AsRetryDue(&scheduler, "2", request.generation);
+    CHECK(!AsStartRequest(&scheduler, &request));
+    
+    AsDestroy(&scheduler);
+}
+
+static void testClassifyResponse(void)
+{
+    static const uint8_t art[] = { 0x89, 'P', 'N', 'G', 1, 2, 3, 4 };
+    static const uint8_t otherArt[] = { 0x89, 'P', 'N', 'G', 1, 2, 3, 5 };
+    
+    digestCalls = 0;
+    
+    // A 304 doesn't need a body or the art we have
+    CHECK_EQ(AsClassifyResponse(304, NULL, 0, NULL, 0, testDigest), AS_RESPONSE_NOT_MODIFIED);
+    
+    CHECK_EQ(AsClassifyResponse(503, art, sizeof(art), art, sizeof(art), testDigest), AS_RESPONSE_FAILED);
+    CHECK_EQ(AsClassifyResponse(200, art, 0, art, sizeof(art), testDigest), AS_RESPONSE_FAILED);
+    CHECK_EQ(AsClassifyResponse(200, art, sizeof(art), NULL, 0, testDigest), AS_RESPONSE_CHANGED);
+    CHECK_EQ(AsClassifyResponse(200, art, sizeof(art), art, sizeof(art) - 1, testDigest), AS_RESPONSE_CHANGED);
+    CHECK_EQ(digestCalls, 0);
+    
+    // Only art of the same size is hashed
+    CHECK_EQ(AsClassifyResponse(200, art, sizeof(art), art, sizeof(art), testDigest), AS_RESPONSE_UNCHANGED);
+    CHECK_EQ(AsClassifyResponse(200, art, sizeof(art), otherArt, sizeof(otherArt), testDigest), AS_RESPONSE_CHANGED);
+    CHECK_EQ(digestCalls, 4);
+}
+
+int main(void)
+{
+    RUN_TEST(testMissingBeforeStale);
+    RUN_TEST(testPrioritize);
+    RUN_TEST(testRequestLimit);
+    RUN_TEST(testRetryBackoff);
+    RUN_TEST(testRetryGoesFirst);
+    RUN_TEST(testRetryJitter);
+    RUN_TEST(testStop);
+    RUN_TEST(testClassifyResponse);
+    return 0;
+}
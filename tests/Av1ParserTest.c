@@ -0,0 +1,389 @@
+//
+//  Av1ParserTest.c
+//  Moonlight
+//
+//  Copyright © 2026 Moonlight Game Streaming Project. All rights reserved.
+//
+//  Checks the AV1 sequence header parser against a corpus of generated sequence
+//  headers, and the av1C written for the IDR temporal units in fixtures/. Those
+//  are key frames encoded with libaom's realtime mode, with HDR metadata OBUs
+//  in the 10-bit one; each .av1c is laid out the way ff_isom_write_av1c() does
+//  it from the sequence header as dav1d parsed it, and dav1d decodes each .obu
+//  to a picture. When built with FFMPEG set (see the Makefile), the parsed fields and
+//  the av1C box are also compared byte for byte with FFmpeg's CBS and
+//  ff_isom_write_av1c(). Real streams in the low overhead OBU format (ffmpeg -f obu)
+//  can be passed as arguments to compare every temporal unit with a sequence header.
+//
+
+#include "Av1Stream.h"
+
+#define FRAME_SIZE 4096
+#define FIXTURE_DIR "fixtures/"
+
+typedef struct _IDR_FIXTURE {
+    const char* name;
+    AV1_SEQUENCE_HEADER seqHeader;
+    int metadataObus;
+} IDR_FIXTURE, *PIDR_FIXTURE;
+
+// profile, level, tier, bitDepth, monochrome, chromaSubsamplingX/Y, chromaSamplePosition,
+// colorPrimaries, transferCharacteristics, matrixCoefficients, colorRange, maxFrameWidth/Height
+static IDR_FIXTURE IDR_FIXTURES[] = {
+    { "av1-1080p-sdr", { 0, 9, 0, 8, false, 1, 1, 0, 1, 1, 1, 0, 1920, 1080 }, 0 },
+    { "av1-2160p-hdr10", { 0, 13, 0, 10, false, 1, 1, 2, 9, 16, 9, 0, 3840, 2160 }, 2 },
+    { "av1-1440p-444", { 1, 12, 0, 8, false, 0, 0, 0, 1, 1, 1, 1, 2560, 1440 }, 0 },
+};
+
+#ifdef HAVE_FFMPEG
+static int comparedWithFfmpeg;
+#endif
+
+// Returns the length of the OBU at offset. Every OBU in our data has a size field.
+static size_t nextObuLength(const uint8_t* data, size_t length, size_t offset)
+{
+    size_t headerLength = (data[offset] & 0x04) ? 2 : 1;
+    uint64_t payloadLength = 0;
+    
+    for (int i = 0; ; i++) {
+        CHECK(i < 8 && offset + headerLength < length);
+        uint8_t leb128Byte = data[offset + headerLength++];
+        payloadLength |= (uint64_t)(leb128Byte & 0x7F) << (i * 7);
+        if (!(leb128Byte & 0x80)) {
+            break;
+        }
+    }
+    
+    CHECK(offset + headerLength + payloadLength <= length);
+    return headerLength + payloadLength;
+}
+
+static uint8_t* readFile(const char* path, size_t* length)
+{
+    FILE* file = fopen(path, "rb");
+    CHECK(file != NULL);
+    CHECK(fseek(file, 0, SEEK_END) == 0);
+    long size = ftell(file);
+    CHECK(size > 0 && fseek(file, 0, SEEK_SET) == 0);
+    uint8_t* data = malloc(size);
+    CHECK(data != NULL && fread(data, 1, size, file) == size);
+    fclose(file);
+    
+    *length = size;
+    return data;
+}
+
+static void checkSequenceHeader(PAV1_SEQUENCE_HEADER actual, PAV1_SEQUENCE_HEADER expected)
+{
+    CHECK_EQ(actual->profile, expected->profile);
+    CHECK_EQ(actual->level, expected->level);
+    CHECK_EQ(actual->tier, expected->tier);
+    CHECK_EQ(actual->bitDepth, expected->bitDepth);
+    CHECK_EQ(actual->monochrome, expected->monochrome);
+    CHECK_EQ(actual->chromaSubsamplingX, expected->chromaSubsamplingX);
+    CHECK_EQ(actual->chromaSubsamplingY, expected->chromaSubsamplingY);
+    CHECK_EQ(actual->chromaSamplePosition, expected->chromaSamplePosition);
+    CHECK_EQ(actual->colorPrimaries, expected->colorPrimaries);
+    CHECK_EQ(actual->transferCharacteristics, expected->transferCharacteristics);
+    CHECK_EQ(actual->matrixCoefficients, expected->matrixCoefficients);
+    CHECK_EQ(actual->colorRange, expected->colorRange);
+    CHECK_EQ(actual->maxFrameWidth, expected->maxFrameWidth);
+    CHECK_EQ(actual->maxFrameHeight, expected->maxFrameHeight);
+}
+
+// Parses a temporal unit and returns its av1C box, which the caller must free
+static uint8_t* parseAndWriteConfig(const uint8_t* data, size_t length, PAV1_SEQUENCE_HEADER seqHeader)
+{
+    CHECK(Av1ParseTemporalUnit(data, length, seqHeader));
+    CHECK(seqHeader->configLength >= AV1_CONFIG_HEADER_SIZE + seqHeader->obuLength);
+    CHECK(seqHeader->configLength < length);
+    
+    // Exactly sized, so ASan catches writes past the reported length
+    uint8_t* config = malloc(seqHeader->configLength);
+    CHECK(config != NULL);
+    Av1WriteCodecConfiguration(data, length, seqHeader, config);
+    return config;
+}
+
+static void compareWithFfmpeg(const uint8_t* data, size_t length, bool sequenceHeaderOnly,
+                              PAV1_SEQUENCE_HEADER seqHeader, const uint8_t* config)
+{
+#ifdef HAVE_FFMPEG
+    AV1_SEQUENCE_HEADER ffmpegSeqHeader;
+    size_t ffmpegConfigLength;
+    
+    CHECK(ffmpegReadSequenceHeader(data, length, sequenceHeaderOnly, &ffmpegSeqHeader));
+    checkSequenceHeader(seqHeader, &ffmpegSeqHeader);
+    
+    uint8_t* ffmpegConfig = ffmpegWriteAv1c(data, length, &ffmpegConfigLength);
+    CHECK(ffmpegConfig != NULL);
+    CHECK_EQ(seqHeader->configLength, ffmpegConfigLength);
+    CHECK(memcmp(config, ffmpegConfig, ffmpegConfigLength) == 0);
+    av_free(ffmpegConfig);
+    
+    comparedWithFfmpeg++;
+#endif
+}
+
+// Builds the expected parse result for a generated sequence header
+static void expectedSequenceHeader(PAV1_STREAM_PARAMS params, PAV1_SEQUENCE_HEADER expected)
+{
+    memset(expected, 0, sizeof(*expected));
+    expected->profile = params->profile;
+    expected->level = params->level;
+    expected->tier = params->level > 7 && !params->reducedStillPictureHeader ? params->tier : 0;
+    expected->bitDepth = params->bitDepth;
+    expected->monochrome = params->monochrome;
+    expected->colorPrimaries = params->colorDescription ? params->colorPrimaries : 2;
+    expected->transferCharacteristics = params->colorDescription ? params->transferCharacteristics : 2;
+    expected->matrixCoefficients = params->colorDescription ? params->matrixCoefficients : 2;
+    expected->colorRange = params->colorRange;
+    expected->chromaSubsamplingX = params->chromaSubsamplingX;
+    expected->chromaSubsamplingY = params->chromaSubsamplingY;
+    expected->chromaSamplePosition = params->chromaSamplePosition;
+    expected->maxFrameWidth = params->maxFrameWidth;
+    expected->maxFrameHeight = params->maxFrameHeight;
+}
+
+// Fills in a valid combination of sequence header fields from a corpus index
+static void generateParams(int index, PAV1_STREAM_PARAMS params)
+{
+    static const int resolutions[][2] = { { 1280, 720 }, { 1920, 1080 }, { 2560, 1440 }, { 3840, 2160 }, { 7680, 4320 }, { 1366, 768 } };
+    static const int colors[][3] = { { 1, 1, 1 }, { 9, 16, 9 }, { 9, 18, 9 }, { 1, 13, 0 }, { 6, 6, 6 } };
+    unsigned int seed = index + 1;
+    
+    memset(params, 0, sizeof(*params));
+    params->profile = index % 3;
+    params->level = rand_r(&seed) % 24;
+    params->tier = rand_r(&seed) % 2;
+    params->maxFrameWidth = resolutions[index % 6][0];
+    params->maxFrameHeight = resolutions[index % 6][1];
+    params->reducedStillPictureHeader = index % 17 == 0;
+    params->timingInfo = !params->reducedStillPictureHeader && index % 2;
+    params->decoderModelInfo = params->timingInfo && index % 4 == 1;
+    params->operatingPoints = params->reducedStillPictureHeader ? 1 : 1 + index % 3;
+    
+    if (params->profile == 2) {
+        params->bitDepth = (int[]){ 8, 10, 12 }[rand_r(&seed) % 3];
+    }
+    else {
+        params->bitDepth = rand_r(&seed) % 2 ? 10 : 8;
+    }
+    params->monochrome = params->profile != 1 && index % 5 == 0;
+    
+    params->colorDescription = index % 7 != 0;
+    if (params->colorDescription) {
+        int color = rand_r(&seed) % 5;
+        params->colorPrimaries = colors[color][0];
+        params->transferCharacteristics = colors[color][1];
+        params->matrixCoefficients = colors[color][2];
+        
+        // sRGB is only allowed for 4:4:4 profiles
+        bool srgb = params->colorPrimaries == 1 && params->transferCharacteristics == 13 && params->matrixCoefficients == 0;
+        if (srgb && !params->monochrome && !(params->profile == 1 || (params->profile == 2 && params->bitDepth == 12))) {
+            params->matrixCoefficients = 1;
+        }
+    }
+    else {
+        params->colorPrimaries = params->transferCharacteristics = params->matrixCoefficients = 2;
+    }
+    
+    params->colorRange = rand_r(&seed) % 2;
+    if (params->monochrome || params->profile == 0) {
+        params->chromaSubsamplingX = params->chromaSubsamplingY = 1;
+    }
+    else if (params->colorPrimaries == 1 && params->transferCharacteristics == 13 && params->matrixCoefficients == 0) {
+        params->colorRange = 1;
+    }
+    else if (params->profile == 2 && params->bitDepth == 12) {
+        params->chromaSubsamplingX = rand_r(&seed) % 2;
+        params->chromaSubsamplingY = params->chromaSubsamplingX ? rand_r(&seed) % 2 : 0;
+    }
+    else if (params->profile == 2) {
+        params->chromaSubsamplingX = 1;
+    }
+    
+    if (!params->monochrome && params->chromaSubsamplingX && params->chromaSubsamplingY) {
+        params->chromaSamplePosition = rand_r(&seed) % 3;
+    }
+}
+
+static void testGeneratedCorpus(void)
+{
+    uint8_t* data = malloc(FRAME_SIZE + 1024);
+    unsigned int seed = 1;
+    CHECK(data != NULL);
+    
+    for (int i = 0; i < 1000; i++) {
+        AV1_STREAM_PARAMS params;
+        AV1_SEQUENCE_HEADER seqHeader, expected;
+        bool hdrMetadata = i % 3 == 0;
+        
+        generateParams(i, &params);
+        size_t length = buildTemporalUnit(data, &params, hdrMetadata, FRAME_SIZE, &seed);
+        uint8_t* config = parseAndWriteConfig(data, length, &seqHeader);
+        
+        expectedSequenceHeader(&params, &expected);
+        checkSequenceHeader(&seqHeader, &expected);
+        
+        // The av1C header as laid out in the AV1 ISOBMFF binding, followed by the
+        // sequence header OBU (after the 2 byte temporal delimiter) and any metadata OBUs
+        CHECK_EQ(config[0], 0x81);
+        CHECK_EQ(config[1], (params.profile << 5) | params.level);
+        CHECK_EQ(config[2], (expected.tier << 7) | ((params.bitDepth > 8) << 6) | ((params.bitDepth == 12) << 5) |
+                 (params.monochrome << 4) | (params.chromaSubsamplingX << 3) | (params.chromaSubsamplingY << 2) |
+                 params.chromaSamplePosition);
+        CHECK_EQ(config[3], 0);
+        CHECK_EQ(seqHeader.obuOffset, 2);
+        CHECK(memcmp(&config[AV1_CONFIG_HEADER_SIZE], &data[2], seqHeader.obuLength) == 0);
+        
+        size_t metadataLength = seqHeader.configLength - AV1_CONFIG_HEADER_SIZE - seqHeader.obuLength;
+        CHECK_EQ(metadataLength, hdrMetadata ? 2 + 26 + 2 + 6 : 0);
+        CHECK(memcmp(&config[AV1_CONFIG_HEADER_SIZE + seqHeader.obuLength],
+                     &data[2 + seqHeader.obuLength], metadataLength) == 0);
+        
+        compareWithFfmpeg(data, length, true, &seqHeader, config);
+        free(config);
+    }
+    
+    free(data);
+}
+
+static void testMalformedTemporalUnits(void)
+{
+    uint8_t* data = malloc(FRAME_SIZE + 1024);
+    AV1_STREAM_PARAMS params;
+    AV1_SEQUENCE_HEADER seqHeader;
+    unsigned int seed = 1;
+    CHECK(data != NULL);
+    
+    generateParams(1, &params);
+    size_t length = buildTemporalUnit(data, &params, true, 64, &seed);
+    CHECK(Av1ParseTemporalUnit(data, length, &seqHeader));
+    
+    // Truncating the data anywhere but at the end of an OBU following the sequence header
+    // must fail. The copy is exactly sized, so ASan catches reads past the end.
+    size_t validEnd = 2 + seqHeader.obuLength;
+    for (size_t truncated = 0; truncated < length; truncated++) {
+        uint8_t* copy = malloc(truncated > 0 ? truncated : 1);
+        CHECK(copy != NULL);
+        memcpy(copy, data, truncated);
+        if (truncated == validEnd) {
+            CHECK(Av1ParseTemporalUnit(copy, truncated, &seqHeader));
+            validEnd += nextObuLength(data, length, validEnd);
+        }
+        else {
+            CHECK(!Av1ParseTemporalUnit(copy, truncated, &seqHeader));
+        }
+        free(copy);
+    }
+    
+    // A second sequence header is rejected, like FFmpeg does
+    size_t seqHeaderLength = seqHeader.obuLength;
+    memmove(&data[2 + seqHeaderLength], &data[2], length - 2);
+    CHECK(!Av1ParseTemporalUnit(data, length + seqHeaderLength, &seqHeader));
+    
+    // So is the forbidden bit
+    length = buildTemporalUnit(data, &params, false, 64, &seed);
+    data[2] |= 0x80;
+    CHECK(!Av1ParseTemporalUnit(data, length, &seqHeader));
+    
+    free(data);
+}
+
+static void testIdrFixtures(void)
+{
+    for (size_t i = 0; i < sizeof(IDR_FIXTURES) / sizeof(IDR_FIXTURES[0]); i++) {
+        PIDR_FIXTURE fixture = &IDR_FIXTURES[i];
+        AV1_SEQUENCE_HEADER seqHeader;
+        char path[256];
+        size_t length;
+        size_t expectedLength;
+        
+        snprintf(path, sizeof(path), FIXTURE_DIR "%s.obu", fixture->name);
+        uint8_t* data = readFile(path, &length);
+        snprintf(path, sizeof(path), FIXTURE_DIR "%s.av1c", fixture->name);
+        uint8_t* expected = readFile(path, &expectedLength);
+        
+        // A temporal delimiter, then the sequence header
+        CHECK_EQ((data[0] >> 3) & 0xF, OBU_TEMPORAL_DELIMITER);
+        uint8_t* config = parseAndWriteConfig(data, length, &seqHeader);
+        checkSequenceHeader(&seqHeader, &fixture->seqHeader);
+        CHECK_EQ(seqHeader.obuOffset, 2);
+        
+        CHECK_EQ(seqHeader.configLength, expectedLength);
+        CHECK(memcmp(config, expected, expectedLength) == 0);
+        
+        // Only the sequence header and metadata OBUs are carried over
+        int metadataObus = 0;
+        for (size_t offset = AV1_CONFIG_HEADER_SIZE + seqHeader.obuLength; offset < expectedLength; ) {
+            CHECK_EQ((config[offset] >> 3) & 0xF, OBU_METADATA);
+            offset += nextObuLength(config, expectedLength, offset);
+            metadataObus++;
+        }
+        CHECK_EQ(metadataObus, fixture->metadataObus);
+        
+        compareWithFfmpeg(data, length, false, &seqHeader, config);
+        free(config);
+        free(expected);
+        free(data);
+    }
+}
+
+// Compares every temporal unit with a sequence header in a low overhead OBU stream
+static void compareStream(const char* path)
+{
+    size_t size;
+    uint8_t* data = readFile(path, &size);
+    
+    int temporalUnits = 0;
+    size_t tuStart = 0;
+    for (size_t offset = 0; offset <= size; ) {
+        int type = -1;
+        size_t obuLength = 0;
+        
+        if (offset < size) {
+            type = (data[offset] >> 3) & 0xF;
+            obuLength = nextObuLength(data, size, offset);
+        }
+        
+        // Temporal units begin with a temporal delimiter
+        if ((type == OBU_TEMPORAL_DELIMITER || offset == size) && offset > tuStart) {
+            AV1_SEQUENCE_HEADER seqHeader;
+            if (Av1ParseTemporalUnit(&data[tuStart], offset - tuStart, &seqHeader)) {
+                uint8_t* config = malloc(seqHeader.configLength);
+                CHECK(config != NULL);
+                Av1WriteCodecConfiguration(&data[tuStart], offset - tuStart, &seqHeader, config);
+                compareWithFfmpeg(&data[tuStart], offset - tuStart, false, &seqHeader, config);
+                free(config);
+                temporalUnits++;
+            }
+            tuStart = offset;
+        }
+        
+        if (offset == size) {
+            break;
+        }
+        offset += obuLength;
+    }
+    
+    printf("  %s: %d temporal units with a sequence header\n", path, temporalUnits);
+    CHECK(temporalUnits > 0);
+    free(data);
+}
+
+int main(int argc, char* argv[])
+{
+    RUN_TEST(testGeneratedCorpus);
+    RUN_TEST(testMalformedTemporalUnits);
+    RUN_TEST(testIdrFixtures);
+    for (int i = 1; i < argc; i++) {
+        compareStream(argv[i]);
+    }
+    
+#ifdef HAVE_FFMPEG
+    printf("  %d temporal units matched FFmpeg\n", comparedWithFfmpeg);
+#else
+    printf("  FFmpeg comparison skipped (build with FFMPEG=<path>)\n");
+#endif
+    return 0;
+}
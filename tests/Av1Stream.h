@@ -0,0 +1,370 @@
+//
+//  Av1Stream.h
+//  Moonlight
+//
+//  Copyright © 2026 Moonlight Game Streaming Project. All rights reserved.
+//
+//  Builds AV1 temporal units with a sequence header for the parser test and
+//  benchmark, and compares the parser with FFmpeg when it is available.
+//
+
+#pragma once
+
+#include "Av1Parser.h"
+#include "TestCommon.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#define OBU_SEQUENCE_HEADER 1
+#define OBU_TEMPORAL_DELIMITER 2
+#define OBU_METADATA 5
+#define OBU_FRAME 6
+
+#define METADATA_TYPE_HDR_CLL 1
+#define METADATA_TYPE_HDR_MDCV 2
+
+// The fields of a sequence header that the test varies
+typedef struct _AV1_STREAM_PARAMS {
+    int profile;
+    int level;
+    int tier;
+    int bitDepth;
+    bool monochrome;
+    bool colorDescription;
+    int colorPrimaries;
+    int transferCharacteristics;
+    int matrixCoefficients;
+    int colorRange;
+    int chromaSubsamplingX;
+    int chromaSubsamplingY;
+    int chromaSamplePosition;
+    int maxFrameWidth;
+    int maxFrameHeight;
+    bool reducedStillPictureHeader;
+    bool timingInfo;
+    bool decoderModelInfo;
+    int operatingPoints;
+} AV1_STREAM_PARAMS, *PAV1_STREAM_PARAMS;
+
+typedef struct _BIT_WRITER {
+    uint8_t* data;
+    size_t bitOffset;
+} BIT_WRITER, *PBIT_WRITER;
+
+static inline void writeBits(PBIT_WRITER writer, uint32_t value, int bits)
+{
+    for (int i = bits - 1; i >= 0; i--) {
+        size_t byteOffset = writer->bitOffset >> 3;
+        if ((writer->bitOffset & 7) == 0) {
+            writer->data[byteOffset] = 0;
+        }
+        writer->data[byteOffset] |= ((value >> i) & 1) << (7 - (writer->bitOffset & 7));
+        writer->bitOffset++;
+    }
+}
+
+// trailing_bits(): a one bit followed by zeros up to the next byte boundary
+static inline size_t finishBits(PBIT_WRITER writer)
+{
+    writeBits(writer, 1, 1);
+    while (writer->bitOffset & 7) {
+        writeBits(writer, 0, 1);
+    }
+    return writer->bitOffset >> 3;
+}
+
+static inline int bitsNeeded(uint32_t value)
+{
+    int bits = 1;
+    while (value >> bits) {
+        bits++;
+    }
+    return bits;
+}
+
+// Writes an OBU with a leb128 size field and returns its total length
+static inline size_t writeObu(uint8_t* data, int type, const uint8_t* payload, size_t payloadLength)
+{
+    size_t offset = 0;
+    size_t size = payloadLength;
+    
+    data[offset++] = (uint8_t)((type << 3) | 0x02);
+    do {
+        uint8_t leb128Byte = size & 0x7F;
+        size >>= 7;
+        data[offset++] = leb128Byte | (size ? 0x80 : 0);
+    } while (size);
+    
+    if (payloadLength > 0) {
+        memcpy(&data[offset], payload, payloadLength);
+    }
+    return offset + payloadLength;
+}
+
+// Writes a complete sequence_header_obu() payload as described in section 5.5 of the AV1 spec
+static inline size_t writeSequenceHeader(uint8_t* payload, PAV1_STREAM_PARAMS params)
+{
+    BIT_WRITER writer = { payload, 0 };
+    PBIT_WRITER w = &writer;
+    
+    writeBits(w, params->profile, 3);
+    writeBits(w, params->reducedStillPictureHeader, 1); // still_picture
+    writeBits(w, params->reducedStillPictureHeader, 1);
+    
+    if (params->reducedStillPictureHeader) {
+        writeBits(w, params->level, 5);
+    }
+    else {
+        writeBits(w, params->timingInfo, 1);
+        if (params->timingInfo) {
+            writeBits(w, 1, 32); // num_units_in_display_tick
+            writeBits(w, 60, 32); // time_scale
+            writeBits(w, 1, 1); // equal_picture_interval
+            writeBits(w, 1, 1); // num_ticks_per_picture_minus_1 = 0 (uvlc)
+            
+            writeBits(w, params->decoderModelInfo, 1);
+            if (params->decoderModelInfo) {
+                writeBits(w, 9, 5); // buffer_delay_length_minus_1
+                writeBits(w, 1, 32); // num_units_in_decoding_tick
+                writeBits(w, 31, 5); // buffer_removal_time_length_minus_1
+                writeBits(w, 31, 5); // frame_presentation_time_length_minus_1
+            }
+        }
+        else if (params->decoderModelInfo) {
+            abort();
+        }
+        
+        writeBits(w, 1, 1); // initial_display_delay_present_flag
+        writeBits(w, params->operatingPoints - 1, 5);
+        for (int i = 0; i < params->operatingPoints; i++) {
+            int level = i == 0 ? params->level : 8 + i % 16;
+            writeBits(w, i == 0 ? 0 : 0x101, 12); // operating_point_idc
+            writeBits(w, level, 5);
+            if (level > 7) {
+                writeBits(w, i == 0 ? params->tier : 1, 1);
+            }
+            if (params->decoderModelInfo) {
+                writeBits(w, 1, 1); // decoder_model_present_for_this_op
+                writeBits(w, 1000, 10); // decoder_buffer_delay
+                writeBits(w, 1000, 10); // encoder_buffer_delay
+                writeBits(w, 1, 1); // low_delay_mode_flag
+            }
+            writeBits(w, i & 1, 1); // initial_display_delay_present_for_this_op
+            if (i & 1) {
+                writeBits(w, 9, 4);
+            }
+        }
+    }
+    
+    int widthBits = bitsNeeded(params->maxFrameWidth - 1);
+    int heightBits = bitsNeeded(params->maxFrameHeight - 1);
+    writeBits(w, widthBits - 1, 4);
+    writeBits(w, heightBits - 1, 4);
+    writeBits(w, params->maxFrameWidth - 1, widthBits);
+    writeBits(w, params->maxFrameHeight - 1, heightBits);
+    
+    if (!params->reducedStillPictureHeader) {
+        writeBits(w, 0, 1); // frame_id_numbers_present_flag
+    }
+    
+    writeBits(w, 0, 1); // use_128x128_superblock
+    writeBits(w, 1, 1); // enable_filter_intra
+    writeBits(w, 1, 1); // enable_intra_edge_filter
+    
+    if (!params->reducedStillPictureHeader) {
+        writeBits(w, 0, 1); // enable_interintra_compound
+        writeBits(w, 0, 1); // enable_masked_compound
+        writeBits(w, 0, 1); // enable_warped_motion
+        writeBits(w, 0, 1); // enable_dual_filter
+        writeBits(w, 1, 1); // enable_order_hint
+        writeBits(w, 0, 1); // enable_jnt_comp
+        writeBits(w, 0, 1); // enable_ref_frame_mvs
+        writeBits(w, 1, 1); // seq_choose_screen_content_tools
+        writeBits(w, 1, 1); // seq_choose_integer_mv
+        writeBits(w, 6, 3); // order_hint_bits_minus_1
+    }
+    
+    writeBits(w, 0, 1); // enable_superres
+    writeBits(w, 1, 1); // enable_cdef
+    writeBits(w, 1, 1); // enable_restoration
+    
+    // color_config()
+    writeBits(w, params->bitDepth > 8, 1);
+    if (params->profile == 2 && params->bitDepth > 8) {
+        writeBits(w, params->bitDepth == 12, 1);
+    }
+    if (params->profile != 1) {
+        writeBits(w, params->monochrome, 1);
+    }
+    writeBits(w, params->colorDescription, 1);
+    if (params->colorDescription) {
+        writeBits(w, params->colorPrimaries, 8);
+        writeBits(w, params->transferCharacteristics, 8);
+        writeBits(w, params->matrixCoefficients, 8);
+    }
+    if (params->monochrome) {
+        writeBits(w, params->colorRange, 1);
+    }
+    else {
+        if (params->colorPrimaries == 1 && params->transferCharacteristics == 13 && params->matrixCoefficients == 0) {
+            // sRGB implies full range 4:4:4
+        }
+        else {
+            writeBits(w, params->colorRange, 1);
+            if (params->profile == 2 && params->bitDepth == 12) {
+                writeBits(w, params->chromaSubsamplingX, 1);
+                if (params->chromaSubsamplingX) {
+                    writeBits(w, params->chromaSubsamplingY, 1);
+                }
+            }
+            if (params->chromaSubsamplingX && params->chromaSubsamplingY) {
+                writeBits(w, params->chromaSamplePosition, 2);
+            }
+        }
+        writeBits(w, 0, 1); // separate_uv_delta_q
+    }
+    
+    writeBits(w, 0, 1); // film_grain_params_present
+    return finishBits(w);
+}
+
+// Writes metadata_obu() payloads for HDR content light level and mastering display volume
+static inline size_t writeHdrMetadata(uint8_t* payload, int metadataType)
+{
+    size_t length = 0;
+    
+    payload[length++] = (uint8_t)metadataType;
+    if (metadataType == METADATA_TYPE_HDR_CLL) {
+        static const uint8_t cll[] = { 0x03, 0xE8, 0x01, 0x90 };
+        memcpy(&payload[length], cll, sizeof(cll));
+        length += sizeof(cll);
+    }
+    else {
+        for (int i = 0; i < 24; i++) {
+            payload[length++] = (uint8_t)(0x11 * (i + 1));
+        }
+    }
+    
+    payload[length++] = 0x80; // trailing_bits()
+    return length;
+}
+
+// Builds a temporal unit as sent by the host for an IDR frame: a temporal delimiter,
+// the sequence header, optional HDR metadata and a frame OBU with frameSize bytes of
+// opaque data. The buffer must hold frameSize + 1024 bytes.
+static inline size_t buildTemporalUnit(uint8_t* data, PAV1_STREAM_PARAMS params, bool hdrMetadata,
+                                       size_t frameSize, unsigned int* seed)
+{
+    static uint8_t payload[256];
+    size_t length = 0;
+    
+    length += writeObu(&data[length], OBU_TEMPORAL_DELIMITER, NULL, 0);
+    length += writeObu(&data[length], OBU_SEQUENCE_HEADER, payload, writeSequenceHeader(payload, params));
+    if (hdrMetadata) {
+        length += writeObu(&data[length], OBU_METADATA, payload, writeHdrMetadata(payload, METADATA_TYPE_HDR_MDCV));
+        length += writeObu(&data[length], OBU_METADATA, payload, writeHdrMetadata(payload, METADATA_TYPE_HDR_CLL));
+    }
+    
+    // The frame OBU itself is skipped by its size, so its contents don't matter
+    uint8_t* frame = malloc(frameSize);
+    CHECK(frame != NULL);
+    for (size_t i = 0; i < frameSize; i++) {
+        frame[i] = (uint8_t)rand_r(seed);
+    }
+    length += writeObu(&data[length], OBU_FRAME, frame, frameSize);
+    free(frame);
+    
+    return length;
+}
+
+#ifdef HAVE_FFMPEG
+
+#include <libavcodec/avcodec.h>
+#include <libavcodec/cbs.h>
+#include <libavcodec/cbs_av1.h>
+#include <libavformat/avio.h>
+#include <libavutil/mem.h>
+
+// Private libavformat API for writing the AV1 Codec Configuration Box
+extern int ff_isom_write_av1c(AVIOContext *pb, const uint8_t *buf, int size,
+                              int write_seq_header);
+
+// Returns the av1C box written by FFmpeg, which must be freed with av_free(), or NULL on failure
+static inline uint8_t* ffmpegWriteAv1c(const uint8_t* data, size_t length, size_t* configLength)
+{
+    AVIOContext* ioctx = NULL;
+    uint8_t* config = NULL;
+    
+    if (avio_open_dyn_buf(&ioctx) < 0) {
+        return NULL;
+    }
+    
+    int err = ff_isom_write_av1c(ioctx, data, (int)length, 1);
+    int len = avio_close_dyn_buf(ioctx, &config);
+    if (err < 0 || len <= 0) {
+        av_free(config);
+        return NULL;
+    }
+    
+    *configLength = len;
+    return config;
+}
+
+// Reads the temporal unit with FFmpeg's CBS like the renderer used to. If sequenceHeaderOnly
+// is set, only the sequence header is decomposed, which works for synthetic frame data.
+static inline bool ffmpegReadSequenceHeader(const uint8_t* data, size_t length, bool sequenceHeaderOnly,
+                                            PAV1_SEQUENCE_HEADER seqHeader)
+{
+    static const CodedBitstreamUnitType sequenceHeaderType = AV1_OBU_SEQUENCE_HEADER;
+    CodedBitstreamContext* cbsCtx = NULL;
+    CodedBitstreamFragment cbsFrag = { 0 };
+    bool ret = false;
+    
+    if (ff_cbs_init(&cbsCtx, AV_CODEC_ID_AV1, NULL) < 0) {
+        return false;
+    }
+    if (sequenceHeaderOnly) {
+        cbsCtx->decompose_unit_types = (CodedBitstreamUnitType*)&sequenceHeaderType;
+        cbsCtx->nb_decompose_unit_types = 1;
+    }
+    
+    AVPacket* packet = av_packet_alloc();
+    if (packet != NULL) {
+        packet->data = (uint8_t*)data;
+        packet->size = (int)length;
+        
+        if (ff_cbs_read_packet(cbsCtx, &cbsFrag, packet) >= 0) {
+            AV1RawSequenceHeader* raw = ((CodedBitstreamAV1Context*)cbsCtx->priv_data)->sequence_header;
+            if (raw != NULL) {
+                const AV1RawColorConfig* cc = &raw->color_config;
+                
+                memset(seqHeader, 0, sizeof(*seqHeader));
+                seqHeader->profile = raw->seq_profile;
+                seqHeader->level = raw->seq_level_idx[0];
+                seqHeader->tier = raw->seq_tier[0];
+                seqHeader->bitDepth = cc->twelve_bit ? 12 : (cc->high_bitdepth ? 10 : 8);
+                seqHeader->monochrome = cc->mono_chrome;
+                seqHeader->chromaSubsamplingX = cc->subsampling_x;
+                seqHeader->chromaSubsamplingY = cc->subsampling_y;
+                seqHeader->chromaSamplePosition = cc->chroma_sample_position;
+                seqHeader->colorPrimaries = cc->color_primaries;
+                seqHeader->transferCharacteristics = cc->transfer_characteristics;
+                seqHeader->matrixCoefficients = cc->matrix_coefficients;
+                seqHeader->colorRange = cc->color_range;
+                seqHeader->maxFrameWidth = raw->max_frame_width_minus_1 + 1;
+                seqHeader->maxFrameHeight = raw->max_frame_height_minus_1 + 1;
+                ret = true;
+            }
+        }
+        
+        av_packet_free(&packet);
+    }
+    
+    ff_cbs_fragment_free(&cbsFrag);
+    ff_cbs_close(&cbsCtx);
+    return ret;
+}
+
+#endif
@@ -0,0 +1,166 @@
+//
+//  ControllerStateTest.c
+//  Moonlight
+//
+//  Copyright © 2026 Moonlight Game Streaming Project. All rights reserved.
+//
+//  Hammers one controller's state from several threads at once, the way the
+//  GCController handlers, on-screen controls and the send thread do, and
+//  checks that no press, release or trigger update is lost.
+//
+
+#include "ControllerState.h"
+#include "Limelight.h"
+#include "TestCommon.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+
+#define ITERATIONS 200000
+
+#define ALL_EMULATION (EMULATING_SELECT | EMULATING_SPECIAL)
+
+static CONTROLLER_STATE state;
+static atomic_bool startFlag;
+
+typedef struct _BUTTON_THREAD_CONTEXT {
+    uint32_t flag;
+    
+    // Combo buttons are cleared while their combo is emulated, so other
+    // threads can make them read back as released
+    bool checkFlag;
+} BUTTON_THREAD_CONTEXT, *PBUTTON_THREAD_CONTEXT;
+
+static void waitForStart(void)
+{
+    while (!atomic_load(&startFlag));
+}
+
+static uint32_t getButtons(void)
+{
+    CONTROLLER_SNAPSHOT snapshot;
+    
+    CsGetSnapshot(&state, &snapshot);
+    return snapshot.buttonFlags;
+}
+
+// Only this thread touches its button, so it should read back what it set
+static void* buttonThread(void* context)
+{
+    PBUTTON_THREAD_CONTEXT ctx = context;
+    
+    waitForStart();
+    for (int i = 0; i < ITERATIONS; i++) {
+        CsPressButtons(&state, ctx->flag, ALL_EMULATION);
+        CHECK(!ctx->checkFlag || (getButtons() & ctx->flag));
+        
+        CsReleaseButtons(&state, ctx->flag, ALL_EMULATION);
+        CHECK(!ctx->checkFlag || !(getButtons() & ctx->flag));
+    }
+    
+    return NULL;
+}
+
+static void startThreads(pthread_t* threads, PBUTTON_THREAD_CONTEXT contexts, int count)
+{
+    atomic_store(&startFlag, false);
+    for (int i = 0; i < count; i++) {
+        CHECK(pthread_create(&threads[i], NULL, buttonThread, &contexts[i]) == 0);
+    }
+    atomic_store(&startFlag, true);
+}
+
+static void joinThreads(pthread_t* threads, int count)
+{
+    for (int i = 0; i < count; i++) {
+        CHECK(pthread_join(threads[i], NULL) == 0);
+    }
+}
+
+static void testConcurrentPressesAreNotLost(void)
+{
+    BUTTON_THREAD_CONTEXT contexts[] = { { A_FLAG, true }, { B_FLAG, true }, { X_FLAG, true }, { Y_FLAG, true } };
+    pthread_t threads[4];
+    
+    CsInit(&state);
+    startThreads(threads, contexts, 4);
+    joinThreads(threads, 4);
+    
+    CHECK_EQ(atomic_load(&state.buttons), 0);
+}
+
+static void testConcurrentCombosDontStick(void)
+{
+    // Start+LB emulates Select and Start+RB emulates Special, so these race
+    // through every combo transition. A release that lost a race with a press
+    // would leave Back, Special or an emulation flag held.
+    BUTTON_THREAD_CONTEXT contexts[] = { { PLAY_FLAG, false }, { LB_FLAG, false }, { RB_FLAG, false }, { A_FLAG, true } };
+    pthread_t threads[4];
+    
+    CsInit(&state);
+    startThreads(threads, contexts, 4);
+    joinThreads(threads, 4);
+    
+    CHECK_EQ(atomic_load(&state.buttons), 0);
+}
+
+static void* triggerThread(void* context)
+{
+    bool right = context != NULL;
+    CONTROLLER_SNAPSHOT snapshot;
+    
+    waitForStart();
+    for (int i = 0; i < ITERATIONS; i++) {
+        uint8_t value = (uint8_t)(i * 7 + (right ? 3 : 0));
+        
+        if (right) {
+            CsSetRightTrigger(&state, value);
+        }
+        else {
+            CsSetLeftTrigger(&state, value);
+        }
+        
+        CsGetSnapshot(&state, &snapshot);
+        CHECK_EQ(right ? snapshot.rightTrigger : snapshot.leftTrigger, value);
+    }
+    
+    return NULL;
+}
+
+static void testConcurrentTriggerUpdatesAreNotLost(void)
+{
+    static int rightTrigger = 1;
+    pthread_t threads[2];
+    
+    CsInit(&state);
+    atomic_store(&startFlag, false);
+    CHECK(pthread_create(&threads[0], NULL, triggerThread, NULL) == 0);
+    CHECK(pthread_create(&threads[1], NULL, triggerThread, &rightTrigger) == 0);
+    atomic_store(&startFlag, true);
+    joinThreads(threads, 2);
+}
+
+static void testSnapshotMerge(void)
+{
+    CONTROLLER_SNAPSHOT snapshot = { A_FLAG, 10, 200, -100, 50, 0, -32768 };
+    CONTROLLER_SNAPSHOT other = { B_FLAG, 20, 100, 50, -200, 1, 32767 };
+    
+    CsMergeSnapshot(&snapshot, &other);
+    
+    CHECK_EQ(snapshot.buttonFlags, A_FLAG | B_FLAG);
+    CHECK_EQ(snapshot.leftTrigger, 20);
+    CHECK_EQ(snapshot.rightTrigger, 200);
+    CHECK_EQ(snapshot.leftStickX, -100);
+    CHECK_EQ(snapshot.leftStickY, -200);
+    CHECK_EQ(snapshot.rightStickX, 1);
+    CHECK_EQ(snapshot.rightStickY, -32768);
+}
+
+int main(void)
+{
+    RUN_TEST(testConcurrentPressesAreNotLost);
+    RUN_TEST(testConcurrentCombosDontStick);
+    RUN_TEST(testConcurrentTriggerUpdatesAreNotLost);
+    RUN_TEST(testSnapshotMerge);
+    return 0;
+}
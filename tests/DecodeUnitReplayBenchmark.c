@@ -0,0 +1,425 @@
+//
+//  DecodeUnitReplayBenchmark.c
+//  Moonlight
+//
+//  Copyright © 2026 Moonlight Game Streaming Project. All rights reserved.
+//
+//  Replays decode units through the picture data handling of DrSubmitDecodeUnit()
+//  and the renderer, and reports the bytes copied and the time per frame of the
+//  old path, which copied the picture data into one malloc'd buffer before
+//  scanning it for start codes, and the new path, which walks the buffer list
+//  in place. Real H.264 Annex B streams can be passed as arguments; every slice
+//  NAL unit becomes one frame, split into packet sized buffers.
+//
+
+#include "Limelight.h"
+#include "NalSplitter.h"
+#include "TestCommon.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#define NALU_START_PREFIX_SIZE 3
+#define PACKET_PAYLOAD_SIZE 1392
+#define SYNTHETIC_FRAMES 600
+#define SYNTHETIC_IDR_INTERVAL 300
+#define SYNTHETIC_SLICES 4
+#define MIN_BENCH_TIME 0.5
+
+typedef struct _REPLAY_STREAM {
+    PDECODE_UNIT units;
+    int count;
+    int capacity;
+} REPLAY_STREAM, *PREPLAY_STREAM;
+
+typedef struct _NAL_TOTALS {
+    size_t units;
+    size_t bytes;
+} NAL_TOTALS, *PNAL_TOTALS;
+
+typedef struct _PATH_RESULT {
+    double nsPerFrame;
+    size_t bytesCopied;
+    NAL_TOTALS totals;
+} PATH_RESULT, *PPATH_RESULT;
+
+// Stands in for AppendAnnexBNalUnit(), which appends a reference to each NAL unit
+static void countNalUnit(void* context, size_t offset, size_t length)
+{
+    PNAL_TOTALS totals = (PNAL_TOTALS)context;
+    
+    if (length <= NALU_START_PREFIX_SIZE) {
+        return;
+    }
+    
+    totals->units++;
+    totals->bytes += length;
+}
+
+// Appends data to the decode unit as packet sized buffers, the way the
+// depacketizer hands over picture data
+static void appendEntries(PDECODE_UNIT du, const uint8_t* data, size_t length, int bufferType)
+{
+    PLENTRY* tail = &du->bufferList;
+    
+    while (*tail != NULL) {
+        tail = &(*tail)->next;
+    }
+    
+    while (length > 0) {
+        size_t chunk = bufferType == BUFFER_TYPE_PICDATA && length > PACKET_PAYLOAD_SIZE ?
+            PACKET_PAYLOAD_SIZE : length;
+        PLENTRY entry = calloc(1, sizeof(*entry));
+        CHECK(entry != NULL);
+        entry->data = malloc(chunk);
+        CHECK(entry->data != NULL);
+        memcpy(entry->data, data, chunk);
+        entry->length = (int)chunk;
+        entry->bufferType = bufferType;
+        
+        *tail = entry;
+        tail = &entry->next;
+        du->fullLength += (int)chunk;
+        data += chunk;
+        length -= chunk;
+    }
+}
+
+static PDECODE_UNIT addDecodeUnit(PREPLAY_STREAM stream, int frameType)
+{
+    if (stream->count == stream->capacity) {
+        stream->capacity = stream->capacity ? stream->capacity * 2 : 64;
+        stream->units = realloc(stream->units, stream->capacity * sizeof(*stream->units));
+        CHECK(stream->units != NULL);
+    }
+    
+    PDECODE_UNIT du = &stream->units[stream->count];
+    memset(du, 0, sizeof(*du));
+    du->frameNumber = ++stream->count;
+    du->frameType = frameType;
+    return du;
+}
+
+static void freeStream(PREPLAY_STREAM stream)
+{
+    for (int i = 0; i < stream->count; i++) {
+        PLENTRY entry = stream->units[i].bufferList;
+        while (entry != NULL) {
+            PLENTRY next = entry->next;
+            free(entry->data);
+            free(entry);
+            entry = next;
+        }
+    }
+    free(stream->units);
+}
+
+// Writes a NAL unit with a 4 byte start code and random slice data with
+// emulation prevention applied. Returns the number of bytes written.
+static size_t writeSyntheticNalUnit(uint8_t* data, uint8_t header, size_t payloadLength, unsigned int* seed)
+{
+    size_t i = 0;
+    int zeros = 0;
+    
+    data[i++] = 0;
+    data[i++] = 0;
+    data[i++] = 0;
+    data[i++] = 1;
+    data[i++] = header;
+    
+    for (size_t j = 0; j < payloadLength; j++) {
+        // Entropy coded data has plenty of zero bytes
+        uint8_t b = rand_r(seed) % 4 == 0 ? 0 : (uint8_t)rand_r(seed);
+        if (zeros >= 2 && b <= 3) {
+            data[i++] = 3;
+            zeros = 0;
+        }
+        data[i++] = b;
+        zeros = b == 0 ? zeros + 1 : 0;
+    }
+    
+    return i;
+}
+
+// Builds a 60 FPS stream of roughly 20 Mbps with a few slices per frame and
+// larger IDR frames that carry their parameter sets in separate buffers
+static void createSyntheticStream(PREPLAY_STREAM stream)
+{
+    uint8_t* buffer = malloc(1024 * 1024);
+    unsigned int seed = 1;
+    
+    CHECK(buffer != NULL);
+    
+    for (int i = 0; i < SYNTHETIC_FRAMES; i++) {
+        bool idr = i % SYNTHETIC_IDR_INTERVAL == 0;
+        PDECODE_UNIT du = addDecodeUnit(stream, idr ? FRAME_TYPE_IDR : FRAME_TYPE_PFRAME);
+        size_t frameSize = idr ? 400 * 1024 : 20 * 1024 + rand_r(&seed) % (40 * 1024);
+        size_t length = 0;
+        
+        if (idr) {
+            length = writeSyntheticNalUnit(buffer, 0x67, 16, &seed);
+            appendEntries(du, buffer, length, BUFFER_TYPE_SPS);
+            length = writeSyntheticNalUnit(buffer, 0x68, 4, &seed);
+            appendEntries(du, buffer, length, BUFFER_TYPE_PPS);
+            length = 0;
+        }
+        
+        for (int j = 0; j < SYNTHETIC_SLICES; j++) {
+            length += writeSyntheticNalUnit(&buffer[length], idr ? 0x65 : 0x41,
+                                            frameSize / SYNTHETIC_SLICES, &seed);
+        }
+        appendEntries(du, buffer, length, BUFFER_TYPE_PICDATA);
+    }
+    
+    free(buffer);
+}
+
+static uint8_t* readFile(const char* path, size_t* length)
+{
+    FILE* file = fopen(path, "rb");
+    uint8_t* data = NULL;
+    long size;
+    
+    if (file == NULL) {
+        return NULL;
+    }
+    
+    if (fseek(file, 0, SEEK_END) == 0 && (size = ftell(file)) > 0 && fseek(file, 0, SEEK_SET) == 0) {
+        data = malloc(size);
+        if (data != NULL && fread(data, 1, size, file) != (size_t)size) {
+            free(data);
+            data = NULL;
+        }
+        *length = size;
+    }
+    
+    fclose(file);
+    return data;
+}
+
+// Groups an H.264 Annex B stream into decode units. Parameter sets get their
+// own buffers and every other NAL unit is picture data for the frame that
+// ends with the next slice.
+static bool loadStream(const char* path, PREPLAY_STREAM stream)
+{
+    size_t length;
+    uint8_t* data = readFile(path, &length);
+    PDECODE_UNIT du = NULL;
+    size_t count;
+    PNAL_UNIT units;
+    
+    if (data == NULL) {
+        return false;
+    }
+    
+    count = NalSplitAnnexB(NalGetBestKernel(), data, length, NULL, 0);
+    units = malloc(count * sizeof(*units));
+    CHECK(units != NULL);
+    NalSplitAnnexB(NalGetBestKernel(), data, length, units, count);
+    
+    for (size_t i = 0; i < count; i++) {
+        const uint8_t* nal = &data[units[i].offset];
+        int type;
+        
+        if (units[i].length <= NALU_START_PREFIX_SIZE) {
+            continue;
+        }
+        
+        type = nal[NALU_START_PREFIX_SIZE] & 0x1F;
+        if (du == NULL) {
+            du = addDecodeUnit(stream, FRAME_TYPE_PFRAME);
+        }
+        
+        if (type == 7 || type == 8) {
+            du->frameType = FRAME_TYPE_IDR;
+            appendEntries(du, nal, units[i].length, type == 7 ? BUFFER_TYPE_SPS : BUFFER_TYPE_PPS);
+        }
+        else {
+            appendEntries(du, nal, units[i].length, BUFFER_TYPE_PICDATA);
+            if (type == 1 || type == 5) {
+                du = NULL;
+            }
+        }
+    }
+    
+    free(units);
+    free(data);
+    return stream->count > 0;
+}
+
+// The picture data path before the change: DrSubmitDecodeUnit() copied the
+// picture data into one allocation and the renderer scanned it byte by byte
+static size_t submitByCopy(PDECODE_UNIT du, PNAL_TOTALS totals)
+{
+    unsigned char* data = (unsigned char*)malloc(du->fullLength);
+    int offset = 0;
+    int lastOffset = -1;
+    
+    CHECK(data != NULL);
+    
+    for (PLENTRY entry = du->bufferList; entry != NULL; entry = entry->next) {
+        if (entry->bufferType == BUFFER_TYPE_PICDATA) {
+            memcpy(&data[offset], entry->data, entry->length);
+            offset += entry->length;
+        }
+    }
+    
+    for (int i = 0; i < offset - NALU_START_PREFIX_SIZE; i++) {
+        if (data[i] == 0 && data[i+1] == 0 && data[i+2] == 1) {
+            if (lastOffset != -1) {
+                countNalUnit(totals, lastOffset, i - lastOffset);
+            }
+            lastOffset = i;
+        }
+    }
+    if (lastOffset != -1) {
+        countNalUnit(totals, lastOffset, offset - lastOffset);
+    }
+    
+    free(data);
+    return offset;
+}
+
+// The same copy, followed by the start code search the renderer uses now, to
+// separate the cost of the copy from the cost of the byte by byte scan
+static size_t submitByCopyAndSplit(PDECODE_UNIT du, NAL_KERNEL kernel, PNAL_TOTALS totals)
+{
+    unsigned char* data = (unsigned char*)malloc(du->fullLength);
+    int offset = 0;
+    NAL_SPLITTER splitter;
+    
+    CHECK(data != NULL);
+    
+    for (PLENTRY entry = du->bufferList; entry != NULL; entry = entry->next) {
+        if (entry->bufferType == BUFFER_TYPE_PICDATA) {
+            memcpy(&data[offset], entry->data, entry->length);
+            offset += entry->length;
+        }
+    }
+    
+    NalSplitterInit(&splitter, kernel);
+    NalSplitterFeed(&splitter, data, offset, countNalUnit, totals);
+    NalSplitterFinish(&splitter, countNalUnit, totals);
+    
+    free(data);
+    return offset;
+}
+
+// The picture data path now: the renderer feeds every picture data buffer
+// through one splitter and references the NAL units where they are
+static size_t submitByReference(PDECODE_UNIT du, NAL_KERNEL kernel, PNAL_TOTALS totals)
+{
+    NAL_SPLITTER splitter;
+    
+    NalSplitterInit(&splitter, kernel);
+    for (PLENTRY entry = du->bufferList; entry != NULL; entry = entry->next) {
+        if (entry->bufferType == BUFFER_TYPE_PICDATA) {
+            NalSplitterFeed(&splitter, (uint8_t*)entry->data, entry->length, countNalUnit, totals);
+        }
+    }
+    NalSplitterFinish(&splitter, countNalUnit, totals);
+    
+    return 0;
+}
+
+typedef enum {
+    PATH_COPY,
+    PATH_COPY_SPLIT,
+    PATH_REFERENCE,
+    PATH_COUNT
+} SUBMIT_PATH;
+
+static const char* pathNames[PATH_COUNT] = {
+    "malloc + memcpy + byte scan",
+    "malloc + memcpy + splitter",
+    "by reference",
+};
+
+static void replayStream(PREPLAY_STREAM stream, SUBMIT_PATH path, NAL_KERNEL kernel, PPATH_RESULT result)
+{
+    int passes = 0;
+    double start = TestGetTime();
+    double elapsed;
+    
+    memset(result, 0, sizeof(*result));
+    
+    do {
+        NAL_TOTALS totals = { 0 };
+        size_t bytesCopied = 0;
+        
+        for (int i = 0; i < stream->count; i++) {
+            switch (path) {
+                case PATH_COPY:
+                    bytesCopied += submitByCopy(&stream->units[i], &totals);
+                    break;
+                case PATH_COPY_SPLIT:
+                    bytesCopied += submitByCopyAndSplit(&stream->units[i], kernel, &totals);
+                    break;
+                default:
+                    bytesCopied += submitByReference(&stream->units[i], kernel, &totals);
+                    break;
+            }
+        }
+        
+        result->totals = totals;
+        result->bytesCopied = bytesCopied;
+        passes++;
+        elapsed = TestGetTime() - start;
+    } while (elapsed < MIN_BENCH_TIME);
+    
+    result->nsPerFrame = elapsed * 1e9 / ((double)passes * stream->count);
+}
+
+static void benchmarkStream(const char* name, PREPLAY_STREAM stream)
+{
+    NAL_KERNEL kernel = NalGetBestKernel();
+    PATH_RESULT results[PATH_COUNT];
+    size_t pictureBytes = 0;
+    
+    for (int i = 0; i < stream->count; i++) {
+        for (PLENTRY entry = stream->units[i].bufferList; entry != NULL; entry = entry->next) {
+            if (entry->bufferType == BUFFER_TYPE_PICDATA) {
+                pictureBytes += entry->length;
+            }
+        }
+    }
+    
+    printf("%s (%d frames, %.1f KB picture data per frame, %s splitter)\n", name, stream->count,
+           pictureBytes / 1024.0 / stream->count, NalGetKernelName(kernel));
+    
+    for (SUBMIT_PATH path = 0; path < PATH_COUNT; path++) {
+        replayStream(stream, path, kernel, &results[path]);
+        printf("  %-28s %9.0f ns/frame  %9.1f KB copied/frame\n", pathNames[path],
+               results[path].nsPerFrame, results[path].bytesCopied / 1024.0 / stream->count);
+        
+        // Every path must hand the renderer the same NAL units
+        CHECK_EQ(results[path].totals.units, results[PATH_COPY].totals.units);
+        CHECK_EQ(results[path].totals.bytes, results[PATH_COPY].totals.bytes);
+    }
+    
+    CHECK_EQ(results[PATH_COPY].bytesCopied, pictureBytes);
+    CHECK_EQ(results[PATH_REFERENCE].bytesCopied, 0);
+    printf("  by reference is %.1fx faster than the old path\n",
+           results[PATH_COPY].nsPerFrame / results[PATH_REFERENCE].nsPerFrame);
+}
+
+int main(int argc, char* argv[])
+{
+    REPLAY_STREAM synthetic = { 0 };
+    createSyntheticStream(&synthetic);
+    benchmarkStream("synthetic", &synthetic);
+    freeStream(&synthetic);
+    
+    for (int i = 1; i < argc; i++) {
+        REPLAY_STREAM stream = { 0 };
+        if (!loadStream(argv[i], &stream)) {
+            fprintf(stderr, "Unable to read %s\n", argv[i]);
+            return 1;
+        }
+        
+        benchmarkStream(argv[i], &stream);
+        freeStream(&stream);
+    }
+    
+    return 0;
+}
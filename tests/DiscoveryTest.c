@@ -0,0 +1,672 @@
+//
+//  DiscoveryTest.c
+//  Moonlight
+//
+//  Copyright © 2026 Moonlight Game Streaming Project. All rights reserved.
+//
+//  Runs the host poller against stand-in hosts on the loopback interface
+//  that answer /serverinfo late, never answer, or alternate between up and
+//  down. Timers and requests run on their own threads the way GCD runs them
+//  for DiscoveryWorker. The scheduled delays can be scaled down so the 2 to
+//  16 second offline backoff doesn't take half a minute.
+//
+
+#include "HostPoller.h"
+#include "TestCommon.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#define TEST_UUID "0123456789ABCDEF"
+#define PROBE_TIMEOUT_MS 1000
+#define MAX_HELD_CONNECTIONS 64
+#define MAX_DELAYS 256
+
+typedef enum {
+    HOST_UP,
+    HOST_DOWN,      // Closes the connection without an answer
+    HOST_DEAD,      // Never answers
+    HOST_FLAPPING,  // Every other request is answered
+} HOST_MODE;
+
+typedef struct _HOST_SERVER {
+    int sock;
+    unsigned short port;
+    char address[HP_ADDRESS_MAX_LENGTH];
+    pthread_t thread;
+    atomic_bool stop;
+    
+    atomic_int mode;
+    atomic_int delayMs;
+    atomic_int requests;
+    
+    int heldConnections[MAX_HELD_CONNECTIONS];
+    int heldConnectionCount;
+} HOST_SERVER, *PHOST_SERVER;
+
+typedef struct _TEST_HOST {
+    HOST_POLLER poller;
+    double timeScale;
+    double startTime;
+    
+    int addressCount;
+    char addresses[HP_MAX_ADDRESSES][HP_ADDRESS_MAX_LENGTH];
+    
+    pthread_mutex_t mutex;
+    char lastAddress[HP_ADDRESS_MAX_LENGTH];
+    double lastResultTime;
+    int onlineResults;
+    int offlineResults;
+    double delays[MAX_DELAYS];
+    int delayCount;
+    
+    atomic_int stoppedCount;
+    atomic_bool discovered;
+} TEST_HOST, *PTEST_HOST;
+
+typedef struct _HELPER_CALL {
+    PTEST_HOST host;
+    double delay;
+    HP_CALL_FN fn;
+    void* arg;
+    PHP_PROBE probe;
+} HELPER_CALL, *PHELPER_CALL;
+
+// Timer and request threads, which must be gone before a poller is destroyed
+static atomic_int liveHelpers;
+static atomic_bool fastForward;
+
+static const char serverInfoBody[] =
+    "<?xml version=\"1.0\" encoding=\"utf-8\"?>"
+    "<root status_code=\"200\"><hostname>TestHost</hostname><uniqueid>" TEST_UUID "</uniqueid></root>";
+
+static void answerRequest(PHOST_SERVER server, int client)
+{
+    char response[1024];
+    int length;
+    
+    for (int waited = 0; waited < atomic_load(&server->delayMs) && !atomic_load(&server->stop); waited += 5) {
+        TestSleepMs(5);
+    }
+    
+    length = snprintf(response, sizeof(response),
+                      "HTTP/1.1 200 OK\r\nContent-Type: application/xml\r\nContent-Length: %zu\r\nConnection: close\r\n\r\n%s",
+                      strlen(serverInfoBody), serverInfoBody);
+    send(client, response, length, MSG_NOSIGNAL);
+}
+
+static void* hostServerThread(void* context)
+{
+    PHOST_SERVER server = context;
+    
+    while (!atomic_load(&server->stop)) {
+        struct pollfd pfd = { server->sock, POLLIN, 0 };
+        if (poll(&pfd, 1, 10) <= 0) {
+            continue;
+        }
+        
+        int client = accept(server->sock, NULL, NULL);
+        if (client < 0) {
+            continue;
+        }
+        
+        // Read the request before deciding what to do with it
+        char request[1024];
+        struct pollfd cpfd = { client, POLLIN, 0 };
+        if (poll(&cpfd, 1, 200) > 0) {
+            recv(client, request, sizeof(request), 0);
+        }
+        
+        int requests = atomic_fetch_add(&server->requests, 1) + 1;
+        HOST_MODE mode = atomic_load(&server->mode);
+        if (mode == HOST_FLAPPING) {
+            mode = requests % 2 == 0 ? HOST_UP : HOST_DOWN;
+        }
+        
+        if (mode == HOST_DEAD && server->heldConnectionCount < MAX_HELD_CONNECTIONS) {
+            server->heldConnections[server->heldConnectionCount++] = client;
+            continue;
+        }
+        
+        if (mode == HOST_UP) {
+            answerRequest(server, client);
+        }
+        close(client);
+    }
+    
+    for (int i = 0; i < server->heldConnectionCount; i++) {
+        close(server->heldConnections[i]);
+    }
+    
+    return NULL;
+}
+
+static void startHostServer(PHOST_SERVER server, HOST_MODE mode, int delayMs)
+{
+    struct sockaddr_in addr = { 0 };
+    socklen_t addrLength = sizeof(addr);
+    
+    memset(server, 0, sizeof(*server));
+    atomic_init(&server->mode, mode);
+    atomic_init(&server->delayMs, delayMs);
+    
+    server->sock = socket(AF_INET, SOCK_STREAM, 0);
+    CHECK(server->sock >= 0);
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    CHECK(bind(server->sock, (struct sockaddr*)&addr, sizeof(addr)) == 0);
+    CHECK(listen(server->sock, 16) == 0);
+    CHECK(getsockname(server->sock, (struct sockaddr*)&addr, &addrLength) == 0);
+    server->port = ntohs(addr.sin_port);
+    snprintf(server->address, sizeof(server->address), "127.0.0.1:%u", server->port);
+    
+    CHECK(pthread_create(&server->thread, NULL, hostServerThread, server) == 0);
+}
+
+static void stopHostServer(PHOST_SERVER server)
+{
+    atomic_store(&server->stop, true);
+    CHECK(pthread_join(server->thread, NULL) == 0);
+    close(server->sock);
+}
+
+// Fetches /serverinfo from "ip:port" and returns the response, or NULL if
+// the connection failed or nothing came back before the timeout
+static char* requestServerInfo(const char* address, int timeoutMs)
+{
+    static const char request[] = "GET /serverinfo HTTP/1.1\r\nHost: localhost\r\nConnection: close\r\n\r\n";
+    struct sockaddr_in addr = { 0 };
+    char ip[HP_ADDRESS_MAX_LENGTH];
+    const char* colon = strchr(address, ':');
+    double deadline = TestGetTime() + timeoutMs / 1000.0;
+    size_t length = 0;
+    char* response;
+    int sock;
+    
+    CHECK(colon != NULL);
+    memcpy(ip, address, colon - address);
+    ip[colon - address] = 0;
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(atoi(colon + 1));
+    addr.sin_addr.s_addr = inet_addr(ip);
+    
+    sock = socket(AF_INET, SOCK_STREAM, 0);
+    CHECK(sock >= 0);
+    if (connect(sock, (struct sockaddr*)&addr, sizeof(addr)) != 0 ||
+        send(sock, request, sizeof(request) - 1, MSG_NOSIGNAL) != (ssize_t)sizeof(request) - 1) {
+        close(sock);
+        return NULL;
+    }
+    
+    response = malloc(4096);
+    CHECK(response != NULL);
+    for (;;) {
+        int remainingMs = (int)((deadline - TestGetTime()) * 1000);
+        struct pollfd pfd = { sock, POLLIN, 0 };
+        if (remainingMs <= 0 || poll(&pfd, 1, remainingMs) <= 0) {
+            // Timed out
+            length = 0;
+            break;
+        }
+        
+        ssize_t ret = recv(sock, &response[length], 4095 - length, 0);
+        if (ret <= 0) {
+            break;
+        }
+        length += ret;
+    }
+    close(sock);
+    
+    if (length == 0) {
+        free(response);
+        return NULL;
+    }
+    
+    response[length] = 0;
+    return response;
+}
+
+static void recordDelay(PTEST_HOST host, double delay)
+{
+    pthread_mutex_lock(&host->mutex);
+    if (host->delayCount < MAX_DELAYS) {
+        host->delays[host->delayCount++] = delay;
+    }
+    pthread_mutex_unlock(&host->mutex);
+}
+
+static void* timerThread(void* context)
+{
+    PHELPER_CALL call = context;
+    double deadline = TestGetTime() + call->delay * call->host->timeScale;
+    
+    while (!atomic_load(&fastForward) && TestGetTime() < deadline) {
+        TestSleepMs(1);
+    }
+    
+    call->fn(call->arg);
+    free(call);
+    atomic_fetch_sub(&liveHelpers, 1);
+    return NULL;
+}
+
+static void* probeThread(void* context)
+{
+    PHELPER_CALL call = context;
+    char* response = requestServerInfo(call->probe->address, PROBE_TIMEOUT_MS);
+    bool reachable = response != NULL && strstr(response, "status_code=\"200\"") != NULL &&
+        strstr(response, "<uniqueid>" TEST_UUID "</uniqueid>") != NULL;
+    
+    HpProbeFinished(call->probe, reachable, response);
+    free(response);
+    free(call);
+    atomic_fetch_sub(&liveHelpers, 1);
+    return NULL;
+}
+
+static void startHelper(void* (*fn)(void*), PHELPER_CALL call)
+{
+    pthread_attr_t attr;
+    pthread_t thread;
+    
+    atomic_fetch_add(&liveHelpers, 1);
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    CHECK(pthread_create(&thread, &attr, fn, call) == 0);
+    pthread_attr_destroy(&attr);
+}
+
+static void scheduleCall(void* context, double delay, HP_CALL_FN fn, void* arg)
+{
+    PHELPER_CALL call = calloc(1, sizeof(*call));
+    
+    CHECK(call != NULL);
+    call->host = context;
+    call->delay = delay;
+    call->fn = fn;
+    call->arg = arg;
+    
+    // Only scheduled polls have a delay when there is a single address
+    if (delay > 0) {
+        recordDelay(context, delay);
+    }
+    
+    startHelper(timerThread, call);
+}
+
+static int getAddresses(void* context, char addresses[HP_MAX_ADDRESSES][HP_ADDRESS_MAX_LENGTH])
+{
+    PTEST_HOST host = context;
+    
+    memcpy(addresses, host->addresses, sizeof(host->addresses));
+    return host->addressCount;
+}
+
+static void probeAddress(void* context, PHP_PROBE probe)
+{
+    PHELPER_CALL call = calloc(1, sizeof(*call));
+    
+    CHECK(call != NULL);
+    call->host = context;
+    call->probe = probe;
+    startHelper(probeThread, call);
+}
+
+static void pollResult(void* context, const char* address, void* result)
+{
+    PTEST_HOST host = context;
+    
+    // The winner's response is still alive while this runs
+    CHECK((address != NULL) == (result != NULL));
+    CHECK(result == NULL || strstr(result, TEST_UUID) != NULL);
+    
+    pthread_mutex_lock(&host->mutex);
+    strcpy(host->lastAddress, address != NULL ? address : "");
+    host->lastResultTime = TestGetTime() - host->startTime;
+    if (address != NULL) {
+        host->onlineResults++;
+    }
+    else {
+        host->offlineResults++;
+    }
+    pthread_mutex_unlock(&host->mutex);
+}
+
+static void pollerStopped(void* context)
+{
+    PTEST_HOST host = context;
+    atomic_fetch_add(&host->stoppedCount, 1);
+}
+
+static void discoveryDone(void* arg)
+{
+    PTEST_HOST host = arg;
+    atomic_store(&host->discovered, true);
+}
+
+static HOST_POLLER_CALLBACKS testCallbacks = {
+    scheduleCall,
+    getAddresses,
+    probeAddress,
+    pollResult,
+    pollerStopped,
+};
+
+static void startTestHost(PTEST_HOST host, double timeScale, bool hostKnown, PHOST_SERVER* servers, int serverCount)
+{
+    memset(host, 0, sizeof(*host));
+    pthread_mutex_init(&host->mutex, NULL);
+    host->timeScale = timeScale;
+    host->addressCount = serverCount;
+    for (int i = 0; i < serverCount; i++) {
+        strcpy(host->addresses[i], servers[i]->address);
+    }
+    
+    HpInit(&host->poller, &testCallbacks, host, HP_POLL_INTERVAL, HP_OFFLINE_MAX_POLL_INTERVAL,
+           HP_ADDRESS_RACE_DELAY, hostKnown);
+    host->startTime = TestGetTime();
+}
+
+static void stopTestHost(PTEST_HOST host)
+{
+    HpCancel(&host->poller);
+    for (int i = 0; i < 500 && atomic_load(&host->stoppedCount) == 0; i++) {
+        TestSleepMs(10);
+    }
+    CHECK_EQ(atomic_load(&host->stoppedCount), 1);
+    
+    // Run any timers that are still pending so they let go of the poller
+    atomic_store(&fastForward, true);
+    while (atomic_load(&liveHelpers) > 0) {
+        TestSleepMs(1);
+    }
+    atomic_store(&fastForward, false);
+    
+    CHECK_EQ(atomic_load(&host->stoppedCount), 1);
+    HpDestroy(&host->poller);
+    pthread_mutex_destroy(&host->mutex);
+}
+
+static int getOnlineResults(PTEST_HOST host)
+{
+    pthread_mutex_lock(&host->mutex);
+    int results = host->onlineResults;
+    pthread_mutex_unlock(&host->mutex);
+    return results;
+}
+
+static int getDelayCount(PTEST_HOST host)
+{
+    pthread_mutex_lock(&host->mutex);
+    int count = host->delayCount;
+    pthread_mutex_unlock(&host->mutex);
+    return count;
+}
+
+static double getDelay(PTEST_HOST host, int index)
+{
+    pthread_mutex_lock(&host->mutex);
+    double delay = host->delays[index];
+    pthread_mutex_unlock(&host->mutex);
+    return delay;
+}
+
+static void waitForDelays(PTEST_HOST host, int count)
+{
+    double deadline = TestGetTime() + 10;
+    while (getDelayCount(host) < count) {
+        CHECK(TestGetTime() < deadline);
+        TestSleepMs(1);
+    }
+}
+
+static void discover(PTEST_HOST host)
+{
+    host->startTime = TestGetTime();
+    HpDiscover(&host->poller, discoveryDone, host);
+    while (!atomic_load(&host->discovered)) {
+        TestSleepMs(1);
+    }
+}
+
+static void testPreferredAddressWins(void)
+{
+    HOST_SERVER preferred, other;
+    TEST_HOST host;
+    
+    startHostServer(&preferred, HOST_UP, 0);
+    startHostServer(&other, HOST_UP, 0);
+    startTestHost(&host, 1, false, (PHOST_SERVER[]){ &preferred, &other }, 2);
+    
+    discover(&host);
+    HpWaitUntilFinished(&host.poller);
+    CHECK(strcmp(host.lastAddress, preferred.address) == 0);
+    CHECK(host.lastResultTime < HP_ADDRESS_RACE_DELAY);
+    
+    // The race was over before the second address's turn came
+    CHECK_EQ(atomic_load(&preferred.requests), 1);
+    CHECK_EQ(atomic_load(&other.requests), 0);
+    
+    stopTestHost(&host);
+    stopHostServer(&preferred);
+    stopHostServer(&other);
+}
+
+static void testHeadStart(void)
+{
+    HOST_SERVER preferred, other;
+    TEST_HOST host;
+    
+    // A preferred address that answers within its head start still wins
+    startHostServer(&preferred, HOST_UP, 100);
+    startHostServer(&other, HOST_UP, 0);
+    startTestHost(&host, 1, false, (PHOST_SERVER[]){ &preferred, &other }, 2);
+    
+    discover(&host);
+    HpWaitUntilFinished(&host.poller);
+    CHECK(strcmp(host.lastAddress, preferred.address) == 0);
+    CHECK(host.lastResultTime >= 0.1);
+    CHECK_EQ(atomic_load(&other.requests), 0);
+    stopTestHost(&host);
+    
+    // A slower one loses to the next address once its head start is up
+    atomic_store(&preferred.delayMs, 600);
+    startTestHost(&host, 1, false, (PHOST_SERVER[]){ &preferred, &other }, 2);
+    
+    discover(&host);
+    CHECK(strcmp(host.lastAddress, other.address) == 0);
+    CHECK(host.lastResultTime >= HP_ADDRESS_RACE_DELAY);
+    CHECK(host.lastResultTime < HP_ADDRESS_RACE_DELAY + 0.2);
+    
+    // The losing probe is still in flight until the slow answer comes in
+    HpWaitUntilFinished(&host.poller);
+    CHECK(TestGetTime() - host.startTime >= 0.59);
+    CHECK_EQ(host.onlineResults, 1);
+    CHECK(strcmp(host.lastAddress, other.address) == 0);
+    stopTestHost(&host);
+    
+    stopHostServer(&preferred);
+    stopHostServer(&other);
+}
+
+static void testDeadAddress(void)
+{
+    HOST_SERVER dead, alive;
+    TEST_HOST host;
+    
+    startHostServer(&dead, HOST_DEAD, 0);
+    startHostServer(&alive, HOST_UP, 0);
+    
+    // A dead preferred address only costs its head start
+    startTestHost(&host, 1, false, (PHOST_SERVER[]){ &dead, &alive }, 2);
+    discover(&host);
+    CHECK(strcmp(host.lastAddress, alive.address) == 0);
+    CHECK(host.lastResultTime >= HP_ADDRESS_RACE_DELAY);
+    CHECK(host.lastResultTime < HP_ADDRESS_RACE_DELAY + 0.2);
+    
+    // But the poller isn't finished until the dead address's request times out
+    HpWaitUntilFinished(&host.poller);
+    CHECK(TestGetTime() - host.startTime >= PROBE_TIMEOUT_MS / 1000.0 - 0.05);
+    stopTestHost(&host);
+    
+    // With nothing else to try, the host is offline after the timeout
+    startTestHost(&host, 1, false, (PHOST_SERVER[]){ &dead }, 1);
+    discover(&host);
+    CHECK_EQ(host.offlineResults, 1);
+    CHECK_EQ(host.onlineResults, 0);
+    CHECK(host.lastResultTime >= PROBE_TIMEOUT_MS / 1000.0 - 0.05);
+    stopTestHost(&host);
+    
+    stopHostServer(&dead);
+    stopHostServer(&alive);
+}
+
+static void testOfflineBackoff(void)
+{
+    static const double expected[] = { 2, 4, 8, 16, 16, 16 };
+    HOST_SERVER server;
+    TEST_HOST host;
+    int count;
+    
+    startHostServer(&server, HOST_DOWN, 0);
+    startTestHost(&host, 0.01, false, (PHOST_SERVER[]){ &server }, 1);
+    
+    HpPollNow(&host.poller);
+    waitForDelays(&host, 6);
+    for (int i = 0; i < 6; i++) {
+        CHECK(getDelay(&host, i) == expected[i]);
+    }
+    
+    // An unknown host gets one try on its first poll, then two per poll
+    CHECK(atomic_load(&server.requests) >= 1 + 5 * 2);
+    
+    // Back to the normal interval once the host answers
+    atomic_store(&server.mode, HOST_UP);
+    while (getOnlineResults(&host) == 0) {
+        TestSleepMs(1);
+    }
+    count = getDelayCount(&host);
+    waitForDelays(&host, count + 1);
+    CHECK(getDelay(&host, count) == HP_POLL_INTERVAL);
+    
+    // And the backoff starts over when it goes away again
+    atomic_store(&server.mode, HOST_DOWN);
+    for (;;) {
+        count = getDelayCount(&host);
+        waitForDelays(&host, count + 1);
+        if (getDelay(&host, count) == 4) {
+            break;
+        }
+        CHECK(getDelay(&host, count) == 2);
+    }
+    
+    stopTestHost(&host);
+    stopHostServer(&server);
+}
+
+static void testFlappingHost(void)
+{
+    HOST_SERVER server;
+    TEST_HOST host;
+    
+    // Every poll gets a second try, so a host that misses every other
+    // request stays online at the normal poll interval
+    startHostServer(&server, HOST_FLAPPING, 0);
+    startTestHost(&host, 0.01, true, (PHOST_SERVER[]){ &server }, 1);
+    
+    HpPollNow(&host.poller);
+    waitForDelays(&host, 5);
+    for (int i = 0; i < 5; i++) {
+        CHECK(getDelay(&host, i) == HP_POLL_INTERVAL);
+    }
+    
+    pthread_mutex_lock(&host.mutex);
+    CHECK_EQ(host.offlineResults, 0);
+    CHECK(host.onlineResults >= 5);
+    pthread_mutex_unlock(&host.mutex);
+    CHECK(atomic_load(&server.requests) >= 10);
+    
+    stopTestHost(&host);
+    stopHostServer(&server);
+}
+
+static void testNetworkChangeReprobe(void)
+{
+    HOST_SERVER server;
+    TEST_HOST host;
+    double changeTime;
+    int count;
+    
+    startHostServer(&server, HOST_DOWN, 0);
+    startTestHost(&host, 0.1, true, (PHOST_SERVER[]){ &server }, 1);
+    
+    // Wait until the host is backed off all the way
+    HpPollNow(&host.poller);
+    waitForDelays(&host, 4);
+    CHECK(getDelay(&host, 3) == HP_OFFLINE_MAX_POLL_INTERVAL);
+    
+    // The network changed and the host is reachable now. We don't wait out
+    // the 16 second interval that's scheduled.
+    atomic_store(&server.mode, HOST_UP);
+    count = getDelayCount(&host);
+    changeTime = TestGetTime();
+    HpPollNow(&host.poller);
+    while (getOnlineResults(&host) == 0) {
+        CHECK(TestGetTime() - changeTime < 0.3);
+        TestSleepMs(1);
+    }
+    
+    waitForDelays(&host, count + 1);
+    CHECK(getDelay(&host, count) == HP_POLL_INTERVAL);
+    
+    stopTestHost(&host);
+    stopHostServer(&server);
+}
+
+static void testCancel(void)
+{
+    HOST_SERVER server;
+    TEST_HOST host;
+    
+    startHostServer(&server, HOST_DEAD, 0);
+    startTestHost(&host, 1, false, (PHOST_SERVER[]){ &server }, 1);
+    
+    HpPollNow(&host.poller);
+    while (atomic_load(&server.requests) == 0) {
+        TestSleepMs(1);
+    }
+    
+    // The poller only reports that it stopped once the probe is done
+    HpCancel(&host.poller);
+    CHECK(HpIsCancelled(&host.poller));
+    CHECK_EQ(atomic_load(&host.stoppedCount), 0);
+    HpPollNow(&host.poller);
+    HpWaitUntilFinished(&host.poller);
+    while (atomic_load(&host.stoppedCount) == 0) {
+        TestSleepMs(1);
+    }
+    
+    // No result is reported for a cancelled poll and no more polls happen
+    CHECK_EQ(host.onlineResults + host.offlineResults, 0);
+    CHECK_EQ(atomic_load(&server.requests), 1);
+    
+    stopTestHost(&host);
+    stopHostServer(&server);
+}
+
+int main(void)
+{
+    RUN_TEST(testPreferredAddressWins);
+    RUN_TEST(testHeadStart);
+    RUN_TEST(testDeadAddress);
+    RUN_TEST(testOfflineBackoff);
+    RUN_TEST(testFlappingHost);
+    RUN_TEST(testNetworkChangeReprobe);
+    RUN_TEST(testCancel);
+    return 0;
+}
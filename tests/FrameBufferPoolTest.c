@@ -0,0 +1,68 @@
+//
+//  FrameBufferPoolTest.c
+//  Moonlight
+//
+//  Copyright © 2026 Moonlight Game Streaming Project. All rights reserved.
+//
+
+#include "FrameBufferPool.h"
+#include "TestCommon.h"
+
+#include <string.h>
+
+// 1080p60 at 20 Mbps
+#define WIDTH 1920
+#define HEIGHT 1080
+#define FPS 60
+#define BITRATE_KBPS 20000
+
+static void testFrameBufferOnlyPreallocatedWhenFramesAreCopied(void)
+{
+    FRAME_BUFFER_POOL_STATS byReferenceStats, copyingStats;
+    
+    PFRAME_BUFFER_POOL byReferencePool = FbpCreatePool(WIDTH, HEIGHT, FPS, BITRATE_KBPS, false);
+    PFRAME_BUFFER_POOL copyingPool = FbpCreatePool(WIDTH, HEIGHT, FPS, BITRATE_KBPS, true);
+    CHECK(byReferencePool != NULL && copyingPool != NULL);
+    
+    FbpGetStats(byReferencePool, &byReferenceStats);
+    FbpGetStats(copyingPool, &copyingStats);
+    
+    // Only the small bookkeeping buffers for H.264 and HEVC
+    CHECK(byReferenceStats.bytesHeld <= 64 * 1024);
+    
+    // AV1 also gets a buffer for a whole IDR frame (8 average frames, rounded up)
+    size_t idrFrameSize = (BITRATE_KBPS * 1000 / 8) / FPS * 8;
+    CHECK(copyingStats.bytesHeld >= byReferenceStats.bytesHeld + idrFrameSize);
+    
+    // That buffer is reused for the IDR frame copy rather than allocated on demand
+    void* frameCopy = FbpAllocate(copyingPool, idrFrameSize);
+    CHECK(frameCopy != NULL);
+    FbpGetStats(copyingPool, &copyingStats);
+    CHECK_EQ(copyingStats.hits, 1);
+    FbpFree(frameCopy);
+    
+    FbpReleasePool(byReferencePool);
+    FbpReleasePool(copyingPool);
+}
+
+static void testBuffersOutliveThePool(void)
+{
+    PFRAME_BUFFER_POOL pool = FbpCreatePool(WIDTH, HEIGHT, FPS, BITRATE_KBPS, false);
+    CHECK(pool != NULL);
+    
+    uint8_t* buffer = FbpAllocate(pool, 1000);
+    CHECK(buffer != NULL);
+    memset(buffer, 0xAB, 1000);
+    
+    // A frame still held by the decoder keeps the pool alive (ASan checks this)
+    FbpReleasePool(pool);
+    CHECK(buffer[999] == 0xAB);
+    FbpFree(buffer);
+}
+
+int main(void)
+{
+    RUN_TEST(testFrameBufferOnlyPreallocatedWhenFramesAreCopied);
+    RUN_TEST(testBuffersOutliveThePool);
+    return 0;
+}
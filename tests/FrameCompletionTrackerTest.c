@@ -0,0 +1,232 @@
+//
+//  FrameCompletionTrackerTest.c
+//  Moonlight
+//
+//  Copyright © 2026 Moonlight Game Streaming Project. All rights reserved.
+//
+//  Models the lifetime of frames submitted by reference: the renderer tracks
+//  each frame, the decoder completes it later on its own thread, and -stop
+//  waits for every frame to be completed before the connection goes away.
+//
+
+#include "FrameCompletionTracker.h"
+#include "SpscQueue.h"
+#include "TestCommon.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <string.h>
+
+#define MAX_FRAMES 64
+
+static atomic_int completedFrames;
+static atomic_int completionsByFrame[MAX_FRAMES];
+static atomic_int lastStatus;
+
+static void resetCompletions(void)
+{
+    atomic_store(&completedFrames, 0);
+    atomic_store(&lastStatus, 0);
+    for (int i = 0; i < MAX_FRAMES; i++) {
+        atomic_store(&completionsByFrame[i], 0);
+    }
+}
+
+// Stands in for LiCompleteVideoFrame(). Frame handles are indexes into completionsByFrame.
+static void completeFrame(void* frameHandle, int drStatus)
+{
+    atomic_fetch_add(&completionsByFrame[(intptr_t)frameHandle], 1);
+    atomic_store(&lastStatus, drStatus);
+    atomic_fetch_add(&completedFrames, 1);
+}
+
+static void testEachFrameCompletesOnce(void)
+{
+    resetCompletions();
+    PFRAME_COMPLETION_TRACKER tracker = FctCreate(completeFrame);
+    CHECK(tracker != NULL);
+    
+    for (int i = 0; i < 8; i++) {
+        FctTrack(tracker);
+    }
+    CHECK_EQ(FctGetOutstandingFrames(tracker), 8);
+    
+    for (intptr_t i = 0; i < 8; i++) {
+        FctComplete(tracker, (void*)i, (int)i);
+    }
+    
+    CHECK_EQ(FctGetOutstandingFrames(tracker), 0);
+    CHECK_EQ(atomic_load(&completedFrames), 8);
+    CHECK_EQ(atomic_load(&lastStatus), 7);
+    for (int i = 0; i < 8; i++) {
+        CHECK_EQ(atomic_load(&completionsByFrame[i]), 1);
+    }
+    
+    // Nothing is outstanding, so this must not wait for the timeout
+    double start = TestGetTime();
+    CHECK(FctWaitForIdle(tracker, 5000));
+    CHECK(TestGetTime() - start < 1.0);
+    
+    FctRelease(tracker);
+}
+
+typedef struct _DECODER_THREAD_CONTEXT {
+    PFRAME_COMPLETION_TRACKER tracker;
+    int firstFrame;
+    int frameCount;
+    int delayMs;
+} DECODER_THREAD_CONTEXT, *PDECODER_THREAD_CONTEXT;
+
+// Releases frames late, like the decoder finishing with buffers after a flush
+static void* decoderThread(void* context)
+{
+    PDECODER_THREAD_CONTEXT ctx = context;
+    
+    TestSleepMs(ctx->delayMs);
+    for (int i = 0; i < ctx->frameCount; i++) {
+        FctComplete(ctx->tracker, (void*)(intptr_t)(ctx->firstFrame + i), 0);
+    }
+    
+    return NULL;
+}
+
+static void testStopWaitsForLateCompletions(void)
+{
+    resetCompletions();
+    PFRAME_COMPLETION_TRACKER tracker = FctCreate(completeFrame);
+    CHECK(tracker != NULL);
+    
+    for (int i = 0; i < 4; i++) {
+        FctTrack(tracker);
+    }
+    
+    pthread_t thread;
+    DECODER_THREAD_CONTEXT ctx = { tracker, 0, 4, 100 };
+    CHECK(pthread_create(&thread, NULL, decoderThread, &ctx) == 0);
+    
+    // Every completion has to have happened by the time the wait returns
+    double start = TestGetTime();
+    CHECK(FctWaitForIdle(tracker, 5000));
+    CHECK(TestGetTime() - start >= 0.05);
+    CHECK_EQ(atomic_load(&completedFrames), 4);
+    
+    pthread_join(thread, NULL);
+    FctRelease(tracker);
+}
+
+// Stands in for CFRelease() of a prepared frame's sample buffer
+static void releaseQueuedFrame(void* context, void* element)
+{
+    FctComplete(context, (void*)*(intptr_t*)element, 0);
+}
+
+static void testQueuedFramesAreCompletedAtStop(void)
+{
+    resetCompletions();
+    PFRAME_COMPLETION_TRACKER tracker = FctCreate(completeFrame);
+    CHECK(tracker != NULL);
+    
+    // With frame pacing, prepared frames wait in a queue for the display link.
+    // They hold sample buffers, so they're outstanding until they're released.
+    SPSC_QUEUE preparedFrames;
+    CHECK(SpscQueueInit(&preparedFrames, 16, sizeof(intptr_t)));
+    for (intptr_t i = 0; i < 3; i++) {
+        FctTrack(tracker);
+        CHECK(SpscQueuePush(&preparedFrames, &i));
+    }
+    
+    // One more frame is still held by the decoder and released shortly after the flush
+    FctTrack(tracker);
+    pthread_t thread;
+    DECODER_THREAD_CONTEXT ctx = { tracker, 3, 1, 20 };
+    CHECK(pthread_create(&thread, NULL, decoderThread, &ctx) == 0);
+    
+    // Nobody consumes the queue once the display link is gone
+    CHECK(!FctWaitForIdle(tracker, 50));
+    CHECK(FctGetOutstandingFrames(tracker) >= 3);
+    
+    // The same sequence as -stop. Draining the queue first keeps the wait
+    // from running into the timeout.
+    FctDrainQueue(&preparedFrames, releaseQueuedFrame, tracker);
+    CHECK_EQ(SpscQueueSize(&preparedFrames), 0);
+    double start = TestGetTime();
+    CHECK_EQ(FctFinish(tracker, 5000), 0);
+    CHECK(TestGetTime() - start < 1.0);
+    
+    CHECK_EQ(atomic_load(&completedFrames), 4);
+    for (int i = 0; i < 4; i++) {
+        CHECK_EQ(atomic_load(&completionsByFrame[i]), 1);
+    }
+    
+    pthread_join(thread, NULL);
+    SpscQueueDestroy(&preparedFrames);
+    FctRelease(tracker);
+}
+
+static void testAbandonedFramesAreNotCompleted(void)
+{
+    resetCompletions();
+    PFRAME_COMPLETION_TRACKER tracker = FctCreate(completeFrame);
+    CHECK(tracker != NULL);
+    
+    FctTrack(tracker);
+    FctTrack(tracker);
+    FctComplete(tracker, (void*)0, 0);
+    
+    // The decoder is holding on to one frame past the timeout, so -stop gives up on it
+    double start = TestGetTime();
+    CHECK_EQ(FctFinish(tracker, 50), 1);
+    CHECK(TestGetTime() - start >= 0.04);
+    CHECK_EQ(FctGetOutstandingFrames(tracker), 1);
+    FctRelease(tracker);
+    
+    // The outstanding frame keeps the tracker alive, but it must not be completed
+    // after the connection is gone. The tracker is freed here (ASan checks this).
+    FctComplete(tracker, (void*)1, 0);
+    CHECK_EQ(atomic_load(&completedFrames), 1);
+    CHECK_EQ(atomic_load(&completionsByFrame[1]), 0);
+}
+
+static void testConcurrentCompletions(void)
+{
+    enum { THREADS = 8, FRAMES_PER_THREAD = MAX_FRAMES / THREADS, ROUNDS = 2000 };
+    
+    for (int round = 0; round < ROUNDS; round++) {
+        resetCompletions();
+        PFRAME_COMPLETION_TRACKER tracker = FctCreate(completeFrame);
+        CHECK(tracker != NULL);
+        
+        pthread_t threads[THREADS];
+        DECODER_THREAD_CONTEXT ctx[THREADS];
+        for (int i = 0; i < THREADS; i++) {
+            for (int j = 0; j < FRAMES_PER_THREAD; j++) {
+                FctTrack(tracker);
+            }
+            ctx[i] = (DECODER_THREAD_CONTEXT){ tracker, i * FRAMES_PER_THREAD, FRAMES_PER_THREAD, 0 };
+            CHECK(pthread_create(&threads[i], NULL, decoderThread, &ctx[i]) == 0);
+        }
+        
+        // The wait races with completions on every decoder thread
+        CHECK(FctWaitForIdle(tracker, 5000));
+        CHECK_EQ(atomic_load(&completedFrames), MAX_FRAMES);
+        FctRelease(tracker);
+        
+        for (int i = 0; i < THREADS; i++) {
+            pthread_join(threads[i], NULL);
+        }
+        for (int i = 0; i < MAX_FRAMES; i++) {
+            CHECK_EQ(atomic_load(&completionsByFrame[i]), 1);
+        }
+    }
+}
+
+int main(void)
+{
+    RUN_TEST(testEachFrameCompletesOnce);
+    RUN_TEST(testStopWaitsForLateCompletions);
+    RUN_TEST(testQueuedFramesAreCompletedAtStop);
+    RUN_TEST(testAbandonedFramesAreNotCompleted);
+    RUN_TEST(testConcurrentCompletions);
+    return 0;
+}
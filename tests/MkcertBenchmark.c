@@ -0,0 +1,75 @@
+//
+//  MkcertBenchmark.c
+//  Moonlight
+//
+//  Copyright © 2026 Moonlight Game Streaming Project. All rights reserved.
+//
+//  Reports how long mkcert takes to generate a client identity for each key
+//  type, and checks that every certificate, key and PKCS#12 it produces is
+//  usable.
+//
+
+#include "mkcert.h"
+#include "TestCommon.h"
+
+#define MIN_BENCH_TIME 2.0
+#define MIN_ITERATIONS 3
+
+// Same password as generateCertKeyPairWithType()
+#define P12_PASSWORD "limelight"
+
+static void checkCertKeyPair(CertKeyPair pair, int keyType)
+{
+    CHECK(pair.x509 != NULL);
+    CHECK(pair.pkey != NULL);
+    CHECK(pair.p12 != NULL);
+    
+    CHECK_EQ(EVP_PKEY_base_id(pair.pkey), keyType);
+    CHECK_EQ(X509_verify(pair.x509, pair.pkey), 1);
+    CHECK_EQ(PKCS12_verify_mac(pair.p12, P12_PASSWORD, -1), 1);
+    
+    // What SecPKCS12Import() gets out of it
+    EVP_PKEY* pkey = NULL;
+    X509* x509 = NULL;
+    CHECK_EQ(PKCS12_parse(pair.p12, P12_PASSWORD, &pkey, &x509, NULL), 1);
+    CHECK_EQ(X509_cmp(x509, pair.x509), 0);
+    CHECK_EQ(X509_check_private_key(pair.x509, pkey), 1);
+    EVP_PKEY_free(pkey);
+    X509_free(x509);
+}
+
+static void benchmarkKeyType(const char* name, CertKeyType certKeyType, int keyType)
+{
+    double total = 0, fastest = 0, slowest = 0;
+    int iterations = 0;
+    
+    while (total < MIN_BENCH_TIME || iterations < MIN_ITERATIONS) {
+        double start = TestGetTime();
+        CertKeyPair pair = generateCertKeyPairWithType(certKeyType);
+        double elapsed = TestGetTime() - start;
+        
+        checkCertKeyPair(pair, keyType);
+        freeCertKeyPair(pair);
+        
+        if (iterations == 0 || elapsed < fastest) {
+            fastest = elapsed;
+        }
+        if (elapsed > slowest) {
+            slowest = elapsed;
+        }
+        total += elapsed;
+        iterations++;
+    }
+    
+    // RSA keygen time varies a lot with how long it takes to find primes
+    printf("  %-12s %8.2f ms per pair  (%.2f-%.2f ms, %d pairs)\n", name,
+           total / iterations * 1000, fastest * 1000, slowest * 1000, iterations);
+}
+
+int main(void)
+{
+    printf("%s\n", OpenSSL_version(OPENSSL_VERSION));
+    benchmarkKeyType("RSA-2048", CertKeyTypeRsa2048, EVP_PKEY_RSA);
+    benchmarkKeyType("ECDSA P-256", CertKeyTypeEcdsaP256, EVP_PKEY_EC);
+    return 0;
+}
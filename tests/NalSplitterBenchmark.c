@@ -0,0 +1,134 @@
+//
+//  NalSplitterBenchmark.c
+//  Moonlight
+//
+//  Copyright © 2026 Moonlight Game Streaming Project. All rights reserved.
+//
+//  Reports the NAL splitting throughput of every start code kernel supported by
+//  this CPU. Real H.264/HEVC Annex B streams can be passed as arguments, e.g.
+//  extracted with: ffmpeg -i input.mkv -c:v copy -bsf:v h264_mp4toannexb out.h264
+//
+
+#include "NalSplitter.h"
+#include "TestCommon.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#define SYNTHETIC_STREAM_SIZE (64 * 1024 * 1024)
+#define MIN_BENCH_TIME 0.5
+
+// Builds a stream that looks like encoded video: random slice data with emulation
+// prevention applied, split into NAL units of 100 bytes to 256 KB with 4 byte start codes.
+static uint8_t* createSyntheticStream(size_t length)
+{
+    uint8_t* data = malloc(length);
+    unsigned int seed = 1;
+    size_t i = 0;
+    
+    if (data == NULL) {
+        return NULL;
+    }
+    
+    while (i < length) {
+        size_t nalLength = 100 + rand_r(&seed) % (256 * 1024);
+        int zeros = 0;
+        
+        for (int j = 0; j < 4 && i < length; j++) {
+            data[i++] = j < 3 ? 0 : 1;
+        }
+        
+        for (size_t j = 0; j < nalLength && i < length; j++) {
+            // Entropy coded data has plenty of zero bytes
+            uint8_t b = rand_r(&seed) % 4 == 0 ? 0 : (uint8_t)rand_r(&seed);
+            if (zeros >= 2 && b <= 3) {
+                data[i++] = 3;
+                zeros = 0;
+                if (i == length) {
+                    break;
+                }
+            }
+            data[i++] = b;
+            zeros = b == 0 ? zeros + 1 : 0;
+        }
+    }
+    
+    return data;
+}
+
+static uint8_t* readFile(const char* path, size_t* length)
+{
+    FILE* file = fopen(path, "rb");
+    uint8_t* data = NULL;
+    long size;
+    
+    if (file == NULL) {
+        return NULL;
+    }
+    
+    if (fseek(file, 0, SEEK_END) == 0 && (size = ftell(file)) > 0 && fseek(file, 0, SEEK_SET) == 0) {
+        data = malloc(size);
+        if (data != NULL && fread(data, 1, size, file) != (size_t)size) {
+            free(data);
+            data = NULL;
+        }
+        *length = size;
+    }
+    
+    fclose(file);
+    return data;
+}
+
+static void countNalUnit(void* context, size_t offset, size_t length)
+{
+    (*(size_t*)context)++;
+}
+
+static void benchmarkStream(const char* name, const uint8_t* data, size_t length)
+{
+    printf("%s (%.1f MB)\n", name, length / (1024.0 * 1024.0));
+    
+    for (NAL_KERNEL kernel = 0; kernel < NAL_KERNEL_COUNT; kernel++) {
+        if (!NalIsKernelSupported(kernel)) {
+            continue;
+        }
+        
+        size_t units = 0;
+        int iterations = 0;
+        double start = TestGetTime();
+        double elapsed;
+        do {
+            NAL_SPLITTER splitter;
+            NalSplitterInit(&splitter, kernel);
+            NalSplitterFeed(&splitter, data, length, countNalUnit, &units);
+            NalSplitterFinish(&splitter, countNalUnit, &units);
+            iterations++;
+            elapsed = TestGetTime() - start;
+        } while (elapsed < MIN_BENCH_TIME);
+        
+        printf("  %-8s %7.2f GB/s  (%zu NAL units)\n", NalGetKernelName(kernel),
+               (double)length * iterations / elapsed / 1e9, units / iterations);
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    uint8_t* synthetic = createSyntheticStream(SYNTHETIC_STREAM_SIZE);
+    CHECK(synthetic != NULL);
+    benchmarkStream("synthetic", synthetic, SYNTHETIC_STREAM_SIZE);
+    free(synthetic);
+    
+    for (int i = 1; i < argc; i++) {
+        size_t length;
+        uint8_t* data = readFile(argv[i], &length);
+        if (data == NULL) {
+            fprintf(stderr, "Unable to read %s\n", argv[i]);
+            return 1;
+        }
+        
+        benchmarkStream(argv[i], data, length);
+        free(data);
+    }
+    
+    return 0;
+}
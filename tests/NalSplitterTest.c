@@ -0,0 +1,211 @@
+//
+//  NalSplitterTest.c
+//  Moonlight
+//
+//  Copyright © 2026 Moonlight Game Streaming Project. All rights reserved.
+//
+//  Checks every start code kernel supported by this CPU against a byte-at-a-time
+//  reference scan, which is what the renderer used to do.
+//
+
+#include "NalSplitter.h"
+#include "TestCommon.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#define MAX_UNITS 4096
+
+// Finds NAL units the way the renderer's old per-byte loop did
+static size_t referenceSplit(const uint8_t* data, size_t length, PNAL_UNIT units)
+{
+    size_t count = 0;
+    
+    for (size_t i = 0; i + 2 < length; i++) {
+        if (data[i] == 0 && data[i + 1] == 0 && data[i + 2] == 1) {
+            if (count > 0) {
+                units[count - 1].length = i - units[count - 1].offset;
+            }
+            units[count].offset = i;
+            count++;
+            i += 2;
+        }
+    }
+    
+    if (count > 0) {
+        units[count - 1].length = length - units[count - 1].offset;
+    }
+    
+    return count;
+}
+
+// Mostly zeros and ones, so start codes and near misses are everywhere
+static void fillStartCodeHeavy(uint8_t* data, size_t length, unsigned int* seed)
+{
+    for (size_t i = 0; i < length; i++) {
+        int r = rand_r(seed) % 8;
+        data[i] = r < 4 ? 0 : (r < 6 ? 1 : (uint8_t)rand_r(seed));
+    }
+}
+
+static void checkUnits(PNAL_UNIT expected, size_t expectedCount, PNAL_UNIT actual, size_t actualCount)
+{
+    CHECK_EQ(actualCount, expectedCount);
+    for (size_t i = 0; i < expectedCount; i++) {
+        CHECK_EQ(actual[i].offset, expected[i].offset);
+        CHECK_EQ(actual[i].length, expected[i].length);
+    }
+}
+
+static void testFindStartCodeAtEveryPosition(void)
+{
+    // Exactly sized allocations, so ASan catches any overread past the end
+    for (size_t length = 0; length <= 80; length++) {
+        for (size_t position = 0; position <= length; position++) {
+            uint8_t* data = malloc(length > 0 ? length : 1);
+            CHECK(data != NULL);
+            memset(data, 0xFF, length);
+            if (position + 3 <= length) {
+                data[position] = 0;
+                data[position + 1] = 0;
+                data[position + 2] = 1;
+            }
+            size_t expected = position + 3 <= length ? position : length;
+            
+            for (NAL_KERNEL kernel = 0; kernel < NAL_KERNEL_COUNT; kernel++) {
+                if (NalIsKernelSupported(kernel)) {
+                    CHECK_EQ(NalFindStartCode(kernel, data, length), expected);
+                }
+            }
+            
+            free(data);
+        }
+    }
+}
+
+static void testSplitMatchesReference(void)
+{
+    static NAL_UNIT expected[MAX_UNITS], actual[MAX_UNITS];
+    unsigned int seed = 1;
+    
+    for (int round = 0; round < 200; round++) {
+        size_t length = 1 + rand_r(&seed) % 8192;
+        uint8_t* data = malloc(length);
+        CHECK(data != NULL);
+        fillStartCodeHeavy(data, length, &seed);
+        
+        size_t expectedCount = referenceSplit(data, length, expected);
+        CHECK(expectedCount < MAX_UNITS);
+        
+        for (NAL_KERNEL kernel = 0; kernel < NAL_KERNEL_COUNT; kernel++) {
+            if (NalIsKernelSupported(kernel)) {
+                size_t count = NalSplitAnnexB(kernel, data, length, actual, MAX_UNITS);
+                checkUnits(expected, expectedCount, actual, count);
+            }
+        }
+        
+        free(data);
+    }
+}
+
+typedef struct _COLLECT_CONTEXT {
+    PNAL_UNIT units;
+    size_t count;
+} COLLECT_CONTEXT, *PCOLLECT_CONTEXT;
+
+static void collectNalUnit(void* context, size_t offset, size_t length)
+{
+    PCOLLECT_CONTEXT ctx = context;
+    
+    CHECK(ctx->count < MAX_UNITS);
+    ctx->units[ctx->count].offset = offset;
+    ctx->units[ctx->count].length = length;
+    ctx->count++;
+}
+
+static void testStartCodesStraddlingBuffers(void)
+{
+    static NAL_UNIT expected[MAX_UNITS], actual[MAX_UNITS];
+    unsigned int seed = 2;
+    
+    for (int round = 0; round < 500; round++) {
+        size_t length = 1 + rand_r(&seed) % 2048;
+        uint8_t* data = malloc(length);
+        CHECK(data != NULL);
+        fillStartCodeHeavy(data, length, &seed);
+        size_t expectedCount = referenceSplit(data, length, expected);
+        
+        for (NAL_KERNEL kernel = 0; kernel < NAL_KERNEL_COUNT; kernel++) {
+            if (!NalIsKernelSupported(kernel)) {
+                continue;
+            }
+            
+            // Feed the data in pieces of 1 to 40 bytes, like a decode unit's buffer list.
+            // Each piece is copied to its own allocation so overreads are caught.
+            NAL_SPLITTER splitter;
+            COLLECT_CONTEXT ctx = { actual, 0 };
+            NalSplitterInit(&splitter, kernel);
+            for (size_t offset = 0; offset < length; ) {
+                size_t pieceLength = 1 + rand_r(&seed) % 40;
+                if (pieceLength > length - offset) {
+                    pieceLength = length - offset;
+                }
+                
+                uint8_t* piece = malloc(pieceLength);
+                CHECK(piece != NULL);
+                memcpy(piece, &data[offset], pieceLength);
+                NalSplitterFeed(&splitter, piece, pieceLength, collectNalUnit, &ctx);
+                free(piece);
+                
+                offset += pieceLength;
+            }
+            NalSplitterFinish(&splitter, collectNalUnit, &ctx);
+            
+            checkUnits(expected, expectedCount, actual, ctx.count);
+        }
+        
+        free(data);
+    }
+}
+
+static void testFourByteStartCodes(void)
+{
+    // SPS, PPS and an IDR slice with 4 byte start codes, as sent by most encoders
+    static const uint8_t frame[] = {
+        0x00, 0x00, 0x00, 0x01, 0x67, 0x64, 0x00, 0x28,
+        0x00, 0x00, 0x00, 0x01, 0x68, 0xEE, 0x3C, 0x80,
+        0x00, 0x00, 0x01, 0x65, 0x88, 0x84, 0x00, 0x00, 0x03, 0x00, 0x21,
+    };
+    NAL_UNIT units[4];
+    
+    for (NAL_KERNEL kernel = 0; kernel < NAL_KERNEL_COUNT; kernel++) {
+        if (!NalIsKernelSupported(kernel)) {
+            continue;
+        }
+        
+        // The leading zero of a 4 byte start code is trailing data of the previous NAL unit.
+        // Emulation prevention bytes (00 00 03) are not start codes.
+        CHECK_EQ(NalSplitAnnexB(kernel, frame, sizeof(frame), units, 4), 3);
+        CHECK_EQ(units[0].offset, 1);
+        CHECK_EQ(units[0].length, 8);
+        CHECK_EQ(units[1].offset, 9);
+        CHECK_EQ(units[1].length, 7);
+        CHECK_EQ(units[2].offset, 16);
+        CHECK_EQ(units[2].length, sizeof(frame) - 16);
+    }
+}
+
+int main(void)
+{
+    for (NAL_KERNEL kernel = 0; kernel < NAL_KERNEL_COUNT; kernel++) {
+        if (NalIsKernelSupported(kernel)) {
+            printf("  testing %s kernel\n", NalGetKernelName(kernel));
+        }
+    }
+    
+    RUN_TEST(testFindStartCodeAtEveryPosition);
+    RUN_TEST(testSplitMatchesReference);
+    RUN_TEST(testStartCodesStraddlingBuffers);
+    RUN_TEST(testFourByteStartCodes);
+    return 0;
+}
@@ -0,0 +1,367 @@
+//
+//  PacingEngineTest.c
+//  Moonlight
+//
+//  Copyright © 2026 Moonlight Game Streaming Project. All rights reserved.
+//
+//  Replays frame arrival traces through the pacing engine with the same queue
+//  handling as -displayLinkCallback:, and compares it with fixed queue depths.
+//  Run with a file of arrival times (seconds, one per line) to replay a
+//  captured trace instead of the tests:
+//
+//    build/PacingEngineTest trace.txt [fps]
+//
+
+#include "PacingEngine.h"
+#include "TestCommon.h"
+
+#include <math.h>
+#include <string.h>
+
+#define FPS 60
+#define INTERVAL (1.0 / FPS)
+
+// Same as VideoDecoderRenderer
+#define MAX_DEPTH 3
+
+#define MAX_FRAMES (FPS * 120)
+
+// Policies other than the adaptive engine hold a fixed number of frames
+#define POLICY_ADAPTIVE -1
+
+typedef struct _SIMULATOR {
+    PACING_ENGINE engine;
+    double interval;
+    int policy;
+    
+    const double* arrivals;
+    int frameCount;
+    int nextFrame;
+    
+    // Display refreshes happen at multiples of the interval
+    long refreshes;
+    
+    int framesShown;
+    double totalLatency;
+    int maxTargetDepth;
+} SIMULATOR, *PSIMULATOR;
+
+static void simInitWithPolicy(PSIMULATOR sim, const double* arrivals, int frameCount, int frameRate, int policy)
+{
+    memset(sim, 0, sizeof(*sim));
+    PeInit(&sim->engine, frameRate, MAX_DEPTH);
+    sim->interval = 1.0 / frameRate;
+    sim->policy = policy;
+    sim->arrivals = arrivals;
+    sim->frameCount = frameCount;
+}
+
+static void simInit(PSIMULATOR sim, const double* arrivals, int frameCount, int frameRate)
+{
+    simInitWithPolicy(sim, arrivals, frameCount, frameRate, POLICY_ADAPTIVE);
+}
+
+// Runs display refreshes up to the given time
+static void simRun(PSIMULATOR sim, double until)
+{
+    double now;
+    
+    while ((now = (sim->refreshes + 1) * sim->interval) <= until) {
+        // The engine still sees every frame under a fixed policy, so it counts
+        // underruns the same way
+        int targetDepth = PeGetTargetDepth(&sim->engine, now);
+        int newFrame = 0;
+        
+        if (sim->policy != POLICY_ADAPTIVE) {
+            targetDepth = sim->policy;
+        }
+        
+        sim->refreshes++;
+        if (targetDepth > sim->maxTargetDepth) {
+            sim->maxTargetDepth = targetDepth;
+        }
+        
+        // Frames that have arrived by now are in the prepared frame queue
+        int queued = sim->nextFrame;
+        while (queued < sim->frameCount && sim->arrivals[queued] <= now) {
+            queued++;
+        }
+        
+        while (sim->nextFrame < queued) {
+            PeRecordArrival(&sim->engine, sim->arrivals[sim->nextFrame]);
+            sim->totalLatency += now - sim->arrivals[sim->nextFrame];
+            sim->framesShown++;
+            sim->nextFrame++;
+            newFrame = 1;
+            
+            if (queued - sim->nextFrame <= targetDepth) {
+                break;
+            }
+        }
+        
+        PeRecordRefresh(&sim->engine, now, newFrame);
+    }
+}
+
+// Frames arriving mid-way between refreshes, starting at the given time
+static int steadyTrace(double* arrivals, int count, double start, int frames)
+{
+    for (int i = 0; i < frames; i++) {
+        arrivals[count++] = start + (i + 0.5) * INTERVAL;
+    }
+    return count;
+}
+
+// Delays one frame, keeping the frames after it in order
+static void delayFrame(double* arrivals, int count, int frame, double delay)
+{
+    arrivals[frame] += delay;
+    for (int i = frame + 1; i < count && arrivals[i] < arrivals[i - 1]; i++) {
+        arrivals[i] = arrivals[i - 1];
+    }
+}
+
+static double arrivals[MAX_FRAMES];
+
+typedef struct _POLICY_RESULT {
+    double averageLatency;
+    uint32_t underruns;
+} POLICY_RESULT, *PPOLICY_RESULT;
+
+// Replays a trace through fixed depths of 0 and 1 and the adaptive engine,
+// printing the latency and stutter of each
+static void comparePolicies(const char* name, int count, int frameRate, POLICY_RESULT results[3])
+{
+    static const int policies[] = { 0, 1, POLICY_ADAPTIVE };
+    
+    printf("  %s:\n", name);
+    for (int i = 0; i < 3; i++) {
+        SIMULATOR sim;
+        
+        simInitWithPolicy(&sim, arrivals, count, frameRate, policies[i]);
+        simRun(&sim, arrivals[count - 1] + 1);
+        CHECK_EQ(sim.framesShown, count);
+        
+        results[i].averageLatency = sim.totalLatency / sim.framesShown;
+        results[i].underruns = sim.engine.underruns;
+        if (policies[i] == POLICY_ADAPTIVE) {
+            printf("    adaptive: ");
+        }
+        else {
+            printf("    depth %d:  ", policies[i]);
+        }
+        printf("%6.2f ms average latency, %4u underruns\n", results[i].averageLatency * 1000, results[i].underruns);
+    }
+}
+
+static void testSteadyStreamNeedsNoExtraDepth(void)
+{
+    SIMULATOR sim;
+    int count = steadyTrace(arrivals, 0, 0, FPS * 10);
+    
+    simInit(&sim, arrivals, count, FPS);
+    simRun(&sim, 10.5);
+    
+    CHECK_EQ(sim.framesShown, count);
+    CHECK_EQ(sim.engine.underruns, 0);
+    CHECK(sim.maxTargetDepth <= 1);
+    CHECK(sim.engine.peakJitter < INTERVAL * 0.01);
+}
+
+static void testIdleHostIsNotJitterOrUnderrun(void)
+{
+    SIMULATOR sim;
+    
+    // The host stops sending for 3 seconds on a static screen
+    int count = steadyTrace(arrivals, 0, 0, FPS * 5);
+    count = steadyTrace(arrivals, count, 8, FPS * 5);
+    
+    simInit(&sim, arrivals, count, FPS);
+    simRun(&sim, 13.5);
+    
+    CHECK_EQ(sim.framesShown, count);
+    CHECK_EQ(sim.engine.underruns, 0);
+    CHECK(sim.maxTargetDepth <= 1);
+    CHECK(sim.engine.peakJitter < INTERVAL * 0.01);
+}
+
+static void testHostFrameRateBelowStreamRateIsNotUnderrun(void)
+{
+    SIMULATOR sim;
+    int count = 0;
+    
+    // A game rendering at half the stream frame rate
+    for (int i = 0; i < FPS * 5; i++) {
+        arrivals[count++] = (i * 2 + 0.5) * INTERVAL;
+    }
+    
+    // The engine learns the host's frame rate from the first few frames, so
+    // even the start of the stream doesn't look late
+    simInit(&sim, arrivals, count, FPS);
+    simRun(&sim, 0.5);
+    CHECK(fabs(sim.engine.arrivalInterval - INTERVAL * 2) < INTERVAL * 0.01);
+    
+    simRun(&sim, 11);
+    CHECK_EQ(sim.framesShown, count);
+    CHECK_EQ(sim.engine.underruns, 0);
+    
+    // A steady half-rate host has no jitter to absorb
+    CHECK_EQ(sim.engine.targetDepth, 0);
+}
+
+static void testLateFrameIsUnderrun(void)
+{
+    SIMULATOR sim;
+    int count = steadyTrace(arrivals, 0, 0, FPS * 10);
+    
+    // Arrives after the refresh it was due for
+    delayFrame(arrivals, count, FPS, INTERVAL * 1.3);
+    
+    simInit(&sim, arrivals, count, FPS);
+    simRun(&sim, 3);
+    
+    CHECK_EQ(sim.engine.underruns, 1);
+    CHECK_EQ(sim.engine.targetDepth, 2);
+}
+
+static void testUnderrunHoldExpiresIndependently(void)
+{
+    SIMULATOR sim;
+    int count = steadyTrace(arrivals, 0, 0, FPS * 60);
+    
+    delayFrame(arrivals, count, FPS, INTERVAL * 1.3);
+    
+    simInit(&sim, arrivals, count, FPS);
+    
+    // The underrun at 1 second holds the extra frame for 10 seconds
+    simRun(&sim, 10.5);
+    CHECK_EQ(sim.engine.underruns, 1);
+    CHECK_EQ(sim.engine.targetDepth, 2);
+    
+    // Then the depth steps back down every 5 seconds. Lowering the depth must
+    // not restart the hold, or the depth would bounce back up forever.
+    simRun(&sim, 30);
+    CHECK_EQ(sim.engine.underruns, 1);
+    CHECK_EQ(sim.engine.targetDepth, 0);
+    CHECK(sim.maxTargetDepth == 2);
+}
+
+static void testJitteryNetworkSettlesWithoutUnderruns(void)
+{
+    SIMULATOR sim;
+    uint32_t seed = 1;
+    int count = 0;
+    
+    // Each frame is delayed by up to 1.5 frame intervals
+    for (int i = 0; i < FPS * 60; i++) {
+        seed = seed * 1664525 + 1013904223;
+        arrivals[count] = (i + 0.5) * INTERVAL + (seed >> 8) / (double)(1 << 24) * INTERVAL * 1.5;
+        if (count > 0 && arrivals[count] < arrivals[count - 1]) {
+            arrivals[count] = arrivals[count - 1];
+        }
+        count++;
+    }
+    
+    simInit(&sim, arrivals, count, FPS);
+    simRun(&sim, 5);
+    uint32_t initialUnderruns = sim.engine.underruns;
+    CHECK(sim.engine.targetDepth >= 1);
+    
+    // Once the depth covers the jitter, we stop running dry
+    simRun(&sim, 61);
+    printf("  %u underruns while settling, %u after\n", initialUnderruns, sim.engine.underruns - initialUnderruns);
+    CHECK(sim.engine.underruns - initialUnderruns <= 1);
+    CHECK_EQ(sim.framesShown, count);
+}
+
+static void testPolicyComparison(void)
+{
+    POLICY_RESULT results[3];
+    uint32_t seed = 1;
+    int count;
+    
+    // One late frame leaves a fixed depth of 1 a frame behind for good, while
+    // adaptive pacing gives the latency back once the stream is steady again...
+    count = steadyTrace(arrivals, 0, 0, FPS * 60);
+    delayFrame(arrivals, count, FPS, INTERVAL * 1.3);
+    comparePolicies("steady with one late frame", count, FPS, results);
+    CHECK_EQ(results[2].underruns, 1);
+    CHECK(results[2].averageLatency < results[1].averageLatency);
+    
+    // ...or never takes it at all for a host rendering below the stream rate...
+    count = 0;
+    for (int i = 0; i < FPS * 15; i++) {
+        arrivals[count++] = (i * 2 + 0.5) * INTERVAL;
+    }
+    comparePolicies("half rate host", count, FPS, results);
+    CHECK_EQ(results[2].underruns, 0);
+    CHECK(results[2].averageLatency <= results[0].averageLatency + 1e-9);
+    
+    // ...and stutters about as little as a fixed depth of 1 when there's jitter
+    count = 0;
+    for (int i = 0; i < FPS * 60; i++) {
+        seed = seed * 1664525 + 1013904223;
+        arrivals[count] = (i + 0.5) * INTERVAL + (seed >> 8) / (double)(1 << 24) * INTERVAL * 1.5;
+        if (count > 0 && arrivals[count] < arrivals[count - 1]) {
+            arrivals[count] = arrivals[count - 1];
+        }
+        count++;
+    }
+    comparePolicies("jittery network", count, FPS, results);
+    CHECK(results[2].underruns * 10 < results[0].underruns);
+    CHECK(results[2].underruns <= results[1].underruns + 1);
+}
+
+static int replayTrace(const char* path, int frameRate)
+{
+    FILE* file = fopen(path, "r");
+    SIMULATOR sim;
+    int count = 0;
+    
+    if (file == NULL) {
+        perror(path);
+        return 1;
+    }
+    while (count < MAX_FRAMES && fscanf(file, "%lf", &arrivals[count]) == 1) {
+        count++;
+    }
+    fclose(file);
+    
+    if (count == 0) {
+        fprintf(stderr, "%s: no arrival times\n", path);
+        return 1;
+    }
+    
+    // Replay relative to the first arrival
+    double start = arrivals[0];
+    for (int i = 0; i < count; i++) {
+        arrivals[i] -= start;
+    }
+    
+    simInit(&sim, arrivals, count, frameRate);
+    simRun(&sim, arrivals[count - 1] + 1);
+    
+    printf("%d frames, %u underruns, max depth %d, final depth %d, %.2f ms average latency\n",
+           sim.framesShown, sim.engine.underruns, sim.maxTargetDepth, sim.engine.targetDepth,
+           sim.totalLatency / sim.framesShown * 1000);
+    
+    POLICY_RESULT results[3];
+    comparePolicies(path, count, frameRate, results);
+    return 0;
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc > 1) {
+        return replayTrace(argv[1], argc > 2 ? atoi(argv[2]) : FPS);
+    }
+    
+    RUN_TEST(testSteadyStreamNeedsNoExtraDepth);
+    RUN_TEST(testIdleHostIsNotJitterOrUnderrun);
+    RUN_TEST(testHostFrameRateBelowStreamRateIsNotUnderrun);
+    RUN_TEST(testLateFrameIsUnderrun);
+    RUN_TEST(testUnderrunHoldExpiresIndependently);
+    RUN_TEST(testJitteryNetworkSettlesWithoutUnderruns);
+    RUN_TEST(testPolicyComparison);
+    return 0;
+}
@@ -0,0 +1,290 @@
+//
+//  PairingCryptoBenchmark.c
+//  Moonlight
+//
+//  Copyright © 2026 Moonlight Game Streaming Project. All rights reserved.
+//
+//  Times the crypto steps CryptoManager performs while pairing, with the same
+//  OpenSSL calls. Steps that take the client identity or the server's
+//  certificate are timed both parsing the PEM on every call, as CryptoManager
+//  used to, and with the parsed key and certificate cached, as it does now.
+//
+
+#include "mkcert.h"
+#include "TestCommon.h"
+
+#include <string.h>
+
+#include <openssl/evp.h>
+#include <openssl/pem.h>
+#include <openssl/rand.h>
+#include <openssl/sha.h>
+
+#define MIN_BENCH_TIME 0.5
+
+typedef struct _PEM_BUFFER {
+    char* data;
+    int length;
+} PEM_BUFFER, *PPEM_BUFFER;
+
+typedef struct _BENCH_CONTEXT {
+    // The client identity as CryptoManager stores it
+    PEM_BUFFER keyPem;
+    PEM_BUFFER certPem;
+    
+    // A second identity standing in for the server
+    PEM_BUFFER serverCertPem;
+    EVP_PKEY* serverKey;
+    
+    // What ClientIdentity and the peer certificate cache hold
+    EVP_PKEY* pkey;
+    X509* x509;
+    X509* serverX509;
+    
+    uint8_t data[48];
+    uint8_t aesKey[16];
+    uint8_t serverSignature[512];
+    size_t serverSignatureLength;
+    
+    int checksum;
+} BENCH_CONTEXT, *PBENCH_CONTEXT;
+
+typedef void (*BENCH_FN)(PBENCH_CONTEXT context);
+
+static void toPem(PPEM_BUFFER pem, EVP_PKEY* pkey, X509* x509)
+{
+    BIO* bio = BIO_new(BIO_s_mem());
+    BUF_MEM* mem;
+    
+    // Same formats as CryptoManager writes to disk
+    if (pkey != NULL) {
+        CHECK(PEM_write_bio_PrivateKey_traditional(bio, pkey, NULL, NULL, 0, NULL, NULL));
+    }
+    else {
+        CHECK(PEM_write_bio_X509(bio, x509));
+    }
+    
+    BIO_get_mem_ptr(bio, &mem);
+    pem->data = malloc(mem->length);
+    CHECK(pem->data != NULL);
+    memcpy(pem->data, mem->data, mem->length);
+    pem->length = (int)mem->length;
+    BIO_free(bio);
+}
+
+static EVP_PKEY* parseKey(PPEM_BUFFER pem)
+{
+    BIO* bio = BIO_new_mem_buf(pem->data, pem->length);
+    EVP_PKEY* pkey = PEM_read_bio_PrivateKey(bio, NULL, NULL, NULL);
+    BIO_free(bio);
+    return pkey;
+}
+
+static X509* parseX509(PPEM_BUFFER pem)
+{
+    BIO* bio = BIO_new_mem_buf(pem->data, pem->length);
+    X509* x509 = PEM_read_bio_X509(bio, NULL, NULL, NULL);
+    BIO_free(bio);
+    return x509;
+}
+
+static size_t sign(EVP_PKEY* pkey, const uint8_t* data, size_t length, uint8_t* signature, size_t signatureLength)
+{
+    EVP_MD_CTX* mdctx = EVP_MD_CTX_create();
+    
+    CHECK(EVP_DigestSignInit(mdctx, NULL, EVP_sha256(), NULL, pkey) == 1);
+    CHECK(EVP_DigestSignUpdate(mdctx, data, length) == 1);
+    CHECK(EVP_DigestSignFinal(mdctx, signature, &signatureLength) == 1);
+    EVP_MD_CTX_destroy(mdctx);
+    
+    return signatureLength;
+}
+
+static int verify(X509* x509, const uint8_t* data, size_t length, const uint8_t* signature, size_t signatureLength)
+{
+    EVP_PKEY* pubKey = X509_get_pubkey(x509);
+    EVP_MD_CTX* mdctx = EVP_MD_CTX_create();
+    
+    EVP_DigestVerifyInit(mdctx, NULL, EVP_sha256(), NULL, pubKey);
+    EVP_DigestVerifyUpdate(mdctx, data, length);
+    int result = EVP_DigestVerifyFinal(mdctx, signature, signatureLength);
+    
+    EVP_PKEY_free(pubKey);
+    EVP_MD_CTX_destroy(mdctx);
+    return result;
+}
+
+// -createAESKeyFromSaltSHA256: on the salt and PIN
+static void benchSha256(PBENCH_CONTEXT context)
+{
+    uint8_t hash[SHA256_DIGEST_LENGTH];
+    
+    SHA256(context->data, 20, hash);
+    context->checksum += hash[0];
+}
+
+// -encryptData:withKey: on a 32 byte challenge response
+static void benchAesEncrypt(PBENCH_CONTEXT context)
+{
+    EVP_CIPHER_CTX* cipher = EVP_CIPHER_CTX_new();
+    uint8_t output[sizeof(context->data)];
+    int outputLength;
+    
+    EVP_EncryptInit(cipher, EVP_aes_128_ecb(), context->aesKey, NULL);
+    EVP_CIPHER_CTX_set_padding(cipher, 0);
+    EVP_EncryptUpdate(cipher, output, &outputLength, context->data, 32);
+    EVP_CIPHER_CTX_free(cipher);
+    
+    context->checksum += output[0];
+}
+
+// -decryptData:withKey: on the server's 48 byte challenge response
+static void benchAesDecrypt(PBENCH_CONTEXT context)
+{
+    EVP_CIPHER_CTX* cipher = EVP_CIPHER_CTX_new();
+    uint8_t output[sizeof(context->data)];
+    int outputLength;
+    
+    EVP_DecryptInit(cipher, EVP_aes_128_ecb(), context->aesKey, NULL);
+    EVP_CIPHER_CTX_set_padding(cipher, 0);
+    EVP_DecryptUpdate(cipher, output, &outputLength, context->data, 48);
+    EVP_CIPHER_CTX_free(cipher);
+    
+    context->checksum += output[0];
+}
+
+// -signData:withKey: on the client pairing secret
+static void benchSignParsed(PBENCH_CONTEXT context)
+{
+    uint8_t signature[512];
+    
+    EVP_PKEY* pkey = parseKey(&context->keyPem);
+    CHECK(pkey != NULL);
+    context->checksum += (int)sign(pkey, context->data, 16, signature, sizeof(signature));
+    EVP_PKEY_free(pkey);
+}
+
+static void benchSignCached(PBENCH_CONTEXT context)
+{
+    uint8_t signature[512];
+    
+    context->checksum += (int)sign(context->pkey, context->data, 16, signature, sizeof(signature));
+}
+
+// -verifySignature:withSignature:andCert: on the server pairing secret
+static void benchVerifyParsed(PBENCH_CONTEXT context)
+{
+    X509* x509 = parseX509(&context->serverCertPem);
+    CHECK(x509 != NULL);
+    CHECK(verify(x509, context->data, 16, context->serverSignature, context->serverSignatureLength) == 1);
+    X509_free(x509);
+}
+
+static void benchVerifyCached(PBENCH_CONTEXT context)
+{
+    CHECK(verify(context->serverX509, context->data, 16, context->serverSignature, context->serverSignatureLength) == 1);
+}
+
+// -getSignatureFromCert: on the client certificate
+static void benchCertSignatureParsed(PBENCH_CONTEXT context)
+{
+    const ASN1_BIT_STRING* signature;
+    
+    X509* x509 = parseX509(&context->certPem);
+    CHECK(x509 != NULL);
+    X509_get0_signature(&signature, NULL, x509);
+    context->checksum += signature->length;
+    X509_free(x509);
+}
+
+static void benchCertSignatureCached(PBENCH_CONTEXT context)
+{
+    const ASN1_BIT_STRING* signature;
+    
+    X509_get0_signature(&signature, NULL, context->x509);
+    context->checksum += signature->length;
+}
+
+static double runBenchmark(const char* name, BENCH_FN fn, PBENCH_CONTEXT context)
+{
+    int iterations = 0;
+    double start = TestGetTime();
+    double elapsed;
+    
+    do {
+        fn(context);
+        iterations++;
+        elapsed = TestGetTime() - start;
+    } while (elapsed < MIN_BENCH_TIME);
+    
+    double perCall = elapsed / iterations;
+    printf("  %-28s %10.2f us per call\n", name, perCall * 1e6);
+    return perCall;
+}
+
+static void compareBenchmarks(const char* name, BENCH_FN parsed, BENCH_FN cached, PBENCH_CONTEXT context)
+{
+    char label[64];
+    
+    snprintf(label, sizeof(label), "%s (parsed)", name);
+    double parsedTime = runBenchmark(label, parsed, context);
+    snprintf(label, sizeof(label), "%s (cached)", name);
+    double cachedTime = runBenchmark(label, cached, context);
+    printf("  %-28s %10.1fx faster\n", "", parsedTime / cachedTime);
+}
+
+static void benchmarkIdentity(const char* name, CertKeyType keyType)
+{
+    BENCH_CONTEXT context;
+    
+    memset(&context, 0, sizeof(context));
+    
+    CertKeyPair client = generateCertKeyPairWithType(keyType);
+    CertKeyPair server = generateCertKeyPair();
+    CHECK(client.x509 != NULL && server.x509 != NULL);
+    
+    toPem(&context.keyPem, client.pkey, NULL);
+    toPem(&context.certPem, NULL, client.x509);
+    toPem(&context.serverCertPem, NULL, server.x509);
+    context.serverKey = server.pkey;
+    
+    context.pkey = parseKey(&context.keyPem);
+    context.x509 = parseX509(&context.certPem);
+    context.serverX509 = parseX509(&context.serverCertPem);
+    CHECK(context.pkey != NULL && context.x509 != NULL && context.serverX509 != NULL);
+    
+    CHECK(RAND_bytes(context.data, sizeof(context.data)) == 1);
+    CHECK(RAND_bytes(context.aesKey, sizeof(context.aesKey)) == 1);
+    context.serverSignatureLength = sign(context.serverKey, context.data, 16,
+                                         context.serverSignature, sizeof(context.serverSignature));
+    
+    printf("%s client identity\n", name);
+    runBenchmark("SHA-256", benchSha256, &context);
+    runBenchmark("AES-128-ECB encrypt", benchAesEncrypt, &context);
+    runBenchmark("AES-128-ECB decrypt", benchAesDecrypt, &context);
+    compareBenchmarks("sign", benchSignParsed, benchSignCached, &context);
+    compareBenchmarks("verify", benchVerifyParsed, benchVerifyCached, &context);
+    compareBenchmarks("cert signature", benchCertSignatureParsed, benchCertSignatureCached, &context);
+    
+    // A signature from the client identity checks out against its certificate
+    uint8_t signature[512];
+    size_t signatureLength = sign(context.pkey, context.data, 16, signature, sizeof(signature));
+    CHECK(verify(context.x509, context.data, 16, signature, signatureLength) == 1);
+    
+    EVP_PKEY_free(context.pkey);
+    X509_free(context.x509);
+    X509_free(context.serverX509);
+    free(context.keyPem.data);
+    free(context.certPem.data);
+    free(context.serverCertPem.data);
+    freeCertKeyPair(client);
+    freeCertKeyPair(server);
+}
+
+int main(void)
+{
+    printf("%s\n", OpenSSL_version(OPENSSL_VERSION));
+    benchmarkIdentity("RSA-2048", CertKeyTypeRsa2048);
+    benchmarkIdentity("ECDSA P-256", CertKeyTypeEcdsaP256);
+    return 0;
+}
@@ -0,0 +1,268 @@
+//
+//  PcmRingTest.c
+//  Moonlight
+//
+//  Copyright © 2026 Moonlight Game Streaming Project. All rights reserved.
+//
+//  Drives the PCM ring with a host clock that drifts from the device clock
+//  and checks that drift correction keeps the fill level bounded without
+//  underruns or audible discontinuities.
+//
+
+#include "PcmRing.h"
+#include "TestCommon.h"
+
+#include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <string.h>
+
+// Same as the stream's Opus configuration: 48 kHz stereo in 5 ms packets, with
+// the ring targeting 3 packets
+#define SAMPLE_RATE 48000
+#define CHANNELS 2
+#define PACKET_FRAMES 240
+#define TARGET_FRAMES (PACKET_FRAMES * 3)
+
+// ArInit() asks SDL for one packet per device callback
+#define CALLBACK_FRAMES PACKET_FRAMES
+
+// A 100 Hz tone changes by at most about 130 per sample, so anything much
+// larger is a click
+#define TONE_FREQUENCY 100
+#define TONE_AMPLITUDE 10000
+#define MAX_SAMPLE_STEP 200
+
+// Sound card and host clocks are usually within 100 ppm of each other, so this
+// is a generous 500 ppm over 10 minutes
+#define DRIFT 0.0005
+#define DRIFT_SECONDS 600
+
+typedef struct _DRIFT_RESULT {
+    PCM_RING_STATS stats;
+    size_t minQueuedFrames;
+    size_t maxQueuedFrames;
+    size_t finalQueuedFrames;
+    int maxSampleStep;
+} DRIFT_RESULT, *PDRIFT_RESULT;
+
+// Plays the given number of seconds of device time while the host produces
+// packets at (1 + drift) times the device rate. Time is simulated, so this is
+// deterministic and runs much faster than real time.
+static void runDrift(double drift, double seconds, PDRIFT_RESULT result)
+{
+    PCM_RING ring;
+    int16_t packet[PACKET_FRAMES * CHANNELS];
+    int16_t output[CALLBACK_FRAMES * CHANNELS];
+    double packetInterval = PACKET_FRAMES / (SAMPLE_RATE * (1 + drift));
+    double callbackInterval = (double)CALLBACK_FRAMES / SAMPLE_RATE;
+    double nextPacketTime = 0;
+    double nextCallbackTime = 0;
+    long framesWritten = 0;
+    int16_t lastSample = 0;
+    bool playing = false;
+    
+    CHECK(PcmRingInit(&ring, CHANNELS, TARGET_FRAMES));
+    memset(result, 0, sizeof(*result));
+    result->minQueuedFrames = SIZE_MAX;
+    
+    while (nextCallbackTime < seconds) {
+        if (nextPacketTime <= nextCallbackTime) {
+            for (int i = 0; i < PACKET_FRAMES; i++) {
+                double t = (double)(framesWritten + i) / SAMPLE_RATE;
+                int16_t sample = (int16_t)(sin(2 * M_PI * TONE_FREQUENCY * t) * TONE_AMPLITUDE);
+                for (int ch = 0; ch < CHANNELS; ch++) {
+                    packet[i * CHANNELS + ch] = sample;
+                }
+            }
+            PcmRingWrite(&ring, packet, PACKET_FRAMES);
+            framesWritten += PACKET_FRAMES;
+            nextPacketTime += packetInterval;
+            continue;
+        }
+        
+        PcmRingRead(&ring, output, CALLBACK_FRAMES);
+        nextCallbackTime += callbackInterval;
+        
+        size_t queuedFrames = PcmRingGetQueuedFrames(&ring);
+        playing = playing || !ring.refilling;
+        if (!playing) {
+            continue;
+        }
+        
+        if (queuedFrames < result->minQueuedFrames) {
+            result->minQueuedFrames = queuedFrames;
+        }
+        if (queuedFrames > result->maxQueuedFrames) {
+            result->maxQueuedFrames = queuedFrames;
+        }
+        
+        for (int i = 0; i < CALLBACK_FRAMES; i++) {
+            int step = abs(output[i * CHANNELS] - lastSample);
+            if (step > result->maxSampleStep) {
+                result->maxSampleStep = step;
+            }
+            lastSample = output[i * CHANNELS];
+        }
+    }
+    
+    result->finalQueuedFrames = PcmRingGetQueuedFrames(&ring);
+    PcmRingGetStats(&ring, &result->stats);
+    PcmRingDestroy(&ring);
+}
+
+static void printResult(double drift, PDRIFT_RESULT result)
+{
+    printf("  %+.2f%% drift: fill %zu-%zu frames, %u dropped, %u duplicated, %u underruns, max step %d\n",
+           drift * 100, result->minQueuedFrames, result->maxQueuedFrames,
+           result->stats.droppedFrames, result->stats.duplicatedFrames,
+           result->stats.underruns, result->maxSampleStep);
+}
+
+static void testNoDriftNeedsNoCorrection(void)
+{
+    DRIFT_RESULT result;
+    
+    runDrift(0, 60, &result);
+    printResult(0, &result);
+    
+    CHECK_EQ(result.stats.underruns, 0);
+    CHECK_EQ(result.stats.overflowFrames, 0);
+    CHECK_EQ(result.stats.droppedFrames, 0);
+    CHECK_EQ(result.stats.duplicatedFrames, 0);
+    CHECK(result.maxSampleStep <= MAX_SAMPLE_STEP);
+}
+
+static void testFastHostClockIsCorrected(void)
+{
+    DRIFT_RESULT result;
+    double drift = DRIFT;
+    
+    runDrift(drift, DRIFT_SECONDS, &result);
+    printResult(drift, &result);
+    
+    CHECK_EQ(result.stats.underruns, 0);
+    CHECK_EQ(result.stats.overflowFrames, 0);
+    CHECK_EQ(result.stats.duplicatedFrames, 0);
+    CHECK(result.maxQueuedFrames <= TARGET_FRAMES * 2 + CALLBACK_FRAMES + PACKET_FRAMES);
+    CHECK(result.maxSampleStep <= MAX_SAMPLE_STEP);
+    
+    // Every surplus frame that isn't still queued was merged away
+    double surplusFrames = drift * SAMPLE_RATE * DRIFT_SECONDS;
+    CHECK(fabs(result.stats.droppedFrames + (double)result.finalQueuedFrames - TARGET_FRAMES - surplusFrames) <
+          TARGET_FRAMES * 2);
+}
+
+static void testSlowHostClockIsCorrected(void)
+{
+    DRIFT_RESULT result;
+    double drift = -DRIFT;
+    
+    runDrift(drift, DRIFT_SECONDS, &result);
+    printResult(drift, &result);
+    
+    CHECK_EQ(result.stats.underruns, 0);
+    CHECK_EQ(result.stats.droppedFrames, 0);
+    CHECK(result.maxSampleStep <= MAX_SAMPLE_STEP);
+    
+    double deficitFrames = -drift * SAMPLE_RATE * DRIFT_SECONDS;
+    CHECK(fabs(result.stats.duplicatedFrames - (double)result.finalQueuedFrames + TARGET_FRAMES - deficitFrames) <
+          TARGET_FRAMES * 2);
+}
+
+static void testLargeFastDriftStaysBounded(void)
+{
+    DRIFT_RESULT result;
+    double drift = 0.02;
+    
+    // Beyond the slow correction, so the fast correction has to kick in
+    runDrift(drift, 60, &result);
+    printResult(drift, &result);
+    
+    CHECK_EQ(result.stats.underruns, 0);
+    CHECK_EQ(result.stats.overflowFrames, 0);
+    CHECK(result.maxQueuedFrames <= TARGET_FRAMES * 4 + CALLBACK_FRAMES + PACKET_FRAMES);
+    CHECK(result.maxSampleStep <= MAX_SAMPLE_STEP);
+}
+
+#define STRESS_FRAMES (SAMPLE_RATE * 20)
+
+static PCM_RING stressRing;
+static atomic_bool stressDone;
+
+// Every channel of a frame carries the same counter, so a frame mixed from
+// two writes shows up as channels that disagree
+static void* producerThread(void* context)
+{
+    int16_t packet[PACKET_FRAMES * CHANNELS];
+    int counter = 1;
+    
+    for (int written = 0; written < STRESS_FRAMES; written += PACKET_FRAMES) {
+        for (int i = 0; i < PACKET_FRAMES; i++) {
+            for (int ch = 0; ch < CHANNELS; ch++) {
+                packet[i * CHANNELS + ch] = (int16_t)counter;
+            }
+            counter = counter % 30000 + 1;
+        }
+        
+        // Wait for the consumer rather than overflowing
+        while (PcmRingGetQueuedFrames(&stressRing) > TARGET_FRAMES * 3) {
+            sched_yield();
+        }
+        PcmRingWrite(&stressRing, packet, PACKET_FRAMES);
+    }
+    
+    atomic_store(&stressDone, true);
+    return NULL;
+}
+
+static void testConcurrentProducerAndConsumer(void)
+{
+    pthread_t producer;
+    int16_t output[CALLBACK_FRAMES * CHANNELS];
+    int lastValue = 0;
+    long framesPlayed = 0;
+    
+    CHECK(PcmRingInit(&stressRing, CHANNELS, TARGET_FRAMES));
+    atomic_store(&stressDone, false);
+    CHECK(pthread_create(&producer, NULL, producerThread, NULL) == 0);
+    
+    while (!atomic_load(&stressDone) || PcmRingGetQueuedFrames(&stressRing) > 0) {
+        PcmRingRead(&stressRing, output, CALLBACK_FRAMES);
+        
+        for (int i = 0; i < CALLBACK_FRAMES; i++) {
+            int value = output[i * CHANNELS];
+            for (int ch = 1; ch < CHANNELS; ch++) {
+                CHECK_EQ(output[i * CHANNELS + ch], value);
+            }
+            
+            // Silence while refilling, otherwise the counter only moves forward
+            // (or wraps). Merged and interpolated frames land in between.
+            if (value != 0) {
+                CHECK(value >= lastValue || lastValue - value > 29000);
+                lastValue = value;
+                framesPlayed++;
+            }
+        }
+        
+        // Let the producer get ahead now and then like a real device would
+        if (framesPlayed % 7 == 0) {
+            sched_yield();
+        }
+    }
+    
+    CHECK(pthread_join(producer, NULL) == 0);
+    CHECK(framesPlayed > 0);
+    
+    PcmRingDestroy(&stressRing);
+}
+
+int main(void)
+{
+    RUN_TEST(testNoDriftNeedsNoCorrection);
+    RUN_TEST(testFastHostClockIsCorrected);
+    RUN_TEST(testSlowHostClockIsCorrected);
+    RUN_TEST(testLargeFastDriftStaysBounded);
+    RUN_TEST(testConcurrentProducerAndConsumer);
+    return 0;
+}
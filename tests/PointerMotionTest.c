@@ -0,0 +1,212 @@
+//
+//  PointerMotionTest.c
+//  Moonlight
+//
+//  Copyright © 2026 Moonlight Game Streaming Project. All rights reserved.
+//
+//  Checks that batched pointer motion is never lost, and that flushing it
+//  before a button event (as -flushMouseMotion does) keeps the button from
+//  overtaking motion that came before it. A mutex stands in for the serial
+//  controller send queue.
+//
+
+#include "PointerMotion.h"
+#include "TestCommon.h"
+
+#include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <string.h>
+
+#define BATCH_INTERVAL (1.0 / 60)
+
+static void testEarlyFlushDrainsPendingMotion(void)
+{
+    POINTER_MOTION motion;
+    int16_t deltaX, deltaY;
+    
+    PmInit(&motion, BATCH_INTERVAL);
+    
+    CHECK(PmAddMotion(&motion, 2.5f, -1.25f));
+    CHECK(!PmFlush(&motion, 1.0, &deltaX, &deltaY));
+    CHECK_EQ(deltaX, 2);
+    CHECK_EQ(deltaY, -1);
+    
+    // A button press right after is still inside the batch interval
+    CHECK(PmAddMotion(&motion, 3.75f, 0));
+    CHECK(PmGetFlushDelay(&motion, 1.001) > 0);
+    CHECK(!PmFlush(&motion, 1.001, &deltaX, &deltaY));
+    CHECK_EQ(deltaX, 4);
+    CHECK_EQ(deltaY, 0);
+    
+    // The scheduled flush that follows finds nothing left but the fraction
+    CHECK(!PmFlush(&motion, 1.0 + BATCH_INTERVAL, &deltaX, &deltaY));
+    CHECK_EQ(deltaX, 0);
+    CHECK_EQ(deltaY, 0);
+    CHECK(fabs(motion.remainderX - 0.25) < 1e-6);
+    CHECK(fabs(motion.remainderY + 0.25) < 1e-6);
+}
+
+static void testFractionalMotionIsPreserved(void)
+{
+    POINTER_MOTION motion;
+    uint32_t seed = 1;
+    double addedX = 0, addedY = 0;
+    long sentX = 0, sentY = 0;
+    double now = 1;
+    
+    PmInit(&motion, BATCH_INTERVAL);
+    
+    for (int i = 0; i < 100000; i++) {
+        // Small deltas like a high polling rate mouse or a slow finger
+        seed = seed * 1664525 + 1013904223;
+        float deltaX = ((int)(seed >> 16) % 2000 - 1000) / 1000.0f;
+        float deltaY = ((int)(seed & 0xFFFF) % 600 - 300) / 1000.0f;
+        PmAddMotion(&motion, deltaX, deltaY);
+        addedX += deltaX;
+        addedY += deltaY;
+        
+        now += 0.001;
+        
+        // Flush on the batch interval, with an early flush for a click now and then
+        if (PmGetFlushDelay(&motion, now) == 0 || seed % 97 == 0) {
+            int16_t flushedX, flushedY;
+            PmFlush(&motion, now, &flushedX, &flushedY);
+            sentX += flushedX;
+            sentY += flushedY;
+        }
+    }
+    
+    int16_t flushedX, flushedY;
+    PmFlush(&motion, now, &flushedX, &flushedY);
+    sentX += flushedX;
+    sentY += flushedY;
+    
+    // Everything was sent except less than a pixel
+    CHECK(fabs(sentX + motion.remainderX - addedX) < 0.01);
+    CHECK(fabs(sentY + motion.remainderY - addedY) < 0.01);
+    CHECK(fabs(motion.remainderX) < 1);
+    CHECK(fabs(motion.remainderY) < 1);
+}
+
+#define MOVES_PER_CLICK 10
+#define CLICKS 5000
+
+typedef enum {
+    EVENT_MOVE,
+    EVENT_BUTTON,
+} EVENT_TYPE;
+
+typedef struct _EVENT {
+    EVENT_TYPE type;
+    int16_t deltaX;
+    int16_t deltaY;
+    
+    // For buttons, the pixels that source had moved before clicking
+    int source;
+    long movedBefore;
+} EVENT;
+
+static POINTER_MOTION sharedMotion;
+static pthread_mutex_t sendQueue = PTHREAD_MUTEX_INITIALIZER;
+static EVENT* events;
+static int eventCount;
+static atomic_int sourcesRunning;
+
+// Must be called with sendQueue held
+static void sendPointerMotion(void)
+{
+    int16_t deltaX, deltaY;
+    
+    PmFlush(&sharedMotion, TestGetTime(), &deltaX, &deltaY);
+    if (deltaX != 0 || deltaY != 0) {
+        events[eventCount++] = (EVENT){ EVENT_MOVE, deltaX, deltaY, 0, 0 };
+    }
+}
+
+// Each source moves along its own axis, so we can tell whose motion was sent
+static void* sourceThread(void* context)
+{
+    int source = context != NULL;
+    long moved = 0;
+    
+    for (int i = 0; i < CLICKS; i++) {
+        for (int j = 0; j < MOVES_PER_CLICK; j++) {
+            PmAddMotion(&sharedMotion, source == 0 ? 1 : 0, source == 1 ? 1 : 0);
+            moved++;
+        }
+        
+        // Like -flushMouseMotion followed by LiSendMouseButtonEvent()
+        pthread_mutex_lock(&sendQueue);
+        sendPointerMotion();
+        events[eventCount++] = (EVENT){ EVENT_BUTTON, 0, 0, source, moved };
+        pthread_mutex_unlock(&sendQueue);
+    }
+    
+    atomic_fetch_sub(&sourcesRunning, 1);
+    return NULL;
+}
+
+// The batched flushes scheduled on the send queue
+static void* flushThread(void* context)
+{
+    while (atomic_load(&sourcesRunning) > 0) {
+        pthread_mutex_lock(&sendQueue);
+        if (PmGetFlushDelay(&sharedMotion, TestGetTime()) == 0) {
+            sendPointerMotion();
+        }
+        pthread_mutex_unlock(&sendQueue);
+        sched_yield();
+    }
+    
+    return NULL;
+}
+
+static void testButtonsNeverOvertakeMotion(void)
+{
+    pthread_t sources[2], flusher;
+    static int secondSource;
+    long sent[2] = { 0, 0 };
+    int buttons = 0;
+    
+    // Room for a move and a button per click and a move per batch
+    events = calloc(CLICKS * 2 * 4 + 100000, sizeof(*events));
+    CHECK(events != NULL);
+    eventCount = 0;
+    
+    // No batch interval, so the flusher races the sources as hard as it can
+    PmInit(&sharedMotion, 0);
+    atomic_store(&sourcesRunning, 2);
+    CHECK(pthread_create(&sources[0], NULL, sourceThread, NULL) == 0);
+    CHECK(pthread_create(&sources[1], NULL, sourceThread, &secondSource) == 0);
+    CHECK(pthread_create(&flusher, NULL, flushThread, NULL) == 0);
+    CHECK(pthread_join(sources[0], NULL) == 0);
+    CHECK(pthread_join(sources[1], NULL) == 0);
+    CHECK(pthread_join(flusher, NULL) == 0);
+    
+    for (int i = 0; i < eventCount; i++) {
+        if (events[i].type == EVENT_MOVE) {
+            sent[0] += events[i].deltaX;
+            sent[1] += events[i].deltaY;
+        }
+        else {
+            // All of this source's motion before the click was sent before it
+            CHECK_EQ(sent[events[i].source], events[i].movedBefore);
+            buttons++;
+        }
+    }
+    
+    CHECK_EQ(buttons, CLICKS * 2);
+    CHECK_EQ(sent[0], CLICKS * MOVES_PER_CLICK);
+    CHECK_EQ(sent[1], CLICKS * MOVES_PER_CLICK);
+    
+    free(events);
+}
+
+int main(void)
+{
+    RUN_TEST(testEarlyFlushDrainsPendingMotion);
+    RUN_TEST(testFractionalMotionIsPreserved);
+    RUN_TEST(testButtonsNeverOvertakeMotion);
+    return 0;
+}
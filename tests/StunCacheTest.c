@@ -0,0 +1,294 @@
+//
+//  StunCacheTest.c
+//  Moonlight
+//
+//  Copyright © 2026 Moonlight Game Streaming Project. All rights reserved.
+//
+//  Runs the STUN cache against stand-in STUN servers on the loopback
+//  interface, using a minimal STUN client in place of
+//  LiFindExternalAddressIP4(). The servers count requests, so we can check
+//  which lookups actually went out over the network.
+//
+
+#include "StunCache.h"
+#include "TestCommon.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#define STUN_BINDING_REQUEST 0x0001
+#define STUN_BINDING_RESPONSE 0x0101
+#define STUN_MAGIC_COOKIE 0x2112A442
+#define STUN_ATTR_XOR_MAPPED_ADDRESS 0x0020
+#define STUN_HEADER_SIZE 20
+
+#define LOOKUP_TIMEOUT_MS 200
+
+typedef struct _STUN_SERVER {
+    int sock;
+    unsigned short port;
+    pthread_t thread;
+    atomic_bool stop;
+    
+    // The address we claim the client has, in network byte order
+    _Atomic(unsigned int) mappedAddr;
+    
+    // Requests are answered after this delay, or not at all
+    atomic_int delayMs;
+    atomic_bool drop;
+    
+    atomic_int requests;
+} STUN_SERVER, *PSTUN_SERVER;
+
+static void* stunServerThread(void* context)
+{
+    PSTUN_SERVER server = context;
+    uint8_t packet[512];
+    
+    while (!atomic_load(&server->stop)) {
+        struct pollfd pfd = { server->sock, POLLIN, 0 };
+        if (poll(&pfd, 1, 10) <= 0) {
+            continue;
+        }
+        
+        struct sockaddr_in from;
+        socklen_t fromLength = sizeof(from);
+        ssize_t length = recvfrom(server->sock, packet, sizeof(packet), 0, (struct sockaddr*)&from, &fromLength);
+        if (length < STUN_HEADER_SIZE || ((packet[0] << 8) | packet[1]) != STUN_BINDING_REQUEST) {
+            continue;
+        }
+        
+        atomic_fetch_add(&server->requests, 1);
+        if (atomic_load(&server->drop)) {
+            continue;
+        }
+        
+        // Answer with the address as of when the request arrived
+        unsigned int mappedAddr = atomic_load(&server->mappedAddr);
+        TestSleepMs(atomic_load(&server->delayMs));
+        
+        // Keep the transaction ID and answer with an XOR-MAPPED-ADDRESS
+        uint32_t cookie = htonl(STUN_MAGIC_COOKIE);
+        uint32_t xorAddr = mappedAddr ^ cookie;
+        uint16_t xorPort = from.sin_port ^ htons(STUN_MAGIC_COOKIE >> 16);
+        packet[0] = STUN_BINDING_RESPONSE >> 8;
+        packet[1] = STUN_BINDING_RESPONSE & 0xFF;
+        packet[2] = 0;
+        packet[3] = 12;
+        packet[20] = STUN_ATTR_XOR_MAPPED_ADDRESS >> 8;
+        packet[21] = STUN_ATTR_XOR_MAPPED_ADDRESS & 0xFF;
+        packet[22] = 0;
+        packet[23] = 8;
+        packet[24] = 0;
+        packet[25] = 0x01;
+        memcpy(&packet[26], &xorPort, sizeof(xorPort));
+        memcpy(&packet[28], &xorAddr, sizeof(xorAddr));
+        sendto(server->sock, packet, 32, 0, (struct sockaddr*)&from, fromLength);
+    }
+    
+    return NULL;
+}
+
+static void startStunServer(PSTUN_SERVER server, const char* mappedAddr)
+{
+    struct sockaddr_in addr = { 0 };
+    socklen_t addrLength = sizeof(addr);
+    
+    memset(server, 0, sizeof(*server));
+    atomic_init(&server->mappedAddr, inet_addr(mappedAddr));
+    
+    server->sock = socket(AF_INET, SOCK_DGRAM, 0);
+    CHECK(server->sock >= 0);
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    CHECK(bind(server->sock, (struct sockaddr*)&addr, sizeof(addr)) == 0);
+    CHECK(getsockname(server->sock, (struct sockaddr*)&addr, &addrLength) == 0);
+    server->port = ntohs(addr.sin_port);
+    
+    CHECK(pthread_create(&server->thread, NULL, stunServerThread, server) == 0);
+}
+
+static void stopStunServer(PSTUN_SERVER server)
+{
+    atomic_store(&server->stop, true);
+    CHECK(pthread_join(server->thread, NULL) == 0);
+    close(server->sock);
+}
+
+// Same contract as LiFindExternalAddressIP4(): 0 and the address in network
+// byte order, or an error
+static int stunLookup(const char* stunServer, unsigned short stunPort, unsigned int* wanAddr)
+{
+    static atomic_uint nextTransaction;
+    struct sockaddr_in addr = { 0 };
+    uint8_t packet[512] = { 0 };
+    int err = -1;
+    
+    int sock = socket(AF_INET, SOCK_DGRAM, 0);
+    if (sock < 0) {
+        return -1;
+    }
+    
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(stunPort);
+    addr.sin_addr.s_addr = inet_addr(stunServer);
+    
+    uint32_t cookie = htonl(STUN_MAGIC_COOKIE);
+    uint32_t transaction = atomic_fetch_add(&nextTransaction, 1);
+    packet[1] = STUN_BINDING_REQUEST;
+    memcpy(&packet[4], &cookie, sizeof(cookie));
+    memcpy(&packet[8], &transaction, sizeof(transaction));
+    
+    if (sendto(sock, packet, STUN_HEADER_SIZE, 0, (struct sockaddr*)&addr, sizeof(addr)) == STUN_HEADER_SIZE) {
+        struct pollfd pfd = { sock, POLLIN, 0 };
+        if (poll(&pfd, 1, LOOKUP_TIMEOUT_MS) > 0) {
+            uint8_t request[STUN_HEADER_SIZE];
+            memcpy(request, packet, sizeof(request));
+            
+            ssize_t length = recv(sock, packet, sizeof(packet), 0);
+            if (length >= 32 &&
+                ((packet[0] << 8) | packet[1]) == STUN_BINDING_RESPONSE &&
+                memcmp(&packet[4], &request[4], 16) == 0 &&
+                ((packet[20] << 8) | packet[21]) == STUN_ATTR_XOR_MAPPED_ADDRESS) {
+                uint32_t xorAddr;
+                memcpy(&xorAddr, &packet[28], sizeof(xorAddr));
+                *wanAddr = xorAddr ^ cookie;
+                err = 0;
+            }
+        }
+    }
+    
+    close(sock);
+    return err;
+}
+
+static STUN_CACHE cache;
+
+typedef struct _LOOKUP_THREAD_CONTEXT {
+    pthread_t thread;
+    int err;
+    unsigned int wanAddr;
+} LOOKUP_THREAD_CONTEXT, *PLOOKUP_THREAD_CONTEXT;
+
+static void* lookupThread(void* context)
+{
+    PLOOKUP_THREAD_CONTEXT ctx = context;
+    
+    ctx->err = ScFindExternalAddressIP4(&cache, &ctx->wanAddr);
+    return NULL;
+}
+
+static void testConcurrentCallersShareOneLookup(void)
+{
+    STUN_SERVER server;
+    LOOKUP_THREAD_CONTEXT contexts[8];
+    
+    startStunServer(&server, "203.0.113.7");
+    atomic_store(&server.delayMs, 100);
+    ScInit(&cache, stunLookup, "127.0.0.1", server.port, 60, 5);
+    
+    for (int i = 0; i < 8; i++) {
+        CHECK(pthread_create(&contexts[i].thread, NULL, lookupThread, &contexts[i]) == 0);
+    }
+    for (int i = 0; i < 8; i++) {
+        CHECK(pthread_join(contexts[i].thread, NULL) == 0);
+        CHECK_EQ(contexts[i].err, 0);
+        CHECK_EQ(contexts[i].wanAddr, inet_addr("203.0.113.7"));
+    }
+    CHECK_EQ(atomic_load(&server.requests), 1);
+    
+    ScDestroy(&cache);
+    stopStunServer(&server);
+}
+
+static void testResultsExpire(void)
+{
+    STUN_SERVER server;
+    unsigned int wanAddr;
+    
+    startStunServer(&server, "203.0.113.7");
+    ScInit(&cache, stunLookup, "127.0.0.1", server.port, 0.3, 5);
+    
+    CHECK_EQ(ScFindExternalAddressIP4(&cache, &wanAddr), 0);
+    CHECK_EQ(ScFindExternalAddressIP4(&cache, &wanAddr), 0);
+    CHECK_EQ(atomic_load(&server.requests), 1);
+    
+    atomic_store(&server.mappedAddr, inet_addr("198.51.100.1"));
+    TestSleepMs(400);
+    CHECK_EQ(ScFindExternalAddressIP4(&cache, &wanAddr), 0);
+    CHECK_EQ(wanAddr, inet_addr("198.51.100.1"));
+    CHECK_EQ(atomic_load(&server.requests), 2);
+    
+    ScDestroy(&cache);
+    stopStunServer(&server);
+}
+
+static void testInvalidationDuringLookupIsNotCached(void)
+{
+    STUN_SERVER server;
+    LOOKUP_THREAD_CONTEXT context;
+    unsigned int wanAddr;
+    
+    startStunServer(&server, "203.0.113.7");
+    atomic_store(&server.delayMs, 150);
+    ScInit(&cache, stunLookup, "127.0.0.1", server.port, 60, 5);
+    
+    // The network changes while the lookup is in flight
+    CHECK(pthread_create(&context.thread, NULL, lookupThread, &context) == 0);
+    TestSleepMs(50);
+    ScInvalidate(&cache);
+    atomic_store(&server.mappedAddr, inet_addr("198.51.100.1"));
+    atomic_store(&server.delayMs, 0);
+    CHECK(pthread_join(context.thread, NULL) == 0);
+    
+    // The caller still gets its answer, but the next one asks again
+    CHECK_EQ(context.err, 0);
+    CHECK_EQ(context.wanAddr, inet_addr("203.0.113.7"));
+    CHECK_EQ(ScFindExternalAddressIP4(&cache, &wanAddr), 0);
+    CHECK_EQ(wanAddr, inet_addr("198.51.100.1"));
+    CHECK_EQ(atomic_load(&server.requests), 2);
+    
+    ScDestroy(&cache);
+    stopStunServer(&server);
+}
+
+static void testFailuresAreCachedUntilServerChanges(void)
+{
+    STUN_SERVER deadServer, server;
+    unsigned int wanAddr;
+    
+    startStunServer(&deadServer, "203.0.113.7");
+    atomic_store(&deadServer.drop, true);
+    startStunServer(&server, "198.51.100.1");
+    ScInit(&cache, stunLookup, "127.0.0.1", deadServer.port, 60, 5);
+    
+    // Only the first call waits for the timeout
+    double startTime = TestGetTime();
+    CHECK(ScFindExternalAddressIP4(&cache, &wanAddr) != 0);
+    CHECK(ScFindExternalAddressIP4(&cache, &wanAddr) != 0);
+    CHECK(TestGetTime() - startTime < LOOKUP_TIMEOUT_MS * 1.9 / 1000);
+    CHECK_EQ(atomic_load(&deadServer.requests), 1);
+    
+    ScSetServer(&cache, "127.0.0.1", server.port);
+    CHECK_EQ(ScFindExternalAddressIP4(&cache, &wanAddr), 0);
+    CHECK_EQ(wanAddr, inet_addr("198.51.100.1"));
+    CHECK_EQ(atomic_load(&server.requests), 1);
+    
+    ScDestroy(&cache);
+    stopStunServer(&deadServer);
+    stopStunServer(&server);
+}
+
+int main(void)
+{
+    RUN_TEST(testConcurrentCallersShareOneLookup);
+    RUN_TEST(testResultsExpire);
+    RUN_TEST(testInvalidationDuringLookupIsNotCached);
+    RUN_TEST(testFailuresAreCachedUntilServerChanges);
+    return 0;
+}
@@ -0,0 +1,51 @@
+//
+//  TestCommon.h
+//  Moonlight
+//
+//  Copyright © 2026 Moonlight Game Streaming Project. All rights reserved.
+//
+
+#pragma once
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+// Stops the test at the first failed check
+#define CHECK(expr) \
+    do { \
+        if (!(expr)) { \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #expr); \
+            exit(1); \
+        } \
+    } while (0)
+
+#define CHECK_EQ(actual, expected) \
+    do { \
+        long long _actual = (long long)(actual); \
+        long long _expected = (long long)(expected); \
+        if (_actual != _expected) { \
+            fprintf(stderr, "%s:%d: check failed: %s == %s (%lld != %lld)\n", \
+                    __FILE__, __LINE__, #actual, #expected, _actual, _expected); \
+            exit(1); \
+        } \
+    } while (0)
+
+#define RUN_TEST(test) \
+    do { \
+        test(); \
+        printf("  %s passed\n", #test); \
+    } while (0)
+
+static inline double TestGetTime(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1000000000.0;
+}
+
+static inline void TestSleepMs(int ms)
+{
+    struct timespec ts = { ms / 1000, (long)(ms % 1000) * 1000000 };
+    nanosleep(&ts, NULL);
+}
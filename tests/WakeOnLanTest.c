@@ -0,0 +1,131 @@
+//
+//  WakeOnLanTest.c
+//  Moonlight
+//
+//  Copyright © 2026 Moonlight Game Streaming Project. All rights reserved.
+//
+//  Checks the magic packet layout and the ports it goes to, and sends it over
+//  the loopback interface the way WakeOnLanManager does to make sure it
+//  arrives intact.
+//
+
+#include "WakeOnLan.h"
+#include "TestCommon.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+static const uint8_t testMac[WOL_MAC_LENGTH] = { 0x00, 0x1A, 0x2B, 0x3C, 0x4D, 0x5E };
+
+// What a NIC looks for: 6 bytes of 0xFF, then the MAC 16 times over
+static bool isMagicPacket(const uint8_t* packet, size_t length, const uint8_t mac[WOL_MAC_LENGTH])
+{
+    if (length != WOL_PAYLOAD_LENGTH) {
+        return false;
+    }
+    
+    for (int i = 0; i < 6; i++) {
+        if (packet[i] != 0xFF) {
+            return false;
+        }
+    }
+    for (int i = 0; i < 16; i++) {
+        if (memcmp(&packet[6 + i * WOL_MAC_LENGTH], mac, WOL_MAC_LENGTH) != 0) {
+            return false;
+        }
+    }
+    
+    return true;
+}
+
+static void testParseMac(void)
+{
+    uint8_t mac[WOL_MAC_LENGTH];
+    
+    CHECK(WolParseMac("00:1A:2B:3C:4D:5E", mac));
+    CHECK(memcmp(mac, testMac, sizeof(mac)) == 0);
+    CHECK(WolParseMac("001a2b3c4d5e", mac));
+    CHECK(memcmp(mac, testMac, sizeof(mac)) == 0);
+    
+    CHECK(!WolParseMac("", mac));
+    CHECK(!WolParseMac("00:1A:2B:3C:4D", mac));
+    CHECK(!WolParseMac("00:1A:2B:3C:4D:5E:6F", mac));
+    CHECK(!WolParseMac("00:1A:2B:3C:4D:5", mac));
+    CHECK(!WolParseMac("00:1A:2B:3C:4D:5G", mac));
+}
+
+static void testPayload(void)
+{
+    uint8_t payload[WOL_PAYLOAD_LENGTH];
+    
+    CHECK_EQ(WOL_PAYLOAD_LENGTH, 102);
+    
+    memset(payload, 0, sizeof(payload));
+    WolCreatePayload(testMac, payload);
+    CHECK(isMagicPacket(payload, sizeof(payload), testMac));
+}
+
+static void testPorts(void)
+{
+    unsigned short ports[WOL_MAX_PORTS];
+    
+    CHECK_EQ(WolGetPorts(47989, ports), 7);
+    CHECK_EQ(ports[0], 9);
+    CHECK_EQ(ports[1], 47009);
+    CHECK_EQ(ports[2], 47998);
+    CHECK_EQ(ports[6], 48010);
+    
+    // Only the ports opened by the host software move with its base port
+    CHECK_EQ(WolGetPorts(50000, ports), 7);
+    CHECK_EQ(ports[0], 9);
+    CHECK_EQ(ports[1], 47009);
+    CHECK_EQ(ports[2], 50009);
+    CHECK_EQ(ports[6], 50021);
+}
+
+static void testLoopbackDelivery(void)
+{
+    struct sockaddr_in addr = { 0 };
+    socklen_t addrLength = sizeof(addr);
+    uint8_t mac[WOL_MAC_LENGTH];
+    uint8_t payload[WOL_PAYLOAD_LENGTH];
+    uint8_t received[512];
+    
+    int receiver = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    CHECK(receiver >= 0);
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    CHECK(bind(receiver, (struct sockaddr*)&addr, sizeof(addr)) == 0);
+    CHECK(getsockname(receiver, (struct sockaddr*)&addr, &addrLength) == 0);
+    
+    // Same socket options as WakeOnLanManager
+    int sender = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    int val = 1;
+    CHECK(sender >= 0);
+    CHECK(setsockopt(sender, SOL_SOCKET, SO_BROADCAST, &val, sizeof(val)) == 0);
+    
+    CHECK(WolParseMac("00:1a:2b:3c:4d:5e", mac));
+    WolCreatePayload(mac, payload);
+    CHECK_EQ(sendto(sender, payload, sizeof(payload), 0, (struct sockaddr*)&addr, addrLength), sizeof(payload));
+    
+    struct pollfd pfd = { receiver, POLLIN, 0 };
+    CHECK(poll(&pfd, 1, 1000) > 0);
+    ssize_t length = recv(receiver, received, sizeof(received), 0);
+    CHECK(isMagicPacket(received, length, testMac));
+    
+    close(sender);
+    close(receiver);
+}
+
+int main(void)
+{
+    RUN_TEST(testParseMac);
+    RUN_TEST(testPayload);
+    RUN_TEST(testPorts);
+    RUN_TEST(testLoopbackDelivery);
+    return 0;
+}
@@ -0,0 +1,153 @@
+//
+//  XmlDomWalk.h
+//  Moonlight
+//
+//  Copyright © 2026 Moonlight Game Streaming Project. All rights reserved.
+//
+//  The DOM walk HttpResponse and AppListResponse did before they used
+//  XmlResponse.c, ported from Objective-C to the XR_CALLBACKS interface so the
+//  two can be compared. Bodies first go through fixXmlVersion:, which
+//  HttpManager applied to every response so libxml2 wouldn't reject GFE's
+//  bogus UTF-16 declaration.
+//
+
+#pragma once
+
+#include "XmlResponse.h"
+
+#include <string.h>
+#include <strings.h>
+
+#include <libxml/parser.h>
+#include <libxml/tree.h>
+
+// Replaces every "UTF-16" with "UTF-8", ignoring case, like fixXmlVersion:.
+// That went through NSString and back, which made two more copies of the body.
+static xmlChar* DomFixXmlVersion(const void* data, int length, int* fixedLength)
+{
+    const char* in = (const char*)data;
+    xmlChar* out = (xmlChar*)xmlMalloc(length + 1);
+    int outLength = 0;
+    
+    for (int i = 0; i < length; i++) {
+        if (i + 6 <= length && strncasecmp(&in[i], "UTF-16", 6) == 0) {
+            memcpy(&out[outLength], "UTF-8", 5);
+            outLength += 5;
+            i += 5;
+        }
+        else {
+            out[outLength++] = in[i];
+        }
+    }
+    out[outLength] = 0;
+    
+    *fixedLength = outLength;
+    return out;
+}
+
+static xmlDocPtr DomParse(const void* data, int length)
+{
+    int fixedLength;
+    xmlChar* fixed = DomFixXmlVersion(data, length, &fixedLength);
+    xmlDocPtr doc = xmlParseMemory((const char*)fixed, fixedLength);
+    
+    xmlFree(fixed);
+    return doc;
+}
+
+static void DomReportRoot(xmlNodePtr root, PXR_CALLBACKS callbacks, void* context)
+{
+    xmlChar* statusCode = xmlGetProp(root, (const xmlChar*)"status_code");
+    xmlChar* statusMessage = xmlGetProp(root, (const xmlChar*)"status_message");
+    
+    callbacks->root(context, (const char*)statusCode, (const char*)statusMessage);
+    xmlFree(statusCode);
+    xmlFree(statusMessage);
+}
+
+static XR_RESULT DomParseElements(const void* data, int length, PXR_CALLBACKS callbacks, void* context)
+{
+    xmlDocPtr doc = DomParse(data, length);
+    xmlNodePtr node;
+    
+    if (doc == NULL) {
+        return XR_PARSE_ERROR;
+    }
+    
+    node = xmlDocGetRootElement(doc);
+    if (node == NULL) {
+        xmlFreeDoc(doc);
+        return XR_NO_ROOT;
+    }
+    
+    DomReportRoot(node, callbacks, context);
+    
+    for (node = node->children; node != NULL; node = node->next) {
+        xmlChar* value = xmlNodeListGetString(doc, node->xmlChildrenNode, 1);
+        
+        // The old walk also stored the whitespace between elements, under the
+        // key "text", which nothing read
+        if (node->type == XML_ELEMENT_NODE) {
+            callbacks->element(context, (const char*)node->name, value != NULL ? (const char*)value : "");
+        }
+        xmlFree(value);
+    }
+    
+    xmlFreeDoc(doc);
+    return XR_OK;
+}
+
+static XR_RESULT DomParseAppList(const void* data, int length, PXR_CALLBACKS callbacks, void* context)
+{
+    xmlDocPtr doc = DomParse(data, length);
+    xmlNodePtr node;
+    
+    if (doc == NULL) {
+        return XR_PARSE_ERROR;
+    }
+    
+    node = xmlDocGetRootElement(doc);
+    if (node == NULL) {
+        xmlFreeDoc(doc);
+        return XR_NO_ROOT;
+    }
+    
+    DomReportRoot(node, callbacks, context);
+    
+    for (node = node->children; node != NULL; node = node->next) {
+        static const char* tags[] = { "ID", "AppTitle", "IsHdrSupported", "AppInstallPath" };
+        xmlChar* values[4] = { NULL };
+        XR_APP app;
+        
+        if (xmlStrcmp(node->name, (const xmlChar*)"App") != 0) {
+            continue;
+        }
+        
+        for (xmlNodePtr appInfoNode = node->xmlChildrenNode; appInfoNode != NULL; appInfoNode = appInfoNode->next) {
+            for (int i = 0; i < 4; i++) {
+                if (xmlStrcmp(appInfoNode->name, (const xmlChar*)tags[i]) == 0) {
+                    xmlChar* value = xmlNodeListGetString(doc, appInfoNode->xmlChildrenNode, 1);
+                    if (value != NULL) {
+                        xmlFree(values[i]);
+                        values[i] = value;
+                    }
+                }
+            }
+        }
+        
+        if (values[0] != NULL) {
+            app.id = (const char*)values[0];
+            app.title = values[1] != NULL ? (const char*)values[1] : "";
+            app.hdrSupported = values[2] != NULL ? (const char*)values[2] : "0";
+            app.installPath = (const char*)values[3];
+            callbacks->app(context, &app);
+        }
+        
+        for (int i = 0; i < 4; i++) {
+            xmlFree(values[i]);
+        }
+    }
+    
+    xmlFreeDoc(doc);
+    return XR_OK;
+}
@@ -0,0 +1,225 @@
+//
+//  XmlResponseBenchmark.c
+//  Moonlight
+//
+//  Copyright © 2026 Moonlight Game Streaming Project. All rights reserved.
+//
+//  Parses the serverinfo and applist responses in fixtures/ by streaming them
+//  with xmlTextReader and with the DOM walk that was used before, and reports
+//  the time per parse along with libxml2's allocations, counted through
+//  xmlMemSetup(). Other files can be passed as arguments; those with "applist"
+//  in their name are parsed as app lists.
+//
+
+#include "XmlResponse.h"
+#include "XmlDomWalk.h"
+#include "TestCommon.h"
+
+#include <stddef.h>
+#include <string.h>
+
+#define FIXTURE_DIR "fixtures/"
+#define MIN_BENCH_TIME 0.3
+
+// Keeps the size in front of each block so frees can be counted
+typedef union _BLOCK_HEADER {
+    size_t size;
+    max_align_t align;
+} BLOCK_HEADER;
+
+typedef struct _ALLOC_STATS {
+    size_t allocations;
+    size_t bytes;
+    size_t liveBytes;
+    size_t peakBytes;
+} ALLOC_STATS, *PALLOC_STATS;
+
+typedef struct _PARSE_RESULT {
+    double usPerParse;
+    ALLOC_STATS allocs;
+    int entries;
+} PARSE_RESULT, *PPARSE_RESULT;
+
+typedef XR_RESULT (*PARSE_FN)(const void* data, int length, PXR_CALLBACKS callbacks, void* context);
+
+static ALLOC_STATS stats;
+
+static void countAllocation(size_t size)
+{
+    stats.allocations++;
+    stats.bytes += size;
+    stats.liveBytes += size;
+    if (stats.liveBytes > stats.peakBytes) {
+        stats.peakBytes = stats.liveBytes;
+    }
+}
+
+static void* countingMalloc(size_t size)
+{
+    BLOCK_HEADER* block = malloc(sizeof(*block) + size);
+    if (block == NULL) {
+        return NULL;
+    }
+    
+    block->size = size;
+    countAllocation(size);
+    return block + 1;
+}
+
+static void countingFree(void* ptr)
+{
+    BLOCK_HEADER* block;
+    
+    if (ptr == NULL) {
+        return;
+    }
+    
+    block = (BLOCK_HEADER*)ptr - 1;
+    stats.liveBytes -= block->size;
+    free(block);
+}
+
+static void* countingRealloc(void* ptr, size_t size)
+{
+    BLOCK_HEADER* block;
+    
+    if (ptr == NULL) {
+        return countingMalloc(size);
+    }
+    
+    block = (BLOCK_HEADER*)ptr - 1;
+    stats.liveBytes -= block->size;
+    block = realloc(block, sizeof(*block) + size);
+    if (block == NULL) {
+        return NULL;
+    }
+    
+    block->size = size;
+    countAllocation(size);
+    return block + 1;
+}
+
+static char* countingStrdup(const char* string)
+{
+    size_t length = strlen(string) + 1;
+    char* copy = countingMalloc(length);
+    
+    if (copy != NULL) {
+        memcpy(copy, string, length);
+    }
+    return copy;
+}
+
+// Stand in for building the NSStrings and TemporaryApps
+static void parsedRoot(void* context, const char* statusCode, const char* statusMessage)
+{
+}
+
+static void parsedElement(void* context, const char* name, const char* value)
+{
+    (*(int*)context)++;
+}
+
+static void parsedApp(void* context, PXR_APP app)
+{
+    (*(int*)context)++;
+}
+
+static XR_CALLBACKS callbacks = { parsedRoot, parsedElement, parsedApp };
+
+static void benchmarkParse(PARSE_FN parse, const char* data, int length, PPARSE_RESULT result)
+{
+    double startTime;
+    double elapsed;
+    int iterations = 0;
+    
+    // Once to warm up libxml2, then once counting allocations
+    CHECK_EQ(parse(data, length, &callbacks, &result->entries), XR_OK);
+    memset(&stats, 0, sizeof(stats));
+    result->entries = 0;
+    CHECK_EQ(parse(data, length, &callbacks, &result->entries), XR_OK);
+    result->allocs = stats;
+    CHECK_EQ(stats.liveBytes, 0);
+    
+    startTime = TestGetTime();
+    do {
+        int entries = 0;
+        parse(data, length, &callbacks, &entries);
+        iterations++;
+        elapsed = TestGetTime() - startTime;
+    } while (elapsed < MIN_BENCH_TIME);
+    
+    result->usPerParse = elapsed * 1000000 / iterations;
+}
+
+static void printResult(const char* name, PPARSE_RESULT result)
+{
+    printf("  %-14s %9.1f us %7zu allocs %9.1f KB allocated %8.1f KB peak\n", name, result->usPerParse,
+           result->allocs.allocations, result->allocs.bytes / 1024.0, result->allocs.peakBytes / 1024.0);
+}
+
+static bool benchmarkFile(const char* path)
+{
+    bool appList = strstr(path, "applist") != NULL;
+    PARSE_RESULT streamed;
+    PARSE_RESULT walked;
+    FILE* file;
+    char* data;
+    long size;
+    
+    file = fopen(path, "rb");
+    if (file == NULL) {
+        return false;
+    }
+    fseek(file, 0, SEEK_END);
+    size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    data = malloc(size);
+    CHECK(data != NULL);
+    CHECK(fread(data, 1, size, file) == (size_t)size);
+    fclose(file);
+    
+    benchmarkParse(appList ? XrParseAppList : XrParseElements, data, (int)size, &streamed);
+    benchmarkParse(appList ? DomParseAppList : DomParseElements, data, (int)size, &walked);
+    CHECK_EQ(streamed.entries, walked.entries);
+    
+    printf("%s (%.1f KB, %d %s)\n", path, size / 1024.0, streamed.entries, appList ? "apps" : "elements");
+    printResult("xmlTextReader", &streamed);
+    printResult("DOM walk", &walked);
+    printf("  xmlTextReader takes %.2fx the time and %.2fx the peak memory of the DOM walk\n",
+           streamed.usPerParse / walked.usPerParse, (double)streamed.allocs.peakBytes / walked.allocs.peakBytes);
+    
+    free(data);
+    return true;
+}
+
+int main(int argc, char* argv[])
+{
+    static const char* fixtures[] = {
+        FIXTURE_DIR "serverinfo-gfe.xml",
+        FIXTURE_DIR "serverinfo-sunshine.xml",
+        FIXTURE_DIR "applist-gfe.xml",
+        FIXTURE_DIR "applist-sunshine.xml",
+        FIXTURE_DIR "applist-large.xml",
+    };
+    
+    CHECK(xmlMemSetup(countingFree, countingMalloc, countingRealloc, countingStrdup) == 0);
+    xmlInitParser();
+    
+    if (argc > 1) {
+        for (int i = 1; i < argc; i++) {
+            if (!benchmarkFile(argv[i])) {
+                fprintf(stderr, "Unable to read %s\n", argv[i]);
+                return 1;
+            }
+        }
+    }
+    else {
+        for (size_t i = 0; i < sizeof(fixtures) / sizeof(fixtures[0]); i++) {
+            CHECK(benchmarkFile(fixtures[i]));
+        }
+    }
+    
+    xmlCleanupParser();
+    return 0;
+}
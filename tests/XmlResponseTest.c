@@ -0,0 +1,321 @@
+//
+//  XmlResponseTest.c
+//  Moonlight
+//
+//  Copyright © 2026 Moonlight Game Streaming Project. All rights reserved.
+//
+//  Checks that streaming serverinfo and applist responses with xmlTextReader
+//  yields the same status, elements and apps as the DOM walk it replaced, for
+//  GFE and Sunshine responses in fixtures/, including a 600 app list and
+//  GFE's UTF-8 bodies that declare UTF-16.
+//
+
+#include "XmlResponse.h"
+#include "XmlDomWalk.h"
+#include "TestCommon.h"
+
+#include <string.h>
+
+#define FIXTURE_DIR "fixtures/"
+
+typedef XR_RESULT (*PARSE_FN)(const void* data, int length, PXR_CALLBACKS callbacks, void* context);
+
+// Everything the callbacks were given, with each entry's strings in one
+// NUL separated record
+typedef struct _PARSED {
+    char* statusCode;
+    char* statusMessage;
+    int rootCount;
+    char** entries;
+    int entryCount;
+} PARSED, *PPARSED;
+
+static char* copyString(const char* string)
+{
+    return string != NULL ? strdup(string) : NULL;
+}
+
+static void addEntry(PPARSED parsed, const char* const* fields, int fieldCount)
+{
+    size_t length = 0;
+    char* entry;
+    
+    for (int i = 0; i < fieldCount; i++) {
+        length += (fields[i] != NULL ? strlen(fields[i]) : strlen("(null)")) + 1;
+    }
+    
+    entry = malloc(length);
+    CHECK(entry != NULL);
+    length = 0;
+    for (int i = 0; i < fieldCount; i++) {
+        const char* field = fields[i] != NULL ? fields[i] : "(null)";
+        memcpy(&entry[length], field, strlen(field) + 1);
+        length += strlen(field) + 1;
+    }
+    
+    parsed->entries = realloc(parsed->entries, (parsed->entryCount + 1) * sizeof(*parsed->entries));
+    CHECK(parsed->entries != NULL);
+    parsed->entries[parsed->entryCount++] = entry;
+}
+
+static void parsedRoot(void* context, const char* statusCode, const char* statusMessage)
+{
+    PPARSED parsed = (PPARSED)context;
+    
+    parsed->statusCode = copyString(statusCode);
+    parsed->statusMessage = copyString(statusMessage);
+    parsed->rootCount++;
+}
+
+static void parsedElement(void* context, const char* name, const char* value)
+{
+    const char* fields[] = { name, value };
+    addEntry((PPARSED)context, fields, 2);
+}
+
+static void parsedApp(void* context, PXR_APP app)
+{
+    const char* fields[] = { app->id, app->title, app->hdrSupported, app->installPath };
+    addEntry((PPARSED)context, fields, 4);
+}
+
+static XR_CALLBACKS callbacks = { parsedRoot, parsedElement, parsedApp };
+
+static void freeParsed(PPARSED parsed)
+{
+    free(parsed->statusCode);
+    free(parsed->statusMessage);
+    for (int i = 0; i < parsed->entryCount; i++) {
+        free(parsed->entries[i]);
+    }
+    free(parsed->entries);
+    memset(parsed, 0, sizeof(*parsed));
+}
+
+static char* readFixture(const char* name, int* length)
+{
+    char path[256];
+    FILE* file;
+    char* data;
+    long size;
+    
+    snprintf(path, sizeof(path), FIXTURE_DIR "%s", name);
+    file = fopen(path, "rb");
+    CHECK(file != NULL);
+    CHECK(fseek(file, 0, SEEK_END) == 0);
+    size = ftell(file);
+    CHECK(fseek(file, 0, SEEK_SET) == 0);
+    
+    data = malloc(size + 1);
+    CHECK(data != NULL);
+    CHECK(fread(data, 1, size, file) == (size_t)size);
+    data[size] = 0;
+    fclose(file);
+    
+    *length = (int)size;
+    return data;
+}
+
+static XR_RESULT parseFixture(const char* name, PARSE_FN parse, PPARSED parsed)
+{
+    int length;
+    char* data = readFixture(name, &length);
+    XR_RESULT result;
+    
+    memset(parsed, 0, sizeof(*parsed));
+    result = parse(data, length, &callbacks, parsed);
+    free(data);
+    return result;
+}
+
+static bool sameString(const char* a, const char* b)
+{
+    return (a == NULL && b == NULL) || (a != NULL && b != NULL && strcmp(a, b) == 0);
+}
+
+static bool sameEntry(const char* a, const char* b, int fieldCount)
+{
+    for (int i = 0; i < fieldCount; i++) {
+        if (strcmp(a, b) != 0) {
+            fprintf(stderr, "  \"%s\" != \"%s\"\n", a, b);
+            return false;
+        }
+        a += strlen(a) + 1;
+        b += strlen(b) + 1;
+    }
+    
+    return true;
+}
+
+static void checkSameResult(const char* name, PARSE_FN streamParse, PARSE_FN domParse, int fieldCount)
+{
+    PARSED streamed;
+    PARSED walked;
+    
+    CHECK_EQ(parseFixture(name, streamParse, &streamed), XR_OK);
+    CHECK_EQ(parseFixture(name, domParse, &walked), XR_OK);
+    
+    CHECK_EQ(streamed.rootCount, 1);
+    CHECK_EQ(walked.rootCount, 1);
+    CHECK(sameString(streamed.statusCode, walked.statusCode));
+    CHECK(sameString(streamed.statusMessage, walked.statusMessage));
+    
+    CHECK_EQ(streamed.entryCount, walked.entryCount);
+    for (int i = 0; i < streamed.entryCount; i++) {
+        CHECK(sameEntry(streamed.entries[i], walked.entries[i], fieldCount));
+    }
+    
+    printf("  %s: %d %s\n", name, streamed.entryCount, fieldCount == 2 ? "elements" : "apps");
+    freeParsed(&streamed);
+    freeParsed(&walked);
+}
+
+static const char* FIXTURES[] = {
+    "serverinfo-gfe.xml",
+    "serverinfo-sunshine.xml",
+    "serverinfo-unpaired.xml",
+    "applist-gfe.xml",
+    "applist-sunshine.xml",
+    "applist-large.xml",
+};
+
+static void testElementsMatchDomWalk(void)
+{
+    for (size_t i = 0; i < sizeof(FIXTURES) / sizeof(FIXTURES[0]); i++) {
+        checkSameResult(FIXTURES[i], XrParseElements, DomParseElements, 2);
+    }
+}
+
+static void testAppsMatchDomWalk(void)
+{
+    for (size_t i = 0; i < sizeof(FIXTURES) / sizeof(FIXTURES[0]); i++) {
+        checkSameResult(FIXTURES[i], XrParseAppList, DomParseAppList, 4);
+    }
+}
+
+// Finds the value of the first element with the given name
+static const char* findElement(PPARSED parsed, const char* name)
+{
+    for (int i = 0; i < parsed->entryCount; i++) {
+        if (strcmp(parsed->entries[i], name) == 0) {
+            return parsed->entries[i] + strlen(name) + 1;
+        }
+    }
+    
+    return NULL;
+}
+
+static void testServerInfoValues(void)
+{
+    PARSED parsed;
+    
+    CHECK_EQ(parseFixture("serverinfo-gfe.xml", XrParseElements, &parsed), XR_OK);
+    CHECK(sameString(parsed.statusCode, "200"));
+    CHECK(sameString(parsed.statusMessage, "OK"));
+    CHECK(sameString(findElement(&parsed, "hostname"), "GAMING-PC"));
+    CHECK(sameString(findElement(&parsed, "HttpsPort"), "47984"));
+    CHECK(sameString(findElement(&parsed, "state"), "MJOLNIR_STATE_SERVER_AVAILABLE"));
+    
+    // Only the text directly inside, not the display modes' values
+    CHECK(sameString(findElement(&parsed, "SupportedDisplayMode"), "\n\n\n\n"));
+    freeParsed(&parsed);
+    
+    CHECK_EQ(parseFixture("serverinfo-sunshine.xml", XrParseElements, &parsed), XR_OK);
+    CHECK(sameString(parsed.statusCode, "200"));
+    CHECK(parsed.statusMessage == NULL);
+    CHECK(sameString(findElement(&parsed, "currentgame"), "881448767"));
+    CHECK(sameString(findElement(&parsed, "state"), "SUNSHINE_SERVER_BUSY"));
+    freeParsed(&parsed);
+    
+    CHECK_EQ(parseFixture("serverinfo-unpaired.xml", XrParseElements, &parsed), XR_OK);
+    CHECK(sameString(findElement(&parsed, "hostname"), "Wohnzimmer-PC & B\xc3\xbc" "ro"));
+    CHECK(sameString(findElement(&parsed, "PairStatus"), "0"));
+    CHECK(sameString(findElement(&parsed, "empty"), ""));
+    CHECK(sameString(findElement(&parsed, "cdata"), "<not markup>"));
+    freeParsed(&parsed);
+}
+
+static void testAppListValues(void)
+{
+    PARSED parsed;
+    
+    // The app without an ID is left out
+    CHECK_EQ(parseFixture("applist-gfe.xml", XrParseAppList, &parsed), XR_OK);
+    CHECK_EQ(parsed.entryCount, 5);
+    CHECK(sameEntry(parsed.entries[0], "1093255277\0Steam\0" "1\0C:\\Program Files (x86)\\Steam\\", 4));
+    CHECK(sameEntry(parsed.entries[2], "581244021\0Rocket League\xc2\xae\0" "0\0C:\\Program Files\\Epic Games\\RocketLeague\\", 4));
+    CHECK(strstr(parsed.entries[3] + strlen(parsed.entries[3]) + 1, "\xe3\x83\x95\xe3\x82\xa1\xe3\x82\xa4\xe3\x83\x8a\xe3\x83\xab") != NULL);
+    CHECK(sameEntry(parsed.entries[4], "1735618305\0mstsc.exe\0" "0\0C:\\Windows\\System32\\", 4));
+    freeParsed(&parsed);
+    
+    CHECK_EQ(parseFixture("applist-sunshine.xml", XrParseAppList, &parsed), XR_OK);
+    CHECK_EQ(parsed.entryCount, 4);
+    CHECK(sameEntry(parsed.entries[2], "42\0Tom & Jerry's <Chase>\0" "0\0(null)", 4));
+    CHECK(sameEntry(parsed.entries[3], "7\0\0" "0\0(null)", 4));
+    freeParsed(&parsed);
+    
+    CHECK_EQ(parseFixture("applist-large.xml", XrParseAppList, &parsed), XR_OK);
+    CHECK_EQ(parsed.entryCount, 600);
+    freeParsed(&parsed);
+}
+
+static void testUtf16Declaration(void)
+{
+    int length;
+    char* data = readFixture("applist-gfe.xml", &length);
+    PARSED parsed;
+    xmlDocPtr doc;
+    
+    // Why HttpManager used to rewrite the declaration of every body
+    doc = xmlParseMemory(data, length);
+    CHECK(doc == NULL);
+    
+    memset(&parsed, 0, sizeof(parsed));
+    CHECK_EQ(XrParseAppList(data, length, &callbacks, &parsed), XR_OK);
+    CHECK_EQ(parsed.entryCount, 5);
+    freeParsed(&parsed);
+    free(data);
+}
+
+static void testBrokenDocuments(void)
+{
+    static const char noRoot[] = "<?xml version=\"1.0\" encoding=\"utf-8\"?>";
+    static const char unclosed[] = "<root status_code=\"200\"><hostname>PC</hostname>";
+    int length;
+    char* data = readFixture("applist-large.xml", &length);
+    PARSED parsed;
+    
+    memset(&parsed, 0, sizeof(parsed));
+    CHECK_EQ(XrParseAppList(NULL, 0, &callbacks, &parsed), XR_PARSE_ERROR);
+    CHECK_EQ(XrParseElements("", 0, &callbacks, &parsed), XR_PARSE_ERROR);
+    CHECK_EQ(XrParseElements(noRoot, (int)strlen(noRoot), &callbacks, &parsed), XR_PARSE_ERROR);
+    CHECK_EQ(XrParseElements(unclosed, (int)strlen(unclosed), &callbacks, &parsed), XR_PARSE_ERROR);
+    CHECK_EQ(DomParseElements(unclosed, (int)strlen(unclosed), &callbacks, &parsed), XR_PARSE_ERROR);
+    freeParsed(&parsed);
+    
+    // Apps before the point where the list is cut off are reported, so the
+    // caller has to drop them
+    CHECK_EQ(XrParseAppList(data, length / 2, &callbacks, &parsed), XR_PARSE_ERROR);
+    CHECK(parsed.entryCount > 0 && parsed.entryCount < 600);
+    freeParsed(&parsed);
+    free(data);
+}
+
+static void silenceErrors(void* context, const char* message, ...)
+{
+}
+
+int main(void)
+{
+    xmlSetGenericErrorFunc(NULL, silenceErrors);
+    
+    RUN_TEST(testElementsMatchDomWalk);
+    RUN_TEST(testAppsMatchDomWalk);
+    RUN_TEST(testServerInfoValues);
+    RUN_TEST(testAppListValues);
+    RUN_TEST(testUtf16Declaration);
+    RUN_TEST(testBrokenDocuments);
+    
+    xmlCleanupParser();
+    return 0;
+}
@@ -0,0 +1,49 @@
+//
+//  Limelight.h
+//  Moonlight
+//
+//  Copyright © 2026 Moonlight Game Streaming Project. All rights reserved.
+//
+//  The parts of moonlight-common-c's Limelight.h that the tested modules use.
+//  Values must match the real header.
+//
+
+#pragma once
+
+#define A_FLAG     0x1000
+#define B_FLAG     0x2000
+#define X_FLAG     0x4000
+#define Y_FLAG     0x8000
+#define UP_FLAG    0x0001
+#define DOWN_FLAG  0x0002
+#define LEFT_FLAG  0x0004
+#define RIGHT_FLAG 0x0008
+#define LB_FLAG    0x0100
+#define RB_FLAG    0x0200
+#define PLAY_FLAG  0x0010
+#define BACK_FLAG  0x0020
+#define LS_CLK_FLAG 0x0040
+#define RS_CLK_FLAG 0x0080
+#define SPECIAL_FLAG 0x0400
+
+#define BUFFER_TYPE_PICDATA 0x00
+#define BUFFER_TYPE_SPS     0x01
+#define BUFFER_TYPE_PPS     0x02
+#define BUFFER_TYPE_VPS     0x03
+
+#define FRAME_TYPE_PFRAME 0x00
+#define FRAME_TYPE_IDR    0x01
+
+typedef struct _LENTRY {
+    struct _LENTRY* next;
+    char* data;
+    int length;
+    int bufferType;
+} LENTRY, *PLENTRY;
+
+typedef struct _DECODE_UNIT {
+    int frameNumber;
+    int frameType;
+    int fullLength;
+    PLENTRY bufferList;
+} DECODE_UNIT, *PDECODE_UNIT;